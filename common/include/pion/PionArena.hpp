@@ -0,0 +1,165 @@
+// -----------------------------------------------------------------------
+// pion-common: a collection of common libraries used by the Pion Platform
+// -----------------------------------------------------------------------
+// Copyright (C) 2007-2011 Atomic Labs, Inc.  (http://www.atomiclabs.com)
+//
+// Distributed under the Boost Software License, Version 1.0.
+// See http://www.boost.org/LICENSE_1_0.txt
+//
+
+#ifndef __PION_PIONARENA_HEADER__
+#define __PION_PIONARENA_HEADER__
+
+#include <cstdlib>
+#include <new>
+#include <boost/noncopyable.hpp>
+#include <pion/PionConfig.hpp>
+
+
+namespace pion {	// begin namespace pion
+
+
+///
+/// PionArena: a simple region allocator that carves memory out of large
+///            blocks and releases all of it at once.  Individual allocations
+///            cannot be freed.  It is not thread-safe, and is meant to be
+///            owned by objects that live for a single request or message.
+///
+class PionArena
+	: private boost::noncopyable
+{
+public:
+
+	/// default size of the blocks that memory is carved out of, in bytes
+	static const std::size_t	DEFAULT_BLOCK_SIZE = 2048;
+
+	/// all allocations are aligned to multiples of this many bytes
+	static const std::size_t	ALIGNMENT = 2 * sizeof(void*);
+
+
+	/// releases all memory owned by the arena
+	~PionArena() { release(); }
+
+	/**
+	 * constructs a new arena; no memory is allocated until it is needed
+	 *
+	 * @param block_size size of the blocks that memory is carved out of
+	 */
+	explicit PionArena(const std::size_t block_size = DEFAULT_BLOCK_SIZE)
+		: m_block_size(block_size), m_blocks(NULL), m_ptr(NULL), m_end(NULL)
+	{}
+
+	/**
+	 * allocates memory from the arena
+	 *
+	 * @param n size of the memory to allocate, in bytes
+	 *
+	 * @return void * raw pointer to the new memory (remains valid until clear())
+	 */
+	inline void *malloc(std::size_t n) {
+		n = align(n);
+		if (static_cast<std::size_t>(m_end - m_ptr) < n)
+			addBlock(n);
+		void *ptr = m_ptr;
+		m_ptr += n;
+		return ptr;
+	}
+
+	/// releases everything allocated from the arena, but keeps one block for reuse
+	inline void clear(void) {
+		if (m_blocks == NULL)
+			return;
+		// keep the largest block (oversized allocations get blocks of their
+		// own, so this is not necessarily the newest one)
+		Block **keep_link = &m_blocks;
+		for (Block **link = &m_blocks->m_next; *link != NULL; link = &(*link)->m_next) {
+			if ((*link)->m_size > (*keep_link)->m_size)
+				keep_link = link;
+		}
+		Block *keep_ptr = *keep_link;
+		*keep_link = keep_ptr->m_next;
+		release();
+		keep_ptr->m_next = NULL;
+		m_blocks = keep_ptr;
+		m_ptr = keep_ptr->data();
+		m_end = m_ptr + keep_ptr->m_size;
+	}
+
+	/// returns the number of bytes that have been allocated from the arena
+	inline std::size_t getBytesUsed(void) const {
+		std::size_t n = 0;
+		for (const Block *block_ptr = m_blocks; block_ptr != NULL; block_ptr = block_ptr->m_next)
+			n += block_ptr->m_size;
+		return (m_blocks == NULL ? 0 : n - static_cast<std::size_t>(m_end - m_ptr));
+	}
+
+	/// returns the number of blocks currently owned by the arena
+	inline std::size_t getNumBlocks(void) const {
+		std::size_t n = 0;
+		for (const Block *block_ptr = m_blocks; block_ptr != NULL; block_ptr = block_ptr->m_next)
+			++n;
+		return n;
+	}
+
+
+private:
+
+	/// header for each block of memory; the usable memory follows it
+	struct Block {
+		/// returns a pointer to the usable memory within the block
+		inline char *data(void) { return reinterpret_cast<char*>(this) + align(sizeof(Block)); }
+
+		/// next (older) block owned by the arena
+		Block *			m_next;
+
+		/// size of the usable memory within the block, in bytes
+		std::size_t		m_size;
+	};
+
+	/// rounds n up to a multiple of ALIGNMENT
+	static inline std::size_t align(const std::size_t n) {
+		return (n + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+	}
+
+	/// adds a new block that has at least n bytes available
+	inline void addBlock(const std::size_t n) {
+		const std::size_t block_size = (n > m_block_size ? n : m_block_size);
+		void *mem_ptr = ::malloc(align(sizeof(Block)) + block_size);
+		if (mem_ptr == NULL)
+			throw std::bad_alloc();
+		Block *block_ptr = static_cast<Block*>(mem_ptr);
+		block_ptr->m_next = m_blocks;
+		block_ptr->m_size = block_size;
+		m_blocks = block_ptr;
+		m_ptr = block_ptr->data();
+		m_end = m_ptr + block_size;
+	}
+
+	/// frees all blocks owned by the arena
+	inline void release(void) {
+		while (m_blocks != NULL) {
+			Block *block_ptr = m_blocks;
+			m_blocks = m_blocks->m_next;
+			::free(block_ptr);
+		}
+		m_ptr = m_end = NULL;
+	}
+
+
+	/// size of the blocks that memory is carved out of, in bytes
+	const std::size_t		m_block_size;
+
+	/// most recently added block (the others are linked from it)
+	Block *					m_blocks;
+
+	/// next available byte in the current block
+	char *					m_ptr;
+
+	/// end of the current block
+	char *					m_end;
+};
+
+
+}	// end namespace pion
+
+#endif
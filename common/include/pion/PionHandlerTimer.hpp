@@ -0,0 +1,129 @@
+// -----------------------------------------------------------------------
+// pion-common: a collection of common libraries used by the Pion Platform
+// -----------------------------------------------------------------------
+// Copyright (C) 2007-2011 Atomic Labs, Inc.  (http://www.atomiclabs.com)
+//
+// Distributed under the Boost Software License, Version 1.0.
+// See http://www.boost.org/LICENSE_1_0.txt
+//
+
+#ifndef __PION_PIONHANDLERTIMER_HEADER__
+#define __PION_PIONHANDLERTIMER_HEADER__
+
+#include <cstddef>
+#include <boost/version.hpp>
+#include <boost/utility/addressof.hpp>
+#include <boost/detail/atomic_count.hpp>
+#include <boost/asio/handler_alloc_hook.hpp>
+#include <boost/asio/handler_invoke_hook.hpp>
+#if BOOST_VERSION >= 105400
+	#include <boost/asio/handler_continuation_hook.hpp>
+#endif
+#include <pion/PionConfig.hpp>
+
+
+namespace pion {	// begin namespace pion
+
+
+///
+/// PionHandlerTimer: lets a PionMultiThreadScheduler that is collecting thread
+///                   statistics tell the time spent running a completion
+///                   handler apart from the time spent waiting for it.
+///                   Handlers only need to be wrapped while isActive().
+///
+class PION_COMMON_API PionHandlerTimer
+{
+public:
+
+	///
+	/// TimedHandler: a completion handler that marks its start before it runs.
+	/// asio's allocation and invocation hooks are forwarded to the wrapped
+	/// handler, so that e.g. handlers wrapped by a strand keep running in it.
+	///
+	template <typename Handler>
+	class TimedHandler {
+	public:
+		explicit TimedHandler(const Handler& handler) : m_handler(handler) {}
+		void operator()(void) {
+			markHandlerStart();
+			m_handler();
+		}
+		template <typename Arg1>
+		void operator()(const Arg1& arg1) {
+			markHandlerStart();
+			m_handler(arg1);
+		}
+		template <typename Arg1, typename Arg2>
+		void operator()(const Arg1& arg1, const Arg2& arg2) {
+			markHandlerStart();
+			m_handler(arg1, arg2);
+		}
+
+		friend inline void *asio_handler_allocate(std::size_t size, TimedHandler *this_handler) {
+			using boost::asio::asio_handler_allocate;
+			return asio_handler_allocate(size, boost::addressof(this_handler->m_handler));
+		}
+		friend inline void asio_handler_deallocate(void *ptr, std::size_t size, TimedHandler *this_handler) {
+			using boost::asio::asio_handler_deallocate;
+			asio_handler_deallocate(ptr, size, boost::addressof(this_handler->m_handler));
+		}
+		template <typename Function>
+		friend inline void asio_handler_invoke(Function& function, TimedHandler *this_handler) {
+			using boost::asio::asio_handler_invoke;
+			asio_handler_invoke(function, boost::addressof(this_handler->m_handler));
+		}
+		template <typename Function>
+		friend inline void asio_handler_invoke(const Function& function, TimedHandler *this_handler) {
+			using boost::asio::asio_handler_invoke;
+			asio_handler_invoke(function, boost::addressof(this_handler->m_handler));
+		}
+#if BOOST_VERSION >= 105400
+		friend inline bool asio_handler_is_continuation(TimedHandler *this_handler) {
+			using boost::asio::asio_handler_is_continuation;
+			return asio_handler_is_continuation(boost::addressof(this_handler->m_handler));
+		}
+#endif
+
+	private:
+		Handler		m_handler;
+	};
+
+
+	/// returns true if any scheduler is collecting thread statistics
+	/// (otherwise, handlers do not need to be wrapped)
+	static inline bool isActive(void) { return m_active_schedulers != 0; }
+
+	/**
+	 * wraps a completion handler so that, if a worker thread runs it after
+	 * waiting for work, the time it takes is recorded as busy time rather
+	 * than idle time.  Handlers that are not wrapped are still counted, but
+	 * a waiting thread cannot tell when they start.
+	 *
+	 * @param handler the completion handler to wrap
+	 */
+	template <typename Handler>
+	static inline TimedHandler<Handler> wrap(const Handler& handler) {
+		return TimedHandler<Handler>(handler);
+	}
+
+	/// marks the time that a handler started running on the calling thread
+	/// (this ends the thread's wait if it is collecting statistics)
+	static void markHandlerStart(void);
+
+	/// called by schedulers when they start collecting thread statistics
+	static inline void addActiveScheduler(void) { ++m_active_schedulers; }
+
+	/// called by schedulers when they stop collecting thread statistics
+	static inline void removeActiveScheduler(void) { --m_active_schedulers; }
+
+
+private:
+
+	/// number of schedulers that are collecting thread statistics
+	static boost::detail::atomic_count		m_active_schedulers;
+};
+
+
+}	// end namespace pion
+
+#endif
@@ -10,6 +10,7 @@
 #ifndef __PION_PIONSCHEDULER_HEADER__
 #define __PION_PIONSCHEDULER_HEADER__
 
+#include <deque>
 #include <vector>
 #include <boost/asio.hpp>
 #include <boost/bind.hpp>
@@ -17,13 +18,16 @@
 #include <boost/cstdint.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/noncopyable.hpp>
+#include <boost/detail/atomic_count.hpp>
 #include <boost/thread/thread.hpp>
 #include <boost/thread/mutex.hpp>
 #include <boost/thread/xtime.hpp>
 #include <boost/thread/condition.hpp>
+#include <boost/thread/tss.hpp>
 #include <pion/PionConfig.hpp>
 #include <pion/PionException.hpp>
 #include <pion/PionLogger.hpp>
+#include <pion/PionHandlerTimer.hpp>
 
 
 namespace pion {	// begin namespace pion
@@ -80,6 +84,25 @@ public:
 	/// returns an async I/O service used to schedule work
 	virtual boost::asio::io_service& getIOService(void) = 0;
 	
+	/**
+	 * returns an async I/O service to be used by a new connection
+	 *
+	 * @param service_num is set to a number that identifies the service to
+	 *                    addServiceConnection() and removeServiceConnection()
+	 */
+	virtual boost::asio::io_service& getConnectionService(boost::uint32_t& service_num) {
+		service_num = 0;
+		return getIOService();
+	}
+	
+	/// notifies the scheduler that a connection has started using an IO service
+	/// (service_num is the number given by getConnectionService())
+	virtual void addServiceConnection(boost::uint32_t /* service_num */) {}
+	
+	/// notifies the scheduler that a connection has stopped using an IO service
+	/// (service_num is the number given by getConnectionService())
+	virtual void removeServiceConnection(boost::uint32_t /* service_num */) {}
+	
 	/**
 	 * schedules work to be performed by one of the pooled threads
 	 *
@@ -98,6 +121,18 @@ public:
 	void keepRunning(boost::asio::io_service& my_service,
 					 boost::asio::deadline_timer& my_timer);
 	
+	/**
+	 * called when the timer used by keepRunning() expires
+	 *
+	 * @param my_service IO service used to re-schedule keepRunning()
+	 * @param my_timer deadline timer used to keep the IO service active while running
+	 * @param wait_error the wait is cancelled if keepRunning() is called again
+	 *                   for a service that was reset (its timer is re-armed then)
+	 */
+	void handleKeepRunningTimer(boost::asio::io_service& my_service,
+								boost::asio::deadline_timer& my_timer,
+								const boost::system::error_code& wait_error);
+	
 	/**
 	 * puts the current thread to sleep for a specific period of time
 	 *
@@ -201,15 +236,203 @@ class PION_COMMON_API PionMultiThreadScheduler :
 {
 public:
 	
+	/// data type for a set of CPU numbers
+	typedef std::vector<boost::uint32_t>	CPUSet;
+	
+	/// number of buckets in the handler latency histogram
+	enum { NUM_LATENCY_BUCKETS = 24 };
+	
+	///
+	/// ThreadStats: statistics collected for a worker thread
+	///
+	struct ThreadStats {
+		/// constructs a new set of statistics (all zero)
+		ThreadStats(void) { reset(); }
+		
+		/// resets all of the statistics to zero
+		void reset(void);
+		
+		/// number of handlers (and posted work functions) executed
+		boost::uint64_t		handlers;
+		
+		/// microseconds spent executing handlers
+		boost::uint64_t		busy_usec;
+		
+		/// microseconds spent waiting for handlers to become ready
+		boost::uint64_t		idle_usec;
+		
+		/// number of handlers that took longer than the long handler threshold
+		boost::uint64_t		long_handlers;
+		
+		/// largest number of microseconds that a single handler took
+		boost::uint64_t		max_handler_usec;
+		
+		/// bucket n counts handlers that took less than 2^n microseconds
+		/// (the last bucket also counts all handlers that took longer)
+		boost::uint64_t		latency[NUM_LATENCY_BUCKETS];
+	};
+	
+	
 	/// constructs a new PionSingleServiceScheduler
-	PionMultiThreadScheduler(void) {}
+	PionMultiThreadScheduler(void)
+		: m_queued_work(0), m_long_handler_usec(DEFAULT_LONG_HANDLER_USEC),
+		m_collect_stats(false), m_stats_active(false)
+	{}
 	
 	/// virtual destructor
 	virtual ~PionMultiThreadScheduler() {}
 
+	/**
+	 * sets the CPUs that a worker thread is allowed to run on; this must be
+	 * called before the scheduler is started.  Only memory that the thread
+	 * allocates (and first writes to) after it has started is normally placed
+	 * on its NUMA node: the io_services and other scheduler state are
+	 * allocated by the thread that calls startup() or first uses the scheduler.
+	 *
+	 * @param thread_num number of the worker thread (0 to getNumThreads()-1)
+	 * @param cpus the CPUs that the thread may run on (empty for any CPU)
+	 */
+	void setThreadAffinity(boost::uint32_t thread_num, const CPUSet& cpus);
+	
+	/// pins each worker thread to a single CPU: thread n runs on CPU n,
+	/// modulo the number of CPUs (this must be called before startup)
+	void pinThreadsToCPUs(void);
+	
+	/// removes the CPU affinity for all worker threads
+	inline void clearThreadAffinity(void) {
+		boost::mutex::scoped_lock scheduler_lock(m_mutex);
+		m_thread_affinity.clear();
+	}
+	
+	/// enables or disables the collection of thread statistics (this takes
+	/// effect the next time that the scheduler is started)
+	inline void setCollectStats(bool b) { m_collect_stats = b; }
+	
+	/// returns true if thread statistics are being collected
+	inline bool getCollectStats(void) const { return m_collect_stats; }
+	
+	/// sets the number of microseconds after which a handler is reported as
+	/// a long handler (and a warning is logged)
+	inline void setLongHandlerThreshold(boost::uint32_t usec) { m_long_handler_usec = usec; }
+	
+	/// returns the number of microseconds after which a handler is reported
+	inline boost::uint32_t getLongHandlerThreshold(void) const { return m_long_handler_usec; }
+	
+	/// returns a copy of the statistics collected for a worker thread
+	/// (all zero if the thread has not been started)
+	ThreadStats getThreadStats(boost::uint32_t n) const;
+	
+	/// resets the statistics collected for all worker threads
+	void resetStats(void);
+	
+	/// returns the number of posted work functions that are waiting to be
+	/// executed (only counted while collecting statistics)
+	inline long getQueuedWork(void) const { return m_queued_work; }
+	
+	/// returns the scheduler that owns the calling thread, or NULL if it is
+	/// not a worker thread
+	static inline PionMultiThreadScheduler *getCurrentScheduler(void) {
+		return m_current_scheduler.get();
+	}
+	
+	/// marks the time that a handler started running on the calling thread
+	/// (this ends the thread's wait if it is collecting statistics; see
+	/// PionHandlerTimer, which is used to wrap completion handlers)
+	static inline void markHandlerStart(void) {
+		ThreadStatsEntry *entry_ptr = m_current_stats.get();
+		if (entry_ptr != NULL && entry_ptr->m_is_waiting) {
+			// only the worker thread changes m_is_waiting, so it can be
+			// checked without locking
+			boost::mutex::scoped_lock stats_lock(entry_ptr->m_mutex);
+			entry_ptr->m_handler_start = boost::get_system_time();
+			entry_ptr->m_stats.idle_usec += (entry_ptr->m_handler_start - entry_ptr->m_wait_start).total_microseconds();
+			entry_ptr->m_is_waiting = false;
+			entry_ptr->m_handler_marked = true;
+		}
+	}
+	
+	/**
+	 * schedules work to be performed by one of the pooled threads
+	 *
+	 * @param work_func work function to be executed
+	 */
+	virtual void post(boost::function0<void> work_func) {
+		if (m_collect_stats) {
+			++m_queued_work;
+			getIOService().post(boost::bind(&PionMultiThreadScheduler::runPostedWork,
+											this, work_func));
+		} else {
+			PionScheduler::post(work_func);
+		}
+	}
+	
+	/**
+	 * thread function used to process work for a single IO service
+	 *
+	 * @param n integer number representing the worker thread
+	 * @param service IO service used by the worker thread
+	 */
+	void processThreadWork(boost::uint32_t n, boost::asio::io_service& service);
+
 	
 protected:
 	
+	/**
+	 * applies the CPU affinity configured for a worker thread to the
+	 * calling thread (this is called by each worker thread when it starts)
+	 *
+	 * @param n integer number representing the worker thread
+	 */
+	void bindThread(boost::uint32_t n);
+	
+	/// makes sure that statistics are available for each worker thread
+	/// (assumes m_mutex is locked; called by startup())
+	void initThreadStats(void);
+	
+	/**
+	 * runs the handlers that are ready for an IO service, one at a time,
+	 * and records the time taken by each one
+	 *
+	 * @param n integer number representing the worker thread
+	 * @param service IO service used by the worker thread
+	 *
+	 * @return std::size_t number of handlers that were run
+	 */
+	std::size_t pollWithStats(boost::uint32_t n, boost::asio::io_service& service);
+	
+	/**
+	 * waits for a handler to become ready for an IO service and runs it;
+	 * the wait is recorded as idle time and the handler as busy time, if it
+	 * was wrapped using PionHandlerTimer (otherwise both are idle time)
+	 *
+	 * @param n integer number representing the worker thread
+	 * @param service IO service used by the worker thread
+	 */
+	void runOneWithStats(boost::uint32_t n, boost::asio::io_service& service);
+	
+	/**
+	 * records the time taken by a handler
+	 *
+	 * @param n integer number representing the worker thread
+	 * @param usec number of microseconds that the handler took
+	 */
+	void recordHandler(boost::uint32_t n, boost::uint64_t usec);
+	
+	/// runs a work function that was posted while collecting statistics
+	inline void runPostedWork(boost::function0<void>& work_func) {
+		--m_queued_work;
+		markHandlerStart();
+		work_func();
+	}
+	
+	/// returns the number of microseconds that have passed since a given time
+	static inline boost::uint64_t getElapsedUSec(const boost::system_time& start_time) {
+		return (boost::get_system_time() - start_time).total_microseconds();
+	}
+	
+	/// cleanup function for m_current_scheduler (schedulers are not owned)
+	static void ignoreScheduler(PionMultiThreadScheduler *) {}
+	
 	/// stops all threads used to perform work
 	virtual void stopThreads(void) {
 		if (! m_thread_pool.empty()) {
@@ -228,7 +451,13 @@ protected:
 	}
 	
 	/// finishes all threads used to perform work
-	virtual void finishThreads(void) { m_thread_pool.clear(); }
+	virtual void finishThreads(void) {
+		m_thread_pool.clear();
+		if (m_stats_active) {
+			PionHandlerTimer::removeActiveScheduler();
+			m_stats_active = false;
+		}
+	}
 
 	
 	/// typedef for a pool of worker threads
@@ -237,6 +466,53 @@ protected:
 	
 	/// pool of threads used to perform work
 	ThreadPool				m_thread_pool;
+	
+	/// CPUs that each worker thread may run on (empty for any CPU)
+	std::vector<CPUSet>		m_thread_affinity;
+	
+	
+	/// default number of microseconds after which a handler is reported
+	static const boost::uint32_t	DEFAULT_LONG_HANDLER_USEC;
+	
+	/// points to the scheduler that owns the current thread, if it is a worker thread
+	static boost::thread_specific_ptr<PionMultiThreadScheduler>	m_current_scheduler;
+	
+	
+	/// data type for the statistics of a worker thread and the mutex that protects them
+	/// (m_wait_start is when the thread started waiting, if m_is_waiting is true;
+	/// m_handler_start is when a wrapped handler ended the wait, if m_handler_marked is true)
+	struct ThreadStatsEntry {
+		ThreadStatsEntry(void) : m_is_waiting(false), m_handler_marked(false) {}
+		mutable boost::mutex		m_mutex;
+		ThreadStats					m_stats;
+		boost::system_time			m_wait_start;
+		boost::system_time			m_handler_start;
+		bool						m_is_waiting;
+		bool						m_handler_marked;
+	};
+	
+	/// points to the statistics of the current thread, if it is a worker
+	/// thread that is collecting statistics
+	static boost::thread_specific_ptr<ThreadStatsEntry>	m_current_stats;
+	
+	/// cleanup function for m_current_stats (statistics are owned by the scheduler)
+	static void ignoreStats(ThreadStatsEntry *) {}
+	
+	/// statistics for each worker thread (this only changes in startup())
+	std::vector<boost::shared_ptr<ThreadStatsEntry> >	m_thread_stats;
+	
+	/// number of posted work functions waiting to be executed
+	boost::detail::atomic_count	m_queued_work;
+	
+	/// number of microseconds after which a handler is reported as a long handler
+	boost::uint32_t				m_long_handler_usec;
+	
+	/// true if thread statistics are being collected
+	bool						m_collect_stats;
+	
+	/// true while the scheduler is running and collecting statistics
+	/// (see PionHandlerTimer::isActive())
+	bool						m_stats_active;
 };
 	
 	
@@ -288,25 +564,67 @@ class PION_COMMON_API PionOneToOneScheduler :
 {
 public:
 	
+	/// policies used by getIOService() to choose an IO service
+	enum SelectionPolicy {
+		SELECT_ROUND_ROBIN,			///< use each service in turn
+		SELECT_LEAST_CONNECTIONS	///< use the service with the fewest connections
+	};
+	
+	
 	/// constructs a new PionOneToOneScheduler
 	PionOneToOneScheduler(void)
-		: m_service_pool(), m_next_service(0)
+		: m_service_pool(), m_num_services(0), m_next_service(0),
+		m_pool_is_fixed(0), m_selection_policy(SELECT_ROUND_ROBIN)
 	{}
 	
 	/// virtual destructor
 	virtual ~PionOneToOneScheduler() { shutdown(); }
 	
-	/// returns an async I/O service used to schedule work
+	/// returns an async I/O service used to schedule work (the service pool
+	/// is fixed while the scheduler is running, so no locking is required)
 	virtual boost::asio::io_service& getIOService(void) {
-		boost::mutex::scoped_lock scheduler_lock(m_mutex);
-		while (m_service_pool.size() < m_num_threads) {
-			boost::shared_ptr<ServicePair>	service_ptr(new ServicePair());
-			m_service_pool.push_back(service_ptr);
+		if (m_pool_is_fixed == 0) {
+			boost::mutex::scoped_lock scheduler_lock(m_mutex);
+			initServicePool();
+			return m_service_pool[selectService()]->first;
+		}
+		return m_service_pool[selectService()]->first;
+	}
+	
+	/// sets the policy used by getIOService() to choose an IO service
+	inline void setSelectionPolicy(SelectionPolicy policy) { m_selection_policy = policy; }
+	
+	/// returns the policy used by getIOService() to choose an IO service
+	inline SelectionPolicy getSelectionPolicy(void) const { return m_selection_policy; }
+	
+	/// returns an async I/O service to be used by a new connection, and its number
+	virtual boost::asio::io_service& getConnectionService(boost::uint32_t& service_num) {
+		if (m_pool_is_fixed == 0) {
+			boost::mutex::scoped_lock scheduler_lock(m_mutex);
+			initServicePool();
+			service_num = selectService();
+			return m_service_pool[service_num]->first;
 		}
-		if (++m_next_service >= m_num_threads)
-			m_next_service = 0;
-		PION_ASSERT(m_next_service < m_num_threads);
-		return m_service_pool[m_next_service]->first;
+		service_num = selectService();
+		return m_service_pool[service_num]->first;
+	}
+	
+	/// notifies the scheduler that a connection has started using an IO service
+	virtual void addServiceConnection(boost::uint32_t service_num) {
+		if (service_num < m_num_services)
+			++m_service_pool[service_num]->connections;
+	}
+	
+	/// notifies the scheduler that a connection has stopped using an IO service
+	virtual void removeServiceConnection(boost::uint32_t service_num) {
+		if (service_num < m_num_services)
+			--m_service_pool[service_num]->connections;
+	}
+	
+	/// returns the number of connections using an IO service
+	inline long getServiceConnections(boost::uint32_t n) const {
+		PION_ASSERT(n < m_service_pool.size());
+		return m_service_pool[n]->connections;
 	}
 	
 	/**
@@ -334,15 +652,38 @@ protected:
 		}
 	}
 		
-	/// finishes all services used to schedule work
-	virtual void finishServices(void) { m_service_pool.clear(); }
+	/// finishes all services used to schedule work (they are reset rather
+	/// than destroyed, since getIOService() may still be using the pool)
+	virtual void finishServices(void) {
+		for (ServicePool::iterator i = m_service_pool.begin(); i != m_service_pool.end(); ++i) {
+			(*i)->first.reset();
+		}
+		if (m_pool_is_fixed > 0)
+			--m_pool_is_fixed;
+	}
+	
+	/// makes sure that the service pool is initialized (assumes m_mutex is
+	/// locked); the pool only grows while it is not fixed
+	void initServicePool(void);
+	
+	/// fixes the service pool, so that it may be used without locking until
+	/// finishServices() is called (assumes m_mutex is locked)
+	inline void fixServicePool(void) {
+		if (m_pool_is_fixed == 0)
+			++m_pool_is_fixed;
+	}
+	
+	/// returns the number of the next service to use for scheduling work
+	boost::uint32_t selectService(void);
 	
 
 	/// typedef for a pair object where first is an IO service and second is a deadline timer
+	/// (connections is the number of connections that are using the service)
 	struct ServicePair {
-		ServicePair(void) : first(), second(first) {}
+		ServicePair(void) : first(), second(first), connections(0) {}
 		boost::asio::io_service			first;
 		boost::asio::deadline_timer		second;
+		boost::detail::atomic_count		connections;
 	};
 	
 	/// typedef for a pool of IO services
@@ -352,8 +693,141 @@ protected:
 	/// pool of IO services used to schedule work
 	ServicePool						m_service_pool;
 
-	/// the next service to use for scheduling work
-	boost::uint32_t					m_next_service;
+	/// number of services in the pool that are used to schedule work
+	boost::uint32_t					m_num_services;
+	
+	/// incremented each time that a service is selected
+	boost::detail::atomic_count		m_next_service;
+	
+	/// non-zero while the service pool is fixed (from startup() until
+	/// finishServices()), so that it may be used without locking
+	boost::detail::atomic_count		m_pool_is_fixed;
+	
+	/// policy used by getIOService() to choose an IO service
+	SelectionPolicy					m_selection_policy;
+};
+	
+	
+///
+/// PionWorkStealingScheduler: uses a single IO service for each thread, like
+/// PionOneToOneScheduler, so that connections keep their thread affinity for
+/// I/O.  Work scheduled using post() is placed into per-thread queues, and
+/// idle threads steal work from the queues of busy threads.
+/// 
+class PION_COMMON_API PionWorkStealingScheduler :
+	public PionOneToOneScheduler
+{
+public:
+	
+	/// constructs a new PionWorkStealingScheduler
+	PionWorkStealingScheduler(void)
+		: m_queue_pool(), m_next_queue(0),
+		m_current_queue(&PionWorkStealingScheduler::ignoreQueue)
+	{}
+	
+	/// virtual destructor
+	virtual ~PionWorkStealingScheduler() { shutdown(); }
+	
+	/// Starts the thread scheduler (this is called automatically when necessary)
+	virtual void startup(void);
+	
+	/**
+	 * schedules work to be performed by one of the pooled threads.  Work
+	 * posted by a pooled thread is queued for the same thread; otherwise
+	 * the queues are used in round-robin order.
+	 *
+	 * @param work_func work function to be executed
+	 */
+	virtual void post(boost::function0<void> work_func);
+	
+	/**
+	 * thread function used to process I/O events and queued work
+	 *
+	 * @param n integer number representing the thread's service and queue
+	 */
+	void processQueuedWork(boost::uint32_t n);
+	
+	
+protected:
+	
+	/// finishes all services used to schedule work
+	virtual void finishServices(void) {
+		m_queue_pool.clear();
+		PionOneToOneScheduler::finishServices();
+	}
+	
+	/**
+	 * runs one work item from a thread's own queue, or steals one from the
+	 * queue of another thread if its own queue is empty
+	 *
+	 * @param n integer number representing the thread's queue
+	 *
+	 * @return true if a work item was run
+	 */
+	bool runQueuedWork(boost::uint32_t n);
+	
+	/**
+	 * marks a thread as idle if there is no queued work for it to run
+	 *
+	 * @param n integer number representing the thread's queue
+	 *
+	 * @return true if the thread is idle and should wait for I/O events
+	 */
+	bool markIdle(boost::uint32_t n);
+	
+	/**
+	 * wakes up an idle thread so that it can run (or steal) queued work
+	 *
+	 * @param n integer number representing the queue that work was added to
+	 */
+	void wakeIdleThread(boost::uint32_t n);
+	
+	/// work function posted to an idle thread's service to wake it up
+	static void wakeup(void) {}
+	
+	
+	/// data type for a queue of work that belongs to one thread
+	struct WorkQueue {
+		WorkQueue(boost::uint32_t n) : m_num(n), m_is_idle(false) {}
+		
+		/// integer number representing the thread that owns the queue
+		const boost::uint32_t						m_num;
+		
+		/// mutex used to protect the queue
+		boost::mutex								m_mutex;
+		
+		/// work functions waiting to be executed
+		std::deque<boost::function0<void> >		m_work;
+		
+		/// true if the thread is waiting for I/O events
+		bool										m_is_idle;
+	};
+	
+	/// typedef for a pool of work queues
+	typedef std::vector<boost::shared_ptr<WorkQueue> >		QueuePool;
+	
+	
+	/**
+	 * adds work to a queue and wakes up a thread to run it
+	 *
+	 * @param queue the queue to add the work to
+	 * @param work_func work function to be executed
+	 */
+	void queueWork(WorkQueue& queue, boost::function0<void>& work_func);
+	
+	
+	/// cleanup function for m_current_queue (queues are owned by m_queue_pool)
+	static void ignoreQueue(WorkQueue *) {}
+	
+	
+	/// pool of work queues (one for each thread)
+	QueuePool								m_queue_pool;
+	
+	/// the next queue to use for work posted by other threads
+	boost::uint32_t							m_next_queue;
+	
+	/// points to the work queue of the current thread, if it is a pooled thread
+	boost::thread_specific_ptr<WorkQueue>	m_current_queue;
 };
 	
 	
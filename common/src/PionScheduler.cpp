@@ -7,8 +7,15 @@
 // See http://www.boost.org/LICENSE_1_0.txt
 //
 
+#ifdef _MSC_VER
+	#include <windows.h>
+#endif
 #include <boost/date_time/posix_time/posix_time_duration.hpp>
 #include <pion/PionScheduler.hpp>
+#if defined(PION_HAVE_PTHREAD_SETAFFINITY)
+	#include <pthread.h>
+	#include <sched.h>
+#endif
 
 namespace pion {	// begin namespace pion
 
@@ -21,6 +28,26 @@ const boost::uint32_t	PionScheduler::MICROSEC_IN_SECOND = 1000000;	// (10^6)
 const boost::uint32_t	PionScheduler::KEEP_RUNNING_TIMER_SECONDS = 5;
 
 
+// static members of PionMultiThreadScheduler
+
+const boost::uint32_t	PionMultiThreadScheduler::DEFAULT_LONG_HANDLER_USEC = 100000;	// 0.1 seconds
+boost::thread_specific_ptr<PionMultiThreadScheduler>	PionMultiThreadScheduler::m_current_scheduler(&PionMultiThreadScheduler::ignoreScheduler);
+boost::thread_specific_ptr<PionMultiThreadScheduler::ThreadStatsEntry>	PionMultiThreadScheduler::m_current_stats(&PionMultiThreadScheduler::ignoreStats);
+
+
+// static members of PionHandlerTimer
+
+boost::detail::atomic_count	PionHandlerTimer::m_active_schedulers(0);
+
+
+// PionHandlerTimer member functions
+
+void PionHandlerTimer::markHandlerStart(void)
+{
+	PionMultiThreadScheduler::markHandlerStart();
+}
+
+
 // PionScheduler member functions
 
 void PionScheduler::shutdown(void)
@@ -79,11 +106,21 @@ void PionScheduler::keepRunning(boost::asio::io_service& my_service,
 	if (m_is_running) {
 		// schedule this again to make sure the service doesn't complete
 		my_timer.expires_from_now(boost::posix_time::seconds(KEEP_RUNNING_TIMER_SECONDS));
-		my_timer.async_wait(boost::bind(&PionScheduler::keepRunning, this,
-										boost::ref(my_service), boost::ref(my_timer)));
+		my_timer.async_wait(boost::bind(&PionScheduler::handleKeepRunningTimer, this,
+										boost::ref(my_service), boost::ref(my_timer),
+										boost::asio::placeholders::error));
 	}
 }
 
+void PionScheduler::handleKeepRunningTimer(boost::asio::io_service& my_service,
+										   boost::asio::deadline_timer& my_timer,
+										   const boost::system::error_code& wait_error)
+{
+	// a cancelled wait has already been replaced by another one
+	if (wait_error != boost::asio::error::operation_aborted)
+		keepRunning(my_service, my_timer);
+}
+
 void PionScheduler::addActiveUser(void)
 {
 	if (!m_is_running) startup();
@@ -117,6 +154,185 @@ void PionScheduler::processServiceWork(boost::asio::io_service& service) {
 }
 					 
 
+// PionMultiThreadScheduler::ThreadStats member functions
+
+void PionMultiThreadScheduler::ThreadStats::reset(void)
+{
+	handlers = busy_usec = idle_usec = long_handlers = max_handler_usec = 0;
+	for (std::size_t n = 0; n < NUM_LATENCY_BUCKETS; ++n)
+		latency[n] = 0;
+}
+
+
+// PionMultiThreadScheduler member functions
+
+void PionMultiThreadScheduler::setThreadAffinity(boost::uint32_t thread_num,
+												 const CPUSet& cpus)
+{
+	boost::mutex::scoped_lock scheduler_lock(m_mutex);
+	if (m_thread_affinity.size() <= thread_num)
+		m_thread_affinity.resize(thread_num + 1);
+	m_thread_affinity[thread_num] = cpus;
+}
+
+void PionMultiThreadScheduler::pinThreadsToCPUs(void)
+{
+	const boost::uint32_t num_cpus = boost::thread::hardware_concurrency();
+	if (num_cpus == 0) {
+		PION_LOG_WARN(m_logger, "Unable to pin threads: the number of CPUs is unknown");
+		return;
+	}
+	boost::mutex::scoped_lock scheduler_lock(m_mutex);
+	m_thread_affinity.resize(m_num_threads);
+	for (boost::uint32_t n = 0; n < m_num_threads; ++n)
+		m_thread_affinity[n] = CPUSet(1, n % num_cpus);
+}
+
+void PionMultiThreadScheduler::processThreadWork(boost::uint32_t n,
+												 boost::asio::io_service& service)
+{
+	bindThread(n);
+	if (! m_collect_stats) {
+		processServiceWork(service);
+		return;
+	}
+	
+	while (m_is_running) {
+		try {
+			if (pollWithStats(n, service) == 0)
+				runOneWithStats(n, service);
+		} catch (std::exception& e) {
+			PION_LOG_ERROR(m_logger, e.what());
+		} catch (...) {
+			PION_LOG_ERROR(m_logger, "caught unrecognized exception");
+		}
+	}
+}
+
+PionMultiThreadScheduler::ThreadStats PionMultiThreadScheduler::getThreadStats(boost::uint32_t n) const
+{
+	if (n >= m_thread_stats.size())
+		return ThreadStats();
+	boost::mutex::scoped_lock stats_lock(m_thread_stats[n]->m_mutex);
+	ThreadStats stats(m_thread_stats[n]->m_stats);
+	if (m_thread_stats[n]->m_is_waiting)
+		stats.idle_usec += getElapsedUSec(m_thread_stats[n]->m_wait_start);
+	return stats;
+}
+
+void PionMultiThreadScheduler::resetStats(void)
+{
+	for (std::size_t n = 0; n < m_thread_stats.size(); ++n) {
+		boost::mutex::scoped_lock stats_lock(m_thread_stats[n]->m_mutex);
+		m_thread_stats[n]->m_stats.reset();
+	}
+}
+
+void PionMultiThreadScheduler::initThreadStats(void)
+{
+	while (m_thread_stats.size() < m_num_threads) {
+		boost::shared_ptr<ThreadStatsEntry>	stats_ptr(new ThreadStatsEntry());
+		m_thread_stats.push_back(stats_ptr);
+	}
+	if (m_collect_stats && ! m_stats_active) {
+		// completion handlers are only wrapped while a scheduler needs them
+		PionHandlerTimer::addActiveScheduler();
+		m_stats_active = true;
+	}
+}
+
+std::size_t PionMultiThreadScheduler::pollWithStats(boost::uint32_t n,
+													boost::asio::io_service& service)
+{
+	std::size_t num_handlers = 0;
+	while (true) {
+		const boost::system_time start_time(boost::get_system_time());
+		if (service.poll_one() == 0)
+			break;
+		recordHandler(n, getElapsedUSec(start_time));
+		++num_handlers;
+	}
+	return num_handlers;
+}
+
+void PionMultiThreadScheduler::runOneWithStats(boost::uint32_t n,
+											   boost::asio::io_service& service)
+{
+	ThreadStatsEntry& entry = *m_thread_stats[n];
+	boost::mutex::scoped_lock stats_lock(entry.m_mutex);
+	entry.m_wait_start = boost::get_system_time();
+	entry.m_is_waiting = true;
+	entry.m_handler_marked = false;
+	stats_lock.unlock();
+	
+	const std::size_t num_handlers = service.run_one();
+	
+	if (entry.m_handler_marked) {
+		// a wrapped handler ended the wait (see markHandlerStart())
+		recordHandler(n, getElapsedUSec(entry.m_handler_start));
+		return;
+	}
+	
+	// the handler was not wrapped, so it cannot be told apart from the wait
+	stats_lock.lock();
+	entry.m_is_waiting = false;
+	entry.m_stats.handlers += num_handlers;
+	entry.m_stats.idle_usec += getElapsedUSec(entry.m_wait_start);
+}
+
+void PionMultiThreadScheduler::recordHandler(boost::uint32_t n, boost::uint64_t usec)
+{
+	std::size_t bucket = 0;
+	while (bucket < NUM_LATENCY_BUCKETS - 1 && (static_cast<boost::uint64_t>(1) << bucket) <= usec)
+		++bucket;
+	
+	ThreadStatsEntry& entry = *m_thread_stats[n];
+	boost::mutex::scoped_lock stats_lock(entry.m_mutex);
+	++entry.m_stats.handlers;
+	entry.m_stats.busy_usec += usec;
+	++entry.m_stats.latency[bucket];
+	if (usec > entry.m_stats.max_handler_usec)
+		entry.m_stats.max_handler_usec = usec;
+	if (usec >= m_long_handler_usec) {
+		++entry.m_stats.long_handlers;
+		stats_lock.unlock();
+		PION_LOG_WARN(m_logger, "Scheduler thread " << n << " ran a handler for " << usec << " microseconds");
+	}
+}
+
+void PionMultiThreadScheduler::bindThread(boost::uint32_t n)
+{
+	m_current_scheduler.reset(this);
+	m_current_stats.reset(m_collect_stats && n < m_thread_stats.size()
+						  ? m_thread_stats[n].get() : NULL);
+	
+	if (n >= m_thread_affinity.size() || m_thread_affinity[n].empty())
+		return;
+	const CPUSet& cpus = m_thread_affinity[n];
+	bool success = false;
+	
+#if defined(PION_HAVE_PTHREAD_SETAFFINITY)
+	cpu_set_t cpu_set;
+	CPU_ZERO(&cpu_set);
+	for (CPUSet::const_iterator i = cpus.begin(); i != cpus.end(); ++i) {
+		if (*i < CPU_SETSIZE)
+			CPU_SET(*i, &cpu_set);
+	}
+	success = (pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set) == 0);
+#elif defined(_MSC_VER)
+	DWORD_PTR cpu_mask = 0;
+	for (CPUSet::const_iterator i = cpus.begin(); i != cpus.end(); ++i) {
+		if (*i < sizeof(cpu_mask) * 8)
+			cpu_mask |= (static_cast<DWORD_PTR>(1) << *i);
+	}
+	success = (cpu_mask != 0 && SetThreadAffinityMask(GetCurrentThread(), cpu_mask) != 0);
+#endif
+
+	if (! success)
+		PION_LOG_WARN(m_logger, "Unable to set the CPU affinity for scheduler thread " << n);
+}
+
+
 // PionSingleServiceScheduler member functions
 
 void PionSingleServiceScheduler::startup(void)
@@ -130,12 +346,13 @@ void PionSingleServiceScheduler::startup(void)
 		
 		// schedule a work item to make sure that the service doesn't complete
 		m_service.reset();
+		initThreadStats();
 		keepRunning(m_service, m_timer);
 		
 		// start multiple threads to handle async tasks
 		for (boost::uint32_t n = 0; n < m_num_threads; ++n) {
-			boost::shared_ptr<boost::thread> new_thread(new boost::thread( boost::bind(&PionScheduler::processServiceWork,
-																					   this, boost::ref(m_service)) ));
+			boost::shared_ptr<boost::thread> new_thread(new boost::thread( boost::bind(&PionMultiThreadScheduler::processThreadWork,
+																					   this, n, boost::ref(m_service)) ));
 			m_thread_pool.push_back(new_thread);
 		}
 	}
@@ -151,13 +368,80 @@ void PionOneToOneScheduler::startup(void)
 	
 	if (! m_is_running) {
 		PION_LOG_INFO(m_logger, "Starting thread scheduler");
-		m_is_running = true;
 		
 		// make sure there are enough services initialized
-		while (m_service_pool.size() < m_num_threads) {
-			boost::shared_ptr<ServicePair>	service_ptr(new ServicePair());
-			m_service_pool.push_back(service_ptr);
+		initServicePool();
+		initThreadStats();
+		m_is_running = true;
+		fixServicePool();
+
+		// schedule a work item for each service to make sure that it doesn't complete
+		for (ServicePool::iterator i = m_service_pool.begin(); i != m_service_pool.end(); ++i) {
+			keepRunning((*i)->first, (*i)->second);
+		}
+		
+		// start multiple threads to handle async tasks
+		for (boost::uint32_t n = 0; n < m_num_threads; ++n) {
+			boost::shared_ptr<boost::thread> new_thread(new boost::thread( boost::bind(&PionMultiThreadScheduler::processThreadWork,
+																					   this, n, boost::ref(m_service_pool[n]->first)) ));
+			m_thread_pool.push_back(new_thread);
+		}
+	}
+}
+
+void PionOneToOneScheduler::initServicePool(void)
+{
+	// the pool may be in use by other threads without locking
+	if (m_pool_is_fixed > 0)
+		return;
+	while (m_service_pool.size() < m_num_threads) {
+		boost::shared_ptr<ServicePair>	service_ptr(new ServicePair());
+		m_service_pool.push_back(service_ptr);
+	}
+	m_num_services = m_num_threads;
+}
+
+boost::uint32_t PionOneToOneScheduler::selectService(void)
+{
+	PION_ASSERT(m_num_services > 0);
+	const boost::uint32_t next_service = static_cast<unsigned long>(++m_next_service) % m_num_services;
+	if (m_selection_policy == SELECT_ROUND_ROBIN)
+		return next_service;
+	
+	// start with the next service in order so that ties are spread evenly
+	boost::uint32_t best_service = next_service;
+	long best_connections = m_service_pool[best_service]->connections;
+	for (boost::uint32_t i = 1; i < m_num_services && best_connections > 0; ++i) {
+		const boost::uint32_t n = (next_service + i) % m_num_services;
+		const long connections = m_service_pool[n]->connections;
+		if (connections < best_connections) {
+			best_service = n;
+			best_connections = connections;
+		}
+	}
+	return best_service;
+}
+
+	
+// PionWorkStealingScheduler member functions
+
+void PionWorkStealingScheduler::startup(void)
+{
+	// lock mutex for thread safety
+	boost::mutex::scoped_lock scheduler_lock(m_mutex);
+	
+	if (! m_is_running) {
+		PION_LOG_INFO(m_logger, "Starting thread scheduler");
+		
+		// make sure there are enough services and queues initialized
+		initServicePool();
+		while (m_queue_pool.size() < m_num_threads) {
+			boost::shared_ptr<WorkQueue>	queue_ptr(new WorkQueue(m_queue_pool.size()));
+			m_queue_pool.push_back(queue_ptr);
 		}
+		initThreadStats();
+		m_is_running = true;
+		fixServicePool();
 
 		// schedule a work item for each service to make sure that it doesn't complete
 		for (ServicePool::iterator i = m_service_pool.begin(); i != m_service_pool.end(); ++i) {
@@ -166,12 +450,160 @@ void PionOneToOneScheduler::startup(void)
 		
 		// start multiple threads to handle async tasks
 		for (boost::uint32_t n = 0; n < m_num_threads; ++n) {
-			boost::shared_ptr<boost::thread> new_thread(new boost::thread( boost::bind(&PionScheduler::processServiceWork,
-																					   this, boost::ref(m_service_pool[n]->first)) ));
+			boost::shared_ptr<boost::thread> new_thread(new boost::thread( boost::bind(&PionWorkStealingScheduler::processQueuedWork,
+																					   this, n) ));
 			m_thread_pool.push_back(new_thread);
 		}
 	}
 }
 
+void PionWorkStealingScheduler::post(boost::function0<void> work_func)
+{
+	// pooled threads use their own queue, which is not released until
+	// after the pooled threads have stopped
+	WorkQueue *queue_ptr = m_current_queue.get();
+	if (queue_ptr != NULL) {
+		queueWork(*queue_ptr, work_func);
+		return;
+	}
+	
+	// other threads hold the scheduler lock so that shutdown() cannot
+	// release the queues while the work is added
+	boost::mutex::scoped_lock scheduler_lock(m_mutex);
+	if (! m_is_running) {
+		// the queues are not available until the scheduler has started
+		scheduler_lock.unlock();
+		PionOneToOneScheduler::post(work_func);
+		return;
+	}
+	
+	// pick the next queue in order
+	if (++m_next_queue >= m_queue_pool.size())
+		m_next_queue = 0;
+	queueWork(*m_queue_pool[m_next_queue], work_func);
+}
+
+void PionWorkStealingScheduler::queueWork(WorkQueue& queue, boost::function0<void>& work_func)
+{
+	// add the work to the queue and make sure that a thread is awake to run it
+	if (m_collect_stats)
+		++m_queued_work;
+	{
+		boost::mutex::scoped_lock queue_lock(queue.m_mutex);
+		queue.m_work.push_back(work_func);
+	}
+	wakeIdleThread(queue.m_num);
+}
+
+void PionWorkStealingScheduler::processQueuedWork(boost::uint32_t n)
+{
+	boost::asio::io_service& my_service = m_service_pool[n]->first;
+	m_current_queue.reset(m_queue_pool[n].get());
+	bindThread(n);
+	
+	while (m_is_running) {
+		try {
+			// run any I/O handlers that are ready, without blocking
+			if (m_collect_stats)
+				pollWithStats(n, my_service);
+			else
+				my_service.poll();
+			
+			// run work from our own queue, or steal it from another thread
+			if (runQueuedWork(n))
+				continue;
+			
+			// nothing to do -> wait for an I/O event or a wakeup from post()
+			if (markIdle(n)) {
+				if (m_collect_stats)
+					runOneWithStats(n, my_service);
+				else
+					my_service.run_one();
+				boost::mutex::scoped_lock queue_lock(m_queue_pool[n]->m_mutex);
+				m_queue_pool[n]->m_is_idle = false;
+			}
+		} catch (std::exception& e) {
+			PION_LOG_ERROR(m_logger, e.what());
+		} catch (...) {
+			PION_LOG_ERROR(m_logger, "caught unrecognized exception");
+		}
+	}
+	
+	m_current_queue.reset();
+}
+
+bool PionWorkStealingScheduler::runQueuedWork(boost::uint32_t n)
+{
+	boost::function0<void> work_func;
+	const std::size_t num_queues = m_queue_pool.size();
+	
+	// the owner takes work from the front of its queue, while other threads
+	// steal the most recently queued work from the back
+	for (std::size_t i = 0; i < num_queues && work_func.empty(); ++i) {
+		WorkQueue& queue = *m_queue_pool[(n + i) % num_queues];
+		boost::mutex::scoped_lock queue_lock(queue.m_mutex);
+		if (! queue.m_work.empty()) {
+			if (i == 0) {
+				work_func.swap(queue.m_work.front());
+				queue.m_work.pop_front();
+			} else {
+				work_func.swap(queue.m_work.back());
+				queue.m_work.pop_back();
+			}
+		}
+	}
+	
+	if (work_func.empty())
+		return false;
+	if (m_collect_stats) {
+		--m_queued_work;
+		const boost::system_time start_time(boost::get_system_time());
+		work_func();
+		recordHandler(n, getElapsedUSec(start_time));
+	} else {
+		work_func();
+	}
+	return true;
+}
+
+bool PionWorkStealingScheduler::markIdle(boost::uint32_t n)
+{
+	WorkQueue& my_queue = *m_queue_pool[n];
+	{
+		boost::mutex::scoped_lock queue_lock(my_queue.m_mutex);
+		my_queue.m_is_idle = true;
+	}
+	
+	// check for work that was queued before we were marked idle; work
+	// queued afterwards will wake us up (see wakeIdleThread())
+	for (QueuePool::iterator i = m_queue_pool.begin(); i != m_queue_pool.end(); ++i) {
+		boost::mutex::scoped_lock queue_lock((*i)->m_mutex);
+		if (! (*i)->m_work.empty()) {
+			queue_lock.unlock();
+			boost::mutex::scoped_lock my_lock(my_queue.m_mutex);
+			my_queue.m_is_idle = false;
+			return false;
+		}
+	}
+	return true;
+}
+
+void PionWorkStealingScheduler::wakeIdleThread(boost::uint32_t n)
+{
+	// prefer the thread that owns the queue, then any other idle thread
+	const std::size_t num_queues = m_queue_pool.size();
+	for (std::size_t i = 0; i < num_queues; ++i) {
+		const std::size_t idle_n = (n + i) % num_queues;
+		WorkQueue& queue = *m_queue_pool[idle_n];
+		boost::mutex::scoped_lock queue_lock(queue.m_mutex);
+		if (queue.m_is_idle) {
+			queue.m_is_idle = false;
+			queue_lock.unlock();
+			m_service_pool[idle_n]->first.post(&PionWorkStealingScheduler::wakeup);
+			break;
+		}
+	}
+}
+
 	
 }	// end namespace pion
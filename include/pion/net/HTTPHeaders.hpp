@@ -0,0 +1,526 @@
+// ------------------------------------------------------------------
+// pion-net: a C++ framework for building lightweight HTTP interfaces
+// ------------------------------------------------------------------
+// Copyright (C) 2007-2011 Atomic Labs, Inc.  (http://www.atomiclabs.com)
+//
+// Distributed under the Boost Software License, Version 1.0.
+// See http://www.boost.org/LICENSE_1_0.txt
+//
+
+#ifndef __PION_HTTPHEADERS_HEADER__
+#define __PION_HTTPHEADERS_HEADER__
+
+#include <string>
+#include <cstring>
+#include <iterator>
+#include <utility>
+#include <pion/PionConfig.hpp>
+#include <pion/PionArena.hpp>
+
+
+namespace pion {	// begin namespace pion
+namespace net {		// begin namespace net (Pion Network Library)
+
+
+///
+/// HTTPHeaders: a case-insensitive multimap of HTTP header names to values.
+///              Messages usually have about ten headers, so they are kept in
+///              a flat array with precomputed hashes of their lowercase names
+///              and searched linearly.
+///              The array and the name-value pairs are allocated from an
+///              arena owned by the container, which frees them all at once.
+///              Values for the same name are kept next to each other; other
+///              headers keep the order in which they were inserted.
+///              Well-known headers are identified by a perfect hash of their
+///              names, and can be found in constant time using a HeaderId.
+///
+class PION_NET_API HTTPHeaders
+{
+public:
+
+	/// identifies the well-known headers (see HTTPTypes::HEADER_HOST, etc.)
+	enum HeaderId {
+		ID_HOST, ID_COOKIE, ID_SET_COOKIE, ID_CONNECTION, ID_CONTENT_TYPE,
+		ID_CONTENT_LENGTH, ID_CONTENT_LOCATION, ID_CONTENT_ENCODING,
+		ID_LAST_MODIFIED, ID_IF_MODIFIED_SINCE, ID_TRANSFER_ENCODING,
+		ID_LOCATION, ID_AUTHORIZATION, ID_REFERER, ID_USER_AGENT,
+		ID_X_FORWARDED_FOR, ID_CLIENT_IP,
+		NUM_HEADER_IDS,
+		ID_UNKNOWN = NUM_HEADER_IDS
+	};
+
+	/**
+	 * identifies a well-known header name (ignoring case).  This uses a
+	 * perfect hash of the name's length and last character, so it needs at
+	 * most one comparison.
+	 *
+	 * @param ptr points to the first character of the name
+	 * @param len number of characters in the name
+	 *
+	 * @return HeaderId the header's identifier, or ID_UNKNOWN if not well-known
+	 */
+	static inline HeaderId findHeaderId(const char *ptr, const std::size_t len) {
+		static const HeaderId HASH_TABLE[64] = {
+			ID_UNKNOWN, ID_UNKNOWN, ID_UNKNOWN, ID_COOKIE,
+			ID_UNKNOWN, ID_UNKNOWN, ID_UNKNOWN, ID_UNKNOWN,
+			ID_HOST, ID_UNKNOWN, ID_UNKNOWN, ID_UNKNOWN,
+			ID_UNKNOWN, ID_UNKNOWN, ID_UNKNOWN, ID_UNKNOWN,
+			ID_UNKNOWN, ID_UNKNOWN, ID_UNKNOWN, ID_UNKNOWN,
+			ID_UNKNOWN, ID_REFERER, ID_LOCATION, ID_SET_COOKIE,
+			ID_UNKNOWN, ID_UNKNOWN, ID_UNKNOWN, ID_UNKNOWN,
+			ID_UNKNOWN, ID_CLIENT_IP, ID_UNKNOWN, ID_UNKNOWN,
+			ID_CONNECTION, ID_CONTENT_TYPE, ID_UNKNOWN, ID_UNKNOWN,
+			ID_UNKNOWN, ID_LAST_MODIFIED, ID_USER_AGENT, ID_UNKNOWN,
+			ID_UNKNOWN, ID_UNKNOWN, ID_UNKNOWN, ID_UNKNOWN,
+			ID_UNKNOWN, ID_UNKNOWN, ID_CONTENT_LENGTH, ID_AUTHORIZATION,
+			ID_UNKNOWN, ID_UNKNOWN, ID_UNKNOWN, ID_UNKNOWN,
+			ID_UNKNOWN, ID_UNKNOWN, ID_UNKNOWN, ID_CONTENT_ENCODING,
+			ID_UNKNOWN, ID_UNKNOWN, ID_IF_MODIFIED_SINCE, ID_UNKNOWN,
+			ID_TRANSFER_ENCODING, ID_X_FORWARDED_FOR, ID_CONTENT_LOCATION, ID_UNKNOWN
+		};
+		if (len == 0)
+			return ID_UNKNOWN;
+		const HeaderId id = HASH_TABLE[(len * 5 + toLower(ptr[len-1])) & 63];
+		if (id == ID_UNKNOWN)
+			return ID_UNKNOWN;
+		const char * const name = getHeaderName(id);
+		if (strlen(name) != len)
+			return ID_UNKNOWN;
+		for (std::size_t n = 0; n < len; ++n) {
+			if (toLower(ptr[n]) != static_cast<unsigned char>(name[n]))
+				return ID_UNKNOWN;
+		}
+		return id;
+	}
+
+	/// identifies a well-known header name (ignoring case)
+	static inline HeaderId findHeaderId(const std::string& key) {
+		return findHeaderId(key.data(), key.size());
+	}
+
+	/// returns the lowercase name of a well-known header
+	static inline const char *getHeaderName(const HeaderId id) {
+		static const char * const HEADER_NAMES[NUM_HEADER_IDS] = {
+			"host", "cookie", "set-cookie", "connection", "content-type",
+			"content-length", "content-location", "content-encoding",
+			"last-modified", "if-modified-since", "transfer-encoding",
+			"location", "authorization", "referer", "user-agent",
+			"x-forwarded-for", "client-ip"
+		};
+		return HEADER_NAMES[id];
+	}
+
+
+private:
+
+	/// a header stored in the container
+	struct Entry {
+		/// identifies well-known headers (ID_UNKNOWN for all others)
+		HeaderId									m_id;
+
+		/// case-insensitive hash of the header name (only used for unknown headers)
+		unsigned long								m_hash;
+
+		/// points to the header's name and value (allocated from the arena)
+		std::pair<const std::string, std::string> *	m_value;
+	};
+
+public:
+
+	// types used by the STL container interfaces
+	typedef std::string									key_type;
+	typedef std::string									mapped_type;
+	typedef std::pair<const std::string, std::string>	value_type;
+	typedef std::size_t									size_type;
+	typedef std::ptrdiff_t								difference_type;
+
+	class const_iterator;
+
+	/// iterator used to access and modify the headers
+	class iterator {
+	public:
+		typedef std::bidirectional_iterator_tag		iterator_category;
+		typedef HTTPHeaders::value_type				value_type;
+		typedef HTTPHeaders::difference_type		difference_type;
+		typedef value_type *						pointer;
+		typedef value_type &						reference;
+
+		iterator(void) : m_ptr(NULL) {}
+		inline reference operator*(void) const { return *m_ptr->m_value; }
+		inline pointer operator->(void) const { return m_ptr->m_value; }
+		inline iterator& operator++(void) { ++m_ptr; return *this; }
+		inline iterator operator++(int) { iterator tmp(*this); ++m_ptr; return tmp; }
+		inline iterator& operator--(void) { --m_ptr; return *this; }
+		inline iterator operator--(int) { iterator tmp(*this); --m_ptr; return tmp; }
+		inline bool operator==(const iterator& i) const { return m_ptr == i.m_ptr; }
+		inline bool operator!=(const iterator& i) const { return m_ptr != i.m_ptr; }
+
+	private:
+		friend class HTTPHeaders;
+		friend class const_iterator;
+		explicit iterator(Entry *ptr) : m_ptr(ptr) {}
+		Entry *		m_ptr;
+	};
+
+	/// iterator used to access the headers
+	class const_iterator {
+	public:
+		typedef std::bidirectional_iterator_tag		iterator_category;
+		typedef HTTPHeaders::value_type				value_type;
+		typedef HTTPHeaders::difference_type		difference_type;
+		typedef const value_type *					pointer;
+		typedef const value_type &					reference;
+
+		const_iterator(void) : m_ptr(NULL) {}
+		const_iterator(const iterator& i) : m_ptr(i.m_ptr) {}
+		inline reference operator*(void) const { return *m_ptr->m_value; }
+		inline pointer operator->(void) const { return m_ptr->m_value; }
+		inline const_iterator& operator++(void) { ++m_ptr; return *this; }
+		inline const_iterator operator++(int) { const_iterator tmp(*this); ++m_ptr; return tmp; }
+		inline const_iterator& operator--(void) { --m_ptr; return *this; }
+		inline const_iterator operator--(int) { const_iterator tmp(*this); --m_ptr; return tmp; }
+		inline bool operator==(const const_iterator& i) const { return m_ptr == i.m_ptr; }
+		inline bool operator!=(const const_iterator& i) const { return m_ptr != i.m_ptr; }
+
+	private:
+		friend class HTTPHeaders;
+		explicit const_iterator(const Entry *ptr) : m_ptr(ptr) {}
+		const Entry *	m_ptr;
+	};
+
+
+	/// default number of headers that space is reserved for
+	static const std::size_t	DEFAULT_CAPACITY = 16;
+
+	/// slot value used for well-known headers that are not in the container
+	static const std::size_t	NO_SLOT = static_cast<std::size_t>(-1);
+
+
+	/// destroys all headers and frees the memory they used
+	~HTTPHeaders() { destroyValues(); }
+
+	/// constructs an empty container (no memory is allocated until needed)
+	HTTPHeaders(void)
+		: m_entries(NULL), m_size(0), m_capacity(0)
+	{
+		clearSlots();
+	}
+
+	/// copy constructor
+	HTTPHeaders(const HTTPHeaders& headers)
+		: m_entries(NULL), m_size(0), m_capacity(0)
+	{
+		clearSlots();
+		for (const Entry *ptr = headers.m_entries; ptr != headers.m_entries + headers.m_size; ++ptr)
+			insert(*ptr->m_value, ptr->m_id);
+	}
+
+	/// assignment operator
+	inline HTTPHeaders& operator=(const HTTPHeaders& headers) {
+		if (this != &headers) {
+			clear();
+			for (const Entry *ptr = headers.m_entries; ptr != headers.m_entries + headers.m_size; ++ptr)
+				insert(*ptr->m_value, ptr->m_id);
+		}
+		return *this;
+	}
+
+	inline iterator begin(void) { return iterator(m_entries); }
+	inline iterator end(void) { return iterator(m_entries + m_size); }
+	inline const_iterator begin(void) const { return const_iterator(m_entries); }
+	inline const_iterator end(void) const { return const_iterator(m_entries + m_size); }
+
+	/// returns the number of headers in the container
+	inline size_type size(void) const { return m_size; }
+
+	/// returns true if the container has no headers
+	inline bool empty(void) const { return m_size == 0; }
+
+	/// removes all headers and releases the memory they used
+	inline void clear(void) {
+		destroyValues();
+		m_entries = NULL;
+		m_size = m_capacity = 0;
+		m_arena.clear();
+		clearSlots();
+	}
+
+	/// returns the first header named key, or end() if there are none
+	inline iterator find(const std::string& key) {
+		return iterator(findEntry(key));
+	}
+
+	/// returns the first header named key, or end() if there are none
+	inline const_iterator find(const std::string& key) const {
+		return const_iterator(findEntry(key));
+	}
+
+	/// returns the first well-known header identified by id, or end() if there are none
+	inline iterator find(const HeaderId id) {
+		return iterator(findEntry(id));
+	}
+
+	/// returns the first well-known header identified by id, or end() if there are none
+	inline const_iterator find(const HeaderId id) const {
+		return const_iterator(findEntry(id));
+	}
+
+	/// returns the range of headers named key
+	inline std::pair<iterator, iterator> equal_range(const std::string& key) {
+		std::pair<Entry*, Entry*> range(findRange(key));
+		return std::make_pair(iterator(range.first), iterator(range.second));
+	}
+
+	/// returns the range of headers named key
+	inline std::pair<const_iterator, const_iterator> equal_range(const std::string& key) const {
+		std::pair<Entry*, Entry*> range(findRange(key));
+		return std::make_pair(const_iterator(range.first), const_iterator(range.second));
+	}
+
+	/// returns the range of well-known headers identified by id
+	inline std::pair<iterator, iterator> equal_range(const HeaderId id) {
+		std::pair<Entry*, Entry*> range(findRange(id));
+		return std::make_pair(iterator(range.first), iterator(range.second));
+	}
+
+	/// returns the range of well-known headers identified by id
+	inline std::pair<const_iterator, const_iterator> equal_range(const HeaderId id) const {
+		std::pair<Entry*, Entry*> range(findRange(id));
+		return std::make_pair(const_iterator(range.first), const_iterator(range.second));
+	}
+
+	/// returns the number of headers named key
+	inline size_type count(const std::string& key) const {
+		std::pair<Entry*, Entry*> range(findRange(key));
+		return static_cast<size_type>(range.second - range.first);
+	}
+
+	/**
+	 * adds a header to the container
+	 *
+	 * @param value the name and value of the header
+	 *
+	 * @return iterator pointing to the new header
+	 */
+	inline iterator insert(const value_type& value) {
+		return insert(value, findHeaderId(value.first));
+	}
+
+	/**
+	 * adds a header to the container
+	 *
+	 * @param value the name and value of the header
+	 * @param id must be equal to findHeaderId(value.first)
+	 *
+	 * @return iterator pointing to the new header
+	 */
+	inline iterator insert(const value_type& value, const HeaderId id) {
+		// keep values for the same name together, after any existing ones
+		const unsigned long hash = (id == ID_UNKNOWN ? hashKey(value.first) : 0);
+		std::size_t pos = m_size;
+		if (id != ID_UNKNOWN) {
+			if (m_slots[id] != NO_SLOT) {
+				pos = m_slots[id];
+				while (pos < m_size && m_entries[pos].m_id == id)
+					++pos;
+			}
+		} else {
+			for (std::size_t n = m_size; n > 0; --n) {
+				if (m_entries[n-1].m_id == ID_UNKNOWN && m_entries[n-1].m_hash == hash
+					&& equalKeys(m_entries[n-1].m_value->first, value.first))
+				{
+					pos = n;
+					break;
+				}
+			}
+		}
+		if (m_size == m_capacity)
+			grow();
+		if (pos < m_size) {
+			memmove(m_entries + pos + 1, m_entries + pos, (m_size - pos) * sizeof(Entry));
+			for (std::size_t n = 0; n < NUM_HEADER_IDS; ++n) {
+				if (m_slots[n] != NO_SLOT && m_slots[n] >= pos)
+					++m_slots[n];
+			}
+		}
+		if (id != ID_UNKNOWN && m_slots[id] == NO_SLOT)
+			m_slots[id] = pos;
+		m_entries[pos].m_id = id;
+		m_entries[pos].m_hash = hash;
+		m_entries[pos].m_value = new (m_arena.malloc(sizeof(value_type))) value_type(value);
+		++m_size;
+		return iterator(m_entries + pos);
+	}
+
+	/// adds a range of headers to the container
+	template <typename InputIterator>
+	inline void insert(InputIterator first, InputIterator last) {
+		for ( ; first != last; ++first)
+			insert(*first);
+	}
+
+	/**
+	 * removes a header from the container (invalidates iterators that follow it)
+	 *
+	 * @param pos points to the header to remove
+	 *
+	 * @return iterator pointing to the header that followed the one removed
+	 */
+	inline iterator erase(iterator pos) {
+		return erase(pos, iterator(pos.m_ptr + 1));
+	}
+
+	/**
+	 * removes a range of headers (invalidates iterators that follow it)
+	 *
+	 * @param first points to the first header to remove
+	 * @param last points to the header following the last one to remove
+	 *
+	 * @return iterator pointing to the header that followed the ones removed
+	 */
+	inline iterator erase(iterator first, iterator last) {
+		// memory used by the values is reclaimed when the container is cleared
+		for (Entry *ptr = first.m_ptr; ptr != last.m_ptr; ++ptr)
+			ptr->m_value->~value_type();
+		Entry * const end_ptr = m_entries + m_size;
+		const std::size_t first_pos = first.m_ptr - m_entries;
+		const std::size_t last_pos = last.m_ptr - m_entries;
+		for (std::size_t n = 0; n < NUM_HEADER_IDS; ++n) {
+			if (m_slots[n] == NO_SLOT || m_slots[n] < first_pos)
+				continue;
+			if (m_slots[n] >= last_pos)
+				m_slots[n] -= (last_pos - first_pos);
+			else if (last_pos < m_size && m_entries[last_pos].m_id == static_cast<HeaderId>(n))
+				m_slots[n] = first_pos;	// the rest of the group moves to first
+			else
+				m_slots[n] = NO_SLOT;
+		}
+		if (last.m_ptr != end_ptr)
+			memmove(first.m_ptr, last.m_ptr, (end_ptr - last.m_ptr) * sizeof(Entry));
+		m_size -= (last.m_ptr - first.m_ptr);
+		return first;
+	}
+
+	/// removes all headers named key, and returns the number removed
+	inline size_type erase(const std::string& key) {
+		std::pair<iterator, iterator> range(equal_range(key));
+		const size_type n = static_cast<size_type>(range.second.m_ptr - range.first.m_ptr);
+		erase(range.first, range.second);
+		return n;
+	}
+
+
+private:
+
+	/// converts an ASCII character to lowercase (header names are ASCII tokens)
+	static inline unsigned char toLower(const char c) {
+		return (c >= 'A' && c <= 'Z') ? static_cast<unsigned char>(c + ('a' - 'A'))
+			: static_cast<unsigned char>(c);
+	}
+
+	/// returns a hash of the lowercase form of a header name
+	static inline unsigned long hashKey(const std::string& key) {
+		unsigned long value = 0;
+		for (std::string::const_iterator i = key.begin(); i != key.end(); ++i)
+			value = toLower(*i) + (value << 6) + (value << 16) - value;
+		return value;
+	}
+
+	/// returns true if two header names are equal (ignoring case)
+	static inline bool equalKeys(const std::string& key1, const std::string& key2) {
+		if (key1.size() != key2.size())
+			return false;
+		for (std::size_t n = 0; n < key1.size(); ++n) {
+			if (toLower(key1[n]) != toLower(key2[n]))
+				return false;
+		}
+		return true;
+	}
+
+	/// returns the first entry for a well-known header, or the end of the array
+	inline Entry *findEntry(const HeaderId id) const {
+		return (m_slots[id] == NO_SLOT ? m_entries + m_size : m_entries + m_slots[id]);
+	}
+
+	/// returns the first entry named key, or the end of the array
+	inline Entry *findEntry(const std::string& key) const {
+		const HeaderId id = findHeaderId(key);
+		if (id != ID_UNKNOWN)
+			return findEntry(id);
+		const unsigned long hash = hashKey(key);
+		Entry * const end_ptr = m_entries + m_size;
+		for (Entry *ptr = m_entries; ptr != end_ptr; ++ptr) {
+			if (ptr->m_id == ID_UNKNOWN && ptr->m_hash == hash && equalKeys(ptr->m_value->first, key))
+				return ptr;
+		}
+		return end_ptr;
+	}
+
+	/// returns the range of entries for a well-known header
+	inline std::pair<Entry*, Entry*> findRange(const HeaderId id) const {
+		Entry * const end_ptr = m_entries + m_size;
+		Entry *first = findEntry(id);
+		Entry *last = first;
+		while (last != end_ptr && last->m_id == id)
+			++last;
+		return std::make_pair(first, last);
+	}
+
+	/// returns the range of entries named key
+	inline std::pair<Entry*, Entry*> findRange(const std::string& key) const {
+		const HeaderId id = findHeaderId(key);
+		if (id != ID_UNKNOWN)
+			return findRange(id);
+		Entry * const end_ptr = m_entries + m_size;
+		Entry *first = findEntry(key);
+		Entry *last = first;
+		while (last != end_ptr && last->m_id == ID_UNKNOWN
+			   && equalKeys(last->m_value->first, key))
+			++last;
+		return std::make_pair(first, last);
+	}
+
+	/// marks all of the well-known headers as missing
+	inline void clearSlots(void) {
+		for (std::size_t n = 0; n < NUM_HEADER_IDS; ++n)
+			m_slots[n] = NO_SLOT;
+	}
+
+	/// makes room for more entries (the old array stays in the arena until cleared)
+	inline void grow(void) {
+		const std::size_t capacity = (m_capacity == 0 ? DEFAULT_CAPACITY : m_capacity * 2);
+		Entry *entries = static_cast<Entry*>(m_arena.malloc(capacity * sizeof(Entry)));
+		if (m_size > 0)
+			memcpy(entries, m_entries, m_size * sizeof(Entry));
+		m_entries = entries;
+		m_capacity = capacity;
+	}
+
+	/// calls the destructors for all of the header names and values
+	inline void destroyValues(void) {
+		for (std::size_t n = 0; n < m_size; ++n)
+			m_entries[n].m_value->~value_type();
+	}
+
+
+	/// memory used for the entries and for the header names and values
+	PionArena					m_arena;
+
+	/// array of headers, in the order they are iterated
+	Entry *						m_entries;
+
+	/// number of headers in the container
+	std::size_t					m_size;
+
+	/// number of headers that fit in m_entries
+	std::size_t					m_capacity;
+
+	/// position of the first entry for each well-known header (or NO_SLOT)
+	std::size_t					m_slots[NUM_HEADER_IDS];
+};
+
+
+}	// end namespace net
+}	// end namespace pion
+
+#endif
@@ -16,9 +16,7 @@
 #include <boost/cstdint.hpp>
 #include <boost/asio.hpp>
 #include <boost/scoped_array.hpp>
-#include <boost/lexical_cast.hpp>
-#include <boost/algorithm/string/trim.hpp>
-#include <boost/regex.hpp>
+#include <boost/shared_ptr.hpp>
 #include <pion/PionConfig.hpp>
 #include <pion/net/HTTPTypes.hpp>
 
@@ -42,8 +40,132 @@ public:
 	/// data type for I/O write buffers (these wrap existing data to be sent)
 	typedef std::vector<boost::asio::const_buffer>	WriteBuffers;
 
-	/// used to cache chunked data
-	typedef std::vector<char>	ChunkCache;
+	///
+	/// ChunkCache: holds payload content that is received in pieces (i.e. chunks).
+	///             Content is copied in bulk into a list of blocks that grow with
+	///             the content, so nothing is moved as more of it arrives.
+	///
+	class ChunkCache {
+	public:
+
+		/// size of the first block allocated, in bytes
+		static const std::size_t	MIN_BLOCK_SIZE = 4096;
+
+		/// largest block that is allocated, in bytes
+		static const std::size_t	MAX_BLOCK_SIZE = 262144;
+
+		/// releases all blocks
+		~ChunkCache() { clear(); }
+
+		/// default constructor
+		ChunkCache() : m_size(0) {}
+
+		/// copy constructor
+		ChunkCache(const ChunkCache& cache) : m_size(0) { appendCache(cache); }
+
+		/// assignment operator
+		ChunkCache& operator=(const ChunkCache& cache) {
+			if (this != &cache) {
+				clear();
+				appendCache(cache);
+			}
+			return *this;
+		}
+
+		/// returns the number of bytes of content cached
+		inline std::size_t size(void) const { return m_size; }
+
+		/// returns true if no content is cached
+		inline bool empty(void) const { return m_size == 0; }
+
+		/// returns the number of segments that hold the cached content
+		inline std::size_t getNumSegments(void) const { return m_blocks.size(); }
+
+		/// returns a pointer to the content held by segment n
+		inline const char *getSegment(std::size_t n) const { return m_blocks[n].m_ptr; }
+
+		/// returns the number of bytes of content held by segment n
+		inline std::size_t getSegmentSize(std::size_t n) const { return m_blocks[n].m_size; }
+
+		/**
+		 * appends content to the cache
+		 *
+		 * @param ptr pointer to the content to append
+		 * @param len number of bytes to append
+		 */
+		inline void append(const char *ptr, std::size_t len) {
+			while (len > 0) {
+				if (m_blocks.empty() || m_blocks.back().m_size == m_blocks.back().m_capacity)
+					addBlock();
+				Block& block = m_blocks.back();
+				std::size_t n = block.m_capacity - block.m_size;
+				if (n > len)
+					n = len;
+				memcpy(block.m_ptr + block.m_size, ptr, n);
+				block.m_size += n;
+				m_size += n;
+				ptr += n;
+				len -= n;
+			}
+		}
+
+		/// appends a single character to the cache
+		inline void push_back(const char c) { append(&c, 1); }
+
+		/// copies all of the cached content into a buffer at least size() bytes long
+		inline void copy(char *ptr) const {
+			for (std::vector<Block>::const_iterator i = m_blocks.begin(); i != m_blocks.end(); ++i) {
+				memcpy(ptr, i->m_ptr, i->m_size);
+				ptr += i->m_size;
+			}
+		}
+
+		/// releases all of the cached content
+		inline void clear(void) {
+			for (std::vector<Block>::iterator i = m_blocks.begin(); i != m_blocks.end(); ++i)
+				delete[] i->m_ptr;
+			m_blocks.clear();
+			m_size = 0;
+		}
+
+	private:
+
+		/// a block of memory that holds cached content
+		struct Block {
+			char *			m_ptr;
+			std::size_t		m_size;
+			std::size_t		m_capacity;
+		};
+
+		/// adds a new, empty block to the end of the cache
+		inline void addBlock(void) {
+			// each block is as large as all of the blocks before it (within
+			// limits) so that there are few blocks, and little space is wasted
+			std::size_t capacity = MIN_BLOCK_SIZE;
+			if (m_size > capacity)
+				capacity = m_size;
+			if (capacity > MAX_BLOCK_SIZE)
+				capacity = MAX_BLOCK_SIZE;
+			m_blocks.reserve(m_blocks.size() + 1);
+			Block block;
+			block.m_ptr = new char[capacity];
+			block.m_size = 0;
+			block.m_capacity = capacity;
+			m_blocks.push_back(block);
+		}
+
+		/// appends all of the content held by another cache
+		inline void appendCache(const ChunkCache& cache) {
+			for (std::vector<Block>::const_iterator i = cache.m_blocks.begin(); i != cache.m_blocks.end(); ++i)
+				append(i->m_ptr, i->m_size);
+		}
+
+		/// blocks of memory that hold the cached content, in order
+		std::vector<Block>		m_blocks;
+
+		/// number of bytes of content cached
+		std::size_t				m_size;
+	};
 
 	/// data type for library errors returned during receive() operations
 	struct ReceiveError
@@ -79,8 +201,11 @@ public:
 		: m_is_valid(false), m_is_chunked(false), m_chunks_supported(false),
 		m_do_not_send_content_length(false),
 		m_version_major(1), m_version_minor(1), m_content_length(0), m_content_buf(),
+		m_cookies_pending(false), m_set_cookies_pending(false),
 		m_status(STATUS_NONE), m_has_missing_packets(false), m_has_data_after_missing(false)
-	{}
+	{
+		clearHeaderRefs();
+	}
 
 	/// copy constructor
 	HTTPMessage(const HTTPMessage& http_msg)
@@ -96,10 +221,16 @@ public:
 		m_content_buf(http_msg.m_content_buf),
 		m_chunk_cache(http_msg.m_chunk_cache),
 		m_headers(http_msg.m_headers),
+		m_header_refs(http_msg.m_header_refs),
+		m_cookies_pending(false), m_set_cookies_pending(false),
 		m_status(http_msg.m_status),
 		m_has_missing_packets(http_msg.m_has_missing_packets),
 		m_has_data_after_missing(http_msg.m_has_data_after_missing)
-	{}
+	{
+		memcpy(m_header_ref_slots, http_msg.m_header_ref_slots, sizeof(m_header_ref_slots));
+		// copies should not depend upon memory owned by the original
+		copyHeaderRefs();
+	}
 
 	/// assignment operator
 	inline HTTPMessage& operator=(const HTTPMessage& http_msg) {
@@ -115,9 +246,12 @@ public:
 		m_content_buf = http_msg.m_content_buf;
 		m_chunk_cache = http_msg.m_chunk_cache;
 		m_headers = http_msg.m_headers;
+		m_header_refs = http_msg.m_header_refs;
+		memcpy(m_header_ref_slots, http_msg.m_header_ref_slots, sizeof(m_header_ref_slots));
 		m_status = http_msg.m_status;
 		m_has_missing_packets = http_msg.m_has_missing_packets;
 		m_has_data_after_missing = http_msg.m_has_data_after_missing;
+		copyHeaderRefs();
 		return *this;
 	}
 
@@ -135,7 +269,9 @@ public:
 		m_content_buf.clear();
 		m_chunk_cache.clear();
 		m_headers.clear();
+		clearHeaderRefs();
 		m_cookie_params.clear();
+		m_cookies_pending = m_set_cookies_pending = false;
 		m_status = STATUS_NONE;
 		m_has_missing_packets = false;
 		m_has_data_after_missing = false;
@@ -163,13 +299,19 @@ public:
 
 	/// returns a string representation of the HTTP version (i.e. "HTTP/1.1")
 	inline std::string getVersionString(void) const {
-		std::string http_version(STRING_HTTP_VERSION);
-		http_version += boost::lexical_cast<std::string>(getVersionMajor());
-		http_version += '.';
-		http_version += boost::lexical_cast<std::string>(getVersionMinor());
+		std::string http_version;
+		appendVersionString(http_version);
 		return http_version;
 	}
 
+	/// appends a string representation of the HTTP version (i.e. "HTTP/1.1")
+	inline void appendVersionString(std::string& str) const {
+		str += STRING_HTTP_VERSION;
+		append_uint64(str, getVersionMajor());
+		str += '.';
+		append_uint64(str, getVersionMinor());
+	}
+
 	/// returns the length of the payload content (in bytes)
 	inline boost::uint64_t getContentLength(void) const { return m_content_length; }
 
@@ -191,55 +333,149 @@ public:
 	/// returns a reference to the chunk cache
 	inline ChunkCache& getChunkCache(void) { return m_chunk_cache; }
 
-	/// returns a value for the header if any are defined; otherwise, an empty string
-	inline const std::string& getHeader(const std::string& key) const {
+	/// returns a value for the header if any are defined; otherwise, an empty
+	/// string (this copies any header references into the message first)
+	inline const std::string& getHeader(const std::string& key) {
+		copyHeaderRefs();
 		return getValue(m_headers, key);
 	}
 
+	/// returns a value for a well-known header if any are defined; otherwise,
+	/// an empty string (this copies any header references into the message first)
+	inline const std::string& getHeader(const Headers::HeaderId id) {
+		copyHeaderRefs();
+		return getCopiedHeader(id);
+	}
+
+	/// returns a copy of the value for the header if any are defined; otherwise,
+	/// an empty string (the message is not changed)
+	inline std::string getHeader(const std::string& key) const {
+		return getHeaderRef(key).str();
+	}
+
+	/// returns a copy of the value for a well-known header if any are defined;
+	/// otherwise, an empty string (the message is not changed)
+	inline std::string getHeader(const Headers::HeaderId id) const {
+		return getHeaderRef(id).str();
+	}
+
 	/// returns a reference to the HTTP headers
 	inline Headers& getHeaders(void) {
+		copyHeaderRefs();
 		return m_headers;
 	}
 
 	/// returns true if at least one value for the header is defined
 	inline bool hasHeader(const std::string& key) const {
-		return(m_headers.find(key) != m_headers.end());
+		StringRef value;
+		return findHeaderRef(key, value);
+	}
+
+	/// returns true if at least one value for a well-known header is defined
+	inline bool hasHeader(const Headers::HeaderId id) const {
+		StringRef value;
+		return findHeaderRef(id, value);
+	}
+
+	/// returns a value for the header if any are defined; otherwise, an empty
+	/// reference.  Unlike getHeader(), this neither copies the value nor
+	/// the message's header references
+	inline StringRef getHeaderRef(const std::string& key) const {
+		StringRef value;
+		findHeaderRef(key, value);
+		return value;
+	}
+
+	/// returns a value for a well-known header if any are defined; otherwise,
+	/// an empty reference.  This does not copy header references
+	inline StringRef getHeaderRef(const Headers::HeaderId id) const {
+		StringRef value;
+		findHeaderRef(id, value);
+		return value;
+	}
+
+	/// returns the headers that still refer to memory owned by something else
+	inline const HeaderRefs& getHeaderRefs(void) const { return m_header_refs; }
+
+	/**
+	 * makes the message share ownership of the memory that its header
+	 * references refer to, so that they remain valid for as long as the
+	 * message keeps them (ownership is dropped when they are copied, or
+	 * when the message is cleared)
+	 *
+	 * @param owner keeps the memory referenced by the headers alive
+	 */
+	inline void setHeaderRefOwner(const boost::shared_ptr<void>& owner) {
+		m_header_ref_owner = owner;
 	}
 
 	/// returns a value for the cookie if any are defined; otherwise, an empty string
 	/// since cookie names are insensitive, key should use lowercase alpha chars
-	inline const std::string& getCookie(const std::string& key) const {
+	inline const std::string& getCookie(const std::string& key) {
+		parsePendingCookies();
 		return getValue(m_cookie_params, key);
 	}
+
+	/// returns a copy of the value for the cookie if any are defined; otherwise,
+	/// an empty string (the message is not changed)
+	inline std::string getCookie(const std::string& key) const {
+		CookieParams parsed_params;
+		return getValue(getParsedCookieParams(parsed_params), key);
+	}
 	
 	/// returns the cookie parameters
 	inline CookieParams& getCookieParams(void) {
+		parsePendingCookies();
 		return m_cookie_params;
 	}
 
 	/// returns true if at least one value for the cookie is defined
 	/// since cookie names are insensitive, key should use lowercase alpha chars
-	inline bool hasCookie(const std::string& key) const {
+	inline bool hasCookie(const std::string& key) {
+		parsePendingCookies();
 		return(m_cookie_params.find(key) != m_cookie_params.end());
 	}
+
+	/// returns true if at least one value for the cookie is defined
+	/// (the message is not changed)
+	inline bool hasCookie(const std::string& key) const {
+		CookieParams parsed_params;
+		const CookieParams& cookie_params(getParsedCookieParams(parsed_params));
+		return(cookie_params.find(key) != cookie_params.end());
+	}
 	
 	/// adds a value for the cookie
 	/// since cookie names are insensitive, key should use lowercase alpha chars
 	inline void addCookie(const std::string& key, const std::string& value) {
+		parsePendingCookies();
 		m_cookie_params.insert(std::make_pair(key, value));
 	}
 
 	/// changes the value of a cookie
 	/// since cookie names are insensitive, key should use lowercase alpha chars
 	inline void changeCookie(const std::string& key, const std::string& value) {
+		parsePendingCookies();
 		changeValue(m_cookie_params, key, value);
 	}
 
 	/// removes all values for a cookie
 	/// since cookie names are insensitive, key should use lowercase alpha chars
 	inline void deleteCookie(const std::string& key) {
+		parsePendingCookies();
 		deleteValue(m_cookie_params, key);
 	}
+
+	/**
+	 * defers parsing the cookie headers until the cookie parameters are first
+	 * used, so that messages whose cookies are never looked at do not pay for it
+	 *
+	 * @param set_cookie_header if true, "Set-Cookie" headers are parsed;
+	 *                          otherwise, "Cookie" headers are parsed
+	 */
+	inline void deferCookieParsing(bool set_cookie_header) {
+		m_cookies_pending = true;
+		m_set_cookies_pending = set_cookie_header;
+	}
 	
 	/// returns a string containing the first line for the HTTP message
 	inline const std::string& getFirstLine(void) const {
@@ -292,25 +528,24 @@ public:
 	/// 
 	inline void setStatus(DataStatus newVal) { m_status = newVal; }
 
-	/// sets the length of the payload content using the Content-Length header
-	inline void updateContentLengthUsingHeader(void) {
-		Headers::const_iterator i = m_headers.find(HEADER_CONTENT_LENGTH);
-		if (i == m_headers.end()) {
+	/// sets the length of the payload content using the Content-Length header;
+	/// returns false (and leaves the length unchanged) if the header is invalid
+	inline bool updateContentLengthUsingHeader(void) {
+		StringRef length_ref;
+		if (! findHeaderRef(Headers::ID_CONTENT_LENGTH, length_ref)) {
 			m_content_length = 0;
-		} else {
-			std::string trimmed_length(i->second);
-			boost::algorithm::trim(trimmed_length);
-			m_content_length = boost::lexical_cast<boost::uint64_t>(trimmed_length);
+			return true;
 		}
+		return parse_uint64(length_ref.data(), length_ref.size(), m_content_length);
 	}
 
 	/// sets the transfer coding using the Transfer-Encoding header
 	inline void updateTransferCodingUsingHeader(void) {
 		m_is_chunked = false;
-		Headers::const_iterator i = m_headers.find(HEADER_TRANSFER_ENCODING);
-		if (i != m_headers.end()) {
+		StringRef coding_ref;
+		if (findHeaderRef(Headers::ID_TRANSFER_ENCODING, coding_ref)) {
 			// From RFC 2616, sec 3.6: All transfer-coding values are case-insensitive.
-			m_is_chunked = boost::regex_match(i->second, REGEX_ICASE_CHUNKED);
+			m_is_chunked = coding_ref.containsNoCase("chunked");
 			// ignoring other possible values for now
 		}
 	}
@@ -333,12 +568,12 @@ public:
 	inline void clearContent(void) {
 		setContentLength(0);
 		createContentBuffer();
-		deleteValue(m_headers, HEADER_CONTENT_TYPE);
+		deleteHeader(HEADER_CONTENT_TYPE);
 	}
 
 	/// sets the content type for the message payload
 	inline void setContentType(const std::string& type) {
-		changeValue(m_headers, HEADER_CONTENT_TYPE, type);
+		changeHeader(HEADER_CONTENT_TYPE, type);
 	}
 
 	/// adds a value for the HTTP header named key
@@ -346,19 +581,61 @@ public:
 		m_headers.insert(std::make_pair(key, value));
 	}
 
+	/// adds a value for the HTTP header named key, which is identified by
+	/// id (this must be equal to Headers::findHeaderId(key))
+	inline void addHeader(const std::string& key, const std::string& value,
+						  const Headers::HeaderId id)
+	{
+		m_headers.insert(std::make_pair(key, value), id);
+	}
+
+	/**
+	 * adds a value for an HTTP header without copying the name or value.
+	 * The memory referenced must remain valid and unchanged until the
+	 * message is cleared or copyHeaderRefs() is called (see setHeaderRefOwner()).
+	 *
+	 * @param key refers to the name of the header
+	 * @param value refers to the value of the header
+	 */
+	inline void addHeaderRef(const StringRef& key, const StringRef& value) {
+		addHeaderRef(key, value, Headers::findHeaderId(key.data(), key.size()));
+	}
+
+	/// adds a value for an HTTP header without copying the name or value,
+	/// where id must be equal to Headers::findHeaderId() for the name
+	inline void addHeaderRef(const StringRef& key, const StringRef& value,
+							 const Headers::HeaderId id)
+	{
+		if (id != Headers::ID_UNKNOWN && m_header_ref_slots[id] == Headers::NO_SLOT)
+			m_header_ref_slots[id] = m_header_refs.size();
+		m_header_refs.push_back(std::make_pair(key, value));
+	}
+
+	/// copies all header references into the message, so that it no longer
+	/// depends upon memory owned by something else (i.e. a read buffer)
+	inline void copyHeaderRefs(void) {
+		if (m_header_refs.empty())
+			return;
+		for (HeaderRefs::const_iterator i = m_header_refs.begin(); i != m_header_refs.end(); ++i)
+			m_headers.insert(std::make_pair(i->first.str(), i->second.str()));
+		clearHeaderRefs();
+	}
+
 	/// changes the value for the HTTP header named key
 	inline void changeHeader(const std::string& key, const std::string& value) {
+		copyHeaderRefs();
 		changeValue(m_headers, key, value);
 	}
 
 	/// removes all values for the HTTP header named key
 	inline void deleteHeader(const std::string& key) {
+		copyHeaderRefs();
 		deleteValue(m_headers, key);
 	}
 
 	/// returns true if the HTTP connection may be kept alive
 	inline bool checkKeepAlive(void) const {
-		return (getHeader(HEADER_CONNECTION) != "close"
+		return (getHeaderRef(Headers::ID_CONNECTION) != "close"
 				&& (getVersionMajor() > 1
 					|| (getVersionMajor() >= 1 && getVersionMinor() >= 1)) );
 	}
@@ -376,11 +653,12 @@ public:
 	{
 		// update message headers
 		prepareHeadersForSend(keep_alive, using_chunks);
-		// add first message line
-		write_buffers.push_back(boost::asio::buffer(getFirstLine()));
-		write_buffers.push_back(boost::asio::buffer(STRING_CRLF));
-		// append HTTP headers
-		appendHeaders(write_buffers);
+		// serialize the first message line and HTTP headers into one block
+		m_header_block.clear();
+		m_header_block += getFirstLine();
+		m_header_block += STRING_CRLF;
+		appendHeaders(m_header_block);
+		write_buffers.push_back(boost::asio::buffer(m_header_block));
 	}
 
 
@@ -505,6 +783,36 @@ protected:
 		char						*m_ptr;
 	};
 
+	/// parses cookie headers into the cookie parameters if that was deferred
+	inline void parsePendingCookies(void) {
+		if (m_cookies_pending) {
+			m_cookies_pending = false;
+			parseCookieHeaders(m_cookie_params);
+		}
+	}
+
+	/**
+	 * returns the cookie parameters without changing the message: if parsing
+	 * them was deferred, they are parsed into a copy instead
+	 *
+	 * @param parsed_params used to hold the copy, if one is needed
+	 * @return the cookie parameters, or parsed_params
+	 */
+	inline const CookieParams& getParsedCookieParams(CookieParams& parsed_params) const {
+		if (! m_cookies_pending)
+			return m_cookie_params;
+		parsed_params = m_cookie_params;
+		parseCookieHeaders(parsed_params);
+		return parsed_params;
+	}
+
+	/**
+	 * parses the cookie headers whose parsing was deferred
+	 *
+	 * @param cookie_params the parameters to add the parsed cookies to
+	 */
+	void parseCookieHeaders(CookieParams& cookie_params) const;
+
 	/**
 	 * prepares HTTP headers for a send operation
 	 *
@@ -519,25 +827,95 @@ protected:
 			if (getChunksSupported())
 				changeHeader(HEADER_TRANSFER_ENCODING, "chunked");
 		} else if (! m_do_not_send_content_length) {
-			changeHeader(HEADER_CONTENT_LENGTH, boost::lexical_cast<std::string>(getContentLength()));
+			char length_buf[UINT64_STRING_MAX];
+			changeHeader(HEADER_CONTENT_LENGTH,
+				std::string(length_buf, format_uint64(getContentLength(), length_buf)));
 		}
 	}
 
 	/**
-	 * appends the message's HTTP headers to a vector of write buffers
+	 * appends the message's HTTP headers to a block of serialized headers
 	 *
-	 * @param write_buffers the buffers to append HTTP headers into
+	 * @param header_block the string to append HTTP headers to
 	 */
-	inline void appendHeaders(WriteBuffers& write_buffers) {
+	inline void appendHeaders(std::string& header_block) {
+		copyHeaderRefs();
+		// reserve room for everything, so the block is allocated at most once
+		std::size_t block_size = header_block.size() + STRING_CRLF.size();
+		for (Headers::const_iterator i = m_headers.begin(); i != m_headers.end(); ++i) {
+			block_size += i->first.size() + HEADER_NAME_VALUE_DELIMITER.size()
+				+ i->second.size() + STRING_CRLF.size();
+		}
+		header_block.reserve(block_size);
 		// add HTTP headers
 		for (Headers::const_iterator i = m_headers.begin(); i != m_headers.end(); ++i) {
-			write_buffers.push_back(boost::asio::buffer(i->first));
-			write_buffers.push_back(boost::asio::buffer(HEADER_NAME_VALUE_DELIMITER));
-			write_buffers.push_back(boost::asio::buffer(i->second));
-			write_buffers.push_back(boost::asio::buffer(STRING_CRLF));
+			header_block += i->first;
+			header_block += HEADER_NAME_VALUE_DELIMITER;
+			header_block += i->second;
+			header_block += STRING_CRLF;
 		}
 		// add an extra CRLF to end HTTP headers
-		write_buffers.push_back(boost::asio::buffer(STRING_CRLF));
+		header_block += STRING_CRLF;
+	}
+
+	/// returns the value of a well-known header that has already been copied
+	/// into the message, or an empty string
+	inline const std::string& getCopiedHeader(const Headers::HeaderId id) const {
+		Headers::const_iterator i = m_headers.find(id);
+		return (i == m_headers.end() ? STRING_EMPTY : i->second);
+	}
+
+	/**
+	 * finds the first value for a header without copying header references
+	 *
+	 * @param key the name of the header to search for
+	 * @param value refers to the value of the header, if found
+	 * @return true if a value for the header was found
+	 */
+	inline bool findHeaderRef(const std::string& key, StringRef& value) const {
+		const Headers::HeaderId id = Headers::findHeaderId(key);
+		if (id != Headers::ID_UNKNOWN)
+			return findHeaderRef(id, value);
+		for (HeaderRefs::const_iterator i = m_header_refs.begin(); i != m_header_refs.end(); ++i) {
+			if (i->first.equalsNoCase(key)) {
+				value = i->second;
+				return true;
+			}
+		}
+		Headers::const_iterator i = m_headers.find(key);
+		if (i == m_headers.end())
+			return false;
+		value = StringRef(i->second);
+		return true;
+	}
+
+	/**
+	 * finds the first value for a well-known header without copying header
+	 * references.  This does not need to hash or compare any names.
+	 *
+	 * @param id identifies the header to search for
+	 * @param value refers to the value of the header, if found
+	 * @return true if a value for the header was found
+	 */
+	inline bool findHeaderRef(const Headers::HeaderId id, StringRef& value) const {
+		if (m_header_ref_slots[id] != Headers::NO_SLOT) {
+			value = m_header_refs[m_header_ref_slots[id]].second;
+			return true;
+		}
+		Headers::const_iterator i = m_headers.find(id);
+		if (i == m_headers.end())
+			return false;
+		value = StringRef(i->second);
+		return true;
+	}
+
+	/// removes all header references (and the memory they referred to is
+	/// no longer kept alive by the message)
+	inline void clearHeaderRefs(void) {
+		m_header_refs.clear();
+		for (std::size_t n = 0; n < Headers::NUM_HEADER_IDS; ++n)
+			m_header_ref_slots[n] = Headers::NO_SLOT;
+		m_header_ref_owner.reset();
 	}
 
 	/**
@@ -580,13 +958,9 @@ protected:
 			// set the first value found for the key to the new one
 			result_pair.first->second = value;
 			// remove any remaining values
-			typename DictionaryType::iterator i;
 			++(result_pair.first);
-			while (result_pair.first != result_pair.second) {
-				i = result_pair.first;
-				++(result_pair.first);
-				dict.erase(i);
-			}
+			if (result_pair.first != result_pair.second)
+				dict.erase(result_pair.first, result_pair.second);
 		}
 	}
 
@@ -624,9 +998,6 @@ protected:
 
 private:
 
-	/// Regex used to check for the "chunked" transfer encoding header
-	static const boost::regex		REGEX_ICASE_CHUNKED;
-
 	/// True if the HTTP message is valid
 	bool							m_is_valid;
 
@@ -660,9 +1031,29 @@ private:
 	/// HTTP message headers
 	Headers							m_headers;
 
+	/// HTTP message headers that refer to memory owned by something else
+	HeaderRefs						m_header_refs;
+
+	/// position of the first reference for each well-known header (or NO_SLOT)
+	std::size_t						m_header_ref_slots[Headers::NUM_HEADER_IDS];
+
+	/// shares ownership of the memory that the header references refer to
+	/// (if it is owned by something that may release it first)
+	boost::shared_ptr<void>			m_header_ref_owner;
+
+	/// first line and headers serialized by prepareBuffersForSend() (its memory
+	/// is re-used each time the message is sent, and it is never copied)
+	std::string						m_header_block;
+
 	/// HTTP cookie parameters parsed from the headers
 	CookieParams					m_cookie_params;
 
+	/// true if cookie headers still need to be parsed into m_cookie_params
+	bool							m_cookies_pending;
+
+	/// true if the pending cookie headers are "Set-Cookie" headers
+	bool							m_set_cookies_pending;
+
 	/// message data integrity status
 	DataStatus						m_status;
 
@@ -129,7 +129,8 @@ public:
 		m_bytes_content_remaining(0), m_bytes_content_read(0),
 		m_bytes_last_read(0), m_bytes_total_read(0),
 		m_max_content_length(max_content_length),
-		m_parse_headers_only(false), m_save_raw_headers(false)
+		m_parse_headers_only(false), m_save_raw_headers(false),
+		m_zero_copy_headers(false), m_concatenate_chunks(true)
 	{}
 
 	/// default destructor
@@ -204,7 +205,8 @@ public:
 		if (m_message_parse_state != PARSE_CONTENT_NO_LENGTH)
 			return true;
 		m_message_parse_state = PARSE_END;
-		http_msg.concatenateChunks();
+		if (m_concatenate_chunks)
+			http_msg.concatenateChunks();
 		finish(http_msg);
 		return false;
 	}
@@ -264,6 +266,12 @@ public:
 	/// returns true if the parser is saving raw HTTP header contents
 	inline bool getSaveRawHeaders(void) const { return m_save_raw_headers; }
 
+	/// returns true if parsed headers may refer to the read buffer instead of being copied
+	inline bool getZeroCopyHeaders(void) const { return m_zero_copy_headers; }
+
+	/// returns true if chunked content is copied into the message's content buffer
+	inline bool getConcatenateChunks(void) const { return m_concatenate_chunks; }
+
 	/// returns true if the parser is being used to parse an HTTP request
 	inline bool isParsingRequest(void) const { return m_is_request; }
 
@@ -282,6 +290,31 @@ public:
 	/// sets parameter for saving raw HTTP header content
 	inline void setSaveRawHeaders(bool b) { m_save_raw_headers = b; }
 
+	/**
+	 * controls whether parsed headers refer to the read buffer instead of
+	 * being copied into the message (default is disabled).  This applies only
+	 * when all of the headers are parsed from a single read buffer; otherwise,
+	 * they are copied before parse() asks for more bytes.  The read buffer
+	 * must not change until the message is finished with, or until
+	 * HTTPMessage::copyHeaderRefs() has been called (non-const accessors such
+	 * as HTTPMessage::getHeaders() also copy them), unless the message is
+	 * given ownership of it using HTTPMessage::setHeaderRefOwner().
+	 *
+	 * @param b if true, headers will refer to the read buffer when possible
+	 */
+	inline void setZeroCopyHeaders(bool b) { m_zero_copy_headers = b; }
+
+	/**
+	 * controls whether chunked content (and content read until the connection
+	 * is closed) is copied into the message's content buffer after it has been
+	 * parsed (default is enabled).  If disabled, the content is left in the
+	 * segments of HTTPMessage::getChunkCache(), and the message's content
+	 * length and buffer are not updated.
+	 *
+	 * @param b if true, the content is copied into a single buffer
+	 */
+	inline void setConcatenateChunks(bool b) { m_concatenate_chunks = b; }
+
 	/// sets the logger to be used
 	inline void setLogger(PionLogger log_ptr) { m_logger = log_ptr; }
 
@@ -464,6 +497,50 @@ protected:
 	/// creates the unique HTTPParser ErrorCategory
 	static void createErrorCategory(void);
 
+	/**
+	 * consumes a run of ordinary characters for the current header parsing
+	 * state in one step, leaving the byte that ends the run (if any) for the
+	 * byte-wise state machine in parseHeaders()
+	 *
+	 * @param ec error_code contains additional information for parsing errors
+	 *
+	 * @return false if the run makes its field exceed the maximum size
+	 */
+	bool consumeHeaderRun(boost::system::error_code& ec);
+
+	/**
+	 * appends the bytes between m_read_ptr and run_end to a field being parsed
+	 *
+	 * @param str the field to append to
+	 * @param run_end points to the first byte that is not part of the run
+	 * @param max_size maximum length allowed for the field
+	 *
+	 * @return false if the field would exceed max_size
+	 */
+	inline bool appendHeaderRun(std::string& str, const char *run_end,
+		const boost::uint32_t max_size);
+
+	/**
+	 * adds the header that has just been parsed to the message
+	 *
+	 * @param http_msg the HTTP message object to populate from parsing
+	 * @param use_ref if true, the header will refer to the read buffer
+	 * @param name_ref refers to the name of the header within the read buffer
+	 */
+	inline void addParsedHeader(HTTPMessage& http_msg, const bool use_ref,
+		const HTTPTypes::StringRef& name_ref);
+
+	/// returns a pointer to the first byte in [ptr, end) that is not a token character
+	static const char *scanTokenRun(const char *ptr, const char *end);
+
+	/// returns a pointer to the first control character, space or '?' (optional) in [ptr, end)
+	static const char *scanURIRun(const char *ptr, const char *end,
+		const bool stop_at_query);
+
+	/// returns a pointer to the first control character (optionally excluding tabs) in [ptr, end)
+	static const char *scanTextRun(const char *ptr, const char *end,
+		const bool allow_tab);
+
 
 	// misc functions used by the parsing functions
 	inline static bool isChar(int c);
@@ -619,6 +696,12 @@ private:
 	/// if true, the raw contents of HTTP headers are stored into m_raw_headers
 	bool								m_save_raw_headers;
 
+	/// if true, parsed headers may refer to the read buffer instead of being copied
+	bool								m_zero_copy_headers;
+
+	/// if true, chunked content is copied into the message's content buffer
+	bool								m_concatenate_chunks;
+
 	/// points to a single and unique instance of the HTTPParser ErrorCategory
 	static ErrorCategory *				m_error_category_ptr;
 		
@@ -662,6 +745,33 @@ inline bool HTTPParser::isHexDigit(int c)
 	return((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F'));
 }
 
+inline bool HTTPParser::appendHeaderRun(std::string& str, const char *run_end,
+	const boost::uint32_t max_size)
+{
+	const std::size_t run_size = (run_end - m_read_ptr);
+	if (str.size() + run_size > max_size)
+		return false;
+	str.append(m_read_ptr, run_size);
+	if (m_save_raw_headers)
+		m_raw_headers.append(m_read_ptr, run_size);
+	m_read_ptr = run_end;
+	return true;
+}
+
+inline void HTTPParser::addParsedHeader(HTTPMessage& http_msg, const bool use_ref,
+	const HTTPTypes::StringRef& name_ref)
+{
+	// well-known headers are identified once here, so later lookups are O(1)
+	const HTTPTypes::Headers::HeaderId header_id = HTTPTypes::Headers::findHeaderId(m_header_name);
+	if (use_ref) {
+		// the value ends right before the line terminator being parsed
+		http_msg.addHeaderRef(name_ref, HTTPTypes::StringRef(m_read_ptr - m_header_value.size(),
+			m_header_value.size()), header_id);
+	} else {
+		http_msg.addHeader(m_header_name, m_header_value, header_id);
+	}
+}
+
 inline bool HTTPParser::isCookieAttribute(const std::string& name, bool set_cookie_header)
 {
 	return (name.empty() || name[0] == '$' || (set_cookie_header &&
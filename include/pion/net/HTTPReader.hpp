@@ -10,7 +10,10 @@
 #ifndef __PION_HTTPREADER_HEADER__
 #define __PION_HTTPREADER_HEADER__
 
+#include <vector>
+#include <utility>
 #include <boost/asio.hpp>
+#include <boost/function/function3.hpp>
 #include <pion/PionConfig.hpp>
 #include <pion/net/HTTPParser.hpp>
 #include <pion/net/HTTPMessage.hpp>
@@ -30,11 +33,44 @@ class PION_NET_API HTTPReader :
 {
 public:
 
+	/**
+	 * function called with each block of streamed payload content; the data
+	 * remains valid only until the handler returns.  A block of zero bytes
+	 * (or an error) indicates that there is no more content to read.
+	 */
+	typedef boost::function3<void, const boost::system::error_code&,
+		const char *, std::size_t>	ContentHandler;
+
+
 	// default destructor
 	virtual ~HTTPReader() {}
 	
 	/// Incrementally reads & parses the HTTP message
 	void receive(void);
+
+	/**
+	 * enables streaming of payload content.  This must be called before the
+	 * message headers have finished parsing (i.e. from finishedParsingHeaders()).
+	 * When enabled, finishedReading() is called as soon as the headers have
+	 * been parsed, and the content must then be pulled using readContent().
+	 */
+	void setStreamContent(void);
+
+	/// returns true if payload content is streamed rather than buffered
+	inline bool getStreamContent(void) const { return m_stream_content; }
+
+	/// returns true if all of the streamed payload content has been read
+	inline bool getContentFinished(void) const { return m_content_finished; }
+
+	/**
+	 * asynchronously reads the next block of streamed payload content.  No more
+	 * data is read from the connection until this is called again, so the
+	 * consumer controls how quickly the content is received.  If content has
+	 * already been received, the handler is called before this returns.
+	 *
+	 * @param handler function called with the next block of content
+	 */
+	void readContent(ContentHandler handler);
 	
 	/// returns a shared pointer to the TCP connection
 	inline TCPConnectionPtr& getTCPConnection(void) { return m_tcp_conn; }
@@ -54,7 +90,9 @@ protected:
 	 */
 	HTTPReader(const bool is_request, TCPConnectionPtr& tcp_conn)
 		: HTTPParser(is_request), m_tcp_conn(tcp_conn),
-		m_read_timeout(DEFAULT_READ_TIMEOUT)
+		m_timer(tcp_conn), m_read_timeout(DEFAULT_READ_TIMEOUT),
+		m_stream_content(false), m_content_finished(false),
+		m_content_block_pos(0), m_delivering_content(false)
 		{}	
 	
 	/**
@@ -91,6 +129,25 @@ private:
 	 */
 	void handleReadError(const boost::system::error_code& read_error);
 
+	/// sets the connection's lifecycle after the whole message has been parsed
+	void updateLifecycle(void);
+
+	/// saves a block of streamed payload content until it is read
+	void saveContentBlock(const char *ptr, std::size_t len);
+
+	/// delivers the next block of streamed payload content, or reads more data
+	void streamContent(void);
+
+	/**
+	 * calls the pending content handler
+	 *
+	 * @param ec error status passed to the handler
+	 * @param ptr pointer to the block of content
+	 * @param len number of bytes of content (zero if no more content)
+	 */
+	void deliverContent(const boost::system::error_code& ec,
+						const char *ptr, std::size_t len);
+
 
 	/// default maximum number of seconds for read operations
 	static const boost::uint32_t			DEFAULT_READ_TIMEOUT;
@@ -99,11 +156,30 @@ private:
 	/// The HTTP connection that has a new HTTP message to parse
 	TCPConnectionPtr						m_tcp_conn;
 	
-	/// pointer to a TCPTimer object if read timeouts are enabled
-	TCPTimerPtr								m_timer_ptr;
+	/// timer used to close the connection if a read times out
+	TCPTimer								m_timer;
 
 	/// maximum number of seconds for read operations
 	boost::uint32_t							m_read_timeout;
+
+	/// true if payload content is streamed using readContent()
+	bool									m_stream_content;
+
+	/// true if all of the streamed payload content has been parsed
+	bool									m_content_finished;
+
+	/// blocks of streamed payload content parsed but not yet read
+	/// (these point into the connection's read buffer)
+	std::vector<std::pair<const char*, std::size_t> >	m_content_blocks;
+
+	/// index of the next block in m_content_blocks to deliver
+	std::size_t								m_content_block_pos;
+
+	/// true while streamContent() is delivering saved blocks
+	bool									m_delivering_content;
+
+	/// function waiting for the next block of streamed payload content
+	ContentHandler							m_content_handler;
 };
 
 
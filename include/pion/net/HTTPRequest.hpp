@@ -22,7 +22,7 @@ namespace net {		// begin namespace net (Pion Network Library)
 ///
 /// HTTPRequest: container for HTTP request information
 /// 
-class HTTPRequest
+class PION_NET_API HTTPRequest
 	: public HTTPMessage
 {
 public:
@@ -33,10 +33,13 @@ public:
 	 * @param resource the HTTP resource to request
 	 */
 	HTTPRequest(const std::string& resource)
-		: m_method(REQUEST_METHOD_GET), m_resource(resource) {}
+		: m_method(REQUEST_METHOD_GET), m_resource(resource),
+		m_query_string_pending(false), m_query_content_pending(false) {}
 	
 	/// constructs a new HTTPRequest object (default constructor)
-	HTTPRequest(void) : m_method(REQUEST_METHOD_GET) {}
+	HTTPRequest(void)
+		: m_method(REQUEST_METHOD_GET),
+		m_query_string_pending(false), m_query_content_pending(false) {}
 	
 	/// virtual destructor
 	virtual ~HTTPRequest() {}
@@ -49,6 +52,7 @@ public:
 		m_original_resource.erase();
 		m_query_string.erase();
 		m_query_params.clear();
+		m_query_string_pending = m_query_content_pending = false;
 		m_user_record.reset();
 	}
 
@@ -68,19 +72,37 @@ public:
 	inline const std::string& getQueryString(void) const { return m_query_string; }
 	
 	/// returns a value for the query key if any are defined; otherwise, an empty string
-	inline const std::string& getQuery(const std::string& key) const {
+	inline const std::string& getQuery(const std::string& key) {
+		parsePendingQueryParams();
 		return getValue(m_query_params, key);
 	}
 
+	/// returns a copy of the value for the query key if any are defined;
+	/// otherwise, an empty string (the request is not changed)
+	inline std::string getQuery(const std::string& key) const {
+		QueryParams parsed_params;
+		return getValue(getParsedQueryParams(parsed_params), key);
+	}
+
 	/// returns the query parameters
 	inline QueryParams& getQueryParams(void) {
+		parsePendingQueryParams();
 		return m_query_params;
 	}
 	
 	/// returns true if at least one value for the query key is defined
-	inline bool hasQuery(const std::string& key) const {
+	inline bool hasQuery(const std::string& key) {
+		parsePendingQueryParams();
 		return(m_query_params.find(key) != m_query_params.end());
 	}
+
+	/// returns true if at least one value for the query key is defined
+	/// (the request is not changed)
+	inline bool hasQuery(const std::string& key) const {
+		QueryParams parsed_params;
+		const QueryParams& query_params(getParsedQueryParams(parsed_params));
+		return(query_params.find(key) != query_params.end());
+	}
 		
 	/// sets the HTTP request method (i.e. GET, POST, PUT)
 	inline void setMethod(const std::string& str) { 
@@ -99,32 +121,38 @@ public:
 
 	/// sets the uri-query or query string requested
 	inline void setQueryString(const std::string& str) {
+		parsePendingQueryParams();
 		m_query_string = str;
 		clearFirstLine();
 	}
 	
 	/// adds a value for the query key
 	inline void addQuery(const std::string& key, const std::string& value) {
+		parsePendingQueryParams();
 		m_query_params.insert(std::make_pair(key, value));
 	}
 	
 	/// changes the value of a query key
 	inline void changeQuery(const std::string& key, const std::string& value) {
+		parsePendingQueryParams();
 		changeValue(m_query_params, key, value);
 	}
 	
 	/// removes all values for a query key
 	inline void deleteQuery(const std::string& key) {
+		parsePendingQueryParams();
 		deleteValue(m_query_params, key);
 	}
 	
 	/// use the query parameters to build a query string for the request
 	inline void useQueryParamsForQueryString(void) {
+		parsePendingQueryParams();
 		setQueryString(make_query_string(m_query_params));
 	}
 
 	/// use the query parameters to build POST content for the request
 	inline void useQueryParamsForPostContent(void) {
+		parsePendingQueryParams();
 		std::string post_content(make_query_string(m_query_params));
 		setContentLength(post_content.size());
 		char *ptr = createContentBuffer();	// null-terminates buffer
@@ -142,6 +170,20 @@ public:
 			memcpy(ptr, value.c_str(), value.size());
 	}
 	
+	/**
+	 * defers parsing the query string into the query parameters until they
+	 * are first used, so that requests which never look at them do not pay
+	 * for it
+	 */
+	inline void deferQueryStringParsing(void) { m_query_string_pending = true; }
+
+	/**
+	 * defers parsing the (x-www-form-urlencoded) payload content into the
+	 * query parameters until they are first used.  The content should not be
+	 * changed before then.
+	 */
+	inline void deferQueryContentParsing(void) { m_query_content_pending = true; }
+
 	/// sets the user record for HTTP request after authentication
 	inline void setUser(PionUserPtr user) { m_user_record = user; }
 	
@@ -165,12 +207,43 @@ protected:
 		}
 		m_first_line += ' ';
 		// append HTTP version
-		m_first_line += getVersionString();
+		appendVersionString(m_first_line);
 	}
 	
 	
 private:
 
+	/// parses the query string and content into the query parameters if that was deferred
+	inline void parsePendingQueryParams(void) {
+		if (m_query_string_pending || m_query_content_pending) {
+			parseQueryParams(m_query_params);
+			m_query_string_pending = m_query_content_pending = false;
+		}
+	}
+
+	/**
+	 * returns the query parameters without changing the request: if parsing
+	 * them was deferred, they are parsed into a copy instead
+	 *
+	 * @param parsed_params used to hold the copy, if one is needed
+	 * @return the query parameters, or parsed_params
+	 */
+	inline const QueryParams& getParsedQueryParams(QueryParams& parsed_params) const {
+		if (! m_query_string_pending && ! m_query_content_pending)
+			return m_query_params;
+		parsed_params = m_query_params;
+		parseQueryParams(parsed_params);
+		return parsed_params;
+	}
+
+	/**
+	 * parses the query string and content whose parsing was deferred
+	 *
+	 * @param query_params the parameters to add the parsed pairs to
+	 */
+	void parseQueryParams(QueryParams& query_params) const;
+
+
 	/// request method (GET, POST, PUT, etc.)
 	std::string						m_method;
 
@@ -186,6 +259,12 @@ private:
 	/// HTTP query parameters parsed from the request line and post content
 	QueryParams						m_query_params;
 
+	/// true if the query string still needs to be parsed into m_query_params
+	bool							m_query_string_pending;
+
+	/// true if the payload content still needs to be parsed into m_query_params
+	bool							m_query_content_pending;
+
 	/// pointer to PionUser record if this request had been authenticated 
 	PionUserPtr						m_user_record;
 };
@@ -15,10 +15,12 @@
 #include <boost/function.hpp>
 #include <boost/function/function2.hpp>
 #include <boost/shared_ptr.hpp>
+#include <boost/make_shared.hpp>
 #include <boost/enable_shared_from_this.hpp>
 #include <pion/PionConfig.hpp>
 #include <pion/net/HTTPRequest.hpp>
 #include <pion/net/HTTPReader.hpp>
+#include <pion/net/RequestArena.hpp>
 
 
 namespace pion {	// begin namespace pion
@@ -44,7 +46,8 @@ public:
 	virtual ~HTTPRequestReader() {}
 	
 	/**
-	 * creates new HTTPRequestReader objects
+	 * creates new HTTPRequestReader objects (allocated from the connection's
+	 * request arena, along with the request that is parsed)
 	 *
 	 * @param tcp_conn TCP connection containing a new message to parse
 	 * @param handler function called after the message has been parsed
@@ -52,12 +55,16 @@ public:
 	static inline boost::shared_ptr<HTTPRequestReader>
 		create(TCPConnectionPtr& tcp_conn, FinishedHandler handler)
 	{
-		return boost::shared_ptr<HTTPRequestReader>
-			(new HTTPRequestReader(tcp_conn, handler));
+		RequestArena::Storage<HTTPRequestReader> storage(tcp_conn->getRequestArena());
+		return storage.share(new (storage.get()) HTTPRequestReader(tcp_conn, handler));
 	}
 	
 	/// sets a function to be called after HTTP headers have been parsed
 	inline void setHeadersParsedCallback(FinishedHandler& h) { m_parsed_headers = h; }
+
+	/// sets the function called after the HTTP message has been parsed
+	/// (or after its headers, if the payload content is streamed)
+	inline void setFinishedHandler(FinishedHandler& h) { m_finished = h; }
 	
 	
 protected:
@@ -69,7 +76,8 @@ protected:
 	 * @param handler function called after the message has been parsed
 	 */
 	HTTPRequestReader(TCPConnectionPtr& tcp_conn, FinishedHandler handler)
-		: HTTPReader(true, tcp_conn), m_http_msg(new HTTPRequest),
+		: HTTPReader(true, tcp_conn),
+		m_http_msg(boost::allocate_shared<HTTPRequest>(RequestArena::Allocator<HTTPRequest>(tcp_conn->getRequestArena()))),
 		m_finished(handler)
 	{
 		m_http_msg->setRemoteIp(tcp_conn->getRemoteIp());
@@ -92,8 +100,11 @@ protected:
 	
 	/// Called after we have finished reading/parsing the HTTP message
 	virtual void finishedReading(const boost::system::error_code& ec) {
-		// call the finished handler with the finished HTTP message
-		if (m_finished) m_finished(m_http_msg, getTCPConnection(), ec);
+		// call the finished handler with the finished HTTP message (it is
+		// released first, since it may hold a reference to this reader)
+		FinishedHandler finished_handler;
+		finished_handler.swap(m_finished);
+		if (finished_handler) finished_handler(m_http_msg, getTCPConnection(), ec);
 	}
 	
 	/// Returns a reference to the HTTP message being parsed
@@ -11,7 +11,6 @@
 #define __PION_HTTPRESPONSE_HEADER__
 
 #include <boost/shared_ptr.hpp>
-#include <boost/lexical_cast.hpp>
 #include <pion/PionConfig.hpp>
 #include <pion/net/HTTPMessage.hpp>
 #include <pion/net/HTTPRequest.hpp>
@@ -195,11 +194,20 @@ protected:
 	
 	/// updates the string containing the first line for the HTTP message
 	virtual void updateFirstLine(void) const {
+		// use a canned status line for standard HTTP/1.1 responses
+		if (getVersionMajor() == 1 && getVersionMinor() == 1) {
+			const std::string *status_line = find_status_line(m_status_code, m_status_message);
+			if (status_line != NULL) {
+				m_first_line = *status_line;
+				return;
+			}
+		}
 		// start out with the HTTP version
-		m_first_line = getVersionString();
+		m_first_line.clear();
+		appendVersionString(m_first_line);
 		m_first_line += ' ';
 		// append the response status code
-		m_first_line +=  boost::lexical_cast<std::string>(m_status_code);
+		append_uint64(m_first_line, m_status_code);
 		m_first_line += ' ';
 		// append the response status message
 		m_first_line += m_status_message;
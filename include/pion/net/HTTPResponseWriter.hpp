@@ -14,8 +14,10 @@
 #include <boost/bind.hpp>
 #include <boost/noncopyable.hpp>
 #include <boost/shared_ptr.hpp>
+#include <boost/make_shared.hpp>
 #include <boost/enable_shared_from_this.hpp>
 #include <pion/PionConfig.hpp>
+#include <pion/net/RequestArena.hpp>
 #include <pion/net/HTTPWriter.hpp>
 #include <pion/net/HTTPRequest.hpp>
 #include <pion/net/HTTPResponse.hpp>
@@ -37,7 +39,8 @@ public:
 	virtual ~HTTPResponseWriter() {}
 
 	/**
-	 * creates new HTTPResponseWriter objects
+	 * creates new HTTPResponseWriter objects (allocated from the connection's
+	 * request arena)
 	 * 
 	 * @param tcp_conn TCP connection used to send the response
 	 * @param http_response pointer to the response that will be sent
@@ -50,11 +53,13 @@ public:
 															   HTTPResponsePtr& http_response,
 															   FinishedHandler handler = FinishedHandler())
 	{
-		return boost::shared_ptr<HTTPResponseWriter>(new HTTPResponseWriter(tcp_conn, http_response, handler));
+		RequestArena::Storage<HTTPResponseWriter> storage(tcp_conn->getRequestArena());
+		return storage.share(new (storage.get()) HTTPResponseWriter(tcp_conn, http_response, handler));
 	}
 
 	/**
-	 * creates new HTTPResponseWriter objects
+	 * creates new HTTPResponseWriter objects (allocated from the connection's
+	 * request arena, along with the response that will be sent)
 	 * 
 	 * @param tcp_conn TCP connection used to send the response
 	 * @param http_request the request we are responding to
@@ -67,7 +72,8 @@ public:
 															   const HTTPRequest& http_request,
 															   FinishedHandler handler = FinishedHandler())
 	{
-		return boost::shared_ptr<HTTPResponseWriter>(new HTTPResponseWriter(tcp_conn, http_request, handler));
+		RequestArena::Storage<HTTPResponseWriter> storage(tcp_conn->getRequestArena());
+		return storage.share(new (storage.get()) HTTPResponseWriter(tcp_conn, http_request, handler));
 	}
 	
 	/// returns a non-const reference to the response that will be sent
@@ -109,7 +115,8 @@ protected:
 	 */
 	HTTPResponseWriter(TCPConnectionPtr& tcp_conn, const HTTPRequest& http_request,
 					   FinishedHandler handler)
-		: HTTPWriter(tcp_conn, handler), m_http_response(new HTTPResponse(http_request))
+		: HTTPWriter(tcp_conn, handler),
+		m_http_response(boost::allocate_shared<HTTPResponse>(RequestArena::Allocator<HTTPResponse>(tcp_conn->getRequestArena()), http_request))
 	{
 		setLogger(PION_GET_LOGGER("pion.net.HTTPResponseWriter"));
 		// tell the HTTPWriter base class whether or not the client supports chunks
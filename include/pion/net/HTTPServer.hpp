@@ -21,9 +21,11 @@
 #include <pion/PionConfig.hpp>
 #include <pion/net/TCPServer.hpp>
 #include <pion/net/TCPConnection.hpp>
+#include <pion/net/TCPTimer.hpp>
 #include <pion/net/HTTPRequest.hpp>
 #include <pion/net/HTTPAuth.hpp>
 #include <pion/net/HTTPParser.hpp>
+#include <pion/net/HTTPRequestReader.hpp>
 
 
 namespace pion {	// begin namespace pion
@@ -41,6 +43,14 @@ public:
 	/// type of function that is used to handle requests
 	typedef boost::function2<void, HTTPRequestPtr&, TCPConnectionPtr&>	RequestHandler;
 
+	/**
+	 * type of function that is used to handle requests whose payload content
+	 * is streamed.  It is called as soon as the request headers have been
+	 * parsed, and reads the content using HTTPReader::readContent().
+	 */
+	typedef boost::function3<void, HTTPRequestPtr&, TCPConnectionPtr&,
+		HTTPRequestReaderPtr&>	StreamingRequestHandler;
+
 	/// handler for requests that result in "500 Server Error"
 	typedef boost::function3<void, HTTPRequestPtr&, TCPConnectionPtr&,
 		const std::string&>	ServerErrorHandler;
@@ -59,7 +69,9 @@ public:
 		m_bad_request_handler(HTTPServer::handleBadRequest),
 		m_not_found_handler(HTTPServer::handleNotFoundRequest),
 		m_server_error_handler(HTTPServer::handleServerError),
-		m_max_content_length(HTTPParser::DEFAULT_CONTENT_MAX)
+		m_max_content_length(HTTPParser::DEFAULT_CONTENT_MAX),
+		m_keepalive_timeout(DEFAULT_KEEPALIVE_TIMEOUT),
+		m_zero_copy_headers(false), m_concatenate_chunks(true)
 	{ 
 		setLogger(PION_GET_LOGGER("pion.net.HTTPServer"));
 	}
@@ -74,7 +86,9 @@ public:
 		m_bad_request_handler(HTTPServer::handleBadRequest),
 		m_not_found_handler(HTTPServer::handleNotFoundRequest),
 		m_server_error_handler(HTTPServer::handleServerError),
-		m_max_content_length(HTTPParser::DEFAULT_CONTENT_MAX)
+		m_max_content_length(HTTPParser::DEFAULT_CONTENT_MAX),
+		m_keepalive_timeout(DEFAULT_KEEPALIVE_TIMEOUT),
+		m_zero_copy_headers(false), m_concatenate_chunks(true)
 	{ 
 		setLogger(PION_GET_LOGGER("pion.net.HTTPServer"));
 	}
@@ -90,7 +104,9 @@ public:
 		m_bad_request_handler(HTTPServer::handleBadRequest),
 		m_not_found_handler(HTTPServer::handleNotFoundRequest),
 		m_server_error_handler(HTTPServer::handleServerError),
-		m_max_content_length(HTTPParser::DEFAULT_CONTENT_MAX)
+		m_max_content_length(HTTPParser::DEFAULT_CONTENT_MAX),
+		m_keepalive_timeout(DEFAULT_KEEPALIVE_TIMEOUT),
+		m_zero_copy_headers(false), m_concatenate_chunks(true)
 	{ 
 		setLogger(PION_GET_LOGGER("pion.net.HTTPServer"));
 	}
@@ -106,7 +122,9 @@ public:
 		m_bad_request_handler(HTTPServer::handleBadRequest),
 		m_not_found_handler(HTTPServer::handleNotFoundRequest),
 		m_server_error_handler(HTTPServer::handleServerError),
-		m_max_content_length(HTTPParser::DEFAULT_CONTENT_MAX)
+		m_max_content_length(HTTPParser::DEFAULT_CONTENT_MAX),
+		m_keepalive_timeout(DEFAULT_KEEPALIVE_TIMEOUT),
+		m_zero_copy_headers(false), m_concatenate_chunks(true)
 	{ 
 		setLogger(PION_GET_LOGGER("pion.net.HTTPServer"));
 	}
@@ -119,6 +137,19 @@ public:
 	 */
 	void addResource(const std::string& resource, RequestHandler request_handler);
 
+	/**
+	 * adds a new web service that streams request payload content instead of
+	 * buffering it (the maximum content length does not apply).  Streaming
+	 * resources take precedence over those added using addResource().
+	 * If the handler responds without reading all of the content, the
+	 * connection is closed afterwards.
+	 *
+	 * @param resource the resource name or uri-stem to bind to the handler
+	 * @param request_handler function used to handle requests to the resource
+	 */
+	void addStreamingResource(const std::string& resource,
+							  StreamingRequestHandler request_handler);
+
 	/**
 	 * removes a web service from the HTTP server
 	 *
@@ -148,6 +179,7 @@ public:
 		if (isListening()) stop();
 		boost::mutex::scoped_lock resource_lock(m_resource_mutex);
 		m_resources.clear();
+		m_streaming_resources.clear();
 	}
 
 	/**
@@ -222,6 +254,45 @@ public:
 	/// sets the maximum length for HTTP request payload content
 	inline void setMaxContentLength(std::size_t n) { m_max_content_length = n; }
 
+	/// sets the maximum number of seconds that an idle keep-alive connection
+	/// may wait for its next request (zero means no limit)
+	inline void setKeepAliveTimeout(boost::uint32_t seconds) { m_keepalive_timeout = seconds; }
+
+	/// returns the maximum number of seconds that idle keep-alive connections may wait
+	inline boost::uint32_t getKeepAliveTimeout(void) const { return m_keepalive_timeout; }
+
+	/**
+	 * controls whether request headers refer to the connection's read buffer
+	 * instead of being copied (default is disabled).  A request that is kept
+	 * after the connection is finished keeps the buffer's memory alive (the
+	 * connection reads into new memory instead), so the server never changes
+	 * a request once it has been handed to a request handler.  Non-const
+	 * accessors such as HTTPMessage::getHeaders() copy the headers first.
+	 *
+	 * @param b if true, request headers will refer to the read buffer when possible
+	 */
+	inline void setZeroCopyHeaders(bool b) { m_zero_copy_headers = b; }
+
+	/// returns true if request headers may refer to the connection's read buffer
+	inline bool getZeroCopyHeaders(void) const { return m_zero_copy_headers; }
+
+	/**
+	 * controls whether chunked request content is copied into the request's
+	 * content buffer before it is passed to a request handler (default is
+	 * enabled).  If disabled, handlers must read the content from the
+	 * segments of HTTPMessage::getChunkCache().
+	 *
+	 * @param b if true, chunked content is copied into a single buffer
+	 */
+	inline void setConcatenateChunks(bool b) { m_concatenate_chunks = b; }
+
+	/// returns true if chunked request content is copied into a single buffer
+	inline bool getConcatenateChunks(void) const { return m_concatenate_chunks; }
+
+
+	/// default maximum number of seconds that idle keep-alive connections may wait
+	static const boost::uint32_t	DEFAULT_KEEPALIVE_TIMEOUT;
+
 protected:
 
 	/**
@@ -241,6 +312,57 @@ protected:
 	virtual void handleRequest(HTTPRequestPtr& http_request,
 		TCPConnectionPtr& tcp_conn, const boost::system::error_code& ec);
 
+	/**
+	 * checks whether a request should be handled by a streaming resource,
+	 * after its headers have been parsed
+	 *
+	 * @param reader_ptr the reader that is parsing the request
+	 * @param http_request the HTTP request being parsed
+	 * @param tcp_conn TCP connection containing the request
+	 * @param ec error_code contains additional information for parsing errors
+	 */
+	void handleRequestHeaders(HTTPRequestReader *reader_ptr, HTTPRequestPtr& http_request,
+		TCPConnectionPtr& tcp_conn, const boost::system::error_code& ec);
+
+	/**
+	 * handles a new HTTP request whose payload content is streamed
+	 *
+	 * @param request_handler the streaming request handler to use
+	 * @param reader_ptr the reader that is parsing the request
+	 * @param resource_requested the resource requested, after any redirection
+	 * @param http_request the HTTP request to handle
+	 * @param tcp_conn TCP connection containing the request
+	 * @param ec error_code contains additional information for parsing errors
+	 */
+	void handleStreamingRequest(StreamingRequestHandler& request_handler,
+		HTTPRequestReaderPtr& reader_ptr, const std::string& resource_requested,
+		HTTPRequestPtr& http_request, TCPConnectionPtr& tcp_conn,
+		const boost::system::error_code& ec);
+
+	/**
+	 * starts reading a new HTTP request from a connection
+	 *
+	 * @param tcp_conn the TCP connection to read the request from
+	 */
+	void readRequest(TCPConnectionPtr& tcp_conn);
+
+	/**
+	 * parks an idle keep-alive connection until more data is available;
+	 * no reader, request or read buffer is held while it waits
+	 *
+	 * @param tcp_conn the idle TCP connection
+	 */
+	void parkConnection(TCPConnectionPtr& tcp_conn);
+
+	/**
+	 * called when a parked connection has data available (or an error occurs)
+	 *
+	 * @param tcp_conn the parked TCP connection
+	 * @param wait_error error status from the wait operation
+	 */
+	void handleParkedConnection(TCPConnectionPtr& tcp_conn,
+								const boost::system::error_code& wait_error);
+
 	/**
 	 * searches for the appropriate request handler to use for a given resource
 	 *
@@ -250,15 +372,64 @@ protected:
 	virtual bool findRequestHandler(const std::string& resource,
 							RequestHandler& request_handler) const;
 
+	/**
+	 * searches for a streaming request handler to use for a given resource
+	 *
+	 * @param resource the name of the resource to search for
+	 * @param request_handler function that can handle requests for this resource
+	 */
+	bool findStreamingRequestHandler(const std::string& resource,
+							StreamingRequestHandler& request_handler) const;
+
+	/**
+	 * applies any redirection to a requested resource
+	 *
+	 * @param resource the resource requested; updated to the redirected resource
+	 * @return false if the maximum number of redirections was exceeded
+	 */
+	bool applyRedirects(std::string& resource) const;
+
 
 private:
 
+	/**
+	 * searches a map of resources for the longest entry that matches a resource
+	 *
+	 * @param resources the map of resources to search
+	 * @param resource the name of the resource to search for
+	 * @param request_handler the handler of the matching entry, if one was found
+	 */
+	template <typename MapType, typename HandlerType>
+	static inline bool findResource(const MapType& resources, const std::string& resource,
+									HandlerType& request_handler)
+	{
+		// iterate through each resource entry that may match the resource
+		typename MapType::const_iterator i = resources.upper_bound(resource);
+		while (i != resources.begin()) {
+			--i;
+			// check for a match if the first part of the strings match
+			if (i->first.empty() || resource.compare(0, i->first.size(), i->first) == 0) {
+				// only if the resource matches the plug-in's identifier
+				// or if resource is followed first with a '/' character
+				if (resource.size() == i->first.size() || resource[i->first.size()]=='/') {
+					request_handler = i->second;
+					return true;
+				}
+			}
+		}
+		return false;
+	}
+
+
 	/// maximum number of redirections
 	static const unsigned int	MAX_REDIRECTS;
 
 	/// data type for a map of resources to request handlers
 	typedef std::map<std::string, RequestHandler>	ResourceMap;
 
+	/// data type for a map of resources to streaming request handlers
+	typedef std::map<std::string, StreamingRequestHandler>	StreamingResourceMap;
+
 	/// data type for a map of requested resources to other resources
 	typedef std::map<std::string, std::string>		RedirectMap;
 
@@ -266,6 +437,9 @@ private:
 	/// collection of resources that are recognized by this HTTP server
 	ResourceMap					m_resources;
 
+	/// collection of resources whose request payload content is streamed
+	StreamingResourceMap		m_streaming_resources;
+
 	/// collection of redirections from a requested resource to another resource
 	RedirectMap					m_redirects;
 
@@ -286,6 +460,15 @@ private:
 
 	/// maximum length for HTTP request payload content
 	std::size_t					m_max_content_length;
+
+	/// maximum number of seconds that idle keep-alive connections may wait
+	boost::uint32_t				m_keepalive_timeout;
+
+	/// if true, request headers may refer to the connection's read buffer
+	bool						m_zero_copy_headers;
+
+	/// if true, chunked request content is copied into a single buffer
+	bool						m_concatenate_chunks;
 };
 
 
@@ -11,8 +11,13 @@
 #define __PION_HTTPTYPES_HEADER__
 
 #include <string>
+#include <vector>
+#include <cctype>
+#include <cstring>
+#include <boost/cstdint.hpp>
 #include <pion/PionConfig.hpp>
 #include <pion/PionHashMap.hpp>
+#include <pion/net/HTTPHeaders.hpp>
 
 
 namespace pion {	// begin namespace pion
@@ -96,8 +101,83 @@ struct PION_NET_API HTTPTypes
 	static const unsigned int	RESPONSE_CODE_NOT_IMPLEMENTED;
 	static const unsigned int	RESPONSE_CODE_CONTINUE;
 	
+	///
+	/// StringRef: refers to a range of characters owned by something else,
+	/// such as a header value inside of a connection's read buffer
+	///
+	class StringRef {
+	public:
+		/// constructs an empty reference
+		StringRef(void) : m_ptr(""), m_len(0) {}
+
+		/// constructs a reference to len characters starting at ptr
+		StringRef(const char *ptr, const std::size_t len) : m_ptr(ptr), m_len(len) {}
+
+		/// constructs a reference to the contents of a string
+		StringRef(const std::string& str) : m_ptr(str.data()), m_len(str.size()) {}
+
+		/// returns a pointer to the first character referenced
+		inline const char *data(void) const { return m_ptr; }
+
+		/// returns the number of characters referenced
+		inline std::size_t size(void) const { return m_len; }
+
+		/// returns true if no characters are referenced
+		inline bool empty(void) const { return m_len == 0; }
+
+		/// returns a copy of the characters referenced
+		inline std::string str(void) const { return std::string(m_ptr, m_len); }
+
+		/// returns true if the characters referenced are equal to str
+		inline bool operator==(const std::string& str) const {
+			return (m_len == str.size() && memcmp(m_ptr, str.data(), m_len) == 0);
+		}
+
+		/// returns true if the characters referenced are not equal to str
+		inline bool operator!=(const std::string& str) const { return !(*this == str); }
+
+		/// returns true if the characters referenced are equal to str, ignoring case
+		inline bool equalsNoCase(const std::string& str) const {
+			if (m_len != str.size())
+				return false;
+			for (std::size_t n = 0; n < m_len; ++n) {
+				if (tolower(m_ptr[n]) != tolower(str[n]))
+					return false;
+			}
+			return true;
+		}
+
+		/// returns true if the characters referenced contain str, ignoring case
+		/// (str must be lowercase)
+		inline bool containsNoCase(const char *str) const {
+			const std::size_t str_len = strlen(str);
+			if (str_len > m_len)
+				return false;
+			const char * const last_ptr = m_ptr + (m_len - str_len);
+			for (const char *ptr = m_ptr; ptr <= last_ptr; ++ptr) {
+				std::size_t n = 0;
+				while (n < str_len && (ptr[n] == str[n]
+					   || (ptr[n] >= 'A' && ptr[n] <= 'Z' && ptr[n] + ('a' - 'A') == str[n])))
+					++n;
+				if (n == str_len)
+					return true;
+			}
+			return false;
+		}
+
+	private:
+		/// points to the first character referenced
+		const char *	m_ptr;
+
+		/// number of characters referenced
+		std::size_t		m_len;
+	};
+
 	/// data type for HTTP headers
-	typedef StringDictionary	Headers;
+	typedef HTTPHeaders		Headers;
+
+	/// data type for HTTP headers that refer to memory owned by something else
+	typedef std::vector<std::pair<StringRef, StringRef> >	HeaderRefs;
 
 	/// data type for HTTP cookie parameters
 	typedef StringDictionary	CookieParams;
@@ -106,6 +186,79 @@ struct PION_NET_API HTTPTypes
 	typedef StringDictionary	QueryParams;
 
 	
+	/**
+	 * parses a non-negative decimal integer, such as a Content-Length value.
+	 * Leading and trailing whitespace is ignored.
+	 *
+	 * @param ptr points to the first character to parse
+	 * @param len number of characters to parse
+	 * @param value receives the integer parsed
+	 *
+	 * @return true if successful, or false if the characters are not a
+	 *         valid integer or it would overflow
+	 */
+	static inline bool parse_uint64(const char *ptr, std::size_t len, boost::uint64_t& value) {
+		const char *end_ptr = ptr + len;
+		while (ptr < end_ptr && isspace(static_cast<unsigned char>(*ptr)))
+			++ptr;
+		while (end_ptr > ptr && isspace(static_cast<unsigned char>(end_ptr[-1])))
+			--end_ptr;
+		if (ptr == end_ptr)
+			return false;
+		const boost::uint64_t MAX_VALUE = ~static_cast<boost::uint64_t>(0);
+		boost::uint64_t result = 0;
+		for ( ; ptr < end_ptr; ++ptr) {
+			const unsigned int digit = static_cast<unsigned char>(*ptr) - '0';
+			if (digit > 9 || result > (MAX_VALUE - digit) / 10)
+				return false;
+			result = result * 10 + digit;
+		}
+		value = result;
+		return true;
+	}
+
+	/// maximum number of characters written by format_uint64()
+	static const std::size_t	UINT64_STRING_MAX = 20;
+
+	/**
+	 * formats a non-negative integer as decimal characters
+	 *
+	 * @param value the integer to format
+	 * @param buf receives the characters (at least UINT64_STRING_MAX bytes,
+	 *            and it is not null-terminated)
+	 *
+	 * @return std::size_t the number of characters written
+	 */
+	static inline std::size_t format_uint64(boost::uint64_t value, char *buf) {
+		char digits[UINT64_STRING_MAX];
+		char *ptr = digits + UINT64_STRING_MAX;
+		do {
+			*--ptr = static_cast<char>('0' + (value % 10));
+			value /= 10;
+		} while (value != 0);
+		const std::size_t len = (digits + UINT64_STRING_MAX) - ptr;
+		memcpy(buf, ptr, len);
+		return len;
+	}
+
+	/// appends a non-negative integer to a string, as decimal characters
+	static inline void append_uint64(std::string& str, const boost::uint64_t value) {
+		char buf[UINT64_STRING_MAX];
+		str.append(buf, format_uint64(value, buf));
+	}
+
+	/**
+	 * finds the canned HTTP/1.1 status line (i.e. "HTTP/1.1 200 OK") for one
+	 * of the standard response codes sent with its standard message
+	 *
+	 * @param status_code the response status code
+	 * @param status_message the response status message
+	 *
+	 * @return the status line, or NULL if there is none for the code and message
+	 */
+	static const std::string *find_status_line(const unsigned int status_code,
+											   const std::string& status_message);
+
 	/// converts time_t format into an HTTP-date string
 	static std::string get_date_string(const time_t t);
 
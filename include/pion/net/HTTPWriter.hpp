@@ -12,6 +12,8 @@
 
 #include <vector>
 #include <string>
+#include <ostream>
+#include <streambuf>
 #include <boost/shared_ptr.hpp>
 #include <boost/function.hpp>
 #include <boost/function/function0.hpp>
@@ -22,6 +24,7 @@
 #include <pion/PionLogger.hpp>
 #include <pion/net/HTTPMessage.hpp>
 #include <pion/net/TCPConnection.hpp>
+#include <pion/net/SlabPool.hpp>
 
 
 namespace pion {	// begin namespace pion
@@ -50,8 +53,9 @@ protected:
 	 */
 	HTTPWriter(TCPConnectionPtr& tcp_conn, FinishedHandler handler)
 		: m_logger(PION_GET_LOGGER("pion.net.HTTPWriter")),
-		m_tcp_conn(tcp_conn), m_content_length(0), m_stream_is_empty(true), 
-		m_client_supports_chunks(true), m_sending_chunks(false),
+		m_tcp_conn(tcp_conn), m_content_length(0),
+		m_slab_buffer(tcp_conn->getIOService(), m_content_buffers, m_content_length),
+		m_content_stream(&m_slab_buffer), m_client_supports_chunks(true), m_sending_chunks(false),
 		m_sent_headers(false), m_finished(handler)
 	{}
 	
@@ -89,10 +93,7 @@ public:
 	/// clears out all of the memory buffers used to cache payload content data
 	inline void clear(void) {
 		m_content_buffers.clear();
-		m_binary_cache.clear();
-		m_text_cache.clear();
-		m_content_stream.str("");
-		m_stream_is_empty = true;
+		m_slab_buffer.clear();
 		m_content_length = 0;
 	}
 
@@ -104,7 +105,6 @@ public:
 	template <typename T>
 	inline void write(const T& data) {
 		m_content_stream << data;
-		if (m_stream_is_empty) m_stream_is_empty = false;
 	}
 
 	/**
@@ -114,11 +114,8 @@ public:
 	 * @param length the length, in bytes, of the binary data
 	 */
 	inline void write(const void *data, size_t length) {
-		if (length != 0) {
-			flushContentStream();
-			m_content_buffers.push_back(m_binary_cache.add(data, length));
-			m_content_length += length;
-		}
+		if (length != 0)
+			m_slab_buffer.sputn(static_cast<const char*>(data), length);
 	}
 	
 	/**
@@ -231,7 +228,9 @@ public:
 	inline TCPConnectionPtr& getTCPConnection(void) { return m_tcp_conn; }
 
 	/// returns the length of the payload content (in bytes)
-	inline size_t getContentLength(void) const { return m_content_length; }
+	inline size_t getContentLength(void) const {
+		return m_content_length + m_slab_buffer.getBytesPending();
+	}
 
 	/// sets whether or not the client supports chunked messages
 	inline void supportsChunkedMessages(bool b) { m_client_supports_chunks = b; }
@@ -266,10 +265,21 @@ private:
 		// make sure that the content-length is up-to-date
 		flushContentStream();
 		// prepare the write buffers to be sent
+		const bool sending_headers = ! m_sent_headers;
 		HTTPMessage::WriteBuffers write_buffers;
 		prepareWriteBuffers(write_buffers, send_final_chunk);
 		// send data in the write buffers
-		m_tcp_conn->async_write(write_buffers, send_handler);
+		if (m_sending_chunks && ! send_final_chunk) {
+			// keep the headers in the same segments as the chunks that
+			// follow them (the connection is uncorked by the final chunk)
+			if (sending_headers)
+				m_tcp_conn->corkWrites();
+			m_tcp_conn->async_write(write_buffers, send_handler);
+		} else {
+			// nothing follows send() or the final chunk, so send any partial
+			// segment (this does nothing unless a chunk corked the socket)
+			m_tcp_conn->asyncWriteAndUncork(write_buffers, send_handler);
+		}
 	}
 	
 	/**
@@ -281,40 +291,120 @@ private:
 	void prepareWriteBuffers(HTTPMessage::WriteBuffers &write_buffers,
 							 const bool send_final_chunk);
 	
-	/// flushes any text data in the content stream after caching it in the TextCache
+	/// wraps any payload content copied since the last flush in write buffers
 	inline void flushContentStream(void) {
-		if (! m_stream_is_empty) {
-			std::string string_to_add(m_content_stream.str());
-			if (! string_to_add.empty()) {
-				m_content_stream.str("");
-				m_content_length += string_to_add.size();
-				m_text_cache.push_back(string_to_add);
-				m_content_buffers.push_back(boost::asio::buffer(m_text_cache.back()));
-			}
-			m_stream_is_empty = true;
-		}
+		m_slab_buffer.flush();
 	}
 	
 	
-	/// used to cache binary data included within the payload content
-	class BinaryCache : public std::vector<std::pair<const char *, size_t> > {
+	///
+	/// SlabBuffer: stream buffer that copies payload content directly into
+	/// slabs from the io_service's SlabPool.  Content copied into a slab is
+	/// wrapped by the writer's content buffers as it is flushed, so the slabs
+	/// are handed to async_write() without being copied again.
+	///
+	class SlabBuffer : public std::streambuf {
 	public:
-		~BinaryCache() {
-			for (iterator i=begin(); i!=end(); ++i) {
-				delete[] i->first;
+		
+		/**
+		 * constructs a new SlabBuffer
+		 *
+		 * @param io_service the io_service whose SlabPool provides the slabs
+		 * @param content_buffers write buffers that flushed content is added to
+		 * @param content_length length of the payload content, updated by flush()
+		 */
+		SlabBuffer(boost::asio::io_service& io_service,
+				   HTTPMessage::WriteBuffers& content_buffers, size_t& content_length)
+			: m_io_service(io_service), m_pool_ptr(NULL),
+			m_content_buffers(content_buffers), m_content_length(content_length),
+			m_flushed_ptr(NULL)
+		{}
+		
+		/// returns all of the slabs to the pool
+		virtual ~SlabBuffer() {
+			if (! m_slabs.empty())
+				m_pool_ptr->release(m_slabs);
+		}
+		
+		/// returns the number of bytes copied since the last flush
+		inline size_t getBytesPending(void) const {
+			return static_cast<size_t>(pptr() - m_flushed_ptr);
+		}
+		
+		/// wraps the bytes copied since the last flush in a write buffer, or
+		/// extends the last write buffer if it ends where they begin
+		inline void flush(void) {
+			const size_t bytes_pending = getBytesPending();
+			if (bytes_pending == 0)
+				return;
+			if (! m_content_buffers.empty()
+				&& boost::asio::buffer_cast<const char*>(m_content_buffers.back())
+					+ boost::asio::buffer_size(m_content_buffers.back()) == m_flushed_ptr)
+			{
+				m_content_buffers.back() = boost::asio::buffer(
+					boost::asio::buffer_cast<const char*>(m_content_buffers.back()),
+					boost::asio::buffer_size(m_content_buffers.back()) + bytes_pending);
+			} else {
+				m_content_buffers.push_back(boost::asio::buffer(m_flushed_ptr, bytes_pending));
 			}
+			m_content_length += bytes_pending;
+			m_flushed_ptr = pptr();
 		}
-		inline boost::asio::const_buffer add(const void *ptr, const size_t size) {
-			char *data_ptr = new char[size];
-			memcpy(data_ptr, ptr, size);
-			push_back( std::make_pair(data_ptr, size) );
-			return boost::asio::buffer(data_ptr, size);
+		
+		/// discards all copied content, keeping one slab for re-use
+		inline void clear(void) {
+			if (m_slabs.empty())
+				return;
+			char *slab = m_slabs.front();
+			m_slabs.front() = m_slabs.back();
+			m_slabs.pop_back();
+			if (! m_slabs.empty())
+				m_pool_ptr->release(m_slabs);
+			m_slabs.push_back(slab);
+			setp(slab, slab + SlabPool::SLAB_SIZE);
+			m_flushed_ptr = slab;
 		}
+		
+	protected:
+		
+		/// called when the current slab is full: continues in a new one
+		virtual int_type overflow(int_type c) {
+			flush();
+			if (m_pool_ptr == NULL)
+				m_pool_ptr = &boost::asio::use_service<SlabPool>(m_io_service);
+			m_slabs.reserve(m_slabs.size() + 1);
+			char *slab = m_pool_ptr->acquire();
+			m_slabs.push_back(slab);
+			setp(slab, slab + SlabPool::SLAB_SIZE);
+			m_flushed_ptr = slab;
+			if (! traits_type::eq_int_type(c, traits_type::eof())) {
+				*pptr() = traits_type::to_char_type(c);
+				pbump(1);
+			}
+			return traits_type::not_eof(c);
+		}
+		
+	private:
+		
+		/// io_service whose SlabPool provides the slabs
+		boost::asio::io_service &		m_io_service;
+		
+		/// pool that slabs are acquired from (looked up when first needed)
+		SlabPool *						m_pool_ptr;
+		
+		/// write buffers that flushed content is added to
+		HTTPMessage::WriteBuffers &		m_content_buffers;
+		
+		/// length of the payload content, updated by flush()
+		size_t &						m_content_length;
+		
+		/// slabs holding the copied content (the last one is being written)
+		std::vector<char*>				m_slabs;
+		
+		/// end of the content that has already been flushed
+		char *							m_flushed_ptr;
 	};
 	
-	/// used to cache text (non-binary) data included within the payload content
-	typedef std::list<std::string>				TextCache;
-
 	
 	/// primary logging interface used by this class
 	PionLogger								m_logger;
@@ -325,20 +415,14 @@ private:
 	/// I/O write buffers that wrap the payload content to be written
 	HTTPMessage::WriteBuffers				m_content_buffers;
 	
-	/// caches binary data included within the payload content
-	BinaryCache								m_binary_cache;
-
-	/// caches text (non-binary) data included within the payload content
-	TextCache								m_text_cache;
-	
-	/// incrementally creates strings of text data for the TextCache
-	std::ostringstream						m_content_stream;
-	
 	/// The length (in bytes) of the response content to be sent (Content-Length)
 	size_t									m_content_length;
 
-	/// true if the content_stream is empty (avoids unnecessary string copies)
-	bool									m_stream_is_empty;
+	/// copies payload content into pooled slabs
+	SlabBuffer								m_slab_buffer;
+	
+	/// formats text (non-binary) payload content into the slab buffer
+	std::ostream							m_content_stream;
 	
 	/// true if the HTTP client supports chunked transfer encodings
 	bool									m_client_supports_chunks;
@@ -349,6 +433,9 @@ private:
 	/// true if the HTTP message headers have already been sent
 	bool									m_sent_headers;
 
+	/// chunk-size line for the chunk being sent (hex length and CRLF)
+	char									m_chunk_header[24];
+
 	/// function called after the HTTP message has been sent
 	FinishedHandler							m_finished;
 };
@@ -0,0 +1,210 @@
+// ------------------------------------------------------------------
+// pion-net: a C++ framework for building lightweight HTTP interfaces
+// ------------------------------------------------------------------
+// Copyright (C) 2007-2011 Atomic Labs, Inc.  (http://www.atomiclabs.com)
+//
+// Distributed under the Boost Software License, Version 1.0.
+// See http://www.boost.org/LICENSE_1_0.txt
+//
+
+#ifndef __PION_REQUESTARENA_HEADER__
+#define __PION_REQUESTARENA_HEADER__
+
+#include <cstddef>
+#include <new>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/detail/atomic_count.hpp>
+#include <pion/PionConfig.hpp>
+#include <pion/PionArena.hpp>
+
+
+namespace pion {	// begin namespace pion
+namespace net {		// begin namespace net (Pion Network Library)
+
+
+///
+/// RequestArena: memory for the objects used to handle one request on a
+///               TCPConnection (readers, writers, messages and the reference
+///               counts of their shared pointers).  Allocations are carved out
+///               of a PionArena and are never freed individually; instead, the
+///               arena counts them and can be cleared in one step once they
+///               have all been released.  The arena itself is reference
+///               counted, so objects that outlive their connection stay valid.
+///
+///               Only one thread may allocate from an arena at a time (the
+///               thread handling the connection), but allocations may be
+///               released from any thread.
+///
+class RequestArena
+	: private boost::noncopyable
+{
+public:
+
+	/// size of the blocks that memory is carved out of; one block is enough
+	/// for the reader, request, writer and response of a typical request
+	static const std::size_t	BLOCK_SIZE = 4096;
+
+	/// arenas that have grown beyond this many bytes should be replaced
+	/// rather than cleared and reused
+	static const std::size_t	MAX_SIZE = 65536;
+
+
+	///
+	/// Allocator: standard allocator that draws memory from a RequestArena
+	/// (i.e. for use with boost::allocate_shared)
+	///
+	template <typename T>
+	class Allocator {
+	public:
+		typedef T					value_type;
+		typedef T *					pointer;
+		typedef const T *			const_pointer;
+		typedef T &					reference;
+		typedef const T &			const_reference;
+		typedef std::size_t			size_type;
+		typedef std::ptrdiff_t		difference_type;
+
+		template <typename U>
+		struct rebind { typedef Allocator<U> other; };
+
+		explicit Allocator(RequestArena& arena) : m_arena_ptr(&arena) {}
+		template <typename U>
+		Allocator(const Allocator<U>& a) : m_arena_ptr(a.m_arena_ptr) {}
+
+		inline pointer address(reference x) const { return &x; }
+		inline const_pointer address(const_reference x) const { return &x; }
+		inline size_type max_size(void) const { return static_cast<size_type>(-1) / sizeof(T); }
+		template <typename V>
+		inline void construct(pointer p, const V& value) { new (static_cast<void*>(p)) T(value); }
+		inline void destroy(pointer p) { p->~T(); }
+
+		inline pointer allocate(size_type n, const void * = 0) {
+			return static_cast<pointer>(m_arena_ptr->allocate(n * sizeof(T)));
+		}
+		inline void deallocate(pointer p, size_type) { m_arena_ptr->deallocate(p); }
+
+		template <typename U>
+		inline bool operator==(const Allocator<U>& a) const { return m_arena_ptr == a.m_arena_ptr; }
+		template <typename U>
+		inline bool operator!=(const Allocator<U>& a) const { return m_arena_ptr != a.m_arena_ptr; }
+
+	private:
+		template <typename U> friend class Allocator;
+
+		/// arena that memory is allocated from
+		RequestArena *	m_arena_ptr;
+	};
+
+
+	///
+	/// Storage: memory for one object of type T with a constructor that is
+	/// not accessible to boost::allocate_shared.  Construct the object in
+	/// get() using placement new, then pass it to share(); the memory is
+	/// returned to the arena if the constructor throws.
+	///
+	template <typename T>
+	class Storage
+		: private boost::noncopyable
+	{
+	public:
+
+		/// allocates memory for the object from the arena
+		explicit Storage(RequestArena& arena)
+			: m_arena(arena), m_ptr(arena.allocate(sizeof(T)))
+		{}
+
+		/// releases the memory unless share() has been called
+		~Storage() { if (m_ptr != NULL) m_arena.deallocate(m_ptr); }
+
+		/// returns the memory that the object should be constructed in
+		inline void *get(void) { return m_ptr; }
+
+		/**
+		 * returns a shared pointer that owns the object constructed in get();
+		 * its reference count is also allocated from the arena
+		 *
+		 * @param object_ptr pointer to the object that was constructed in get()
+		 */
+		inline boost::shared_ptr<T> share(T *object_ptr) {
+			m_ptr = NULL;
+			return boost::shared_ptr<T>(object_ptr, Deleter(m_arena), Allocator<T>(m_arena));
+		}
+
+	private:
+
+		/// destroys the object and releases its memory back to the arena
+		struct Deleter {
+			explicit Deleter(RequestArena& arena) : m_arena_ptr(&arena) {}
+			inline void operator()(T *object_ptr) {
+				object_ptr->~T();
+				m_arena_ptr->deallocate(object_ptr);
+			}
+			RequestArena *	m_arena_ptr;
+		};
+
+		/// arena that the memory was allocated from
+		RequestArena &		m_arena;
+
+		/// memory for the object (NULL after share() is called)
+		void *				m_ptr;
+	};
+
+
+	/// constructs a new arena, with one reference held by the caller
+	RequestArena(void) : m_arena(BLOCK_SIZE), m_references(1) {}
+
+	/**
+	 * allocates memory from the arena; each allocation holds a reference to
+	 * the arena until it is released using deallocate()
+	 *
+	 * @param n size of the memory to allocate, in bytes
+	 */
+	inline void *allocate(std::size_t n) {
+		void *ptr = m_arena.malloc(n);
+		++m_references;
+		return ptr;
+	}
+
+	/// releases memory obtained from allocate() (it is not reused until clear())
+	inline void deallocate(void * /* ptr */) { removeReference(); }
+
+	/// adds a reference to the arena
+	inline void addReference(void) { ++m_references; }
+
+	/// removes a reference to the arena, and deletes it if it was the last one
+	inline void removeReference(void) {
+		if (--m_references == 0)
+			delete this;
+	}
+
+	/// returns true if the caller holds the only reference to the arena
+	/// (no memory allocated from it is still in use)
+	inline bool unique(void) const { return m_references == 1; }
+
+	/// releases all memory allocated from the arena in one step; this must
+	/// only be called if unique() returns true
+	inline void clear(void) { m_arena.clear(); }
+
+	/// returns the number of bytes that have been allocated from the arena
+	inline std::size_t getBytesUsed(void) const { return m_arena.getBytesUsed(); }
+
+
+private:
+
+	/// the arena is deleted when its last reference is removed
+	~RequestArena() {}
+
+
+	/// memory that allocations are carved out of
+	PionArena						m_arena;
+
+	/// references held by the owner of the arena and by each allocation
+	boost::detail::atomic_count		m_references;
+};
+
+
+}	// end namespace net
+}	// end namespace pion
+
+#endif
@@ -0,0 +1,108 @@
+// ------------------------------------------------------------------
+// pion-net: a C++ framework for building lightweight HTTP interfaces
+// ------------------------------------------------------------------
+// Copyright (C) 2007-2011 Atomic Labs, Inc.  (http://www.atomiclabs.com)
+//
+// Distributed under the Boost Software License, Version 1.0.
+// See http://www.boost.org/LICENSE_1_0.txt
+//
+
+#ifndef __PION_SLABPOOL_HEADER__
+#define __PION_SLABPOOL_HEADER__
+
+#include <cstddef>
+#include <vector>
+#include <boost/asio.hpp>
+#include <boost/thread/mutex.hpp>
+#include <pion/PionConfig.hpp>
+
+
+namespace pion {	// begin namespace pion
+namespace net {		// begin namespace net (Pion Network Library)
+
+
+///
+/// SlabPool: recycles the fixed-size blocks of memory ("slabs") that outgoing
+/// data is copied into before it is written to a connection.  There is one
+/// pool for each io_service, shared by all of its connections; look it up
+/// using boost::asio::use_service<SlabPool>(io_service).
+///
+class SlabPool :
+	public boost::asio::io_service::service
+{
+public:
+
+	/// unique identifier for the service
+	static boost::asio::io_service::id		id;
+
+	/// size of each slab, in bytes
+	static const std::size_t				SLAB_SIZE;
+
+	/// default maximum number of free slabs kept by the pool
+	static const std::size_t				DEFAULT_MAX_FREE_SLABS;
+
+
+	/**
+	 * constructs a new slab pool service
+	 *
+	 * @param io_service the io_service that owns the service
+	 */
+	explicit SlabPool(boost::asio::io_service& io_service);
+
+	/// frees all of the slabs in the pool
+	virtual ~SlabPool();
+
+	/// returns a slab of SLAB_SIZE bytes (allocates one if the pool is empty)
+	char *acquire(void);
+
+	/**
+	 * returns a slab to the pool; it is freed if the pool is already full
+	 *
+	 * @param slab the slab to return
+	 */
+	void release(char *slab);
+
+	/**
+	 * returns slabs to the pool; slabs beyond the maximum number kept are freed
+	 *
+	 * @param slabs the slabs to return (the vector is cleared)
+	 */
+	void release(std::vector<char*>& slabs);
+
+	/// sets the maximum number of free slabs kept by the pool
+	void setMaxFreeSlabs(const std::size_t n);
+
+	/// returns the maximum number of free slabs kept by the pool
+	inline std::size_t getMaxFreeSlabs(void) const {
+		boost::mutex::scoped_lock pool_lock(m_mutex);
+		return m_max_free_slabs;
+	}
+
+	/// returns the number of free slabs in the pool
+	inline std::size_t getNumFreeSlabs(void) const {
+		boost::mutex::scoped_lock pool_lock(m_mutex);
+		return m_free_slabs.size();
+	}
+
+
+private:
+
+	/// nothing to do when the io_service is shut down (slabs may still be in use)
+	virtual void shutdown_service(void) {}
+
+
+	/// slabs that are available for re-use
+	std::vector<char*>						m_free_slabs;
+
+	/// maximum number of free slabs kept by the pool
+	std::size_t								m_max_free_slabs;
+
+	/// mutex used to synchronize the pool
+	mutable boost::mutex					m_mutex;
+};
+
+
+}	// end namespace net
+}	// end namespace pion
+
+#endif
@@ -23,16 +23,35 @@
 #include <boost/lexical_cast.hpp>
 #include <boost/enable_shared_from_this.hpp>
 #include <boost/asio.hpp>
-#include <boost/array.hpp>
+#include <boost/bind.hpp>
 #include <boost/function.hpp>
 #include <boost/function/function1.hpp>
 #include <pion/PionConfig.hpp>
+#include <pion/PionHandlerTimer.hpp>
+#include <pion/net/RequestArena.hpp>
+#include <pion/net/SlabPool.hpp>
+#include <pion/net/TCPSocketOptions.hpp>
 #include <string>
+#include <vector>
+#include <cstring>
+
+#if defined(TCP_CORK)
+	/// socket option used to cork writes (Linux)
+	#define PION_TCP_CORK	TCP_CORK
+#elif defined(TCP_NOPUSH)
+	/// socket option used to cork writes (BSD and Mac OS X)
+	#define PION_TCP_CORK	TCP_NOPUSH
+#endif
 
 
 namespace pion {	// begin namespace pion
 namespace net {		// begin namespace net (Pion Network Library)
 
+
+// forward declaration of the timer used to close idle connections
+class TCPTimer;
+
+
 ///
 /// TCPConnection: represents a single tcp connection
 /// 
@@ -47,14 +66,197 @@ public:
 		LIFECYCLE_CLOSE, LIFECYCLE_KEEPALIVE, LIFECYCLE_PIPELINED
 	};
 	
-	/// size of the read buffer
+	/// default size of the read buffer
 	enum { READ_BUFFER_SIZE = 8192 };
+
+	/// default maximum number of bytes held back for pipelined requests
+	enum { DEFAULT_PIPELINE_LIMIT = 65536 };
 	
 	/// data type for a function that handles TCP connection objects
 	typedef boost::function1<void, boost::shared_ptr<TCPConnection> >	ConnectionHandler;
 	
-	/// data type for an I/O read buffer
-	typedef boost::array<char, READ_BUFFER_SIZE>	ReadBuffer;
+	///
+	/// ReadBuffer: I/O read buffer whose size may be changed at runtime.  In
+	/// adaptive mode (max size > min size), the buffer doubles in size each
+	/// time a read fills it completely, and returns to its minimum size when
+	/// shrink() is called.  Buffers of SlabPool::SLAB_SIZE bytes are allocated
+	/// the same way as slabs, so that they can be released to a SlabPool.
+	/// Memory that is shared using share() is never reused: it is handed over
+	/// to the sharers, and the last of them frees it.
+	///
+	class ReadBuffer :
+		private boost::noncopyable
+	{
+	public:
+		
+		/// frees the memory used by the buffer (unless it is still shared)
+		~ReadBuffer() {
+			if (! handOff())
+				delete[] m_buffer;
+		}
+		
+		/// constructs a new read buffer using the default size
+		ReadBuffer(void)
+			: m_buffer(new char[READ_BUFFER_SIZE]), m_size(READ_BUFFER_SIZE),
+			m_min_size(READ_BUFFER_SIZE), m_max_size(READ_BUFFER_SIZE)
+		{}
+		
+		/// returns a pointer to the beginning of the buffer
+		inline char *data(void) { return m_buffer; }
+		
+		/// returns a const pointer to the beginning of the buffer
+		inline const char *data(void) const { return m_buffer; }
+		
+		/// returns a pointer to the beginning of the buffer
+		inline char *c_array(void) { return m_buffer; }
+		
+		/// returns the current size of the buffer
+		inline std::size_t size(void) const { return m_size; }
+		
+		/// returns the size that the buffer starts with (and shrinks to)
+		inline std::size_t getMinSize(void) const { return m_min_size; }
+		
+		/// returns the largest size that the buffer may grow to
+		inline std::size_t getMaxSize(void) const { return m_max_size; }
+		
+		/// returns an object that keeps the buffer's current memory alive for
+		/// as long as it is referenced
+		inline boost::shared_ptr<void> share(void) {
+			if (! m_owner)
+				m_owner.reset(new SharedMemory());
+			return m_owner;
+		}
+		
+		/// returns true if the buffer's current memory is still shared
+		inline bool isShared(void) const { return m_owner && ! m_owner.unique(); }
+		
+		/**
+		 * moves the buffer to new memory of the same size if its current
+		 * memory is still shared, and copies any unconsumed bytes into it
+		 *
+		 * @param read_ptr points to the next byte to be consumed (or NULL);
+		 *                 this is updated to point into the new memory
+		 * @param read_end_ptr points to the end of the bytes to be consumed
+		 */
+		inline void unshare(const char *&read_ptr, const char *&read_end_ptr) {
+			if (! isShared())
+				return;
+			char *ptr = new char[m_size];
+			const std::size_t bytes = (read_ptr == NULL ? 0 : read_end_ptr - read_ptr);
+			if (bytes > 0)
+				memcpy(ptr, read_ptr, bytes);
+			handOff();
+			m_buffer = ptr;
+			read_ptr = (read_ptr == NULL ? NULL : ptr);
+			read_end_ptr = (read_end_ptr == NULL ? NULL : ptr + bytes);
+		}
+		
+		/**
+		 * changes the minimum and maximum sizes of the buffer (any data in
+		 * the buffer is discarded if its size changes)
+		 *
+		 * @param min_size size that the buffer starts with (and shrinks to)
+		 * @param max_size largest size that the buffer may grow to
+		 */
+		inline void setSize(std::size_t min_size, std::size_t max_size) {
+			m_min_size = (min_size > 0 ? min_size : static_cast<std::size_t>(READ_BUFFER_SIZE));
+			m_max_size = (max_size > m_min_size ? max_size : m_min_size);
+			resize(m_min_size);
+		}
+		
+		/**
+		 * grows the buffer if the last read filled it completely (any data
+		 * in the buffer is discarded if its size changes)
+		 *
+		 * @param bytes_read number of bytes read by the last read operation
+		 */
+		inline void grow(std::size_t bytes_read) {
+			if (bytes_read >= m_size && m_size < m_max_size)
+				resize(m_size * 2 < m_max_size ? m_size * 2 : m_max_size);
+		}
+		
+		/**
+		 * shrinks the buffer back to its minimum size (discards any data);
+		 * if it has been released, a slab is taken from the pool when possible
+		 *
+		 * @param slab_pool pool that the memory may be taken from
+		 */
+		inline void shrink(SlabPool& slab_pool) {
+			if (m_buffer == NULL && m_min_size == SlabPool::SLAB_SIZE) {
+				m_buffer = slab_pool.acquire();
+				m_size = m_min_size;
+			} else {
+				resize(m_min_size);
+			}
+		}
+		
+		/**
+		 * frees the memory used by the buffer until shrink() or setSize() is
+		 * called; a buffer of SlabPool::SLAB_SIZE bytes is returned to the pool
+		 *
+		 * @param slab_pool pool that the memory may be returned to
+		 */
+		inline void release(SlabPool& slab_pool) {
+			if (handOff())
+				;	// the memory is freed by the last of its sharers
+			else if (m_size == SlabPool::SLAB_SIZE)
+				slab_pool.release(m_buffer);
+			else
+				delete[] m_buffer;
+			m_buffer = NULL;
+			m_size = 0;
+		}
+		
+	private:
+		
+		///
+		/// SharedMemory: frees memory that was handed over by a ReadBuffer
+		/// once the last of its sharers is finished with it
+		///
+		struct SharedMemory : private boost::noncopyable {
+			SharedMemory(void) : m_buffer(NULL) {}
+			~SharedMemory() { delete[] m_buffer; }
+			char *	m_buffer;
+		};
+		
+		/// reallocates the buffer if its size changes (or if it is shared)
+		inline void resize(std::size_t n) {
+			if (n != m_size || isShared()) {
+				char *ptr = new char[n];
+				if (! handOff())
+					delete[] m_buffer;
+				m_buffer = ptr;
+				m_size = n;
+			}
+		}
+		
+		/// stops sharing the buffer's memory; returns true if the memory was
+		/// still shared, in which case it now belongs to its sharers
+		inline bool handOff(void) {
+			if (! m_owner)
+				return false;
+			const bool shared = ! m_owner.unique();
+			if (shared)
+				m_owner->m_buffer = m_buffer;
+			m_owner.reset();
+			return shared;
+		}
+		
+		/// memory used by the buffer
+		char *							m_buffer;
+		
+		/// shares ownership of m_buffer (if share() has been called)
+		boost::shared_ptr<SharedMemory>	m_owner;
+		
+		/// current size of the buffer
+		std::size_t						m_size;
+		
+		/// size that the buffer starts with (and shrinks to)
+		std::size_t						m_min_size;
+		
+		/// largest size that the buffer may grow to
+		std::size_t						m_max_size;
+	};
 	
 	/// data type for a socket connection
 	typedef boost::asio::ip::tcp::socket			Socket;
@@ -98,6 +300,29 @@ public:
 																  ssl_flag, finished_handler));
 	}
 	
+	/**
+	 * creates new shared TCPConnection objects that are released using a
+	 * custom deleter (i.e. to allow objects to be recycled)
+	 *
+	 * @param io_service asio service associated with the connection
+	 * @param ssl_context asio ssl context associated with the connection
+	 * @param ssl_flag if true then the connection will be encrypted using SSL 
+	 * @param finished_handler function called when a server has finished
+	 *                         handling	the connection
+	 * @param deleter called instead of delete when the last reference is released
+	 */
+	template <typename Deleter>
+	static inline boost::shared_ptr<TCPConnection> create(boost::asio::io_service& io_service,
+														  SSLContext& ssl_context,
+														  const bool ssl_flag,
+														  ConnectionHandler finished_handler,
+														  Deleter deleter)
+	{
+		return boost::shared_ptr<TCPConnection>(new TCPConnection(io_service, ssl_context,
+																  ssl_flag, finished_handler),
+												deleter);
+	}
+	
 	/**
 	 * creates a new TCPConnection object
 	 *
@@ -115,7 +340,11 @@ public:
 		m_ssl_socket(io_service),
 		m_ssl_flag(false),
 #endif
-		m_lifecycle(LIFECYCLE_CLOSE)
+		m_lifecycle(LIFECYCLE_CLOSE), m_request_arena(NULL), m_previous_arena(NULL),
+		m_slab_pool_ptr(NULL), m_held_bytes(0), m_coalesce_limit(SlabPool::SLAB_SIZE),
+		m_pipeline_limit(DEFAULT_PIPELINE_LIMIT), m_coalesced_writes(0),
+		m_gathered_writes(0), m_held_writes(0), m_hold_writes(false), m_cork_writes(false),
+		m_is_corked(false), m_writing_slabs(false), m_release_slabs(false)
 	{
 		saveReadPosition(NULL, NULL);
 	}
@@ -135,7 +364,11 @@ public:
 		m_ssl_context(0),
 		m_ssl_socket(io_service), m_ssl_flag(false), 
 #endif
-		m_lifecycle(LIFECYCLE_CLOSE)
+		m_lifecycle(LIFECYCLE_CLOSE), m_request_arena(NULL), m_previous_arena(NULL),
+		m_slab_pool_ptr(NULL), m_held_bytes(0), m_coalesce_limit(SlabPool::SLAB_SIZE),
+		m_pipeline_limit(DEFAULT_PIPELINE_LIMIT), m_coalesced_writes(0),
+		m_gathered_writes(0), m_held_writes(0), m_hold_writes(false), m_cork_writes(false),
+		m_is_corked(false), m_writing_slabs(false), m_release_slabs(false)
 	{
 		saveReadPosition(NULL, NULL);
 	}
@@ -151,6 +384,29 @@ public:
 			m_ssl_socket.lowest_layer().close();
 	}
 
+	/// closes the connection and restores its initial state so that the
+	/// object may be used to accept another connection (not for SSL connections)
+	inline void reset(void) {
+		close();
+		m_lifecycle = LIFECYCLE_CLOSE;
+		m_hold_writes = false;
+		saveReadPosition(NULL, NULL);
+		m_read_buffer.shrink(getSlabPool());
+		releaseRequestArena(m_request_arena);
+		releaseRequestArena(m_previous_arena);
+		m_held_bytes = 0;
+		m_writing_slabs = false;	// no handlers are left to finish a write
+		releaseWriteSlabs();
+		m_coalesce_limit = SlabPool::SLAB_SIZE;
+		m_pipeline_limit = DEFAULT_PIPELINE_LIMIT;
+		m_coalesced_writes = 0;
+		m_gathered_writes = 0;
+		m_held_writes = 0;
+		m_cork_writes = false;
+		m_is_corked = false;
+		m_idle_timer.reset();
+	}
+
 	/*
 	Use close instead; basic_socket::cancel is deprecated for Windows XP.
 
@@ -161,7 +417,15 @@ public:
 	*/
 	
 	/// virtual destructor
-	virtual ~TCPConnection() { close(); }
+	virtual ~TCPConnection() {
+		close();
+		if (m_request_arena != NULL)
+			m_request_arena->removeReference();
+		if (m_previous_arena != NULL)
+			m_previous_arena->removeReference();
+		m_writing_slabs = false;
+		releaseWriteSlabs();
+	}
 	
 	/**
 	 * asynchronously accepts a new tcp connection
@@ -175,7 +439,10 @@ public:
 	inline void async_accept(boost::asio::ip::tcp::acceptor& tcp_acceptor,
 							 AcceptHandler handler)
 	{
-		tcp_acceptor.async_accept(m_ssl_socket.lowest_layer(), handler);
+		if (PionHandlerTimer::isActive())
+			tcp_acceptor.async_accept(m_ssl_socket.lowest_layer(), PionHandlerTimer::wrap(handler));
+		else
+			tcp_acceptor.async_accept(m_ssl_socket.lowest_layer(), handler);
 	}
 
 	/**
@@ -205,7 +472,10 @@ public:
 	inline void async_connect(boost::asio::ip::tcp::endpoint& tcp_endpoint,
 							  ConnectHandler handler)
 	{
-		m_ssl_socket.lowest_layer().async_connect(tcp_endpoint, handler);
+		if (PionHandlerTimer::isActive())
+			m_ssl_socket.lowest_layer().async_connect(tcp_endpoint, PionHandlerTimer::wrap(handler));
+		else
+			m_ssl_socket.lowest_layer().async_connect(tcp_endpoint, handler);
 	}
 
 	/**
@@ -303,7 +573,10 @@ public:
 	template <typename SSLHandshakeHandler>
 	inline void async_handshake_client(SSLHandshakeHandler handler) {
 #ifdef PION_HAVE_SSL
-		m_ssl_socket.async_handshake(boost::asio::ssl::stream_base::client, handler);
+		if (PionHandlerTimer::isActive())
+			m_ssl_socket.async_handshake(boost::asio::ssl::stream_base::client, PionHandlerTimer::wrap(handler));
+		else
+			m_ssl_socket.async_handshake(boost::asio::ssl::stream_base::client, handler);
 		m_ssl_flag = true;
 #endif
 	}
@@ -318,7 +591,10 @@ public:
 	template <typename SSLHandshakeHandler>
 	inline void async_handshake_server(SSLHandshakeHandler handler) {
 #ifdef PION_HAVE_SSL
-		m_ssl_socket.async_handshake(boost::asio::ssl::stream_base::server, handler);
+		if (PionHandlerTimer::isActive())
+			m_ssl_socket.async_handshake(boost::asio::ssl::stream_base::server, PionHandlerTimer::wrap(handler));
+		else
+			m_ssl_socket.async_handshake(boost::asio::ssl::stream_base::server, handler);
 		m_ssl_flag = true;
 #endif
 	}
@@ -355,6 +631,23 @@ public:
 		return ec;
 	}
 	
+	/**
+	 * asynchronously waits until data is available to be read from the
+	 * connection, without reading any of it or using the read buffer
+	 * (not supported for SSL connections, which may have buffered data)
+	 *
+	 * @param handler called when data is available or an error occurs
+	 *
+	 * @see boost::asio::null_buffers
+	 */
+	template <typename ReadHandler>
+	inline void async_wait_readable(ReadHandler handler) {
+		if (PionHandlerTimer::isActive())
+			m_ssl_socket.next_layer().async_read_some(boost::asio::null_buffers(), PionHandlerTimer::wrap(handler));
+		else
+			m_ssl_socket.next_layer().async_read_some(boost::asio::null_buffers(), handler);
+	}
+	
 	/**
 	 * asynchronously reads some data into the connection's read buffer 
 	 *
@@ -364,14 +657,13 @@ public:
 	 */
 	template <typename ReadHandler>
 	inline void async_read_some(ReadHandler handler) {
-#ifdef PION_HAVE_SSL
-		if (getSSLFlag())
-			m_ssl_socket.async_read_some(boost::asio::buffer(m_read_buffer),
-										 handler);
-		else
-#endif		
-			m_ssl_socket.next_layer().async_read_some(boost::asio::buffer(m_read_buffer),
-										 handler);
+		if (m_held_bytes > 0) {
+			// send the responses held back for pipelined requests before
+			// waiting for more data from the client
+			sendHeldWrites(ReadAfterHeldWrites<ReadHandler>(shared_from_this(), handler));
+			return;
+		}
+		async_read_some(boost::asio::buffer(m_read_buffer.data(), m_read_buffer.size()), handler);
 	}
 	
 	/**
@@ -385,12 +677,10 @@ public:
 	template <typename ReadBufferType, typename ReadHandler>
 	inline void async_read_some(ReadBufferType read_buffer,
 								ReadHandler handler) {
-#ifdef PION_HAVE_SSL
-		if (getSSLFlag())
-			m_ssl_socket.async_read_some(read_buffer, handler);
+		if (PionHandlerTimer::isActive())
+			startReadSome(read_buffer, PionHandlerTimer::wrap(handler));
 		else
-#endif		
-			m_ssl_socket.next_layer().async_read_some(read_buffer, handler);
+			startReadSome(read_buffer, handler);
 	}
 	
 	/**
@@ -402,12 +692,14 @@ public:
 	 * @see boost::asio::basic_stream_socket::read_some()
 	 */
 	inline std::size_t read_some(boost::system::error_code& ec) {
+		if (m_held_bytes > 0 && ! writeHeldData(ec))
+			return 0;
 #ifdef PION_HAVE_SSL
 		if (getSSLFlag())
-			return m_ssl_socket.read_some(boost::asio::buffer(m_read_buffer), ec);
+			return m_ssl_socket.read_some(boost::asio::buffer(m_read_buffer.data(), m_read_buffer.size()), ec);
 		else
 #endif		
-			return m_ssl_socket.next_layer().read_some(boost::asio::buffer(m_read_buffer), ec);
+			return m_ssl_socket.next_layer().read_some(boost::asio::buffer(m_read_buffer.data(), m_read_buffer.size()), ec);
 	}
 	
 	/**
@@ -423,6 +715,8 @@ public:
 	inline std::size_t read_some(ReadBufferType read_buffer,
 								 boost::system::error_code& ec)
 	{
+		if (m_held_bytes > 0 && ! writeHeldData(ec))
+			return 0;
 #ifdef PION_HAVE_SSL
 		if (getSSLFlag())
 			return m_ssl_socket.read_some(read_buffer, ec);
@@ -444,14 +738,8 @@ public:
 	inline void async_read(CompletionCondition completion_condition,
 						   ReadHandler handler)
 	{
-#ifdef PION_HAVE_SSL
-		if (getSSLFlag())
-			boost::asio::async_read(m_ssl_socket, boost::asio::buffer(m_read_buffer),
-									completion_condition, handler);
-		else
-#endif		
-			boost::asio::async_read(m_ssl_socket.next_layer(), boost::asio::buffer(m_read_buffer),
-									completion_condition, handler);
+		async_read(boost::asio::buffer(m_read_buffer.data(), m_read_buffer.size()),
+				   completion_condition, handler);
 	}
 			
 	/**
@@ -469,14 +757,10 @@ public:
 						   CompletionCondition completion_condition,
 						   ReadHandler handler)
 	{
-#ifdef PION_HAVE_SSL
-		if (getSSLFlag())
-			boost::asio::async_read(m_ssl_socket, buffers,
-									completion_condition, handler);
+		if (PionHandlerTimer::isActive())
+			startRead(buffers, completion_condition, PionHandlerTimer::wrap(handler));
 		else
-#endif		
-			boost::asio::async_read(m_ssl_socket.next_layer(), buffers,
-									completion_condition, handler);
+			startRead(buffers, completion_condition, handler);
 	}
 	
 	/**
@@ -495,11 +779,11 @@ public:
 	{
 #ifdef PION_HAVE_SSL
 		if (getSSLFlag())
-			return boost::asio::async_read(m_ssl_socket, boost::asio::buffer(m_read_buffer),
+			return boost::asio::async_read(m_ssl_socket, boost::asio::buffer(m_read_buffer.data(), m_read_buffer.size()),
 										   completion_condition, ec);
 		else
 #endif		
-			return boost::asio::async_read(m_ssl_socket.next_layer(), boost::asio::buffer(m_read_buffer),
+			return boost::asio::async_read(m_ssl_socket.next_layer(), boost::asio::buffer(m_read_buffer.data(), m_read_buffer.size()),
 										   completion_condition, ec);
 	}
 	
@@ -530,7 +814,18 @@ public:
 	}
 	
 	/**
-	 * asynchronously writes data to the connection
+	 * asynchronously writes data to the connection.  If there are several
+	 * buffers holding no more than getCoalesceLimit() bytes altogether, they
+	 * are first copied into one pooled buffer so that they are sent using a
+	 * single write (and a single record for SSL connections).  Larger writes
+	 * are gathered from the buffers given.
+	 *
+	 * While a server has more pipelined requests waiting to be handled (see
+	 * setHoldWrites()), up to getPipelineLimit() bytes are copied and held
+	 * back instead, and the handler is called right away.  Held data is sent
+	 * along with the next write that is not held back, or before the
+	 * connection reads more data or finishes.  If sending it fails, the error
+	 * is passed to the handler of the operation that sent it.
 	 *
 	 * @param buffers one or more buffers containing the data to be written
 	 * @param handler called after the data has been written
@@ -539,16 +834,67 @@ public:
 	 */
 	template <typename ConstBufferSequence, typename WriteHandler>
 	inline void async_write(const ConstBufferSequence& buffers, WriteHandler handler) {
-#ifdef PION_HAVE_SSL
-		if (getSSLFlag())
-			boost::asio::async_write(m_ssl_socket, buffers, handler);
-		else
-#endif		
-			boost::asio::async_write(m_ssl_socket.next_layer(), buffers, handler);
+		std::size_t num_buffers = 0;
+		std::size_t num_bytes = 0;
+		for (typename ConstBufferSequence::const_iterator i = buffers.begin(); i != buffers.end(); ++i) {
+			++num_buffers;
+			num_bytes += boost::asio::buffer_size(*i);
+		}
+		if (getHoldWrites() && m_held_bytes + num_bytes <= m_pipeline_limit) {
+			// hold the data back so that it is sent along with the responses
+			// to the pipelined requests that follow
+			copyToWriteSlabs(buffers);
+			++m_held_writes;
+			if (PionHandlerTimer::isActive())
+				getIOService().post(PionHandlerTimer::wrap(boost::bind<void>(handler, boost::system::error_code(), num_bytes)));
+			else
+				getIOService().post(boost::bind<void>(handler, boost::system::error_code(), num_bytes));
+		} else if (m_held_bytes > 0) {
+			// send the data held back for earlier requests in the same write
+			if (m_held_bytes + num_bytes <= m_pipeline_limit) {
+				copyToWriteSlabs(buffers);
+				sendHeldWrites(handler);
+			} else {
+				std::vector<boost::asio::const_buffer> write_buffers;
+				appendHeldBuffers(write_buffers);
+				write_buffers.insert(write_buffers.end(), buffers.begin(), buffers.end());
+				m_held_bytes = 0;
+				++m_gathered_writes;
+				asyncWriteSlabs(write_buffers, handler);
+			}
+		} else if (num_buffers > 1 && num_bytes <= m_coalesce_limit) {
+			// copy everything into one buffer
+			copyToWriteSlabs(buffers);
+			m_held_bytes = 0;
+			++m_coalesced_writes;
+			asyncWriteSlabs(boost::asio::buffer(m_write_slabs.front(), num_bytes), handler);
+		} else {
+			asyncWriteGathered(buffers, handler);
+		}
 	}	
+	
+	/**
+	 * asynchronously writes the last data of a message: the same as
+	 * async_write(), except that the socket is uncorked (see corkWrites())
+	 * once the data has been written
+	 *
+	 * @param buffers one or more buffers containing the data to be written
+	 * @param handler called after the data has been written
+	 */
+	template <typename ConstBufferSequence, typename WriteHandler>
+	inline void asyncWriteAndUncork(const ConstBufferSequence& buffers, WriteHandler handler) {
+#ifdef PION_TCP_CORK
+		if (m_is_corked) {
+			async_write(buffers, UncorkAfterWrite<WriteHandler>(shared_from_this(), handler));
+			return;
+		}
+#endif
+		async_write(buffers, handler);
+	}
 		
 	/**
-	 * writes data to the connection (blocks until finished)
+	 * writes data to the connection (blocks until finished).  Any data held
+	 * back by async_write() is sent first.
 	 *
 	 * @param buffers one or more buffers containing the data to be written
 	 * @param ec contains error code if the write fails
@@ -560,6 +906,8 @@ public:
 	inline std::size_t write(const ConstBufferSequence& buffers,
 							 boost::system::error_code& ec)
 	{
+		if (m_held_bytes > 0 && ! writeHeldData(ec))
+			return 0;
 #ifdef PION_HAVE_SSL
 		if (getSSLFlag())
 			return boost::asio::write(m_ssl_socket, buffers,
@@ -572,14 +920,34 @@ public:
 	
 	
 	/// This function should be called when a server has finished handling
-	/// the connection
-	inline void finish(void) { if (m_finished_handler) m_finished_handler(shared_from_this()); }
+	/// the connection (after any writes have completed).  The server does
+	/// not keep connections alive by itself: if the last reference to a
+	/// connection is released without calling finish(), the socket is closed.
+	inline void finish(void) {
+		if (m_held_bytes > 0 && ! getHoldWrites()) {
+			// no more requests will be handled: send the held data first
+			sendHeldWrites(boost::bind(&TCPConnection::finishAfterHeldWrites, shared_from_this(),
+									   boost::asio::placeholders::error));
+			return;
+		}
+		startNewRequestArena();
+		if (m_held_bytes == 0)
+			releaseWriteSlabs();
+		uncorkWrites();
+		// leave the read buffer's memory to any request that still refers to
+		// it (pipelined bytes that have not been consumed yet are moved)
+		if (! getPipelined())
+			saveReadPosition(NULL, NULL);
+		m_read_buffer.unshare(m_read_position.first, m_read_position.second);
+		if (m_finished_handler) m_finished_handler(shared_from_this());
+	}
 
 	/// returns true if the connection is encrypted using SSL
 	inline bool getSSLFlag(void) const { return m_ssl_flag; }
 
-	/// sets the lifecycle type for the connection
-	inline void setLifecycle(LifecycleType t) { m_lifecycle = t; }
+	/// sets the lifecycle type for the connection (this also stops
+	/// async_write() from holding back writes; see setHoldWrites())
+	inline void setLifecycle(LifecycleType t) { m_lifecycle = t; m_hold_writes = false; }
 	
 	/// returns the lifecycle type for the connection
 	inline LifecycleType getLifecycle(void) const { return m_lifecycle; }
@@ -590,9 +958,160 @@ public:
 	/// returns true if the HTTP requests are pipelined
 	inline bool getPipelined(void) const { return m_lifecycle == LIFECYCLE_PIPELINED; }
 
+	/**
+	 * sets whether async_write() holds back data so that it is sent together
+	 * with the responses to the pipelined requests that follow.  This is set
+	 * by servers after reading a request that has more pipelined requests
+	 * behind it, and is cleared whenever the lifecycle is changed.
+	 *
+	 * @param b true to hold back writes (only while the lifecycle is
+	 *          LIFECYCLE_PIPELINED)
+	 */
+	inline void setHoldWrites(bool b) { m_hold_writes = b; }
+
+	/// returns true if async_write() is holding back writes for pipelined requests
+	inline bool getHoldWrites(void) const { return m_hold_writes && getPipelined(); }
+
 	/// returns the buffer used for reading data from the TCP connection
 	inline ReadBuffer& getReadBuffer(void) { return m_read_buffer; }
 	
+	/**
+	 * sets the largest number of bytes that async_write() will copy into one
+	 * buffer to avoid a gathered write; it may be no more than SlabPool::SLAB_SIZE
+	 *
+	 * @param n the limit, in bytes (0 disables coalescing)
+	 */
+	inline void setCoalesceLimit(const std::size_t n) {
+		m_coalesce_limit = (n < SlabPool::SLAB_SIZE ? n : SlabPool::SLAB_SIZE);
+	}
+
+	/// returns the largest number of bytes that async_write() will coalesce
+	inline std::size_t getCoalesceLimit(void) const { return m_coalesce_limit; }
+
+	/**
+	 * sets the largest number of bytes that async_write() will hold back
+	 * while pipelined requests are waiting to be handled
+	 *
+	 * @param n the limit, in bytes (0 sends each response right away)
+	 */
+	inline void setPipelineLimit(const std::size_t n) { m_pipeline_limit = n; }
+
+	/// returns the largest number of bytes held back for pipelined requests
+	inline std::size_t getPipelineLimit(void) const { return m_pipeline_limit; }
+
+	/// returns the number of bytes currently held back for pipelined requests
+	inline std::size_t getHeldBytes(void) const { return m_held_bytes; }
+
+	/// returns the number of writes that were sent from copies in pooled buffers
+	inline unsigned long getNumCoalescedWrites(void) const { return m_coalesced_writes; }
+
+	/// returns the number of writes that were gathered from the buffers given
+	inline unsigned long getNumGatheredWrites(void) const { return m_gathered_writes; }
+
+	/// returns the number of writes that were held back for pipelined requests
+	inline unsigned long getNumHeldWrites(void) const { return m_held_writes; }
+
+	/**
+	 * sets whether corkWrites() corks the socket (using TCP_CORK or
+	 * TCP_NOPUSH), so that the headers of a chunked message are sent in the
+	 * same segments as the chunks that follow them.  Ignored on other platforms.
+	 *
+	 * @param b true to allow the socket to be corked
+	 */
+	inline void setCorkWrites(bool b) { m_cork_writes = b; }
+
+	/// returns true if corkWrites() corks the socket
+	inline bool getCorkWrites(void) const { return m_cork_writes; }
+
+	/// corks the socket (if setCorkWrites() is enabled) so that the writes
+	/// which follow are only sent in full segments, until uncorkWrites(),
+	/// asyncWriteAndUncork() or finish() is called
+	inline void corkWrites(void) {
+#ifdef PION_TCP_CORK
+		if (m_cork_writes && ! m_is_corked) {
+			setCork(true);
+			m_is_corked = true;
+		}
+#endif
+	}
+
+	/// uncorks the socket if it was corked by corkWrites(), which sends any
+	/// partial segment right away
+	inline void uncorkWrites(void) {
+#ifdef PION_TCP_CORK
+		if (m_is_corked) {
+			setCork(false);
+			m_is_corked = false;
+		}
+#endif
+	}
+
+	/// returns the timer used to close the connection while it is idle; this
+	/// is empty until a server creates it, and is then reused every time the
+	/// connection waits for another request
+	inline boost::shared_ptr<TCPTimer>& getIdleTimer(void) { return m_idle_timer; }
+
+	/// returns the arena used to allocate objects for the current request
+	/// (a new one is started each time finish() is called)
+	inline RequestArena& getRequestArena(void) {
+		if (m_request_arena == NULL) {
+			m_request_arena = new RequestArena();
+		} else if (m_request_arena->unique()) {
+			// nothing allocated from the arena is still in use
+			m_request_arena->clear();
+		} else if (m_request_arena->getBytesUsed() >= RequestArena::MAX_SIZE) {
+			// objects are not being released between requests; let the old
+			// arena be deleted along with the last of them
+			m_request_arena->removeReference();
+			m_request_arena = new RequestArena();
+		}
+		return *m_request_arena;
+	}
+	
+	/**
+	 * sets the size of the buffer used for reading data from the connection
+	 * (any data in the buffer is discarded if its size changes)
+	 *
+	 * @param min_size initial size of the read buffer
+	 * @param max_size the buffer may grow up to this size while large
+	 *                 messages are being read (adaptive mode)
+	 */
+	inline void setReadBufferSize(std::size_t min_size, std::size_t max_size = 0) {
+		m_read_buffer.setSize(min_size, max_size);
+	}
+	
+	/**
+	 * grows the read buffer (in adaptive mode) if the last read filled it;
+	 * this must only be called after all of the bytes read have been consumed
+	 *
+	 * @param bytes_read number of bytes read by the last read operation
+	 */
+	inline void growReadBuffer(std::size_t bytes_read) {
+		if (! getPipelined())
+			m_read_buffer.grow(bytes_read);
+	}
+	
+	/// returns an object that keeps the read buffer's current memory alive
+	/// for as long as it is referenced (e.g. by a message whose headers refer
+	/// to it); the connection reads into new memory after finish() instead
+	inline boost::shared_ptr<void> shareReadBuffer(void) { return m_read_buffer.share(); }
+	
+	/// shrinks the read buffer back to its initial size (e.g. for an idle
+	/// keep-alive connection), unless it contains pipelined messages
+	inline void shrinkReadBuffer(void) {
+		if (! getPipelined())
+			m_read_buffer.shrink(getSlabPool());
+	}
+	
+	/// frees the memory used by the read buffer (unless it contains pipelined
+	/// messages); shrinkReadBuffer() must be called before reading more data.
+	/// A buffer of the default size is kept by the io_service's SlabPool, so
+	/// that parking a keep-alive connection does not free and allocate it
+	inline void releaseReadBuffer(void) {
+		if (! getPipelined())
+			m_read_buffer.release(getSlabPool());
+	}
+	
 	/**
 	 * saves a read position bookmark
 	 *
@@ -678,7 +1197,11 @@ protected:
 		m_ssl_context(0),
 		m_ssl_socket(io_service), m_ssl_flag(false), 
 #endif
-		m_lifecycle(LIFECYCLE_CLOSE),
+		m_lifecycle(LIFECYCLE_CLOSE), m_request_arena(NULL), m_previous_arena(NULL),
+		m_slab_pool_ptr(NULL), m_held_bytes(0), m_coalesce_limit(SlabPool::SLAB_SIZE),
+		m_pipeline_limit(DEFAULT_PIPELINE_LIMIT), m_coalesced_writes(0),
+		m_gathered_writes(0), m_held_writes(0), m_hold_writes(false), m_cork_writes(false),
+		m_is_corked(false), m_writing_slabs(false), m_release_slabs(false),
 		m_finished_handler(finished_handler)
 	{
 		saveReadPosition(NULL, NULL);
@@ -687,6 +1210,284 @@ protected:
 
 private:
 
+	/**
+	 * starts a new arena for the next request.  The arena used by the request
+	 * before the one that just finished is normally no longer in use by this
+	 * time, so its memory is released in one step and reused for the next one.
+	 */
+	inline void startNewRequestArena(void) {
+		if (m_request_arena == NULL)
+			return;
+		RequestArena *arena_ptr = m_previous_arena;
+		m_previous_arena = m_request_arena;
+		m_request_arena = arena_ptr;
+		releaseRequestArena(m_request_arena);
+	}
+	
+	/**
+	 * asynchronously writes buffers to the socket
+	 *
+	 * @param buffers one or more buffers containing the data to be written
+	 * @param handler called after the data has been written
+	 */
+	template <typename ConstBufferSequence, typename WriteHandler>
+	inline void asyncWriteBuffers(const ConstBufferSequence& buffers, WriteHandler handler) {
+		if (PionHandlerTimer::isActive())
+			startWrite(buffers, PionHandlerTimer::wrap(handler));
+		else
+			startWrite(buffers, handler);
+	}
+	
+	/// starts an asynchronous write to the socket (see asyncWriteBuffers())
+	template <typename ConstBufferSequence, typename WriteHandler>
+	inline void startWrite(const ConstBufferSequence& buffers, const WriteHandler& handler) {
+#ifdef PION_HAVE_SSL
+		if (getSSLFlag())
+			boost::asio::async_write(m_ssl_socket, buffers, handler);
+		else
+#endif		
+			boost::asio::async_write(m_ssl_socket.next_layer(), buffers, handler);
+	}
+	
+	/// starts an asynchronous read from the socket (see async_read_some())
+	template <typename ReadBufferType, typename ReadHandler>
+	inline void startReadSome(const ReadBufferType& read_buffer, const ReadHandler& handler) {
+#ifdef PION_HAVE_SSL
+		if (getSSLFlag())
+			m_ssl_socket.async_read_some(read_buffer, handler);
+		else
+#endif		
+			m_ssl_socket.next_layer().async_read_some(read_buffer, handler);
+	}
+	
+	/// starts an asynchronous read from the socket (see async_read())
+	template <typename MutableBufferSequence, typename CompletionCondition, typename ReadHandler>
+	inline void startRead(const MutableBufferSequence& buffers,
+						  const CompletionCondition& completion_condition,
+						  const ReadHandler& handler)
+	{
+#ifdef PION_HAVE_SSL
+		if (getSSLFlag())
+			boost::asio::async_read(m_ssl_socket, buffers, completion_condition, handler);
+		else
+#endif		
+			boost::asio::async_read(m_ssl_socket.next_layer(), buffers, completion_condition, handler);
+	}
+
+	/**
+	 * asynchronously writes data that is gathered from the buffers given
+	 *
+	 * @param buffers one or more buffers containing the data to be written
+	 * @param handler called after the data has been written
+	 */
+	template <typename ConstBufferSequence, typename WriteHandler>
+	inline void asyncWriteGathered(const ConstBufferSequence& buffers, WriteHandler handler) {
+		++m_gathered_writes;
+		asyncWriteBuffers(buffers, handler);
+	}
+
+#ifdef PION_TCP_CORK
+	/// socket option used to cork writes
+	typedef BooleanSocketOption<IPPROTO_TCP, PION_TCP_CORK>	CorkOption;
+
+	/// corks or uncorks the socket (errors are ignored)
+	inline void setCork(bool b) {
+		boost::system::error_code ec;
+		getSocket().set_option(CorkOption(b), ec);
+	}
+
+	///
+	/// UncorkAfterWrite: write handler that uncorks the socket once the last
+	/// write of a message has finished
+	///
+	template <typename WriteHandler>
+	class UncorkAfterWrite {
+	public:
+		UncorkAfterWrite(const boost::shared_ptr<TCPConnection>& tcp_conn, WriteHandler handler)
+			: m_tcp_conn(tcp_conn), m_handler(handler)
+		{}
+		inline void operator()(const boost::system::error_code& write_error, std::size_t bytes_written) {
+			m_tcp_conn->uncorkWrites();
+			m_handler(write_error, bytes_written);
+		}
+	private:
+		boost::shared_ptr<TCPConnection>	m_tcp_conn;
+		WriteHandler						m_handler;
+	};
+#endif
+
+	/**
+	 * copies data into the write slabs, after any data that is held back
+	 *
+	 * @param buffers one or more buffers containing the data to copy
+	 */
+	template <typename ConstBufferSequence>
+	inline void copyToWriteSlabs(const ConstBufferSequence& buffers) {
+		for (typename ConstBufferSequence::const_iterator i = buffers.begin(); i != buffers.end(); ++i) {
+			const char *ptr = boost::asio::buffer_cast<const char*>(*i);
+			std::size_t bytes_left = boost::asio::buffer_size(*i);
+			while (bytes_left > 0) {
+				const std::size_t slab_num = m_held_bytes / SlabPool::SLAB_SIZE;
+				const std::size_t slab_pos = m_held_bytes % SlabPool::SLAB_SIZE;
+				if (slab_num == m_write_slabs.size())
+					m_write_slabs.push_back(getSlabPool().acquire());
+				const std::size_t n = (bytes_left < SlabPool::SLAB_SIZE - slab_pos
+									   ? bytes_left : SlabPool::SLAB_SIZE - slab_pos);
+				memcpy(m_write_slabs[slab_num] + slab_pos, ptr, n);
+				ptr += n;
+				bytes_left -= n;
+				m_held_bytes += n;
+			}
+		}
+	}
+
+	/**
+	 * appends buffers that refer to the data copied into the write slabs
+	 *
+	 * @param write_buffers the buffers to append to
+	 */
+	inline void appendHeldBuffers(std::vector<boost::asio::const_buffer>& write_buffers) const {
+		for (std::size_t offset = 0; offset < m_held_bytes; offset += SlabPool::SLAB_SIZE) {
+			const std::size_t n = m_held_bytes - offset;
+			write_buffers.push_back(boost::asio::buffer(m_write_slabs[offset / SlabPool::SLAB_SIZE],
+				(n < SlabPool::SLAB_SIZE ? n : SlabPool::SLAB_SIZE)));
+		}
+	}
+
+	/**
+	 * sends all of the data that is held back for pipelined requests
+	 * (blocks until finished)
+	 *
+	 * @param ec contains error code if the write fails
+	 * @return true if the data was sent
+	 */
+	inline bool writeHeldData(boost::system::error_code& ec) {
+		std::vector<boost::asio::const_buffer> write_buffers;
+		appendHeldBuffers(write_buffers);
+		m_held_bytes = 0;
+		++m_coalesced_writes;
+		write(write_buffers, ec);
+		return ! ec;
+	}
+
+	/**
+	 * finishes the connection once the data held back by finish() is sent
+	 *
+	 * @param write_error error status from sending the held data
+	 */
+	inline void finishAfterHeldWrites(const boost::system::error_code& write_error) {
+		if (write_error)
+			m_lifecycle = LIFECYCLE_CLOSE;	// make sure it will get closed
+		finish();
+	}
+
+	/**
+	 * sends all of the data that is held back for pipelined requests
+	 *
+	 * @param handler called after the data has been written
+	 */
+	template <typename WriteHandler>
+	inline void sendHeldWrites(WriteHandler handler) {
+		std::vector<boost::asio::const_buffer> write_buffers;
+		appendHeldBuffers(write_buffers);
+		m_held_bytes = 0;
+		++m_coalesced_writes;
+		asyncWriteSlabs(write_buffers, handler);
+	}
+
+	///
+	/// ReadAfterHeldWrites: write handler used by async_read_some() to start
+	/// reading once the data held back for pipelined requests has been sent
+	///
+	template <typename ReadHandler>
+	class ReadAfterHeldWrites {
+	public:
+		ReadAfterHeldWrites(const boost::shared_ptr<TCPConnection>& tcp_conn, ReadHandler handler)
+			: m_tcp_conn(tcp_conn), m_handler(handler)
+		{}
+		inline void operator()(const boost::system::error_code& write_error, std::size_t) {
+			m_tcp_conn->releaseWriteSlabs();
+			if (write_error)
+				m_handler(write_error, 0);
+			else
+				m_tcp_conn->async_read_some(m_handler);
+		}
+	private:
+		boost::shared_ptr<TCPConnection>	m_tcp_conn;
+		ReadHandler							m_handler;
+	};
+
+	/**
+	 * asynchronously writes buffers that refer to the write slabs; the slabs
+	 * are not released until the write has finished
+	 *
+	 * @param buffers one or more buffers containing the data to be written
+	 * @param handler called after the data has been written
+	 */
+	template <typename ConstBufferSequence, typename WriteHandler>
+	inline void asyncWriteSlabs(const ConstBufferSequence& buffers, WriteHandler handler) {
+		m_writing_slabs = true;
+		asyncWriteBuffers(buffers, SlabWriteFinished<WriteHandler>(shared_from_this(), handler));
+	}
+
+	///
+	/// SlabWriteFinished: write handler that releases the write slabs once
+	/// they have been written, if finish() tried to release them before
+	///
+	template <typename WriteHandler>
+	class SlabWriteFinished {
+	public:
+		SlabWriteFinished(const boost::shared_ptr<TCPConnection>& tcp_conn, WriteHandler handler)
+			: m_tcp_conn(tcp_conn), m_handler(handler)
+		{}
+		inline void operator()(const boost::system::error_code& write_error, std::size_t bytes_written) {
+			m_tcp_conn->m_writing_slabs = false;
+			if (m_tcp_conn->m_release_slabs && m_tcp_conn->m_held_bytes == 0)
+				m_tcp_conn->releaseWriteSlabs();
+			m_handler(write_error, bytes_written);
+		}
+	private:
+		boost::shared_ptr<TCPConnection>	m_tcp_conn;
+		WriteHandler						m_handler;
+	};
+
+	/// returns the slab pool for the connection's io_service
+	inline SlabPool& getSlabPool(void) {
+		if (m_slab_pool_ptr == NULL)
+			m_slab_pool_ptr = &boost::asio::use_service<SlabPool>(getIOService());
+		return *m_slab_pool_ptr;
+	}
+
+	/// returns the write slabs to the pool; if they are still being written,
+	/// they are released once the write finishes
+	inline void releaseWriteSlabs(void) {
+		if (m_writing_slabs) {
+			m_release_slabs = true;
+			return;
+		}
+		m_release_slabs = false;
+		if (! m_write_slabs.empty())
+			m_slab_pool_ptr->release(m_write_slabs);
+	}
+
+	/**
+	 * clears an arena so that it may be reused if nothing allocated from it
+	 * is still in use; otherwise it is deleted along with the last object
+	 *
+	 * @param arena_ptr the arena to release (set to NULL unless it is reused)
+	 */
+	static inline void releaseRequestArena(RequestArena *& arena_ptr) {
+		if (arena_ptr != NULL) {
+			if (arena_ptr->unique()) {
+				arena_ptr->clear();
+			} else {
+				arena_ptr->removeReference();
+				arena_ptr = NULL;
+			}
+		}
+	}
+	
+	
 	/// data type for a read position bookmark
 	typedef std::pair<const char*, const char*>		ReadPosition;
 
@@ -709,6 +1510,55 @@ private:
 	/// lifecycle state for the connection
 	LifecycleType				m_lifecycle;
 
+	/// arena used to allocate objects for the current request
+	RequestArena *				m_request_arena;
+	
+	/// arena used by the previous request (released by the next finish())
+	RequestArena *				m_previous_arena;
+
+	/// pool that the write buffer is acquired from (looked up when first needed)
+	SlabPool *					m_slab_pool_ptr;
+
+	/// buffers used to coalesce small writes and to hold back responses to
+	/// pipelined requests (kept until the data is sent and finish() is called)
+	std::vector<char*>			m_write_slabs;
+
+	/// number of bytes copied into the write slabs that have not been sent
+	std::size_t					m_held_bytes;
+
+	/// largest number of bytes that async_write() will coalesce
+	std::size_t					m_coalesce_limit;
+
+	/// largest number of bytes held back for pipelined requests
+	std::size_t					m_pipeline_limit;
+
+	/// number of writes that were copied into one buffer
+	unsigned long				m_coalesced_writes;
+
+	/// number of writes that were gathered from the buffers given
+	unsigned long				m_gathered_writes;
+
+	/// number of writes that were held back for pipelined requests
+	unsigned long				m_held_writes;
+
+	/// true if async_write() should hold back writes for pipelined requests
+	bool						m_hold_writes;
+
+	/// true if corkWrites() corks the socket
+	bool						m_cork_writes;
+	
+	/// true if the socket is corked
+	bool						m_is_corked;
+	
+	/// true while an asynchronous write refers to the write slabs
+	bool						m_writing_slabs;
+
+	/// true if the write slabs should be released once they have been written
+	bool						m_release_slabs;
+	
+	/// timer used to close the connection while it is idle
+	boost::shared_ptr<TCPTimer>	m_idle_timer;
+	
 	/// function called when a server has finished handling the connection
 	ConnectionHandler			m_finished_handler;
 };
@@ -10,16 +10,21 @@
 #ifndef __PION_TCPSERVER_HEADER__
 #define __PION_TCPSERVER_HEADER__
 
-#include <set>
+#include <vector>
 #include <boost/asio.hpp>
+#include <boost/cstdint.hpp>
 #include <boost/noncopyable.hpp>
 #include <boost/shared_ptr.hpp>
+#include <boost/weak_ptr.hpp>
+#include <boost/detail/atomic_count.hpp>
 #include <boost/thread/mutex.hpp>
 #include <boost/thread/condition.hpp>
 #include <pion/PionConfig.hpp>
+#include <pion/PionHashMap.hpp>
 #include <pion/PionLogger.hpp>
 #include <pion/PionScheduler.hpp>
 #include <pion/net/TCPConnection.hpp>
+#include <pion/net/TCPSocketPolicy.hpp>
 
 
 namespace pion {	// begin namespace pion
@@ -34,7 +39,11 @@ class PION_NET_API TCPServer :
 public:
 
 	/// default destructor
-	virtual ~TCPServer() { if (m_is_listening) stop(false); }
+	virtual ~TCPServer() {
+		if (isListening()) stop(false);
+		// connections that outlive the server must not use its scheduler
+		m_conn_recycler->setScheduler(NULL);
+	}
 	
 	/// starts listening for new connections
 	void start(void);
@@ -77,6 +86,73 @@ public:
 	/// sets tcp endpoint that the server listens for connections on
 	inline void setEndpoint(const boost::asio::ip::tcp::endpoint& ep) { m_endpoint = ep; }
 
+	/// returns the number of listening sockets used to accept new connections
+	inline unsigned int getNumAcceptors(void) const { return m_num_acceptors; }
+
+	/**
+	 * sets the number of listening sockets used to accept new connections.
+	 * If greater than one, each acceptor is bound to the same endpoint using
+	 * SO_REUSEPORT so that the kernel distributes new connections between
+	 * them.  With a PionOneToOneScheduler, each acceptor (and every connection
+	 * it accepts) is assigned to its own I/O service.  Ignored on platforms
+	 * that do not support SO_REUSEPORT.  Takes effect the next time the
+	 * server is started.
+	 *
+	 * @param n number of acceptors (zero means one per scheduler thread)
+	 */
+	inline void setNumAcceptors(unsigned int n) { m_num_acceptors = n; }
+
+	/// returns the initial size of the read buffer used by new connections
+	inline std::size_t getReadBufferSize(void) const { return m_read_buffer_size; }
+	
+	/**
+	 * sets the initial size of the read buffer used by new connections
+	 *
+	 * @param n size of the read buffer in bytes
+	 */
+	inline void setReadBufferSize(std::size_t n) { m_read_buffer_size = n; }
+	
+	/// returns the size that read buffers may grow to while reading large messages
+	inline std::size_t getMaxReadBufferSize(void) const { return m_max_read_buffer_size; }
+	
+	/**
+	 * enables adaptive read buffers: a connection's read buffer doubles in
+	 * size (up to this limit) each time a read fills it, and returns to its
+	 * initial size once the connection is idle between requests
+	 *
+	 * @param n maximum size of read buffers in bytes (zero disables growth)
+	 */
+	inline void setMaxReadBufferSize(std::size_t n) { m_max_read_buffer_size = n; }
+	
+	/**
+	 * sets the maximum number of finished connection objects that are kept
+	 * by the server so that they may be reused for new connections (zero
+	 * disables recycling).  SSL connections are never recycled.
+	 *
+	 * @param n maximum number of connection objects to keep
+	 */
+	inline void setConnectionCacheSize(std::size_t n) { m_conn_recycler->setMaxSize(n); }
+	
+	/// returns the maximum number of finished connection objects kept for reuse
+	inline std::size_t getConnectionCacheSize(void) const { return m_conn_recycler->getMaxSize(); }
+	
+	/// returns the number of new connections that reused a recycled object
+	inline boost::uint64_t getConnectionCacheHits(void) const { return m_conn_recycler->getHits(); }
+	
+	/// returns the number of new connections that required a new object
+	inline boost::uint64_t getConnectionCacheMisses(void) const { return m_conn_recycler->getMisses(); }
+
+	/// returns the socket options applied to listening sockets and new
+	/// connections (changes to listening sockets take effect the next time
+	/// the server is started)
+	inline TCPSocketPolicy& getSocketPolicy(void) { return m_socket_policy; }
+
+	/// returns the socket options applied to listening sockets and new connections
+	inline const TCPSocketPolicy& getSocketPolicy(void) const { return m_socket_policy; }
+
+	/// sets the socket options applied to listening sockets and new connections
+	inline void setSocketPolicy(const TCPSocketPolicy& policy) { m_socket_policy = policy; }
+
 	/// returns true if the server uses SSL to encrypt connections
 	inline bool getSSLFlag(void) const { return m_ssl_flag; }
 	
@@ -87,7 +163,7 @@ public:
 	inline TCPConnection::SSLContext& getSSLContext(void) { return m_ssl_context; }
 	
 	/// returns true if the server is listening for connections
-	inline bool isListening(void) const { return m_is_listening; }
+	inline bool isListening(void) const { return m_is_listening != 0; }
 	
 	/// sets the logger to be used
 	inline void setLogger(PionLogger log_ptr) { m_logger = log_ptr; }
@@ -95,6 +171,10 @@ public:
 	/// returns the logger currently in use
 	inline PionLogger getLogger(void) { return m_logger; }
 	
+	
+	/// default maximum number of connection objects kept for reuse
+	static const std::size_t			DEFAULT_CONNECTION_CACHE_SIZE;
+	
 
 protected:
 		
@@ -158,16 +238,23 @@ private:
 	/// handles a request to stop the server
 	void handleStopRequest(void);
 	
-	/// listens for a new connection
-	void listen(void);
+	/**
+	 * listens for a new connection.  This does not lock the server, since
+	 * the acceptors do not change while it is listening; each acceptor has
+	 * its own lock so that stop() cannot close it while an accept starts.
+	 *
+	 * @param acceptor_num index of the acceptor used to accept the connection
+	 */
+	void listen(std::size_t acceptor_num);
 
 	/**
 	 * handles new connections (checks if there was an accept error)
 	 *
+	 * @param acceptor_num index of the acceptor that accepted the connection
 	 * @param tcp_conn the new TCP connection (if no error occurred)
 	 * @param accept_error true if an error occurred while accepting connections
 	 */
-	void handleAccept(TCPConnectionPtr& tcp_conn,
+	void handleAccept(std::size_t acceptor_num, TCPConnectionPtr& tcp_conn,
 					  const boost::system::error_code& accept_error);
 
 	/**
@@ -182,15 +269,277 @@ private:
 	/// This will be called by TCPConnection::finish() after a server has
 	/// finished handling a connection.  If the keep_alive flag is true,
 	/// it will call handleConnection(); otherwise, it will close the
-	/// connection and remove it from the server's management pool
+	/// connection and remove it from the server's management pool.
+	/// Connections whose last reference is released without calling
+	/// finish() are closed right away, since the pool only keeps weak
+	/// references to them.
 	void finishConnection(TCPConnectionPtr& tcp_conn);
 	
     /// prunes orphaned connections that did not close cleanly
     /// and returns the remaining number of connections in the pool
     std::size_t pruneConnections(void);
 	
-	/// data type for a pool of TCP connections
-	typedef std::set<TCPConnectionPtr>		ConnectionPool;
+	/**
+	 * returns a new connection object, reusing a recycled one if possible,
+	 * and tells the scheduler that the connection uses its I/O service
+	 *
+	 * @param io_service asio service to associate with the connection
+	 * @param service_num number of the service (see PionScheduler::getConnectionService())
+	 */
+	TCPConnectionPtr createConnection(boost::asio::io_service& io_service,
+									  boost::uint32_t service_num);
+	
+	/// creates the acceptors and binds them to the server's endpoint
+	void openAcceptors(void);
+	
+	/// returns the number of acceptors that should be opened by start()
+	std::size_t getAcceptorsToOpen(void) const;
+	
+	///
+	/// ConnectionPool: sharded registry of the connections managed by a server.
+	/// Connections are tracked using weak references so that objects which are
+	/// released without calling finish() are closed immediately; their entries
+	/// are swept lazily.
+	///
+	class ConnectionPool :
+		private boost::noncopyable
+	{
+	public:
+		
+		/// constructs an empty connection pool
+		ConnectionPool(void) : m_size(0) {}
+		
+		/// adds a connection to the pool (amortized constant time)
+		void add(const TCPConnectionPtr& tcp_conn);
+		
+		/// removes a connection from the pool; returns false if it was not found
+		bool remove(const TCPConnectionPtr& tcp_conn);
+		
+		/// closes every connection in the pool
+		void closeAll(void);
+		
+		/// removes connections that were released without being finished
+		/// and returns the number of entries that were removed
+		std::size_t prune(void);
+		
+		/// returns the number of connections in the pool (including any
+		/// released connections that have not yet been pruned)
+		inline std::size_t size(void) const { return static_cast<std::size_t>(m_size); }
+		
+		/// returns true if the pool is empty
+		inline bool empty(void) const { return m_size == 0; }
+		
+	private:
+		
+		/// number of independently locked shards (must be a power of two)
+		enum { NUM_SHARDS = 16 };
+		
+		/// minimum size a shard must grow to before it is swept
+		enum { MIN_SWEEP_SIZE = 32 };
+		
+		/// data type for a map of connections, indexed by address
+		typedef PION_HASH_MAP<TCPConnection*, boost::weak_ptr<TCPConnection>,
+			PION_HASH(TCPConnection*) >		ConnectionMap;
+		
+		/// a subset of the pool protected by its own mutex
+		struct Shard {
+			Shard(void) : m_sweep_size(MIN_SWEEP_SIZE) {}
+			/// mutex used to protect the shard's connections
+			boost::mutex		m_mutex;
+			/// connections assigned to the shard
+			ConnectionMap		m_connections;
+			/// the shard is swept when it grows larger than this
+			std::size_t			m_sweep_size;
+		};
+		
+		/// returns the shard that a connection belongs to (the low address
+		/// bits are always zero for heap objects, so they are shifted out)
+		inline Shard& getShard(const TCPConnection *ptr) {
+			const std::size_t n = reinterpret_cast<std::size_t>(ptr) >> 4;
+			return m_shards[(n ^ (n >> 8)) & (NUM_SHARDS - 1)];
+		}
+		
+		/**
+		 * removes expired entries from a shard (assumes the shard is locked)
+		 *
+		 * @return std::size_t number of entries that were removed
+		 */
+		std::size_t sweep(Shard& shard);
+		
+		
+		/// shards that make up the pool
+		Shard						m_shards[NUM_SHARDS];
+		
+		/// total number of entries in all shards
+		boost::detail::atomic_count	m_size;
+	};
+	
+	///
+	/// ConnectionRecycler: keeps finished connection objects (and their read
+	/// buffers) so that they can be reused instead of being reallocated.
+	/// Objects are kept in a separate free list for each I/O service, since
+	/// sockets cannot be moved between services.  Each free list has its own
+	/// mutex, so connections that use different services do not contend.
+	///
+	class ConnectionRecycler :
+		private boost::noncopyable
+	{
+	public:
+		
+		/**
+		 * constructs a new connection recycler
+		 *
+		 * @param max_size maximum number of recycled objects to keep
+		 * @param scheduler the scheduler to notify when connections are released
+		 */
+		ConnectionRecycler(std::size_t max_size, PionScheduler& scheduler)
+			: m_max_size(max_size), m_size(0),
+			m_is_enabled(false), m_scheduler_ptr(&scheduler)
+		{}
+		
+		/// virtual destructor deletes all recycled objects
+		virtual ~ConnectionRecycler() { clear(); }
+		
+		/**
+		 * returns a recycled connection object for an I/O service
+		 *
+		 * @param io_service the I/O service that the connection must use
+		 * @param service_num number of the service (see PionScheduler::getConnectionService())
+		 * @return TCPConnection* pointer to a recycled object, or NULL if none are available
+		 */
+		TCPConnection *acquire(boost::asio::io_service& io_service, boost::uint32_t service_num);
+		
+		/**
+		 * resets and recycles a connection object, or deletes it if the
+		 * recycler is full or disabled.  Every connection created by the server
+		 * is released here, so this is also where the scheduler is told that
+		 * it no longer uses its I/O service.
+		 *
+		 * @param conn_ptr the connection object to release
+		 * @param service_num number of the connection's I/O service
+		 *                    (see PionScheduler::getConnectionService())
+		 */
+		void release(TCPConnection *conn_ptr, boost::uint32_t service_num);
+		
+		/// sets the scheduler to notify when connections are released (or NULL)
+		void setScheduler(PionScheduler *scheduler_ptr);
+		
+		/// deletes all recycled objects
+		void clear(void);
+		
+		/// enables or disables recycling of connection objects
+		void setEnabled(bool b);
+		
+		/// sets the maximum number of recycled objects to keep
+		void setMaxSize(std::size_t n);
+		
+		/// returns the maximum number of recycled objects to keep
+		inline std::size_t getMaxSize(void) const { return m_max_size; }
+		
+		/// returns the number of successful acquire() calls
+		boost::uint64_t getHits(void) const;
+		
+		/// returns the number of unsuccessful acquire() calls
+		boost::uint64_t getMisses(void) const;
+		
+	private:
+		
+		/// number of independently locked free lists (services with the
+		/// same number modulo this share a lock)
+		enum { NUM_FREE_LISTS = 32 };
+		
+		/// data type for a list of recycled objects
+		typedef std::vector<TCPConnection*>		ObjectList;
+		
+		/// data type for object lists indexed by I/O service
+		typedef PION_HASH_MAP<boost::asio::io_service*, ObjectList,
+			PION_HASH(boost::asio::io_service*) >	ObjectListMap;
+		
+		/// recycled objects for the I/O services that share a lock
+		struct FreeList {
+			FreeList(void) : m_hits(0), m_misses(0) {}
+			/// mutex used to protect the free list
+			mutable boost::mutex	m_mutex;
+			/// recycled objects for each I/O service
+			ObjectListMap			m_objects;
+			/// number of successful acquire() calls
+			boost::uint64_t			m_hits;
+			/// number of unsuccessful acquire() calls
+			boost::uint64_t			m_misses;
+		};
+		
+		/// returns the free list used for an I/O service
+		inline FreeList& getFreeList(boost::uint32_t service_num) {
+			return m_free_lists[service_num % NUM_FREE_LISTS];
+		}
+		
+		/// locks every free list, so that the settings may be changed
+		inline void lockFreeLists(void) {
+			for (std::size_t n = 0; n < NUM_FREE_LISTS; ++n)
+				m_free_lists[n].m_mutex.lock();
+		}
+		
+		/// unlocks every free list (see lockFreeLists())
+		inline void unlockFreeLists(void) {
+			for (std::size_t n = NUM_FREE_LISTS; n > 0; --n)
+				m_free_lists[n - 1].m_mutex.unlock();
+		}
+		
+		
+		/// free lists for the I/O services; the settings below are only
+		/// changed while every free list is locked, and are read while
+		/// holding any one of their locks
+		FreeList						m_free_lists[NUM_FREE_LISTS];
+		
+		/// maximum number of recycled objects to keep
+		std::size_t						m_max_size;
+		
+		/// number of recycled objects currently kept
+		boost::detail::atomic_count		m_size;
+		
+		/// true if released objects should be recycled
+		bool							m_is_enabled;
+		
+		/// the scheduler to notify when connections are released (may be NULL)
+		PionScheduler *					m_scheduler_ptr;
+	};
+	
+	/// data type for a pointer to a connection recycler
+	typedef boost::shared_ptr<ConnectionRecycler>	ConnectionRecyclerPtr;
+	
+	///
+	/// ConnectionDeleter: returns connection objects to a recycler when they
+	/// are released (holds a reference so that the recycler outlives them).
+	/// It also keeps the number of the connection's I/O service.
+	///
+	class ConnectionDeleter {
+	public:
+		ConnectionDeleter(const ConnectionRecyclerPtr& recycler_ptr, boost::uint32_t service_num)
+			: m_recycler_ptr(recycler_ptr), m_service_num(service_num)
+		{}
+		inline void operator()(TCPConnection *conn_ptr) {
+			m_recycler_ptr->release(conn_ptr, m_service_num);
+		}
+	private:
+		ConnectionRecyclerPtr			m_recycler_ptr;
+		boost::uint32_t					m_service_num;
+	};
+	
+	/// data type for a listening socket and the I/O service that it uses
+	/// (m_service_num identifies the service to the scheduler, and m_mutex
+	/// keeps stop() from closing the socket while an accept is started)
+	struct Acceptor {
+		Acceptor(boost::asio::io_service& io_service, boost::uint32_t service_num)
+			: m_service(io_service), m_service_num(service_num), m_acceptor(io_service)
+		{}
+		boost::asio::io_service &			m_service;
+		boost::uint32_t						m_service_num;
+		boost::asio::ip::tcp::acceptor		m_acceptor;
+		boost::mutex						m_mutex;
+	};
+	
+	/// data type for a collection of listening sockets
+	typedef std::vector<boost::shared_ptr<Acceptor> >	AcceptorPool;
 	
 	
 	/// the default PionScheduler object used to manage worker threads
@@ -199,8 +548,8 @@ private:
 	/// reference to the active PionScheduler object used to manage worker threads
 	PionScheduler &							m_active_scheduler;
 	
-	/// manages async TCP connections
-	boost::asio::ip::tcp::acceptor			m_tcp_acceptor;
+	/// listening sockets used to accept new TCP connections
+	AcceptorPool							m_acceptors;
 
 	/// context used for SSL configuration
 	TCPConnection::SSLContext				m_ssl_context;
@@ -212,16 +561,35 @@ private:
 	boost::condition						m_no_more_connections;
 
 	/// pool of active connections associated with this server 
-	ConnectionPool							m_conn_pool;
+	mutable ConnectionPool					m_conn_pool;
+	
+	/// number of connections in the pool that are waiting to be accepted
+	boost::detail::atomic_count				m_pending_accepts;
+	
+	/// finished connection objects kept for reuse
+	ConnectionRecyclerPtr					m_conn_recycler;
 
 	/// tcp endpoint used to listen for new connections
 	boost::asio::ip::tcp::endpoint			m_endpoint;
 
+	/// number of listening sockets to open (zero = one per scheduler thread)
+	unsigned int							m_num_acceptors;
+
+	/// initial size of the read buffer used by new connections
+	std::size_t								m_read_buffer_size;
+
+	/// size that read buffers may grow to (adaptive mode if > m_read_buffer_size)
+	std::size_t								m_max_read_buffer_size;
+
+	/// socket options applied to listening sockets and new connections
+	TCPSocketPolicy							m_socket_policy;
+
 	/// true if the server uses SSL to encrypt connections
 	bool									m_ssl_flag;
 
-	/// set to true when the server is listening for new connections
-	bool									m_is_listening;
+	/// nonzero when the server is listening for new connections (only changed
+	/// by start() and stop() with m_mutex locked, but read without the lock)
+	boost::detail::atomic_count				m_is_listening;
 
 	/// mutex to make class thread-safe
 	mutable boost::mutex					m_mutex;
@@ -0,0 +1,110 @@
+// ------------------------------------------------------------------
+// pion-net: a C++ framework for building lightweight HTTP interfaces
+// ------------------------------------------------------------------
+// Copyright (C) 2007-2011 Atomic Labs, Inc.  (http://www.atomiclabs.com)
+//
+// Distributed under the Boost Software License, Version 1.0.
+// See http://www.boost.org/LICENSE_1_0.txt
+//
+
+#ifndef __PION_TCPSOCKETOPTIONS_HEADER__
+#define __PION_TCPSOCKETOPTIONS_HEADER__
+
+#include <cstddef>
+#include <stdexcept>
+#include <boost/asio.hpp>
+#include <pion/PionConfig.hpp>
+
+
+namespace pion {	// begin namespace pion
+namespace net {		// begin namespace net (Pion Network Library)
+
+
+///
+/// IntegerSocketOption: an integer socket option that is not provided by
+/// Boost.Asio, implementing its GettableSocketOption and SettableSocketOption
+/// requirements
+///
+template <int Level, int Name>
+class IntegerSocketOption {
+public:
+
+	/// default constructor: the option's value is zero
+	IntegerSocketOption(void) : m_value(0) {}
+
+	/// constructs an option with the given value
+	explicit IntegerSocketOption(int v) : m_value(v) {}
+
+	/// returns the value of the option
+	inline int value(void) const { return m_value; }
+
+	/// returns the protocol level of the option
+	template <typename Protocol>
+	inline int level(const Protocol&) const { return Level; }
+
+	/// returns the name of the option
+	template <typename Protocol>
+	inline int name(const Protocol&) const { return Name; }
+
+	/// returns a pointer to the option's data
+	template <typename Protocol>
+	inline int *data(const Protocol&) { return &m_value; }
+
+	/// returns a pointer to the option's data
+	template <typename Protocol>
+	inline const int *data(const Protocol&) const { return &m_value; }
+
+	/// returns the size of the option's data
+	template <typename Protocol>
+	inline std::size_t size(const Protocol&) const { return sizeof(m_value); }
+
+	/// checks the size of the data returned by getsockopt()
+	template <typename Protocol>
+	inline void resize(const Protocol&, std::size_t s) {
+		if (s != sizeof(m_value))
+			throw std::length_error("integer socket option resize");
+	}
+
+protected:
+
+	/// the option's value
+	int		m_value;
+};
+
+
+///
+/// BooleanSocketOption: a boolean socket option that is not provided by
+/// Boost.Asio (stored as an integer, which is what the socket calls expect)
+///
+template <int Level, int Name>
+class BooleanSocketOption :
+	public IntegerSocketOption<Level, Name>
+{
+public:
+
+	/// default constructor: the option is disabled
+	BooleanSocketOption(void) {}
+
+	/// constructs an option that is enabled or disabled
+	explicit BooleanSocketOption(bool b)
+		: IntegerSocketOption<Level, Name>(b ? 1 : 0) {}
+
+	/// returns true if the option is enabled
+	inline bool value(void) const { return this->m_value != 0; }
+
+	/// checks the size of the data returned by getsockopt(), which may be a
+	/// single byte on some platforms
+	template <typename Protocol>
+	inline void resize(const Protocol& p, std::size_t s) {
+		if (s == sizeof(char))
+			this->m_value = (*reinterpret_cast<unsigned char*>(&this->m_value) ? 1 : 0);
+		else
+			IntegerSocketOption<Level, Name>::resize(p, s);
+	}
+};
+
+
+}	// end namespace net
+}	// end namespace pion
+
+#endif
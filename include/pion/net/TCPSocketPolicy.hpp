@@ -0,0 +1,203 @@
+// ------------------------------------------------------------------
+// pion-net: a C++ framework for building lightweight HTTP interfaces
+// ------------------------------------------------------------------
+// Copyright (C) 2007-2011 Atomic Labs, Inc.  (http://www.atomiclabs.com)
+//
+// Distributed under the Boost Software License, Version 1.0.
+// See http://www.boost.org/LICENSE_1_0.txt
+//
+
+#ifndef __PION_TCPSOCKETPOLICY_HEADER__
+#define __PION_TCPSOCKETPOLICY_HEADER__
+
+#include <string>
+#include <boost/asio.hpp>
+#include <pion/PionConfig.hpp>
+#include <pion/PionException.hpp>
+#include <pion/net/TCPConnection.hpp>
+
+
+namespace pion {	// begin namespace pion
+namespace net {		// begin namespace net (Pion Network Library)
+
+
+///
+/// TCPSocketPolicy: socket options that a TCPServer applies to its listening
+/// sockets and to each connection that it accepts.  Every option is off (or
+/// left at the system default) unless it is set.  Options that the platform
+/// does not support are ignored.
+///
+class PION_NET_API TCPSocketPolicy
+{
+public:
+
+	/// exception thrown if an option name or value is not recognized
+	class BadOptionException : public PionException {
+	public:
+		BadOptionException(const std::string& option)
+			: PionException("Invalid socket option: ", option) {}
+	};
+
+
+	/// constructs a policy that does not change any socket options
+	TCPSocketPolicy(void)
+		: m_no_delay(false), m_cork_headers(false), m_quick_ack(false),
+		m_send_buffer_size(0), m_receive_buffer_size(0), m_keep_alive(false),
+		m_keep_alive_idle(0), m_keep_alive_interval(0), m_keep_alive_count(0),
+		m_defer_accept(0)
+	{}
+
+	/**
+	 * sets an option using its name, as used by configuration files:
+	 *
+	 * nodelay=BOOL  :  disables Nagle's algorithm (TCP_NODELAY)
+	 * cork=BOOL  :  corks chunked messages from their headers until the final
+	 *               chunk, so that headers are sent in the same segments as the
+	 *               chunks that follow them
+	 * quickack=BOOL  :  acknowledges the first data received right away
+	 *                   (TCP_QUICKACK)
+	 * sndbuf=BYTES  :  size of the socket send buffer (SO_SNDBUF)
+	 * rcvbuf=BYTES  :  size of the socket receive buffer (SO_RCVBUF)
+	 * keepalive=BOOL  :  sends keepalive probes on idle connections (SO_KEEPALIVE)
+	 * keepidle=SECONDS  :  idle time before the first probe (TCP_KEEPIDLE)
+	 * keepintvl=SECONDS  :  time between probes (TCP_KEEPINTVL)
+	 * keepcnt=COUNT  :  probes sent before the connection is dropped (TCP_KEEPCNT)
+	 * deferaccept=SECONDS  :  accepts connections only once data arrives
+	 *                         (TCP_DEFER_ACCEPT)
+	 *
+	 * BOOL values may be true, false, yes, no, on, off, 1 or 0.  Numbers equal
+	 * to zero leave the system default in place.
+	 *
+	 * @param name the name of the option
+	 * @param value the value to set the option to
+	 */
+	void setOption(const std::string& name, const std::string& value);
+
+	/**
+	 * applies the options for listening sockets to an acceptor; this must be
+	 * called before the acceptor starts listening
+	 *
+	 * @param tcp_acceptor the acceptor to configure
+	 */
+	void applyToAcceptor(boost::asio::ip::tcp::acceptor& tcp_acceptor) const;
+
+	/**
+	 * applies the options for connections to a newly accepted connection
+	 *
+	 * @param tcp_conn the connection to configure
+	 * @param ec contains the error code of the first option that could not be set
+	 */
+	void applyToConnection(TCPConnection& tcp_conn, boost::system::error_code& ec) const;
+
+	/// sets whether Nagle's algorithm is disabled (TCP_NODELAY)
+	inline void setNoDelay(bool b) { m_no_delay = b; }
+
+	/// returns true if Nagle's algorithm is disabled (TCP_NODELAY)
+	inline bool getNoDelay(void) const { return m_no_delay; }
+
+	/// sets whether chunked messages are corked from their headers until the
+	/// final chunk (TCP_CORK or TCP_NOPUSH).  Messages sent in a single write
+	/// are never corked.
+	inline void setCorkHeaders(bool b) { m_cork_headers = b; }
+
+	/// returns true if chunked messages are corked from their headers until
+	/// the final chunk (TCP_CORK or TCP_NOPUSH)
+	inline bool getCorkHeaders(void) const { return m_cork_headers; }
+
+	/**
+	 * sets whether TCP_QUICKACK is set when a connection is accepted (Linux
+	 * only).  The kernel clears this flag again by itself, so it only covers
+	 * the first round trip; later acknowledgements may still be delayed.
+	 *
+	 * @param b true to set TCP_QUICKACK on new connections
+	 */
+	inline void setQuickAck(bool b) { m_quick_ack = b; }
+
+	/// returns true if TCP_QUICKACK is set on new connections
+	inline bool getQuickAck(void) const { return m_quick_ack; }
+
+	/// sets the size of the socket send buffer (zero uses the system default)
+	inline void setSendBufferSize(int n) { m_send_buffer_size = n; }
+
+	/// returns the size of the socket send buffer (zero uses the system default)
+	inline int getSendBufferSize(void) const { return m_send_buffer_size; }
+
+	/// sets the size of the socket receive buffer (zero uses the system default)
+	inline void setReceiveBufferSize(int n) { m_receive_buffer_size = n; }
+
+	/// returns the size of the socket receive buffer (zero uses the system default)
+	inline int getReceiveBufferSize(void) const { return m_receive_buffer_size; }
+
+	/**
+	 * sets whether keepalive probes are sent on idle connections
+	 *
+	 * @param b true to send keepalive probes (SO_KEEPALIVE)
+	 * @param idle seconds that a connection is idle before the first probe
+	 * @param interval seconds between probes
+	 * @param count number of probes sent before the connection is dropped
+	 */
+	inline void setKeepAlive(bool b, int idle = 0, int interval = 0, int count = 0) {
+		m_keep_alive = b;
+		m_keep_alive_idle = idle;
+		m_keep_alive_interval = interval;
+		m_keep_alive_count = count;
+	}
+
+	/// returns true if keepalive probes are sent on idle connections
+	inline bool getKeepAlive(void) const { return m_keep_alive; }
+
+	/// returns the seconds that a connection is idle before the first probe
+	inline int getKeepAliveIdle(void) const { return m_keep_alive_idle; }
+
+	/// returns the seconds between keepalive probes
+	inline int getKeepAliveInterval(void) const { return m_keep_alive_interval; }
+
+	/// returns the number of probes sent before the connection is dropped
+	inline int getKeepAliveCount(void) const { return m_keep_alive_count; }
+
+	/// sets the seconds that accepting a connection is deferred until data
+	/// arrives (TCP_DEFER_ACCEPT, Linux only; zero disables)
+	inline void setDeferAccept(int n) { m_defer_accept = n; }
+
+	/// returns the seconds that accepting a connection is deferred until data arrives
+	inline int getDeferAccept(void) const { return m_defer_accept; }
+
+
+private:
+
+	/// true if Nagle's algorithm is disabled
+	bool			m_no_delay;
+
+	/// true if chunked messages are corked from their headers until the final chunk
+	bool			m_cork_headers;
+
+	/// true if TCP_QUICKACK is set on new connections
+	bool			m_quick_ack;
+
+	/// size of the socket send buffer (zero uses the system default)
+	int				m_send_buffer_size;
+
+	/// size of the socket receive buffer (zero uses the system default)
+	int				m_receive_buffer_size;
+
+	/// true if keepalive probes are sent on idle connections
+	bool			m_keep_alive;
+
+	/// seconds that a connection is idle before the first keepalive probe
+	int				m_keep_alive_idle;
+
+	/// seconds between keepalive probes
+	int				m_keep_alive_interval;
+
+	/// number of keepalive probes sent before the connection is dropped
+	int				m_keep_alive_count;
+
+	/// seconds that accepting a connection is deferred until data arrives
+	int				m_defer_accept;
+};
+
+
+}	// end namespace net
+}	// end namespace pion
+
+#endif
@@ -137,6 +137,14 @@ protected:
 	 * @return int_type the next character available for reading, or eof() if there was an error
 	 */
 	virtual int_type underflow(void) {
+		// the connection may have replaced its read buffer since the last read
+		// (see TCPConnection::growReadBuffer()); if so, the get area is stale
+		char_type *read_buf = m_conn_ptr->getReadBuffer().c_array();
+		if (read_buf != m_read_buf) {
+			m_read_buf = read_buf;
+			setg(m_read_buf+PUT_BACK_MAX, m_read_buf+PUT_BACK_MAX, m_read_buf+PUT_BACK_MAX);
+		}
+		
 		// first check if we still have bytes available in the read buffer
 		if (gptr() < egptr())
 			return traits_type::to_int_type(*gptr());
@@ -156,7 +164,7 @@ protected:
 		boost::mutex::scoped_lock async_lock(m_async_mutex);
 		m_bytes_transferred = 0;
 		m_conn_ptr->async_read_some(boost::asio::buffer(m_read_buf+PUT_BACK_MAX,
-														TCPConnection::READ_BUFFER_SIZE-PUT_BACK_MAX),
+														m_conn_ptr->getReadBuffer().size()-PUT_BACK_MAX),
 									boost::bind(&TCPStreamBuffer::operationFinished, this,
 												boost::asio::placeholders::error,
 												boost::asio::placeholders::bytes_transferred));
@@ -309,7 +317,8 @@ private:
 	/// the number of bytes transferred by the last asynchronous operation
 	std::size_t					m_bytes_transferred;
 	
-	/// pointer to the start of the TCP connection's read buffer
+	/// pointer to the start of the read buffer that the get area points into
+	/// (checked against the connection's read buffer by underflow())
 	char_type *					m_read_buf;
 			 
 	/// buffer used to write output
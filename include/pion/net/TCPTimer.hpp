@@ -10,9 +10,12 @@
 #ifndef __PION_TCPTIMER_HEADER__
 #define __PION_TCPTIMER_HEADER__
 
+#include <vector>
 #include <boost/asio.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
 #include <boost/shared_ptr.hpp>
-#include <boost/enable_shared_from_this.hpp>
+#include <boost/weak_ptr.hpp>
 #include <boost/thread/mutex.hpp>
 #include <pion/PionConfig.hpp>
 #include <pion/net/TCPConnection.hpp>
@@ -22,11 +25,20 @@ namespace pion {	// begin namespace pion
 namespace net {		// begin namespace net (Pion Network Library)
 
 
+// forward declaration of the timing wheel service
+class TCPTimerService;
+
+
 ///
-/// TCPTimer: helper class used to time-out TCP connections
+/// TCPTimer: closes a TCP connection if an operation does not finish within
+/// a number of seconds.  This is a lightweight handle onto the timing wheel
+/// of the connection's io_service; starting and cancelling the timer take
+/// constant time and do not allocate memory.  The timer is cancelled when
+/// the handle is destroyed.  The timer does not keep the connection alive,
+/// so a connection may own the timer that monitors it.
 ///
-class TCPTimer
-	: public boost::enable_shared_from_this<TCPTimer>
+class TCPTimer :
+	private boost::noncopyable
 {
 public:
 
@@ -37,8 +49,12 @@ public:
 	 */
 	TCPTimer(TCPConnectionPtr& conn_ptr);
 
+	/// virtual destructor cancels the timer
+	virtual ~TCPTimer() { cancel(); }
+
 	/**
-	 * starts a timer for closing a TCP connection
+	 * starts a timer for closing a TCP connection (restarts the timer
+	 * if it is already active)
 	 *
 	 * @param seconds number of seconds before the timeout triggers
 	 */
@@ -50,33 +66,122 @@ public:
 
 private:
 
+	/// the timing wheel service manages the timer's links and expiration
+	friend class TCPTimerService;
+
+
+	/// the TCP connection that is being monitored
+	boost::weak_ptr<TCPConnection>			m_conn_ptr;
+
+	/// timing wheel service for the connection's io_service
+	TCPTimerService &						m_service;
+
+	/// previous timer in the same wheel slot
+	TCPTimer *								m_prev;
+
+	/// next timer in the same wheel slot
+	TCPTimer *								m_next;
+
+	/// the wheel tick at which the timer expires
+	boost::uint64_t							m_expires;
+
+	/// true if the timer is linked into the timing wheel
+	bool									m_timer_active;
+};
+
+
+/// data type for a TCPTimer pointer
+typedef boost::shared_ptr<TCPTimer>		TCPTimerPtr;
+
+
+///
+/// TCPTimerService: hashed timing wheel used to track the deadlines of all
+/// the TCPTimer objects for an io_service.  A single deadline_timer advances
+/// the wheel while any timers are active.
+///
+class TCPTimerService :
+	public boost::asio::io_service::service
+{
+public:
+
+	/// unique identifier for the service
+	static boost::asio::io_service::id		id;
+
+	/// number of milliseconds between each tick of the wheel
+	static const boost::uint32_t			TICK_MILLISECONDS;
+
+
+	/**
+	 * constructs a new timing wheel service
+	 *
+	 * @param io_service the io_service that owns the service
+	 */
+	explicit TCPTimerService(boost::asio::io_service& io_service);
+
+	/// virtual destructor
+	virtual ~TCPTimerService() {}
+
+	/**
+	 * links a timer into the wheel (unlinks it first if it is already active)
+	 *
+	 * @param timer the timer to link
+	 * @param seconds number of seconds before the timer expires
+	 */
+	void add(TCPTimer& timer, const boost::uint32_t seconds);
+
+	/// unlinks a timer from the wheel if it is active
+	void remove(TCPTimer& timer);
+
+	/// returns the number of active timers
+	inline std::size_t getNumTimers(void) const {
+		boost::mutex::scoped_lock wheel_lock(m_mutex);
+		return m_num_timers;
+	}
+
+
+private:
+
+	/// number of slots in the wheel (must be a power of two)
+	enum { NUM_SLOTS = 512 };
+
+	/// unlinks all timers when the io_service is shut down
+	virtual void shutdown_service(void);
+
+	/// unlinks a timer (assumes the wheel is locked)
+	void unlink(TCPTimer& timer);
+
 	/**
-	 * Callback handler for the deadline timer
+	 * advances the wheel by one tick and closes connections for expired timers
 	 *
 	 * @param ec deadline timer error status code
 	 */
-	void timerCallback(const boost::system::error_code& ec);
+	void tick(const boost::system::error_code& ec);
 
 
-	/// pointer to the TCP connection that is being monitored
-	TCPConnectionPtr						m_conn_ptr;
+	/// deadline timer used to advance the wheel
+	boost::asio::deadline_timer				m_tick_timer;
 
-	/// deadline timer used to timeout TCP operations
-	boost::asio::deadline_timer				m_timer;
-	
-	/// mutex used to synchronize the TCP connection timer
-	boost::mutex							m_mutex;
+	/// first timer linked into each slot of the wheel
+	TCPTimer *								m_slots[NUM_SLOTS];
 
-	/// true if the deadline timer is active
-	bool									m_timer_active;	
+	/// number of ticks since the wheel was created
+	boost::uint64_t							m_current_tick;
 
-	/// true if the timer was cancelled (operation completed)
-	bool									m_was_cancelled;	
-};
+	/// number of timers linked into the wheel
+	std::size_t								m_num_timers;
 
+	/// true if the deadline timer is advancing the wheel
+	bool									m_is_ticking;
 
-/// shared pointer to a TCPTimer object
-typedef boost::shared_ptr<TCPTimer>		TCPTimerPtr;
+	/// true after the io_service has been shut down
+	bool									m_is_shutdown;
+
+	/// connections for expired timers (re-used by each tick)
+	std::vector<TCPConnectionPtr>			m_expired;
+
+	/// mutex used to synchronize the timing wheel
+	mutable boost::mutex					m_mutex;
+};
 
 
 }	// end namespace net
@@ -155,6 +155,7 @@ public:
 	 * path VALUE  :  adds a directory to the web service search path
 	 * service RESOURCE FILE  :  loads web service bound to RESOURCE from FILE
 	 * option RESOURCE NAME=VALUE  :  sets web service option NAME to VALUE
+	 * socket NAME=VALUE  :  sets socket option NAME to VALUE (see TCPSocketPolicy)
 	 *
 	 * Blank lines or lines that begin with # are ignored as comments.
 	 *
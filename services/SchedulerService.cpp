@@ -0,0 +1,85 @@
+// ------------------------------------------------------------------
+// pion-net: a C++ framework for building lightweight HTTP interfaces
+// ------------------------------------------------------------------
+// Copyright (C) 2007-2008 Atomic Labs, Inc.  (http://www.atomiclabs.com)
+//
+// Distributed under the Boost Software License, Version 1.0.
+// See http://www.boost.org/LICENSE_1_0.txt
+//
+
+#include "SchedulerService.hpp"
+#include <pion/PionScheduler.hpp>
+#include <pion/net/HTTPResponseWriter.hpp>
+
+using namespace pion;
+using namespace pion::net;
+
+namespace pion {		// begin namespace pion
+namespace plugins {		// begin namespace plugins
+
+	
+// SchedulerService member functions
+
+/// handles requests for SchedulerService
+void SchedulerService::operator()(HTTPRequestPtr& request, TCPConnectionPtr& tcp_conn)
+{
+	// Set Content-type to "text/plain" (plain ascii text)
+	HTTPResponseWriterPtr writer(HTTPResponseWriter::create(tcp_conn, *request,
+															boost::bind(&TCPConnection::finish, tcp_conn)));
+	writer->getResponse().setContentType(HTTPTypes::CONTENT_TYPE_TEXT);
+
+	// requests are handled by the scheduler's own worker threads
+	PionMultiThreadScheduler *scheduler_ptr = PionMultiThreadScheduler::getCurrentScheduler();
+	if (scheduler_ptr == NULL) {
+		writer << "Scheduler statistics are not available." << HTTPTypes::STRING_CRLF;
+		writer->send();
+		return;
+	}
+
+	writer << "Scheduler threads: " << scheduler_ptr->getNumThreads() << HTTPTypes::STRING_CRLF
+		<< "Queued work: " << scheduler_ptr->getQueuedWork() << HTTPTypes::STRING_CRLF;
+	if (! scheduler_ptr->getCollectStats())
+		writer << "Statistics are not being collected." << HTTPTypes::STRING_CRLF;
+
+	for (boost::uint32_t n = 0; n < scheduler_ptr->getNumThreads(); ++n) {
+		const PionMultiThreadScheduler::ThreadStats stats(scheduler_ptr->getThreadStats(n));
+		const boost::uint64_t total_usec = stats.busy_usec + stats.idle_usec;
+		writer << HTTPTypes::STRING_CRLF << "Thread " << n << ": handlers=" << stats.handlers
+			<< " busy_usec=" << stats.busy_usec << " idle_usec=" << stats.idle_usec
+			<< " utilization=" << (total_usec == 0 ? 0 : stats.busy_usec * 100 / total_usec) << '%'
+			<< " long_handlers=" << stats.long_handlers
+			<< " max_handler_usec=" << stats.max_handler_usec << HTTPTypes::STRING_CRLF;
+		
+		// handler latency histogram (empty buckets are skipped)
+		writer << "Thread " << n << " latency:";
+		for (unsigned int i = 0; i < PionMultiThreadScheduler::NUM_LATENCY_BUCKETS; ++i) {
+			if (stats.latency[i] == 0)
+				continue;
+			if (i == PionMultiThreadScheduler::NUM_LATENCY_BUCKETS - 1)
+				writer << " >=" << (static_cast<boost::uint64_t>(1) << (i - 1));
+			else
+				writer << " <" << (static_cast<boost::uint64_t>(1) << i);
+			writer << "us=" << stats.latency[i];
+		}
+		writer << HTTPTypes::STRING_CRLF;
+	}
+
+	writer->send();
+}
+
+
+}	// end namespace plugins
+}	// end namespace pion
+
+
+/// creates new SchedulerService objects
+extern "C" PION_SERVICE_API pion::plugins::SchedulerService *pion_create_SchedulerService(void)
+{
+	return new pion::plugins::SchedulerService();
+}
+
+/// destroys SchedulerService objects
+extern "C" PION_SERVICE_API void pion_destroy_SchedulerService(pion::plugins::SchedulerService *service_ptr)
+{
+	delete service_ptr;
+}
@@ -56,7 +56,7 @@ bool HTTPBasicAuth::handleRequest(HTTPRequestPtr& request, TCPConnectionPtr& tcp
 	}
 	
 	// if we are here, we need to check if access authorized...
-	std::string authorization = request->getHeader(HTTPTypes::HEADER_AUTHORIZATION);
+	std::string authorization(request->getHeaderRef(HTTPTypes::HEADER_AUTHORIZATION).str());
 	if (!authorization.empty()) {
 		std::string credentials;
 		if (parseAuthorization(authorization, credentials)) {
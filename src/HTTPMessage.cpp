@@ -10,7 +10,6 @@
 #include <iostream>
 #include <algorithm>
 #include <boost/asio.hpp>
-#include <boost/regex.hpp>
 #include <boost/logic/tribool.hpp>
 #include <pion/net/HTTPMessage.hpp>
 #include <pion/net/HTTPRequest.hpp>
@@ -21,11 +20,6 @@
 namespace pion {	// begin namespace pion
 namespace net {		// begin namespace net (Pion Network Library)
 
-// static members of HTTPMessage
-
-const boost::regex		HTTPMessage::REGEX_ICASE_CHUNKED(".*chunked.*", boost::regex::icase);
-
-
 // HTTPMessage member functions
 
 std::size_t HTTPMessage::send(TCPConnection& tcp_conn,
@@ -81,6 +75,8 @@ std::size_t HTTPMessage::receive(TCPConnection& tcp_conn,
 		if (! boost::indeterminate(parse_result)) break;
 
 		// read more bytes from the connection
+		// (grows the read buffer first if the last read filled it)
+		tcp_conn.growReadBuffer(last_bytes_read);
 		last_bytes_read = tcp_conn.read_some(ec);
 		if (ec || last_bytes_read == 0) {
 			if (http_parser.checkPrematureEOF(*this)) {
@@ -203,12 +199,63 @@ std::size_t HTTPMessage::read(std::istream& in,
 	return (http_parser.getTotalBytesRead());
 }
 
+void HTTPMessage::parseCookieHeaders(CookieParams& cookie_params) const
+{
+	const std::string& header_name(m_set_cookies_pending ? HEADER_SET_COOKIE : HEADER_COOKIE);
+	// finding a well-known header is O(1), so this is cheap when there are none
+	if (! hasHeader(header_name))
+		return;
+
+	PionLogger logger(PION_GET_LOGGER("pion.net.HTTPMessage"));
+
+	if (! m_header_refs.empty()) {
+		// headers still refer to the read buffer (only happens if all of them do)
+		for (HeaderRefs::const_iterator i = m_header_refs.begin(); i != m_header_refs.end(); ++i) {
+			if (i->first.equalsNoCase(header_name)
+				&& ! HTTPParser::parseCookieHeader(cookie_params, i->second.data(),
+												   i->second.size(), m_set_cookies_pending))
+			{
+				PION_LOG_WARN(logger, header_name << " header parsing failed");
+			}
+		}
+		return;
+	}
+
+	std::pair<Headers::const_iterator, Headers::const_iterator>
+		cookie_pair = m_headers.equal_range(header_name);
+	for (Headers::const_iterator cookie_iterator = cookie_pair.first;
+		 cookie_iterator != m_headers.end() && cookie_iterator != cookie_pair.second;
+		 ++cookie_iterator)
+	{
+		if (! HTTPParser::parseCookieHeader(cookie_params, cookie_iterator->second,
+											m_set_cookies_pending))
+			PION_LOG_WARN(logger, header_name << " header parsing failed");
+	}
+}
+
+void HTTPRequest::parseQueryParams(QueryParams& query_params) const
+{
+	if (m_query_string_pending) {
+		if (! HTTPParser::parseURLEncoded(query_params, m_query_string.c_str(),
+										  m_query_string.size()))
+		{
+			PionLogger logger(PION_GET_LOGGER("pion.net.HTTPRequest"));
+			PION_LOG_WARN(logger, "Request query string parsing failed (URI)");
+		}
+	}
+	if (m_query_content_pending) {
+		if (! HTTPParser::parseURLEncoded(query_params, getContent(), getContentLength())) {
+			PionLogger logger(PION_GET_LOGGER("pion.net.HTTPRequest"));
+			PION_LOG_WARN(logger, "Request query string parsing failed (POST content)");
+		}
+	}
+}
+
 void HTTPMessage::concatenateChunks(void)
 {
 	setContentLength(m_chunk_cache.size());
 	char *post_buffer = createContentBuffer();
-	if (m_chunk_cache.size() > 0)
-		std::copy(m_chunk_cache.begin(), m_chunk_cache.end(), post_buffer);
+	m_chunk_cache.copy(post_buffer);
 }
 	
 }	// end namespace net
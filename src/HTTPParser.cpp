@@ -15,6 +15,15 @@
 #include <pion/net/HTTPResponse.hpp>
 #include <pion/net/HTTPMessage.hpp>
 
+// SSE2 is part of the baseline for x86-64 and must be enabled explicitly for x86
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#define PION_PARSER_USE_SSE2
+	#include <emmintrin.h>
+	#ifdef _MSC_VER
+		#include <intrin.h>
+	#endif
+#endif
+
 
 namespace pion {	// begin namespace pion
 namespace net {		// begin namespace net (Pion Network Library)
@@ -36,6 +45,40 @@ const std::size_t		HTTPParser::DEFAULT_CONTENT_MAX = 1024 * 1024;	// 1 MB
 HTTPParser::ErrorCategory *	HTTPParser::m_error_category_ptr = NULL;
 boost::once_flag			HTTPParser::m_instance_flag = BOOST_ONCE_INIT;
 
+/// lookup table for characters allowed in tokens (isChar && !isControl && !isSpecial)
+static const unsigned char	TOKEN_CHAR_TABLE[256] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 1, 0, 1, 1, 1, 1, 1, 0, 0, 1, 1, 0, 1, 1, 0,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0,
+	0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 1, 0, 1, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+};
+
+#ifdef PION_PARSER_USE_SSE2
+/// returns the index of the lowest bit set in a (non-zero) movemask result
+static inline unsigned int firstMaskBit(int mask)
+{
+#ifdef _MSC_VER
+	unsigned long n;
+	_BitScanForward(&n, static_cast<unsigned long>(mask));
+	return n;
+#else
+	return __builtin_ctz(static_cast<unsigned int>(mask));
+#endif
+}
+#endif
+
 
 // HTTPParser member functions
 
@@ -74,7 +117,7 @@ boost::tribool HTTPParser::parse(HTTPMessage& http_msg,
 				rc = parseChunks(http_msg.getChunkCache(), ec);
 				total_bytes_parsed += m_bytes_last_read;
 				// check if we have finished parsing all chunks
-				if (rc == true && !m_payload_handler) {
+				if (rc == true && !m_payload_handler && m_concatenate_chunks) {
 					http_msg.concatenateChunks();
 				}
 				break;
@@ -104,6 +147,9 @@ boost::tribool HTTPParser::parse(HTTPMessage& http_msg,
 		finish(http_msg);
 	} else if(rc == false) {
 		computeMsgStatus(http_msg, false);
+	} else if (m_zero_copy_headers) {
+		// the next bytes will be read into the same buffer
+		http_msg.copyHeaderRefs();
 	}
 
 	// update bytes last read (aggregate individual operations for caller)
@@ -237,8 +283,19 @@ boost::tribool HTTPParser::parseHeaders(HTTPMessage& http_msg,
 	//
 	const char *read_start_ptr = m_read_ptr;
 	m_bytes_last_read = 0;
+
+	// headers may only refer to the read buffer if all of them are in it
+	const bool use_header_refs = (m_zero_copy_headers && m_bytes_total_read == 0);
+	HTTPTypes::StringRef header_name_ref;
+
 	while (m_read_ptr < m_read_end_ptr) {
 
+		// skip ahead over ordinary characters for the current field
+		if (! consumeHeaderRun(ec))
+			return false;
+		if (m_read_ptr == m_read_end_ptr)
+			break;
+
 		if (m_save_raw_headers)
 			m_raw_headers += *m_read_ptr;
 		
@@ -584,6 +641,8 @@ boost::tribool HTTPParser::parseHeaders(HTTPMessage& http_msg,
 		case PARSE_HEADER_NAME:
 			// parsing the name of a header
 			if (*m_read_ptr == ':') {
+				if (use_header_refs)
+					header_name_ref = HTTPTypes::StringRef(m_read_ptr - m_header_name.size(), m_header_name.size());
 				m_header_value.erase();
 				m_headers_parse_state = PARSE_SPACE_BEFORE_HEADER_VALUE;
 			} else if (!isChar(*m_read_ptr) || isControl(*m_read_ptr) || isSpecial(*m_read_ptr)) {
@@ -603,10 +662,10 @@ boost::tribool HTTPParser::parseHeaders(HTTPMessage& http_msg,
 			if (*m_read_ptr == ' ') {
 				m_headers_parse_state = PARSE_HEADER_VALUE;
 			} else if (*m_read_ptr == '\r') {
-				http_msg.addHeader(m_header_name, m_header_value);
+				addParsedHeader(http_msg, use_header_refs, header_name_ref);
 				m_headers_parse_state = PARSE_EXPECTING_NEWLINE;
 			} else if (*m_read_ptr == '\n') {
-				http_msg.addHeader(m_header_name, m_header_value);
+				addParsedHeader(http_msg, use_header_refs, header_name_ref);
 				m_headers_parse_state = PARSE_EXPECTING_CR;
 			} else if (!isChar(*m_read_ptr) || isControl(*m_read_ptr) || isSpecial(*m_read_ptr)) {
 				setError(ec, ERROR_HEADER_CHAR);
@@ -621,10 +680,10 @@ boost::tribool HTTPParser::parseHeaders(HTTPMessage& http_msg,
 		case PARSE_HEADER_VALUE:
 			// parsing the value of a header
 			if (*m_read_ptr == '\r') {
-				http_msg.addHeader(m_header_name, m_header_value);
+				addParsedHeader(http_msg, use_header_refs, header_name_ref);
 				m_headers_parse_state = PARSE_EXPECTING_NEWLINE;
 			} else if (*m_read_ptr == '\n') {
-				http_msg.addHeader(m_header_name, m_header_value);
+				addParsedHeader(http_msg, use_header_refs, header_name_ref);
 				m_headers_parse_state = PARSE_EXPECTING_CR;
 			} else if (*m_read_ptr != '\t' && isControl(*m_read_ptr)) {
 				// RFC 2616, 2.2 basic Rules.
@@ -665,6 +724,110 @@ boost::tribool HTTPParser::parseHeaders(HTTPMessage& http_msg,
 	return boost::indeterminate;
 }
 
+bool HTTPParser::consumeHeaderRun(boost::system::error_code& ec)
+{
+	switch (m_headers_parse_state) {
+	case PARSE_METHOD:
+		if (! appendHeaderRun(m_method, scanTokenRun(m_read_ptr, m_read_end_ptr), METHOD_MAX)) {
+			setError(ec, ERROR_METHOD_SIZE);
+			return false;
+		}
+		break;
+	case PARSE_URI_STEM:
+		if (! appendHeaderRun(m_resource, scanURIRun(m_read_ptr, m_read_end_ptr, true), RESOURCE_MAX)) {
+			setError(ec, ERROR_URI_SIZE);
+			return false;
+		}
+		break;
+	case PARSE_URI_QUERY:
+		if (! appendHeaderRun(m_query_string, scanURIRun(m_read_ptr, m_read_end_ptr, false), QUERY_STRING_MAX)) {
+			setError(ec, ERROR_QUERY_SIZE);
+			return false;
+		}
+		break;
+	case PARSE_STATUS_MESSAGE:
+		if (! appendHeaderRun(m_status_message, scanTextRun(m_read_ptr, m_read_end_ptr, false), STATUS_MESSAGE_MAX)) {
+			setError(ec, ERROR_STATUS_CHAR);
+			return false;
+		}
+		break;
+	case PARSE_HEADER_NAME:
+		if (! appendHeaderRun(m_header_name, scanTokenRun(m_read_ptr, m_read_end_ptr), HEADER_NAME_MAX)) {
+			setError(ec, ERROR_HEADER_NAME_SIZE);
+			return false;
+		}
+		break;
+	case PARSE_HEADER_VALUE:
+		if (! appendHeaderRun(m_header_value, scanTextRun(m_read_ptr, m_read_end_ptr, true), HEADER_VALUE_MAX)) {
+			setError(ec, ERROR_HEADER_VALUE_SIZE);
+			return false;
+		}
+		break;
+	default:
+		// all other states consume only a few bytes each
+		break;
+	}
+	return true;
+}
+
+const char *HTTPParser::scanTokenRun(const char *ptr, const char *end)
+{
+	// tokens are short (methods and header names), so a table lookup beats SIMD
+	while (ptr < end && TOKEN_CHAR_TABLE[static_cast<unsigned char>(*ptr)])
+		++ptr;
+	return ptr;
+}
+
+const char *HTTPParser::scanURIRun(const char *ptr, const char *end,
+	const bool stop_at_query)
+{
+#ifdef PION_PARSER_USE_SSE2
+	// check 16 bytes at a time for CTLs, SP, DEL and '?'
+	const __m128i space = _mm_set1_epi8(' ');
+	const __m128i del = _mm_set1_epi8(127);
+	const __m128i query = _mm_set1_epi8(stop_at_query ? '?' : 127);
+	while (end - ptr >= 16) {
+		const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ptr));
+		// unsigned (bytes <= ' ') is true when min(bytes, ' ') == bytes
+		__m128i stop = _mm_cmpeq_epi8(_mm_min_epu8(bytes, space), bytes);
+		stop = _mm_or_si128(stop, _mm_cmpeq_epi8(bytes, del));
+		stop = _mm_or_si128(stop, _mm_cmpeq_epi8(bytes, query));
+		const int mask = _mm_movemask_epi8(stop);
+		if (mask != 0)
+			return ptr + firstMaskBit(mask);
+		ptr += 16;
+	}
+#endif
+	while (ptr < end && *ptr != ' ' && !isControl(*ptr)
+		&& !(stop_at_query && *ptr == '?'))
+		++ptr;
+	return ptr;
+}
+
+const char *HTTPParser::scanTextRun(const char *ptr, const char *end,
+	const bool allow_tab)
+{
+#ifdef PION_PARSER_USE_SSE2
+	// check 16 bytes at a time for CTLs and DEL
+	const __m128i control = _mm_set1_epi8(31);
+	const __m128i del = _mm_set1_epi8(127);
+	const __m128i tab = _mm_set1_epi8(allow_tab ? '\t' : 127);
+	while (end - ptr >= 16) {
+		const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ptr));
+		__m128i stop = _mm_cmpeq_epi8(_mm_min_epu8(bytes, control), bytes);
+		stop = _mm_andnot_si128(_mm_cmpeq_epi8(bytes, tab), stop);
+		stop = _mm_or_si128(stop, _mm_cmpeq_epi8(bytes, del));
+		const int mask = _mm_movemask_epi8(stop);
+		if (mask != 0)
+			return ptr + firstMaskBit(mask);
+		ptr += 16;
+	}
+#endif
+	while (ptr < end && (!isControl(*ptr) || (allow_tab && *ptr == '\t')))
+		++ptr;
+	return ptr;
+}
+
 void HTTPParser::updateMessageWithHeaderData(HTTPMessage& http_msg) const
 {
 	if (isParsingRequest()) {
@@ -676,25 +839,12 @@ void HTTPParser::updateMessageWithHeaderData(HTTPMessage& http_msg) const
 		http_request.setResource(m_resource);
 		http_request.setQueryString(m_query_string);
 
-		// parse query pairs from the URI query string
-		if (! m_query_string.empty()) {
-			if (! parseURLEncoded(http_request.getQueryParams(),
-								  m_query_string.c_str(),
-								  m_query_string.size())) 
-				PION_LOG_WARN(m_logger, "Request query string parsing failed (URI)");
-		}
+		// query pairs from the URI query string are parsed when first used
+		if (! m_query_string.empty())
+			http_request.deferQueryStringParsing();
 
-		// parse "Cookie" headers in request
-		std::pair<HTTPTypes::Headers::const_iterator, HTTPTypes::Headers::const_iterator>
-		cookie_pair = http_request.getHeaders().equal_range(HTTPTypes::HEADER_COOKIE);
-		for (HTTPTypes::Headers::const_iterator cookie_iterator = cookie_pair.first;
-			 cookie_iterator != http_request.getHeaders().end()
-			 && cookie_iterator != cookie_pair.second; ++cookie_iterator)
-		{
-			if (! parseCookieHeader(http_request.getCookieParams(),
-									cookie_iterator->second, false) )
-				PION_LOG_WARN(m_logger, "Cookie header parsing failed");
-		}
+		// as are "Cookie" headers in the request
+		http_request.deferCookieParsing(false);
 
 	} else {
 
@@ -704,18 +854,8 @@ void HTTPParser::updateMessageWithHeaderData(HTTPMessage& http_msg) const
 		http_response.setStatusCode(m_status_code);
 		http_response.setStatusMessage(m_status_message);
 
-		// parse "Set-Cookie" headers in response
-		std::pair<HTTPTypes::Headers::const_iterator, HTTPTypes::Headers::const_iterator>
-		cookie_pair = http_response.getHeaders().equal_range(HTTPTypes::HEADER_SET_COOKIE);
-		for (HTTPTypes::Headers::const_iterator cookie_iterator = cookie_pair.first;
-			 cookie_iterator != http_response.getHeaders().end()
-			 && cookie_iterator != cookie_pair.second; ++cookie_iterator)
-		{
-			if (! parseCookieHeader(http_response.getCookieParams(),
-									cookie_iterator->second, true) )
-				PION_LOG_WARN(m_logger, "Set-Cookie header parsing failed");
-		}
-
+		// "Set-Cookie" headers in the response are parsed when first used
+		http_response.deferCookieParsing(true);
 	}
 }
 
@@ -747,12 +887,10 @@ boost::tribool HTTPParser::finishHeaderParsing(HTTPMessage& http_msg,
 	} else {
 		// content length should be specified in the headers
 
-		if (http_msg.hasHeader(HTTPTypes::HEADER_CONTENT_LENGTH)) {
+		if (http_msg.hasHeader(HTTPTypes::Headers::ID_CONTENT_LENGTH)) {
 
 			// message has a content-length header
-			try {
-				http_msg.updateContentLengthUsingHeader();
-			} catch (...) {
+			if (! http_msg.updateContentLengthUsingHeader()) {
 				PION_LOG_ERROR(m_logger, "Unable to update content length");
 				setError(ec, ERROR_INVALID_CONTENT_LENGTH);
 				return false;
@@ -766,13 +904,6 @@ boost::tribool HTTPParser::finishHeaderParsing(HTTPMessage& http_msg,
 				m_message_parse_state = PARSE_CONTENT;
 				m_bytes_content_remaining = http_msg.getContentLength();
 
-				// check if content-length exceeds maximum allowed
-				if (m_bytes_content_remaining > m_max_content_length)
-					http_msg.setContentLength(m_max_content_length);
-
-				// allocate a buffer for payload content (may be zero-size)
-				http_msg.createContentBuffer();
-				
 				// return true if parsing headers only
 				if (m_parse_headers_only)
 					rc = true;
@@ -801,6 +932,17 @@ boost::tribool HTTPParser::finishHeaderParsing(HTTPMessage& http_msg,
 	}
 
 	finishedParsingHeaders(ec);
+
+	// the content buffer is allocated after finishedParsingHeaders(), since
+	// it may set a payload handler that consumes the content instead
+	if (m_message_parse_state == PARSE_CONTENT && ! m_payload_handler) {
+		// check if content-length exceeds maximum allowed
+		if (m_bytes_content_remaining > m_max_content_length)
+			http_msg.setContentLength(m_max_content_length);
+
+		// allocate a buffer for payload content (may be zero-size)
+		http_msg.createContentBuffer();
+	}
 	
 	return rc;
 }
@@ -1069,17 +1211,19 @@ boost::tribool HTTPParser::parseChunks(HTTPMessage::ChunkCache& chunk_cache,
 
 		case PARSE_CHUNK:
 			if (m_bytes_read_in_current_chunk < m_size_of_current_chunk) {
+				// consume as much of the chunk as is available at once
+				const std::size_t bytes_avail = bytes_available();
+				const std::size_t bytes_in_chunk = m_size_of_current_chunk - m_bytes_read_in_current_chunk;
+				const std::size_t len = (bytes_in_chunk > bytes_avail) ? bytes_avail : bytes_in_chunk;
 				if (m_payload_handler) {
-					const std::size_t bytes_avail = bytes_available();
-					const std::size_t bytes_in_chunk = m_size_of_current_chunk - m_bytes_read_in_current_chunk;
-					const std::size_t len = (bytes_in_chunk > bytes_avail) ? bytes_avail : bytes_in_chunk;
 					m_payload_handler(m_read_ptr, len);
-					m_bytes_read_in_current_chunk += len;
-					if (len > 1) m_read_ptr += (len - 1);
 				} else if (chunk_cache.size() < m_max_content_length) {
-					chunk_cache.push_back(*m_read_ptr);
-					m_bytes_read_in_current_chunk++;
+					// content beyond the maximum length is discarded
+					const std::size_t room = m_max_content_length - chunk_cache.size();
+					chunk_cache.append(m_read_ptr, (len > room) ? room : len);
 				}
+				m_bytes_read_in_current_chunk += len;
+				if (len > 1) m_read_ptr += (len - 1);
 			}
 			if (m_bytes_read_in_current_chunk == m_size_of_current_chunk) {
 				m_chunked_content_parse_state = PARSE_EXPECTING_CR_AFTER_CHUNK;
@@ -1194,13 +1338,12 @@ std::size_t HTTPParser::consumeContentAsNextChunk(HTTPMessage::ChunkCache& chunk
 		if (m_payload_handler) {
 			if (m_bytes_last_read)
 				m_payload_handler(m_read_ptr, m_bytes_last_read);
-		} else {
-			while (m_read_ptr < m_read_end_ptr) {
-				if (chunk_cache.size() < m_max_content_length)
-					chunk_cache.push_back(*m_read_ptr);
-				++m_read_ptr;
-			}
+		} else if (chunk_cache.size() < m_max_content_length) {
+			// content beyond the maximum length is discarded
+			const std::size_t room = m_max_content_length - chunk_cache.size();
+			chunk_cache.append(m_read_ptr, (m_bytes_last_read > room) ? room : m_bytes_last_read);
 		}
+		m_read_ptr = m_read_end_ptr;
 		m_bytes_total_read += m_bytes_last_read;
 		m_bytes_content_read += m_bytes_last_read;
 	}
@@ -1231,12 +1374,12 @@ void HTTPParser::finish(HTTPMessage& http_msg) const
 		break;
 	case PARSE_CHUNKS:
 		http_msg.setIsValid(m_chunked_content_parse_state==PARSE_CHUNK_SIZE_START);
-		if (!m_payload_handler)
+		if (!m_payload_handler && m_concatenate_chunks)
 			http_msg.concatenateChunks();
 		break;
 	case PARSE_CONTENT_NO_LENGTH:
 		http_msg.setIsValid(true);
-		if (!m_payload_handler)
+		if (!m_payload_handler && m_concatenate_chunks)
 			http_msg.concatenateChunks();
 		break;
 	}
@@ -1248,14 +1391,13 @@ void HTTPParser::finish(HTTPMessage& http_msg) const
 		// Type could be followed by parameters (as defined in section 3.6 of RFC 2616)
 		// e.g. Content-Type: application/x-www-form-urlencoded; charset=UTF-8
 		HTTPRequest& http_request(dynamic_cast<HTTPRequest&>(http_msg));
-		const std::string& content_type_header = http_request.getHeader(HTTPTypes::HEADER_CONTENT_TYPE);
-		if (content_type_header.compare(0, HTTPTypes::CONTENT_TYPE_URLENCODED.length(),
-										HTTPTypes::CONTENT_TYPE_URLENCODED) == 0)
+		const HTTPTypes::StringRef content_type_header(http_request.getHeaderRef(HTTPTypes::Headers::ID_CONTENT_TYPE));
+		if (content_type_header.size() >= HTTPTypes::CONTENT_TYPE_URLENCODED.size()
+			&& HTTPTypes::CONTENT_TYPE_URLENCODED.compare(0, HTTPTypes::CONTENT_TYPE_URLENCODED.size(),
+				content_type_header.data(), HTTPTypes::CONTENT_TYPE_URLENCODED.size()) == 0)
 		{
-			if (! parseURLEncoded(http_request.getQueryParams(),
-								  http_request.getContent(),
-								  http_request.getContentLength())) 
-				PION_LOG_WARN(m_logger, "Request query string parsing failed (POST content)");
+			// query pairs are parsed from the content when first used
+			http_request.deferQueryContentParsing();
 		}
 	}
 }
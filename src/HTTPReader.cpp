@@ -8,6 +8,7 @@
 //
 
 #include <boost/asio.hpp>
+#include <boost/bind.hpp>
 #include <boost/logic/tribool.hpp>
 #include <pion/net/HTTPReader.hpp>
 #include <pion/net/HTTPRequest.hpp>
@@ -42,10 +43,7 @@ void HTTPReader::consumeBytes(const boost::system::error_code& read_error,
 							  std::size_t bytes_read)
 {
 	// cancel read timer if operation didn't time-out
-	if (m_timer_ptr) {
-		m_timer_ptr->cancel();
-		m_timer_ptr.reset();
-	}
+	m_timer.cancel();
 
 	if (read_error) {
 		// a read error occured
@@ -63,6 +61,20 @@ void HTTPReader::consumeBytes(const boost::system::error_code& read_error,
 }
 
 
+void HTTPReader::setStreamContent(void)
+{
+	m_stream_content = true;
+	PayloadHandler payload_handler(boost::bind(&HTTPReader::saveContentBlock, this, _1, _2));
+	setPayloadHandler(payload_handler);
+}
+
+void HTTPReader::readContent(ContentHandler handler)
+{
+	m_content_handler = handler;
+	if (! m_delivering_content)
+		streamContent();
+}
+
 void HTTPReader::consumeBytes(void)
 {
 	// parse the bytes read from the last operation
@@ -81,31 +93,30 @@ void HTTPReader::consumeBytes(void)
 		PION_LOG_DEBUG(m_logger, "Parsed " << gcount() << " HTTP bytes");
 	}
 
-	if (result == true) {
-		// finished reading HTTP message and it is valid
+	if (! boost::indeterminate(result) && ! getMessage().getHeaderRefs().empty()) {
+		// headers that still refer to the read buffer keep its memory alive
+		// for as long as the message does (see TCPConnection::shareReadBuffer())
+		getMessage().setHeaderRefOwner(m_tcp_conn->shareReadBuffer());
+	}
 
-		// set the connection's lifecycle type
-		if (getMessage().checkKeepAlive()) {
-			if ( eof() ) {
-				// the connection should be kept alive, but does not have pipelined messages
-				m_tcp_conn->setLifecycle(TCPConnection::LIFECYCLE_KEEPALIVE);
-			} else {
-				// the connection has pipelined messages
-				m_tcp_conn->setLifecycle(TCPConnection::LIFECYCLE_PIPELINED);
-
-				// save the read position as a bookmark so that it can be retrieved
-				// by a new HTTP parser, which will be created after the current
-				// message has been handled
-				m_tcp_conn->saveReadPosition(m_read_ptr, m_read_end_ptr);
-
-				PION_LOG_DEBUG(m_logger, "HTTP pipelined "
-							   << (isParsingRequest() ? "request (" : "response (")
-							   << bytes_available() << " bytes available)");
-			}
+	if (m_content_handler) {
+		// parsed more streamed payload content for a pending readContent()
+		if (result == false) {
+			m_tcp_conn->setLifecycle(TCPConnection::LIFECYCLE_CLOSE);	// make sure it will get closed
+			deliverContent(ec, NULL, 0);
 		} else {
-			m_tcp_conn->setLifecycle(TCPConnection::LIFECYCLE_CLOSE);
+			if (result == true) {
+				m_content_finished = true;
+				updateLifecycle();
+			}
+			streamContent();
 		}
 
+	} else if (result == true) {
+		// finished reading HTTP message and it is valid
+		m_content_finished = true;
+		updateLifecycle();
+
 		// we have finished parsing the HTTP message
 		finishedReading(ec);
 
@@ -114,20 +125,99 @@ void HTTPReader::consumeBytes(void)
 		m_tcp_conn->setLifecycle(TCPConnection::LIFECYCLE_CLOSE);	// make sure it will get closed
 		getMessage().setIsValid(false);
 		finishedReading(ec);
+	} else if (m_stream_content) {
+		// finished parsing the headers: the payload content will be pulled
+		// using readContent(), so the message is handled before it arrives
+		getMessage().setIsValid(true);
+		finishedReading(ec);
 	} else {
 		// not yet finished parsing the message -> read more data
+		// (all of the bytes have been consumed, so the read buffer may grow
+		// if the last read filled it)
+		m_tcp_conn->growReadBuffer(m_read_end_ptr - m_tcp_conn->getReadBuffer().data());
 		readBytesWithTimeout();
 	}
 }
 
-void HTTPReader::readBytesWithTimeout(void)
+void HTTPReader::updateLifecycle(void)
+{
+	// set the connection's lifecycle type
+	if (getMessage().checkKeepAlive()) {
+		if ( eof() ) {
+			// the connection should be kept alive, but does not have pipelined messages
+			m_tcp_conn->setLifecycle(TCPConnection::LIFECYCLE_KEEPALIVE);
+		} else {
+			// the connection has pipelined messages
+			m_tcp_conn->setLifecycle(TCPConnection::LIFECYCLE_PIPELINED);
+			// responses to pipelined requests are sent together with the
+			// response to the last one
+			if (isParsingRequest())
+				m_tcp_conn->setHoldWrites(true);
+
+			// save the read position as a bookmark so that it can be retrieved
+			// by a new HTTP parser, which will be created after the current
+			// message has been handled
+			m_tcp_conn->saveReadPosition(m_read_ptr, m_read_end_ptr);
+
+			PION_LOG_DEBUG(m_logger, "HTTP pipelined "
+						   << (isParsingRequest() ? "request (" : "response (")
+						   << bytes_available() << " bytes available)");
+		}
+	} else {
+		m_tcp_conn->setLifecycle(TCPConnection::LIFECYCLE_CLOSE);
+	}
+}
+
+void HTTPReader::saveContentBlock(const char *ptr, std::size_t len)
+{
+	if (len > 0)
+		m_content_blocks.push_back(std::make_pair(ptr, len));
+}
+
+void HTTPReader::streamContent(void)
 {
-	if (m_read_timeout > 0) {
-		m_timer_ptr.reset(new TCPTimer(m_tcp_conn));
-		m_timer_ptr->start(m_read_timeout);
-	} else if (m_timer_ptr) {
-		m_timer_ptr.reset();
+	// deliver content that has already been parsed.  Handlers usually call
+	// readContent() again before they return, so this loops rather than
+	// recursing once for every block
+	const boost::system::error_code ec;
+	m_delivering_content = true;
+	while (m_content_handler && m_content_block_pos < m_content_blocks.size()) {
+		const std::pair<const char*, std::size_t> block(m_content_blocks[m_content_block_pos++]);
+		deliverContent(ec, block.first, block.second);
+	}
+	m_delivering_content = false;
+	if (! m_content_handler || m_content_block_pos < m_content_blocks.size())
+		return;
+
+	// all of the saved blocks have been delivered; they point into the
+	// read buffer, which may now be reused
+	m_content_blocks.clear();
+	m_content_block_pos = 0;
+
+	if (m_content_finished) {
+		// there is no more content
+		deliverContent(ec, NULL, 0);
+	} else if (bytes_available() > 0) {
+		consumeBytes();
+	} else {
+		m_tcp_conn->growReadBuffer(m_read_end_ptr - m_tcp_conn->getReadBuffer().data());
+		readBytesWithTimeout();
 	}
+}
+
+void HTTPReader::deliverContent(const boost::system::error_code& ec,
+								const char *ptr, std::size_t len)
+{
+	// the handler is cleared before it is called, since it may call readContent()
+	ContentHandler handler;
+	handler.swap(m_content_handler);
+	handler(ec, ptr, len);
+}
+
+void HTTPReader::readBytesWithTimeout(void)
+{
+	if (m_read_timeout > 0)
+		m_timer.start(m_read_timeout);
 	readBytes();
 }
 
@@ -139,7 +229,12 @@ void HTTPReader::handleReadError(const boost::system::error_code& read_error)
 	// check if this is just a message with unknown content length
 	if (! checkPrematureEOF(getMessage())) {
 		boost::system::error_code ec;	// clear error code
-		finishedReading(ec);
+		if (m_content_handler) {
+			m_content_finished = true;
+			deliverContent(ec, NULL, 0);
+		} else {
+			finishedReading(ec);
+		}
 		return;
 	}
 	
@@ -156,7 +251,10 @@ void HTTPReader::handleReadError(const boost::system::error_code& read_error)
 		}
 	}
 
-	finishedReading(read_error);
+	if (m_content_handler)
+		deliverContent(read_error, NULL, 0);
+	else
+		finishedReading(read_error);
 }
 
 }	// end namespace net
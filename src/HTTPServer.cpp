@@ -20,19 +20,144 @@ namespace net {		// begin namespace net (Pion Network Library)
 // static members of HTTPServer
 
 const unsigned int			HTTPServer::MAX_REDIRECTS = 10;
+const boost::uint32_t		HTTPServer::DEFAULT_KEEPALIVE_TIMEOUT = 10;
 
 
 // HTTPServer member functions
 
 void HTTPServer::handleConnection(TCPConnectionPtr& tcp_conn)
+{
+	if (tcp_conn->getLifecycle() == TCPConnection::LIFECYCLE_KEEPALIVE
+		&& ! tcp_conn->getSSLFlag())
+	{
+		// wait for the next request without holding any resources
+		parkConnection(tcp_conn);
+	} else {
+		// new connection or pipelined request -> start reading right away
+		readRequest(tcp_conn);
+	}
+}
+
+void HTTPServer::readRequest(TCPConnectionPtr& tcp_conn)
 {
 	HTTPRequestReaderPtr reader_ptr;
 	reader_ptr = HTTPRequestReader::create(tcp_conn, boost::bind(&HTTPServer::handleRequest,
 										   this, _1, _2, _3));
 	reader_ptr->setMaxContentLength(m_max_content_length);
+	reader_ptr->setZeroCopyHeaders(m_zero_copy_headers);
+	reader_ptr->setConcatenateChunks(m_concatenate_chunks);
+	bool has_streaming_resources;
+	{
+		boost::mutex::scoped_lock resource_lock(m_resource_mutex);
+		has_streaming_resources = ! m_streaming_resources.empty();
+	}
+	if (has_streaming_resources) {
+		// the reader outlives its own callbacks, so a plain pointer is used
+		// to avoid a reference cycle
+		HTTPRequestReader::FinishedHandler headers_handler(boost::bind(&HTTPServer::handleRequestHeaders,
+																	   this, reader_ptr.get(), _1, _2, _3));
+		reader_ptr->setHeadersParsedCallback(headers_handler);
+	}
 	reader_ptr->receive();
 }
 
+void HTTPServer::handleRequestHeaders(HTTPRequestReader *reader_ptr, HTTPRequestPtr& http_request,
+	TCPConnectionPtr& tcp_conn, const boost::system::error_code& ec)
+{
+	if (ec)
+		return;
+
+	std::string resource_requested(stripTrailingSlash(http_request->getResource()));
+	StreamingRequestHandler request_handler;
+	if (applyRedirects(resource_requested)
+		&& findStreamingRequestHandler(resource_requested, request_handler))
+	{
+		// hand the request over as soon as the headers have been parsed
+		// (the reader releases its finished handler before calling it)
+		reader_ptr->setStreamContent();
+		HTTPRequestReaderPtr shared_reader_ptr(reader_ptr->shared_from_this());
+		HTTPRequestReader::FinishedHandler finished_handler(boost::bind(&HTTPServer::handleStreamingRequest,
+																		this, request_handler, shared_reader_ptr,
+																		resource_requested, _1, _2, _3));
+		reader_ptr->setFinishedHandler(finished_handler);
+	}
+}
+
+void HTTPServer::handleStreamingRequest(StreamingRequestHandler& request_handler,
+	HTTPRequestReaderPtr& reader_ptr, const std::string& resource_requested,
+	HTTPRequestPtr& http_request, TCPConnectionPtr& tcp_conn,
+	const boost::system::error_code& ec)
+{
+	if (ec || ! http_request->isValid()) {
+		// errors are handled the same way as for other requests
+		handleRequest(http_request, tcp_conn, ec);
+		return;
+	}
+
+	PION_LOG_DEBUG(m_logger, "Received valid HTTP request headers (streaming content)");
+
+	// apply the redirection found after the headers were parsed
+	if (resource_requested != stripTrailingSlash(http_request->getResource()))
+		http_request->changeResource(resource_requested);
+
+	// if authentication activated, check current request
+	if (m_auth && ! m_auth->handleRequest(http_request, tcp_conn)) {
+		// the HTTP 401 message has already been sent by the authentication object
+		PION_LOG_DEBUG(m_logger, "Authentication required for HTTP resource: "
+			<< resource_requested);
+		return;
+	}
+
+	// try to handle the request
+	try {
+		request_handler(http_request, tcp_conn, reader_ptr);
+		PION_LOG_DEBUG(m_logger, "Found streaming request handler for HTTP resource: "
+					   << resource_requested);
+	} catch (std::bad_alloc&) {
+		// propagate memory errors (FATAL)
+		throw;
+	} catch (std::exception& e) {
+		// recover gracefully from other exceptions thrown request handlers
+		PION_LOG_ERROR(m_logger, "HTTP request handler: " << e.what());
+		m_server_error_handler(http_request, tcp_conn, e.what());
+	}
+}
+
+void HTTPServer::parkConnection(TCPConnectionPtr& tcp_conn)
+{
+	if (m_keepalive_timeout > 0) {
+		// the connection keeps its timer so that it is only created once
+		TCPTimerPtr& timer_ptr = tcp_conn->getIdleTimer();
+		if (! timer_ptr)
+			timer_ptr.reset(new TCPTimer(tcp_conn));
+		timer_ptr->start(m_keepalive_timeout);
+	}
+	tcp_conn->releaseReadBuffer();
+	tcp_conn->async_wait_readable(boost::bind(&HTTPServer::handleParkedConnection,
+											  this, tcp_conn,
+											  boost::asio::placeholders::error));
+}
+
+void HTTPServer::handleParkedConnection(TCPConnectionPtr& tcp_conn,
+										const boost::system::error_code& wait_error)
+{
+	TCPTimerPtr& timer_ptr = tcp_conn->getIdleTimer();
+	if (timer_ptr)
+		timer_ptr->cancel();
+
+	// restore the read buffer before doing anything else with the connection
+	tcp_conn->shrinkReadBuffer();
+
+	if (wait_error) {
+		// the connection was closed (i.e. by the idle timeout)
+		PION_LOG_DEBUG(m_logger, "Closing idle keep-alive connection on port " << getPort());
+		tcp_conn->setLifecycle(TCPConnection::LIFECYCLE_CLOSE);
+		tcp_conn->finish();
+	} else {
+		readRequest(tcp_conn);
+	}
+}
+
 void HTTPServer::handleRequest(HTTPRequestPtr& http_request,
 	TCPConnectionPtr& tcp_conn, const boost::system::error_code& ec)
 {
@@ -56,18 +181,13 @@ void HTTPServer::handleRequest(HTTPRequestPtr& http_request,
 	std::string resource_requested(stripTrailingSlash(http_request->getResource()));
 
 	// apply any redirection
-	RedirectMap::const_iterator it = m_redirects.find(resource_requested);
-	unsigned int num_redirects = 0;
-	while (it != m_redirects.end()) {
-		if (++num_redirects > MAX_REDIRECTS) {
-			PION_LOG_ERROR(m_logger, "Maximum number of redirects (HTTPServer::MAX_REDIRECTS) exceeded for requested resource: " << http_request->getOriginalResource());
-			m_server_error_handler(http_request, tcp_conn, "Maximum number of redirects (HTTPServer::MAX_REDIRECTS) exceeded for requested resource");
-			return;
-		}
-		resource_requested = it->second;
-		http_request->changeResource(resource_requested);
-		it = m_redirects.find(resource_requested);
+	if (! applyRedirects(resource_requested)) {
+		PION_LOG_ERROR(m_logger, "Maximum number of redirects (HTTPServer::MAX_REDIRECTS) exceeded for requested resource: " << http_request->getOriginalResource());
+		m_server_error_handler(http_request, tcp_conn, "Maximum number of redirects (HTTPServer::MAX_REDIRECTS) exceeded for requested resource");
+		return;
 	}
+	if (resource_requested != stripTrailingSlash(http_request->getResource()))
+		http_request->changeResource(resource_requested);
 
 	// if authentication activated, check current request
 	if (m_auth) {
@@ -119,27 +239,28 @@ void HTTPServer::handleRequest(HTTPRequestPtr& http_request,
 bool HTTPServer::findRequestHandler(const std::string& resource,
 									RequestHandler& request_handler) const
 {
-	// first make sure that HTTP resources are registered
 	boost::mutex::scoped_lock resource_lock(m_resource_mutex);
-	if (m_resources.empty())
-		return false;
-	
-	// iterate through each resource entry that may match the resource
-	ResourceMap::const_iterator i = m_resources.upper_bound(resource);
-	while (i != m_resources.begin()) {
-		--i;
-		// check for a match if the first part of the strings match
-		if (i->first.empty() || resource.compare(0, i->first.size(), i->first) == 0) {
-			// only if the resource matches the plug-in's identifier
-			// or if resource is followed first with a '/' character
-			if (resource.size() == i->first.size() || resource[i->first.size()]=='/') {
-				request_handler = i->second;
-				return true;
-			}
-		}
+	return findResource(m_resources, resource, request_handler);
+}
+
+bool HTTPServer::findStreamingRequestHandler(const std::string& resource,
+											 StreamingRequestHandler& request_handler) const
+{
+	boost::mutex::scoped_lock resource_lock(m_resource_mutex);
+	return findResource(m_streaming_resources, resource, request_handler);
+}
+
+bool HTTPServer::applyRedirects(std::string& resource) const
+{
+	RedirectMap::const_iterator it = m_redirects.find(resource);
+	unsigned int num_redirects = 0;
+	while (it != m_redirects.end()) {
+		if (++num_redirects > MAX_REDIRECTS)
+			return false;
+		resource = it->second;
+		it = m_redirects.find(resource);
 	}
-	
-	return false;
+	return true;
 }
 
 void HTTPServer::addResource(const std::string& resource,
@@ -151,11 +272,21 @@ void HTTPServer::addResource(const std::string& resource,
 	PION_LOG_INFO(m_logger, "Added request handler for HTTP resource: " << clean_resource);
 }
 
+void HTTPServer::addStreamingResource(const std::string& resource,
+									  StreamingRequestHandler request_handler)
+{
+	boost::mutex::scoped_lock resource_lock(m_resource_mutex);
+	const std::string clean_resource(stripTrailingSlash(resource));
+	m_streaming_resources.insert(std::make_pair(clean_resource, request_handler));
+	PION_LOG_INFO(m_logger, "Added streaming request handler for HTTP resource: " << clean_resource);
+}
+
 void HTTPServer::removeResource(const std::string& resource)
 {
 	boost::mutex::scoped_lock resource_lock(m_resource_mutex);
 	const std::string clean_resource(stripTrailingSlash(resource));
 	m_resources.erase(clean_resource);
+	m_streaming_resources.erase(clean_resource);
 	PION_LOG_INFO(m_logger, "Removed request handler for HTTP resource: " << clean_resource);
 }
 
@@ -7,7 +7,6 @@
 // See http://www.boost.org/LICENSE_1_0.txt
 //
 
-#include <boost/lexical_cast.hpp>
 #include <boost/thread/mutex.hpp>
 #include <pion/net/HTTPTypes.hpp>
 #include <pion/PionAlgorithms.hpp>
@@ -90,8 +89,47 @@ const unsigned int	HTTPTypes::RESPONSE_CODE_NOT_IMPLEMENTED = 501;
 const unsigned int	HTTPTypes::RESPONSE_CODE_CONTINUE = 100;
 
 
+// canned HTTP/1.1 status lines for the standard response codes and messages
+
+namespace {
+	struct CannedStatusLine {
+		unsigned int		m_code;
+		const std::string&	m_message;
+		const std::string	m_line;
+	};
+	const CannedStatusLine CANNED_STATUS_LINES[] = {
+		{ 200, HTTPTypes::RESPONSE_MESSAGE_OK, "HTTP/1.1 200 OK" },
+		{ 404, HTTPTypes::RESPONSE_MESSAGE_NOT_FOUND, "HTTP/1.1 404 Not Found" },
+		{ 304, HTTPTypes::RESPONSE_MESSAGE_NOT_MODIFIED, "HTTP/1.1 304 Not Modified" },
+		{ 302, HTTPTypes::RESPONSE_MESSAGE_FOUND, "HTTP/1.1 302 Found" },
+		{ 204, HTTPTypes::RESPONSE_MESSAGE_NO_CONTENT, "HTTP/1.1 204 No Content" },
+		{ 201, HTTPTypes::RESPONSE_MESSAGE_CREATED, "HTTP/1.1 201 Created" },
+		{ 202, HTTPTypes::RESPONSE_MESSAGE_ACCEPTED, "HTTP/1.1 202 Accepted" },
+		{ 400, HTTPTypes::RESPONSE_MESSAGE_BAD_REQUEST, "HTTP/1.1 400 Bad Request" },
+		{ 401, HTTPTypes::RESPONSE_MESSAGE_UNAUTHORIZED, "HTTP/1.1 401 Unauthorized" },
+		{ 403, HTTPTypes::RESPONSE_MESSAGE_FORBIDDEN, "HTTP/1.1 403 Forbidden" },
+		{ 405, HTTPTypes::RESPONSE_MESSAGE_METHOD_NOT_ALLOWED, "HTTP/1.1 405 Method Not Allowed" },
+		{ 500, HTTPTypes::RESPONSE_MESSAGE_SERVER_ERROR, "HTTP/1.1 500 Server Error" },
+		{ 501, HTTPTypes::RESPONSE_MESSAGE_NOT_IMPLEMENTED, "HTTP/1.1 501 Not Implemented" },
+		{ 100, HTTPTypes::RESPONSE_MESSAGE_CONTINUE, "HTTP/1.1 100 Continue" }
+	};
+}
+
+
 // static member functions
 
+const std::string *HTTPTypes::find_status_line(const unsigned int status_code,
+											   const std::string& status_message)
+{
+	const std::size_t num_lines = sizeof(CANNED_STATUS_LINES) / sizeof(CANNED_STATUS_LINES[0]);
+	for (std::size_t n = 0; n < num_lines; ++n) {
+		if (CANNED_STATUS_LINES[n].m_code == status_code)
+			return (CANNED_STATUS_LINES[n].m_message == status_message
+					? &CANNED_STATUS_LINES[n].m_line : NULL);
+	}
+	return NULL;
+}
+
 std::string HTTPTypes::get_date_string(const time_t t)
 {
 	// use mutex since time functions are normally not thread-safe
@@ -138,7 +176,7 @@ std::string HTTPTypes::make_set_cookie_header(const std::string& name,
 	}
 	if (has_max_age) {
 		set_cookie_header += "; Max-Age=\"";
-		set_cookie_header += boost::lexical_cast<std::string>(max_age);
+		append_uint64(set_cookie_header, max_age);
 		set_cookie_header += '\"';
 	}
 	return set_cookie_header;
@@ -37,17 +37,17 @@ void HTTPWriter::prepareWriteBuffers(HTTPMessage::WriteBuffers& write_buffers,
 	// don't send anything if there is no data in content buffers
 	if (m_content_length > 0) {
 		if (supportsChunkedMessages() && sendingChunkedMessage()) {
-			// prepare the next chunk of data to send
-			// write chunk length in hex
-			char cast_buf[35];
-			sprintf(cast_buf, "%lx", static_cast<long>(m_content_length));
-			
-			// add chunk length as a string at the back of the text cache
-			m_text_cache.push_back(cast_buf);
-			// append length of chunk to write_buffers
-			write_buffers.push_back(boost::asio::buffer(m_text_cache.back()));
-			// append an extra CRLF for chunk formatting
-			write_buffers.push_back(boost::asio::buffer(HTTPTypes::STRING_CRLF));
+			// prepare the next chunk of data to send:
+			// write chunk length in hex, followed by CRLF
+			static const char HEX_DIGITS[] = "0123456789abcdef";
+			char *const header_end = m_chunk_header + sizeof(m_chunk_header);
+			char *header_ptr = header_end;
+			*--header_ptr = '\n';
+			*--header_ptr = '\r';
+			for (size_t n = m_content_length; n != 0; n >>= 4)
+				*--header_ptr = HEX_DIGITS[n & 0x0F];
+			// append chunk length line to write_buffers
+			write_buffers.push_back(boost::asio::buffer(header_ptr, header_end - header_ptr));
 			
 			// append response content buffers
 			write_buffers.insert(write_buffers.end(), m_content_buffers.begin(),
@@ -63,13 +63,9 @@ void HTTPWriter::prepareWriteBuffers(HTTPMessage::WriteBuffers& write_buffers,
 	
 	// prepare a zero-byte (final) chunk
 	if (send_final_chunk && supportsChunkedMessages() && sendingChunkedMessage()) {
-		// add chunk length as a string at the back of the text cache
-		m_text_cache.push_back("0");
-		// append length of chunk to write_buffers
-		write_buffers.push_back(boost::asio::buffer(m_text_cache.back()));
-		// append an extra CRLF for chunk formatting
-		write_buffers.push_back(boost::asio::buffer(HTTPTypes::STRING_CRLF));
-		write_buffers.push_back(boost::asio::buffer(HTTPTypes::STRING_CRLF));
+		// append the zero-byte chunk and the empty trailer
+		static const char FINAL_CHUNK[] = "0\r\n\r\n";
+		write_buffers.push_back(boost::asio::buffer(FINAL_CHUNK, sizeof(FINAL_CHUNK) - 1));
 	}
 }
 
@@ -0,0 +1,95 @@
+// ------------------------------------------------------------------
+// pion-net: a C++ framework for building lightweight HTTP interfaces
+// ------------------------------------------------------------------
+// Copyright (C) 2007-2011 Atomic Labs, Inc.  (http://www.atomiclabs.com)
+//
+// Distributed under the Boost Software License, Version 1.0.
+// See http://www.boost.org/LICENSE_1_0.txt
+//
+
+#include <pion/net/SlabPool.hpp>
+
+
+namespace pion {	// begin namespace pion
+namespace net {		// begin namespace net (Pion Network Library)
+
+
+// static members of SlabPool
+
+boost::asio::io_service::id		SlabPool::id;
+const std::size_t				SlabPool::SLAB_SIZE = 8192;
+const std::size_t				SlabPool::DEFAULT_MAX_FREE_SLABS = 256;
+
+
+// SlabPool member functions
+
+SlabPool::SlabPool(boost::asio::io_service& io_service)
+	: boost::asio::io_service::service(io_service),
+	m_max_free_slabs(DEFAULT_MAX_FREE_SLABS)
+{
+	m_free_slabs.reserve(m_max_free_slabs);
+}
+
+SlabPool::~SlabPool()
+{
+	for (std::vector<char*>::iterator i = m_free_slabs.begin(); i != m_free_slabs.end(); ++i)
+		delete[] *i;
+}
+
+char *SlabPool::acquire(void)
+{
+	{
+		boost::mutex::scoped_lock pool_lock(m_mutex);
+		if (! m_free_slabs.empty()) {
+			char *slab = m_free_slabs.back();
+			m_free_slabs.pop_back();
+			return slab;
+		}
+	}
+	return new char[SLAB_SIZE];
+}
+
+void SlabPool::release(char *slab)
+{
+	{
+		boost::mutex::scoped_lock pool_lock(m_mutex);
+		if (m_free_slabs.size() < m_max_free_slabs) {
+			m_free_slabs.push_back(slab);
+			return;
+		}
+	}
+	delete[] slab;
+}
+
+void SlabPool::release(std::vector<char*>& slabs)
+{
+	std::vector<char*>::iterator i = slabs.begin();
+	{
+		boost::mutex::scoped_lock pool_lock(m_mutex);
+		for ( ; i != slabs.end() && m_free_slabs.size() < m_max_free_slabs; ++i)
+			m_free_slabs.push_back(*i);
+	}
+	// free whatever did not fit back into the pool
+	for ( ; i != slabs.end(); ++i)
+		delete[] *i;
+	slabs.clear();
+}
+
+void SlabPool::setMaxFreeSlabs(const std::size_t n)
+{
+	std::vector<char*> extra_slabs;
+	{
+		boost::mutex::scoped_lock pool_lock(m_mutex);
+		m_max_free_slabs = n;
+		if (m_free_slabs.size() > n) {
+			extra_slabs.assign(m_free_slabs.begin() + n, m_free_slabs.end());
+			m_free_slabs.resize(n);
+		}
+	}
+	for (std::vector<char*>::iterator i = extra_slabs.begin(); i != extra_slabs.end(); ++i)
+		delete[] *i;
+}
+
+
+}	// end namespace net
+}	// end namespace pion
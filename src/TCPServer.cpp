@@ -7,67 +7,91 @@
 // See http://www.boost.org/LICENSE_1_0.txt
 //
 
+#include <algorithm>
 #include <boost/asio.hpp>
 #include <boost/bind.hpp>
 #include <boost/thread/mutex.hpp>
 #include <pion/PionAdminRights.hpp>
 #include <pion/net/TCPServer.hpp>
+#include <pion/net/TCPSocketOptions.hpp>
 
 using boost::asio::ip::tcp;
 
+#ifdef SO_REUSEPORT
+/// socket option used to bind multiple acceptors to the same endpoint
+typedef pion::net::BooleanSocketOption<SOL_SOCKET, SO_REUSEPORT>	ReusePortOption;
+#endif
+
 
 namespace pion {	// begin namespace pion
 namespace net {		// begin namespace net (Pion Network Library)
 
 	
+// static members of TCPServer
+
+const std::size_t		TCPServer::DEFAULT_CONNECTION_CACHE_SIZE = 128;
+
+
 // TCPServer member functions
 
 TCPServer::TCPServer(PionScheduler& scheduler, const unsigned int tcp_port)
 	: m_logger(PION_GET_LOGGER("pion.net.TCPServer")),
 	m_active_scheduler(scheduler),
-	m_tcp_acceptor(m_active_scheduler.getIOService()),
 #ifdef PION_HAVE_SSL
 	m_ssl_context(m_active_scheduler.getIOService(), boost::asio::ssl::context::sslv23),
 #else
 	m_ssl_context(0),
 #endif
-	m_endpoint(tcp::v4(), tcp_port), m_ssl_flag(false), m_is_listening(false)
+	m_pending_accepts(0),
+	m_conn_recycler(new ConnectionRecycler(DEFAULT_CONNECTION_CACHE_SIZE, m_active_scheduler)),
+	m_endpoint(tcp::v4(), tcp_port), m_num_acceptors(1),
+	m_read_buffer_size(TCPConnection::READ_BUFFER_SIZE), m_max_read_buffer_size(0),
+	m_ssl_flag(false), m_is_listening(0)
 {}
 	
 TCPServer::TCPServer(PionScheduler& scheduler, const tcp::endpoint& endpoint)
 	: m_logger(PION_GET_LOGGER("pion.net.TCPServer")),
 	m_active_scheduler(scheduler),
-	m_tcp_acceptor(m_active_scheduler.getIOService()),
 #ifdef PION_HAVE_SSL
 	m_ssl_context(m_active_scheduler.getIOService(), boost::asio::ssl::context::sslv23),
 #else
 	m_ssl_context(0),
 #endif
-	m_endpoint(endpoint), m_ssl_flag(false), m_is_listening(false)
+	m_pending_accepts(0),
+	m_conn_recycler(new ConnectionRecycler(DEFAULT_CONNECTION_CACHE_SIZE, m_active_scheduler)),
+	m_endpoint(endpoint), m_num_acceptors(1),
+	m_read_buffer_size(TCPConnection::READ_BUFFER_SIZE), m_max_read_buffer_size(0),
+	m_ssl_flag(false), m_is_listening(0)
 {}
 
 TCPServer::TCPServer(const unsigned int tcp_port)
 	: m_logger(PION_GET_LOGGER("pion.net.TCPServer")),
 	m_default_scheduler(), m_active_scheduler(m_default_scheduler),
-	m_tcp_acceptor(m_active_scheduler.getIOService()),
 #ifdef PION_HAVE_SSL
 	m_ssl_context(m_active_scheduler.getIOService(), boost::asio::ssl::context::sslv23),
 #else
 	m_ssl_context(0),
 #endif
-	m_endpoint(tcp::v4(), tcp_port), m_ssl_flag(false), m_is_listening(false)
+	m_pending_accepts(0),
+	m_conn_recycler(new ConnectionRecycler(DEFAULT_CONNECTION_CACHE_SIZE, m_active_scheduler)),
+	m_endpoint(tcp::v4(), tcp_port), m_num_acceptors(1),
+	m_read_buffer_size(TCPConnection::READ_BUFFER_SIZE), m_max_read_buffer_size(0),
+	m_ssl_flag(false), m_is_listening(0)
 {}
 
 TCPServer::TCPServer(const tcp::endpoint& endpoint)
 	: m_logger(PION_GET_LOGGER("pion.net.TCPServer")),
 	m_default_scheduler(), m_active_scheduler(m_default_scheduler),
-	m_tcp_acceptor(m_active_scheduler.getIOService()),
 #ifdef PION_HAVE_SSL
 	m_ssl_context(m_active_scheduler.getIOService(), boost::asio::ssl::context::sslv23),
 #else
 	m_ssl_context(0),
 #endif
-	m_endpoint(endpoint), m_ssl_flag(false), m_is_listening(false)
+	m_pending_accepts(0),
+	m_conn_recycler(new ConnectionRecycler(DEFAULT_CONNECTION_CACHE_SIZE, m_active_scheduler)),
+	m_endpoint(endpoint), m_num_acceptors(1),
+	m_read_buffer_size(TCPConnection::READ_BUFFER_SIZE), m_max_read_buffer_size(0),
+	m_ssl_flag(false), m_is_listening(0)
 {}
 	
 void TCPServer::start(void)
@@ -75,7 +99,7 @@ void TCPServer::start(void)
 	// lock mutex for thread safety
 	boost::mutex::scoped_lock server_lock(m_mutex);
 
-	if (! m_is_listening) {
+	if (! isListening()) {
 		PION_LOG_INFO(m_logger, "Starting server on port " << getPort());
 		
 		beforeStarting();
@@ -84,28 +108,18 @@ void TCPServer::start(void)
 		try {
 			// get admin permissions in case we're binding to a privileged port
 			pion::PionAdminRights use_admin_rights(getPort() < 1024);
-			m_tcp_acceptor.open(m_endpoint.protocol());
-			// allow the acceptor to reuse the address (i.e. SO_REUSEADDR)
-			// ...except when running not on Windows - see http://msdn.microsoft.com/en-us/library/ms740621%28VS.85%29.aspx
-#ifndef _MSC_VER
-			m_tcp_acceptor.set_option(tcp::acceptor::reuse_address(true));
-#endif
-			m_tcp_acceptor.bind(m_endpoint);
-			if (m_endpoint.port() == 0) {
-				// update the endpoint to reflect the port chosen by bind
-				m_endpoint = m_tcp_acceptor.local_endpoint();
-			}
-			m_tcp_acceptor.listen();
+			openAcceptors();
 		} catch (std::exception& e) {
+			m_acceptors.clear();
 			PION_LOG_ERROR(m_logger, "Unable to bind to port " << getPort() << ": " << e.what());
 			throw;
 		}
 
-		m_is_listening = true;
+		++m_is_listening;
+		m_conn_recycler->setEnabled(true);
 
-		// unlock the mutex since listen() requires its own lock
-		server_lock.unlock();
-		listen();
+		for (std::size_t n = 0; n < m_acceptors.size(); ++n)
+			listen(n);
 		
 		// notify the thread scheduler that we need it now
 		m_active_scheduler.addActiveUser();
@@ -117,18 +131,20 @@ void TCPServer::stop(bool wait_until_finished)
 	// lock mutex for thread safety
 	boost::mutex::scoped_lock server_lock(m_mutex);
 
-	if (m_is_listening) {
+	if (isListening()) {
 		PION_LOG_INFO(m_logger, "Shutting down server on port " << getPort());
 	
-		m_is_listening = false;
+		--m_is_listening;
 
 		// this terminates any connections waiting to be accepted
-		m_tcp_acceptor.close();
+		for (AcceptorPool::iterator i = m_acceptors.begin(); i != m_acceptors.end(); ++i) {
+			boost::mutex::scoped_lock acceptor_lock((*i)->m_mutex);
+			(*i)->m_acceptor.close();
+		}
 		
 		if (! wait_until_finished) {
 			// this terminates any other open connections
-			std::for_each(m_conn_pool.begin(), m_conn_pool.end(),
-						  boost::bind(&TCPConnection::close, _1));
+			m_conn_pool.closeAll();
 		}
 	
 		// wait for all pending connections to complete
@@ -141,6 +157,11 @@ void TCPServer::stop(bool wait_until_finished)
 			PionScheduler::sleep(m_no_more_connections, server_lock, 0, 250000000);
 		}
 		
+		// release the listening sockets and recycled connections before
+		// their I/O services may be destroyed
+		m_acceptors.clear();
+		m_conn_recycler->setEnabled(false);
+
 		// notify the thread scheduler that we no longer need it
 		m_active_scheduler.removeActiveUser();
 		
@@ -153,7 +174,7 @@ void TCPServer::stop(bool wait_until_finished)
 void TCPServer::join(void)
 {
 	boost::mutex::scoped_lock server_lock(m_mutex);
-	while (m_is_listening) {
+	while (isListening()) {
 		// sleep until server_has_stopped condition is signaled
 		m_server_has_stopped.wait(server_lock);
 	}
@@ -172,40 +193,121 @@ void TCPServer::setSSLKeyFile(const std::string& pem_key_file)
 #endif
 }
 
-void TCPServer::listen(void)
+void TCPServer::openAcceptors(void)
 {
-	// lock mutex for thread safety
-	boost::mutex::scoped_lock server_lock(m_mutex);
+	// assumes that a server lock has already been acquired
+	m_acceptors.clear();
+	const std::size_t num_acceptors = getAcceptorsToOpen();
 	
-	if (m_is_listening) {
+	// with multiple acceptors, give each one its own I/O service if possible
+	PionOneToOneScheduler *one_to_one_ptr = (num_acceptors > 1
+		? dynamic_cast<PionOneToOneScheduler*>(&m_active_scheduler) : NULL);
+	if (one_to_one_ptr != NULL)
+		one_to_one_ptr->getIOService();	// makes sure that the service pool is initialized
+
+	for (std::size_t n = 0; n < num_acceptors; ++n) {
+		boost::shared_ptr<Acceptor> acceptor_ptr;
+		if (one_to_one_ptr == NULL) {
+			boost::uint32_t service_num;
+			boost::asio::io_service& io_service(m_active_scheduler.getConnectionService(service_num));
+			acceptor_ptr.reset(new Acceptor(io_service, service_num));
+		} else {
+			const boost::uint32_t service_num = n % one_to_one_ptr->getNumThreads();
+			acceptor_ptr.reset(new Acceptor(one_to_one_ptr->getIOService(service_num), service_num));
+		}
+		tcp::acceptor& tcp_acceptor = acceptor_ptr->m_acceptor;
+		tcp_acceptor.open(m_endpoint.protocol());
+		// allow the acceptor to reuse the address (i.e. SO_REUSEADDR)
+		// ...except when running not on Windows - see http://msdn.microsoft.com/en-us/library/ms740621%28VS.85%29.aspx
+#ifndef _MSC_VER
+		tcp_acceptor.set_option(tcp::acceptor::reuse_address(true));
+#endif
+#ifdef SO_REUSEPORT
+		// allow the kernel to balance new connections between the acceptors
+		if (num_acceptors > 1)
+			tcp_acceptor.set_option(ReusePortOption(true));
+#endif
+		m_socket_policy.applyToAcceptor(tcp_acceptor);
+		tcp_acceptor.bind(m_endpoint);
+		if (m_endpoint.port() == 0) {
+			// update the endpoint to reflect the port chosen by bind
+			// (remaining acceptors will share the same port)
+			m_endpoint = tcp_acceptor.local_endpoint();
+		}
+		tcp_acceptor.listen();
+		m_acceptors.push_back(acceptor_ptr);
+	}
+
+	if (num_acceptors > 1) {
+		PION_LOG_DEBUG(m_logger, "Opened " << num_acceptors << " acceptors on port " << getPort());
+	}
+}
+
+std::size_t TCPServer::getAcceptorsToOpen(void) const
+{
+#ifdef SO_REUSEPORT
+	if (m_num_acceptors == 0)
+		return (m_active_scheduler.getNumThreads() > 0 ? m_active_scheduler.getNumThreads() : 1);
+	return m_num_acceptors;
+#else
+	return 1;
+#endif
+}
+
+void TCPServer::listen(std::size_t acceptor_num)
+{
+	// this is called by start() or by the handler of the previous accept,
+	// whose connection keeps stop() from releasing the acceptors
+	if (isListening()) {
+		// when using multiple acceptors, connections stay on the same
+		// I/O service as the acceptor that received them
+		Acceptor& acceptor = *m_acceptors[acceptor_num];
+		boost::uint32_t service_num = acceptor.m_service_num;
+		boost::asio::io_service& io_service = (m_acceptors.size() > 1
+			? acceptor.m_service : m_active_scheduler.getConnectionService(service_num));
+		
 		// create a new TCP connection object
-		TCPConnectionPtr new_connection(TCPConnection::create(getIOService(),
-															  m_ssl_context, m_ssl_flag,
-															  boost::bind(&TCPServer::finishConnection,
-																		  this, _1)));
+		TCPConnectionPtr new_connection(createConnection(io_service, service_num));
 		
-		// prune connections that finished uncleanly
-		pruneConnections();
-
 		// keep track of the object in the server's connection pool
-		m_conn_pool.insert(new_connection);
+		++m_pending_accepts;
+		m_conn_pool.add(new_connection);
 		
 		// use the object to accept a new connection
-		new_connection->async_accept(m_tcp_acceptor,
+		boost::mutex::scoped_lock acceptor_lock(acceptor.m_mutex);
+		new_connection->async_accept(acceptor.m_acceptor,
 									 boost::bind(&TCPServer::handleAccept,
-												 this, new_connection,
+												 this, acceptor_num, new_connection,
 												 boost::asio::placeholders::error));
 	}
 }
 
-void TCPServer::handleAccept(TCPConnectionPtr& tcp_conn,
+TCPConnectionPtr TCPServer::createConnection(boost::asio::io_service& io_service,
+											 boost::uint32_t service_num)
+{
+	// SSL stream state cannot be reset, so only plain connections are recycled
+	TCPConnection *conn_ptr = (m_ssl_flag ? NULL : m_conn_recycler->acquire(io_service, service_num));
+	TCPConnectionPtr new_connection(conn_ptr != NULL
+		? TCPConnectionPtr(conn_ptr, ConnectionDeleter(m_conn_recycler, service_num))
+		: TCPConnection::create(io_service, m_ssl_context, m_ssl_flag,
+								boost::bind(&TCPServer::finishConnection, this, _1),
+								ConnectionDeleter(m_conn_recycler, service_num)));
+	new_connection->setReadBufferSize(m_read_buffer_size, m_max_read_buffer_size);
+	// the count is decremented by ConnectionRecycler::release(), which every
+	// connection passes through however it is closed
+	m_active_scheduler.addServiceConnection(service_num);
+	return new_connection;
+}
+
+void TCPServer::handleAccept(std::size_t acceptor_num, TCPConnectionPtr& tcp_conn,
 							 const boost::system::error_code& accept_error)
 {
+	--m_pending_accepts;
 	if (accept_error) {
 		// an error occured while trying to a accept a new connection
 		// this happens when the server is being shut down
-		if (m_is_listening) {
-			listen();	// schedule acceptance of another connection
+		if (isListening()) {
+			listen(acceptor_num);	// schedule acceptance of another connection
 			PION_LOG_WARN(m_logger, "Accept error on port " << getPort() << ": " << accept_error.message());
 		}
 		finishConnection(tcp_conn);
@@ -216,7 +318,15 @@ void TCPServer::handleAccept(TCPConnectionPtr& tcp_conn,
 
 		// schedule the acceptance of another new connection
 		// (this returns immediately since it schedules it as an event)
-		if (m_is_listening) listen();
+		if (isListening()) listen(acceptor_num);
+		
+		// configure the socket before anything is read or written
+		boost::system::error_code option_error;
+		m_socket_policy.applyToConnection(*tcp_conn, option_error);
+		if (option_error) {
+			PION_LOG_WARN(m_logger, "Unable to set socket options on port " << getPort()
+						  << ": " << option_error.message());
+		}
 		
 		// handle the new connection
 #ifdef PION_HAVE_SSL
@@ -248,40 +358,35 @@ void TCPServer::handleSSLHandshake(TCPConnectionPtr& tcp_conn,
 
 void TCPServer::finishConnection(TCPConnectionPtr& tcp_conn)
 {
-	boost::mutex::scoped_lock server_lock(m_mutex);
-	if (m_is_listening && tcp_conn->getKeepAlive()) {
+	// the listening flag is atomic, so keep-alive connections are handled
+	// without locking the server
+	if (isListening() && tcp_conn->getKeepAlive()) {
 		
-		// keep the connection alive
+		// keep the connection alive (releasing any memory used to read
+		// large messages while it waits for the next request)
+		tcp_conn->shrinkReadBuffer();
 		handleConnection(tcp_conn);
 
 	} else {
 		PION_LOG_DEBUG(m_logger, "Closing connection on port " << getPort());
 		
 		// remove the connection from the server's management pool
-		ConnectionPool::iterator conn_itr = m_conn_pool.find(tcp_conn);
-		if (conn_itr != m_conn_pool.end())
-			m_conn_pool.erase(conn_itr);
+		m_conn_pool.remove(tcp_conn);
 
 		// trigger the no more connections condition if we're waiting to stop
-		if (!m_is_listening && m_conn_pool.empty())
+		// (stop() changes the flag and waits for the condition with the lock held)
+		if (! isListening() && m_conn_pool.empty()) {
+			boost::mutex::scoped_lock server_lock(m_mutex);
 			m_no_more_connections.notify_all();
+		}
 	}
 }
 
 std::size_t TCPServer::pruneConnections(void)
 {
-	// assumes that a server lock has already been acquired
-	ConnectionPool::iterator conn_itr = m_conn_pool.begin();
-	while (conn_itr != m_conn_pool.end()) {
-		if (conn_itr->unique()) {
-			PION_LOG_WARN(m_logger, "Closing orphaned connection on port " << getPort());
-			ConnectionPool::iterator erase_itr = conn_itr;
-			++conn_itr;
-			(*erase_itr)->close();
-			m_conn_pool.erase(erase_itr);
-		} else {
-			++conn_itr;
-		}
+	const std::size_t num_pruned = m_conn_pool.prune();
+	if (num_pruned > 0) {
+		PION_LOG_WARN(m_logger, "Removed " << num_pruned << " orphaned connections on port " << getPort());
 	}
 
 	// return the number of connections remaining
@@ -290,8 +395,192 @@ std::size_t TCPServer::pruneConnections(void)
 
 std::size_t TCPServer::getConnections(void) const
 {
-	boost::mutex::scoped_lock server_lock(m_mutex);
-	return (m_is_listening ? (m_conn_pool.size() - 1) : m_conn_pool.size());
+	m_conn_pool.prune();
+	// the pool includes the connections waiting to be accepted (which are
+	// counted before they are added, so there may briefly be more of them)
+	const std::size_t num_connections = m_conn_pool.size();
+	const std::size_t num_pending = static_cast<std::size_t>(m_pending_accepts);
+	return (num_connections > num_pending ? num_connections - num_pending : 0);
+}
+
+
+// TCPServer::ConnectionRecycler member functions
+
+TCPConnection *TCPServer::ConnectionRecycler::acquire(boost::asio::io_service& io_service,
+													  boost::uint32_t service_num)
+{
+	FreeList& free_list = getFreeList(service_num);
+	boost::mutex::scoped_lock free_list_lock(free_list.m_mutex);
+	ObjectListMap::iterator i = free_list.m_objects.find(&io_service);
+	if (i == free_list.m_objects.end() || i->second.empty()) {
+		++free_list.m_misses;
+		return NULL;
+	}
+	TCPConnection *conn_ptr = i->second.back();
+	i->second.pop_back();
+	--m_size;
+	++free_list.m_hits;
+	return conn_ptr;
+}
+
+void TCPServer::ConnectionRecycler::release(TCPConnection *conn_ptr,
+											 boost::uint32_t service_num)
+{
+	// SSL stream state cannot be reset, so only plain connections are recycled
+	const bool is_recyclable = ! conn_ptr->getSSLFlag();
+	if (is_recyclable) {
+		// make sure that the socket is closed before the object is reused
+		conn_ptr->reset();
+	}
+	
+	FreeList& free_list = getFreeList(service_num);
+	boost::mutex::scoped_lock free_list_lock(free_list.m_mutex);
+	if (m_scheduler_ptr != NULL)
+		m_scheduler_ptr->removeServiceConnection(service_num);
+	// other free lists may be changing the size, so the limit is approximate
+	if (is_recyclable && m_is_enabled && static_cast<std::size_t>(m_size) < m_max_size) {
+		free_list.m_objects[&conn_ptr->getIOService()].push_back(conn_ptr);
+		++m_size;
+		return;
+	}
+	free_list_lock.unlock();
+	delete conn_ptr;
+}
+
+void TCPServer::ConnectionRecycler::setScheduler(PionScheduler *scheduler_ptr)
+{
+	lockFreeLists();
+	m_scheduler_ptr = scheduler_ptr;
+	unlockFreeLists();
+}
+
+void TCPServer::ConnectionRecycler::setMaxSize(std::size_t n)
+{
+	lockFreeLists();
+	m_max_size = n;
+	unlockFreeLists();
+}
+
+boost::uint64_t TCPServer::ConnectionRecycler::getHits(void) const
+{
+	boost::uint64_t hits = 0;
+	for (std::size_t n = 0; n < NUM_FREE_LISTS; ++n) {
+		boost::mutex::scoped_lock free_list_lock(m_free_lists[n].m_mutex);
+		hits += m_free_lists[n].m_hits;
+	}
+	return hits;
+}
+
+boost::uint64_t TCPServer::ConnectionRecycler::getMisses(void) const
+{
+	boost::uint64_t misses = 0;
+	for (std::size_t n = 0; n < NUM_FREE_LISTS; ++n) {
+		boost::mutex::scoped_lock free_list_lock(m_free_lists[n].m_mutex);
+		misses += m_free_lists[n].m_misses;
+	}
+	return misses;
+}
+
+void TCPServer::ConnectionRecycler::clear(void)
+{
+	for (std::size_t n = 0; n < NUM_FREE_LISTS; ++n) {
+		ObjectListMap objects;
+		boost::mutex::scoped_lock free_list_lock(m_free_lists[n].m_mutex);
+		objects.swap(m_free_lists[n].m_objects);
+		free_list_lock.unlock();
+		
+		for (ObjectListMap::iterator i = objects.begin(); i != objects.end(); ++i) {
+			for (ObjectList::iterator j = i->second.begin(); j != i->second.end(); ++j) {
+				--m_size;
+				delete *j;
+			}
+		}
+	}
+}
+
+void TCPServer::ConnectionRecycler::setEnabled(bool b)
+{
+	lockFreeLists();
+	m_is_enabled = b;
+	unlockFreeLists();
+	if (! b)
+		clear();
+}
+
+
+// TCPServer::ConnectionPool member functions
+
+void TCPServer::ConnectionPool::add(const TCPConnectionPtr& tcp_conn)
+{
+	Shard& shard = getShard(tcp_conn.get());
+	boost::mutex::scoped_lock shard_lock(shard.m_mutex);
+	std::pair<ConnectionMap::iterator, bool> result = shard.m_connections.insert(
+		std::make_pair(tcp_conn.get(), boost::weak_ptr<TCPConnection>(tcp_conn)));
+	if (result.second) {
+		++m_size;
+	} else {
+		// the address was reused after a released connection was destroyed
+		result.first->second = tcp_conn;
+	}
+	// sweep released connections once the shard has doubled in size, so
+	// that the cost of sweeping is spread across the insertions
+	if (shard.m_connections.size() > shard.m_sweep_size) {
+		sweep(shard);
+		shard.m_sweep_size = std::max(static_cast<std::size_t>(MIN_SWEEP_SIZE),
+									  shard.m_connections.size() * 2);
+	}
+}
+
+bool TCPServer::ConnectionPool::remove(const TCPConnectionPtr& tcp_conn)
+{
+	Shard& shard = getShard(tcp_conn.get());
+	boost::mutex::scoped_lock shard_lock(shard.m_mutex);
+	if (shard.m_connections.erase(tcp_conn.get()) == 0)
+		return false;
+	--m_size;
+	return true;
+}
+
+void TCPServer::ConnectionPool::closeAll(void)
+{
+	for (std::size_t n = 0; n < NUM_SHARDS; ++n) {
+		Shard& shard = m_shards[n];
+		boost::mutex::scoped_lock shard_lock(shard.m_mutex);
+		for (ConnectionMap::iterator i = shard.m_connections.begin();
+			 i != shard.m_connections.end(); ++i)
+		{
+			TCPConnectionPtr tcp_conn(i->second.lock());
+			if (tcp_conn)
+				tcp_conn->close();
+		}
+	}
+}
+
+std::size_t TCPServer::ConnectionPool::prune(void)
+{
+	std::size_t num_pruned = 0;
+	for (std::size_t n = 0; n < NUM_SHARDS; ++n) {
+		boost::mutex::scoped_lock shard_lock(m_shards[n].m_mutex);
+		num_pruned += sweep(m_shards[n]);
+	}
+	return num_pruned;
+}
+
+std::size_t TCPServer::ConnectionPool::sweep(Shard& shard)
+{
+	// assumes that the shard lock has already been acquired
+	std::size_t num_pruned = 0;
+	ConnectionMap::iterator i = shard.m_connections.begin();
+	while (i != shard.m_connections.end()) {
+		if (i->second.expired()) {
+			shard.m_connections.erase(i++);
+			--m_size;
+			++num_pruned;
+		} else {
+			++i;
+		}
+	}
+	return num_pruned;
 }
 
 }	// end namespace net
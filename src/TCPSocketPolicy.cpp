@@ -0,0 +1,157 @@
+// ------------------------------------------------------------------
+// pion-net: a C++ framework for building lightweight HTTP interfaces
+// ------------------------------------------------------------------
+// Copyright (C) 2007-2011 Atomic Labs, Inc.  (http://www.atomiclabs.com)
+//
+// Distributed under the Boost Software License, Version 1.0.
+// See http://www.boost.org/LICENSE_1_0.txt
+//
+
+#include <boost/lexical_cast.hpp>
+#include <pion/net/TCPSocketPolicy.hpp>
+#include <pion/net/TCPSocketOptions.hpp>
+
+using boost::asio::ip::tcp;
+
+#ifdef TCP_QUICKACK
+/// socket option used to disable delayed acknowledgements
+typedef pion::net::BooleanSocketOption<IPPROTO_TCP, TCP_QUICKACK>	QuickAckOption;
+#endif
+#ifdef TCP_KEEPIDLE
+/// socket option used to set the idle time before the first keepalive probe
+typedef pion::net::IntegerSocketOption<IPPROTO_TCP, TCP_KEEPIDLE>	KeepAliveIdleOption;
+#endif
+#ifdef TCP_KEEPINTVL
+/// socket option used to set the time between keepalive probes
+typedef pion::net::IntegerSocketOption<IPPROTO_TCP, TCP_KEEPINTVL>	KeepAliveIntervalOption;
+#endif
+#ifdef TCP_KEEPCNT
+/// socket option used to set the number of keepalive probes
+typedef pion::net::IntegerSocketOption<IPPROTO_TCP, TCP_KEEPCNT>	KeepAliveCountOption;
+#endif
+#ifdef TCP_DEFER_ACCEPT
+/// socket option used to defer accepting connections until data arrives
+typedef pion::net::IntegerSocketOption<IPPROTO_TCP, TCP_DEFER_ACCEPT>	DeferAcceptOption;
+#endif
+
+
+namespace pion {	// begin namespace pion
+namespace net {		// begin namespace net (Pion Network Library)
+
+
+// static helper functions
+
+/// parses a boolean option value
+static bool parseBoolOption(const std::string& name, const std::string& value)
+{
+	if (value == "true" || value == "yes" || value == "on" || value == "1")
+		return true;
+	if (value == "false" || value == "no" || value == "off" || value == "0")
+		return false;
+	throw TCPSocketPolicy::BadOptionException(name + '=' + value);
+}
+
+/// parses a non-negative integer option value
+static int parseIntOption(const std::string& name, const std::string& value)
+{
+	int n = -1;
+	try { n = boost::lexical_cast<int>(value); }
+	catch (boost::bad_lexical_cast&) {}
+	if (n < 0)
+		throw TCPSocketPolicy::BadOptionException(name + '=' + value);
+	return n;
+}
+
+
+// TCPSocketPolicy member functions
+
+void TCPSocketPolicy::setOption(const std::string& name, const std::string& value)
+{
+	if (name == "nodelay") {
+		m_no_delay = parseBoolOption(name, value);
+	} else if (name == "cork") {
+		m_cork_headers = parseBoolOption(name, value);
+	} else if (name == "quickack") {
+		m_quick_ack = parseBoolOption(name, value);
+	} else if (name == "sndbuf") {
+		m_send_buffer_size = parseIntOption(name, value);
+	} else if (name == "rcvbuf") {
+		m_receive_buffer_size = parseIntOption(name, value);
+	} else if (name == "keepalive") {
+		m_keep_alive = parseBoolOption(name, value);
+	} else if (name == "keepidle") {
+		m_keep_alive_idle = parseIntOption(name, value);
+	} else if (name == "keepintvl") {
+		m_keep_alive_interval = parseIntOption(name, value);
+	} else if (name == "keepcnt") {
+		m_keep_alive_count = parseIntOption(name, value);
+	} else if (name == "deferaccept") {
+		m_defer_accept = parseIntOption(name, value);
+	} else {
+		throw BadOptionException(name);
+	}
+}
+
+void TCPSocketPolicy::applyToAcceptor(tcp::acceptor& tcp_acceptor) const
+{
+#ifdef TCP_DEFER_ACCEPT
+	if (m_defer_accept > 0)
+		tcp_acceptor.set_option(DeferAcceptOption(m_defer_accept));
+#endif
+}
+
+void TCPSocketPolicy::applyToConnection(TCPConnection& tcp_conn,
+										boost::system::error_code& ec) const
+{
+	// keep going after errors so that every option has a chance to be set,
+	// but report the first one
+	tcp::socket& tcp_socket = tcp_conn.getSocket();
+	boost::system::error_code option_ec;
+	ec.clear();
+	if (m_no_delay) {
+		tcp_socket.set_option(tcp::no_delay(true), option_ec);
+		if (option_ec && ! ec) ec = option_ec;
+	}
+#ifdef TCP_QUICKACK
+	// this is not sticky: the kernel clears it after the first round trip
+	if (m_quick_ack) {
+		tcp_socket.set_option(QuickAckOption(true), option_ec);
+		if (option_ec && ! ec) ec = option_ec;
+	}
+#endif
+	if (m_send_buffer_size > 0) {
+		tcp_socket.set_option(tcp::socket::send_buffer_size(m_send_buffer_size), option_ec);
+		if (option_ec && ! ec) ec = option_ec;
+	}
+	if (m_receive_buffer_size > 0) {
+		tcp_socket.set_option(tcp::socket::receive_buffer_size(m_receive_buffer_size), option_ec);
+		if (option_ec && ! ec) ec = option_ec;
+	}
+	if (m_keep_alive) {
+		tcp_socket.set_option(tcp::socket::keep_alive(true), option_ec);
+		if (option_ec && ! ec) ec = option_ec;
+#ifdef TCP_KEEPIDLE
+		if (m_keep_alive_idle > 0) {
+			tcp_socket.set_option(KeepAliveIdleOption(m_keep_alive_idle), option_ec);
+			if (option_ec && ! ec) ec = option_ec;
+		}
+#endif
+#ifdef TCP_KEEPINTVL
+		if (m_keep_alive_interval > 0) {
+			tcp_socket.set_option(KeepAliveIntervalOption(m_keep_alive_interval), option_ec);
+			if (option_ec && ! ec) ec = option_ec;
+		}
+#endif
+#ifdef TCP_KEEPCNT
+		if (m_keep_alive_count > 0) {
+			tcp_socket.set_option(KeepAliveCountOption(m_keep_alive_count), option_ec);
+			if (option_ec && ! ec) ec = option_ec;
+		}
+#endif
+	}
+	tcp_conn.setCorkWrites(m_cork_headers);
+}
+
+
+}	// end namespace net
+}	// end namespace pion
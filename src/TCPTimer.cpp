@@ -18,34 +18,150 @@ namespace net {		// begin namespace net (Pion Network Library)
 // TCPTimer member functions
 
 TCPTimer::TCPTimer(TCPConnectionPtr& conn_ptr)
-	: m_conn_ptr(conn_ptr), m_timer(conn_ptr->getIOService()),
-	m_timer_active(false), m_was_cancelled(false)
+	: m_conn_ptr(conn_ptr),
+	m_service(boost::asio::use_service<TCPTimerService>(conn_ptr->getIOService())),
+	m_prev(NULL), m_next(NULL), m_expires(0), m_timer_active(false)
 {
 }
 
 void TCPTimer::start(const boost::uint32_t seconds)
 {
-	boost::mutex::scoped_lock timer_lock(m_mutex);
-	m_timer_active = true;
-	m_timer.expires_from_now(boost::posix_time::seconds(seconds));
-	m_timer.async_wait(boost::bind(&TCPTimer::timerCallback,
-		shared_from_this(), _1));
+	m_service.add(*this, seconds);
 }
 
 void TCPTimer::cancel(void)
 {
-	boost::mutex::scoped_lock timer_lock(m_mutex);
-	m_was_cancelled = true;
-	if (m_timer_active)
-		m_timer.cancel();
+	m_service.remove(*this);
 }
 
-void TCPTimer::timerCallback(const boost::system::error_code& ec)
+
+// static members of TCPTimerService
+
+boost::asio::io_service::id		TCPTimerService::id;
+const boost::uint32_t			TCPTimerService::TICK_MILLISECONDS = 250;
+
+
+// TCPTimerService member functions
+
+TCPTimerService::TCPTimerService(boost::asio::io_service& io_service)
+	: boost::asio::io_service::service(io_service),
+	m_tick_timer(io_service), m_current_tick(0), m_num_timers(0),
+	m_is_ticking(false), m_is_shutdown(false)
+{
+	for (std::size_t n = 0; n < NUM_SLOTS; ++n)
+		m_slots[n] = NULL;
+}
+
+void TCPTimerService::add(TCPTimer& timer, const boost::uint32_t seconds)
+{
+	boost::mutex::scoped_lock wheel_lock(m_mutex);
+	if (m_is_shutdown)
+		return;
+	if (timer.m_timer_active)
+		unlink(timer);
+
+	// round up so that the timer never expires early
+	const boost::uint64_t ticks = (static_cast<boost::uint64_t>(seconds) * 1000
+		+ TICK_MILLISECONDS - 1) / TICK_MILLISECONDS + 1;
+	timer.m_expires = m_current_tick + ticks;
+
+	// link the timer at the front of its slot
+	TCPTimer *& slot_head = m_slots[timer.m_expires & (NUM_SLOTS - 1)];
+	timer.m_prev = NULL;
+	timer.m_next = slot_head;
+	if (slot_head != NULL)
+		slot_head->m_prev = &timer;
+	slot_head = &timer;
+	timer.m_timer_active = true;
+	++m_num_timers;
+
+	// make sure that the wheel is turning
+	if (! m_is_ticking) {
+		m_is_ticking = true;
+		m_tick_timer.expires_from_now(boost::posix_time::milliseconds(TICK_MILLISECONDS));
+		m_tick_timer.async_wait(boost::bind(&TCPTimerService::tick, this,
+											boost::asio::placeholders::error));
+	}
+}
+
+void TCPTimerService::remove(TCPTimer& timer)
 {
-	boost::mutex::scoped_lock timer_lock(m_mutex);
-	m_timer_active = false;
-	if (! m_was_cancelled)
-		m_conn_ptr->close();
+	boost::mutex::scoped_lock wheel_lock(m_mutex);
+	if (timer.m_timer_active)
+		unlink(timer);
+}
+
+void TCPTimerService::unlink(TCPTimer& timer)
+{
+	// assumes that the wheel is already locked
+	if (timer.m_prev == NULL)
+		m_slots[timer.m_expires & (NUM_SLOTS - 1)] = timer.m_next;
+	else
+		timer.m_prev->m_next = timer.m_next;
+	if (timer.m_next != NULL)
+		timer.m_next->m_prev = timer.m_prev;
+	timer.m_prev = timer.m_next = NULL;
+	timer.m_timer_active = false;
+	--m_num_timers;
+}
+
+void TCPTimerService::shutdown_service(void)
+{
+	boost::mutex::scoped_lock wheel_lock(m_mutex);
+	m_is_shutdown = true;
+	for (std::size_t n = 0; n < NUM_SLOTS; ++n) {
+		while (m_slots[n] != NULL)
+			unlink(*m_slots[n]);
+	}
+}
+
+void TCPTimerService::tick(const boost::system::error_code& ec)
+{
+	if (ec == boost::asio::error::operation_aborted)
+		return;
+
+	boost::mutex::scoped_lock wheel_lock(m_mutex);
+	if (m_is_shutdown)
+		return;
+
+	// unlink the timers in the current slot that have expired
+	++m_current_tick;
+	TCPTimer *timer_ptr = m_slots[m_current_tick & (NUM_SLOTS - 1)];
+	while (timer_ptr != NULL) {
+		TCPTimer *next_ptr = timer_ptr->m_next;
+		if (timer_ptr->m_expires <= m_current_tick) {
+			// skip connections that are already being destroyed
+			TCPConnectionPtr conn_ptr(timer_ptr->m_conn_ptr.lock());
+			if (conn_ptr)
+				m_expired.push_back(conn_ptr);
+			unlink(*timer_ptr);
+		}
+		timer_ptr = next_ptr;
+	}
+
+	// keep turning the wheel while there are active timers
+	if (m_num_timers > 0) {
+		m_tick_timer.expires_at(m_tick_timer.expires_at()
+								+ boost::posix_time::milliseconds(TICK_MILLISECONDS));
+		m_tick_timer.async_wait(boost::bind(&TCPTimerService::tick, this,
+											boost::asio::placeholders::error));
+	} else {
+		m_is_ticking = false;
+	}
+
+	// close the connections after unlocking, since their timers may be
+	// cancelled by handlers running in other threads
+	if (m_expired.empty())
+		return;
+	std::vector<TCPConnectionPtr> expired;
+	expired.swap(m_expired);
+	wheel_lock.unlock();
+	for (std::vector<TCPConnectionPtr>::iterator i = expired.begin(); i != expired.end(); ++i)
+		(*i)->close();
+	expired.clear();
+	wheel_lock.lock();
+	if (m_expired.empty())
+		m_expired.swap(expired);	// keeps the memory for the next tick
 }
 
 
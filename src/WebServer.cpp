@@ -117,7 +117,9 @@ void WebServer::loadServiceConfig(const std::string& config_name)
 			// parsing command portion (or beginning of line)
 			if (c == ' ' || c == '\t') {
 				// command finished -> check if valid
-				if (command_string=="path" || command_string=="auth" || command_string=="restrict") {
+				if (command_string=="path" || command_string=="auth" || command_string=="restrict"
+					|| command_string=="socket")
+				{
 					value_string.clear();
 					parse_state = PARSE_VALUE;
 				} else if (command_string=="service" || command_string=="option") {
@@ -225,6 +227,16 @@ void WebServer::loadServiceConfig(const std::string& config_name)
 					option_value_string = value_string.substr(pos + 1);
 					setServiceOption(resource_string, option_name_string,
 									 option_value_string);
+				} else if (command_string == "socket") {
+					// finished socket command
+					std::string::size_type pos = value_string.find('=');
+					if (pos == std::string::npos)
+						throw ConfigParsingException(config_name);
+					option_name_string = value_string.substr(0, pos);
+					option_value_string = value_string.substr(pos + 1);
+					getSocketPolicy().setOption(option_name_string, option_value_string);
+					PION_LOG_INFO(m_logger, "Set socket option: " << option_name_string
+								  << '=' << option_value_string);
 				}
 				command_string.clear();
 				parse_state = PARSE_NEWLINE;
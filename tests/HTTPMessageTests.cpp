@@ -104,6 +104,29 @@ BOOST_AUTO_TEST_CASE(checkGetFirstLineForResponse) {
 	http_response.setStatusMessage(HTTPTypes::RESPONSE_MESSAGE_NOT_FOUND);
 
 	BOOST_CHECK_EQUAL(http_response.getFirstLine(), "HTTP/1.1 404 Not Found");
+
+	http_response.setVersionMinor(0);
+
+	BOOST_CHECK_EQUAL(http_response.getFirstLine(), "HTTP/1.0 404 Not Found");
+}
+
+BOOST_AUTO_TEST_CASE(checkPrepareBuffersForSendUsesOneBlock) {
+	HTTPResponse http_response;
+	http_response.setStatusCode(HTTPTypes::RESPONSE_CODE_NOT_FOUND);
+	http_response.setStatusMessage(HTTPTypes::RESPONSE_MESSAGE_NOT_FOUND);
+	http_response.addHeader("X-Test", "value");
+
+	// the first line and all of the headers are sent from one buffer
+	HTTPMessage::WriteBuffers write_buffers;
+	http_response.prepareBuffersForSend(write_buffers, false, false);
+	BOOST_REQUIRE_EQUAL(write_buffers.size(), static_cast<std::size_t>(1));
+	const std::string header_block(boost::asio::buffer_cast<const char*>(write_buffers[0]),
+								   boost::asio::buffer_size(write_buffers[0]));
+	BOOST_CHECK_EQUAL(header_block.find("HTTP/1.1 404 Not Found\r\n"), static_cast<std::size_t>(0));
+	BOOST_CHECK(header_block.find("\r\nX-Test: value\r\n") != std::string::npos);
+	BOOST_CHECK(header_block.find("\r\nConnection: close\r\n") != std::string::npos);
+	BOOST_CHECK(header_block.find("\r\nContent-Length: 0\r\n") != std::string::npos);
+	BOOST_CHECK_EQUAL(header_block.find("\r\n\r\n"), header_block.size() - 4);
 }
 
 
@@ -169,6 +192,22 @@ BOOST_AUTO_TEST_CASE_FIXTURE_TEMPLATE(testHeaderCaseIsIgnored) {
 	BOOST_CHECK_EQUAL(F::getHeader(HTTPTypes::HEADER_CONTENT_LENGTH), "10");
 }
 
+BOOST_AUTO_TEST_CASE_FIXTURE_TEMPLATE(testUpdateUsingHeaders) {
+	F::addHeader(HTTPTypes::HEADER_CONTENT_LENGTH, " 1234\t");
+	BOOST_CHECK(F::updateContentLengthUsingHeader());
+	BOOST_CHECK_EQUAL(F::getContentLength(), 1234U);
+	F::changeHeader(HTTPTypes::HEADER_CONTENT_LENGTH, "12x");
+	BOOST_CHECK(!F::updateContentLengthUsingHeader());
+	BOOST_CHECK_EQUAL(F::getContentLength(), 1234U);
+
+	F::addHeader(HTTPTypes::HEADER_TRANSFER_ENCODING, "gzip, Chunked");
+	F::updateTransferCodingUsingHeader();
+	BOOST_CHECK(F::isChunked());
+	F::changeHeader(HTTPTypes::HEADER_TRANSFER_ENCODING, "chunk");
+	F::updateTransferCodingUsingHeader();
+	BOOST_CHECK(!F::isChunked());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 
 template<typename ConcreteMessageType>
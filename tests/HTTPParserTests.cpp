@@ -7,6 +7,7 @@
 // See http://www.boost.org/LICENSE_1_0.txt
 //
 
+#include <boost/regex.hpp>
 #include <boost/test/unit_test.hpp>
 #include <pion/PionAlgorithms.hpp>
 #include <pion/net/HTTPParser.hpp>
@@ -342,6 +343,219 @@ BOOST_AUTO_TEST_CASE(testHTTPParser_MultipleResponseFrames)
 	BOOST_CHECK(boost::regex_match(http_response.getContent(), content_regex));
 }
 
+BOOST_AUTO_TEST_CASE(testHTTPParserLongFieldsSplitAcrossReads)
+{
+	const std::string request_str("GET /a/long/resource/path/name.html?first=value&second=another+value HTTP/1.1\r\n"
+		"User-Agent: Mozilla/5.0 (X11; Linux x86_64)\tAppleWebKit/537.36 (KHTML, like Gecko)\r\n"
+		"X-Long-Header-Name-For-Testing: \xc3\xa9t\xc3\xa9\r\n\r\n");
+
+	// parse the same request with every read size from one byte up to the whole message
+	for (std::size_t read_size = 1; read_size <= request_str.size(); ++read_size) {
+		HTTPParser request_parser(true);
+		request_parser.setSaveRawHeaders(true);
+		HTTPRequest http_request;
+		boost::system::error_code ec;
+		boost::tribool rc = boost::indeterminate;
+		for (std::size_t offset = 0; offset < request_str.size() && boost::indeterminate(rc); offset += read_size) {
+			request_parser.setReadBuffer(request_str.c_str() + offset,
+				std::min(read_size, request_str.size() - offset));
+			rc = request_parser.parse(http_request, ec);
+		}
+		BOOST_REQUIRE(rc == true);
+		BOOST_CHECK(!ec);
+		BOOST_CHECK_EQUAL(http_request.getMethod(), "GET");
+		BOOST_CHECK_EQUAL(http_request.getResource(), "/a/long/resource/path/name.html");
+		BOOST_CHECK_EQUAL(http_request.getQueryString(), "first=value&second=another+value");
+		BOOST_CHECK_EQUAL(http_request.getHeader("User-Agent"),
+			"Mozilla/5.0 (X11; Linux x86_64)\tAppleWebKit/537.36 (KHTML, like Gecko)");
+		BOOST_CHECK_EQUAL(http_request.getHeader("X-Long-Header-Name-For-Testing"), "\xc3\xa9t\xc3\xa9");
+		BOOST_CHECK_EQUAL(request_parser.getRawHeaders(), request_str);
+		BOOST_CHECK_EQUAL(request_parser.getTotalBytesRead(), request_str.size());
+	}
+}
+
+BOOST_AUTO_TEST_CASE(testHTTPParserBadCharactersInLongFields)
+{
+	// control character in the middle of a long header value
+	const std::string bad_value("GET / HTTP/1.1\r\nX-Value: abcdefghijklmnopqrstuvwxyz\x01z\r\n\r\n");
+	HTTPParser request_parser(true);
+	request_parser.setReadBuffer(bad_value.c_str(), bad_value.size());
+	HTTPRequest http_request;
+	boost::system::error_code ec;
+	BOOST_CHECK(!request_parser.parse(http_request, ec));
+	BOOST_CHECK_EQUAL(ec.value(), HTTPParser::ERROR_HEADER_CHAR);
+
+	// separator in the middle of a long header name
+	const std::string bad_name("GET / HTTP/1.1\r\nX-Some-Long-Header[Name]: value\r\n\r\n");
+	request_parser.reset();
+	request_parser.setReadBuffer(bad_name.c_str(), bad_name.size());
+	BOOST_CHECK(!request_parser.parse(http_request, ec));
+	BOOST_CHECK_EQUAL(ec.value(), HTTPParser::ERROR_HEADER_CHAR);
+
+	// header name longer than the maximum size
+	const std::string long_name("GET / HTTP/1.1\r\n" + std::string(2048, 'N') + ": value\r\n\r\n");
+	request_parser.reset();
+	request_parser.setReadBuffer(long_name.c_str(), long_name.size());
+	BOOST_CHECK(!request_parser.parse(http_request, ec));
+	BOOST_CHECK_EQUAL(ec.value(), HTTPParser::ERROR_HEADER_NAME_SIZE);
+}
+
+BOOST_AUTO_TEST_CASE(testHTTPParserZeroCopyHeaders)
+{
+	const std::string request_str("GET /index.html HTTP/1.1\r\nHost: www.example.com\r\n"
+		"Cookie: a=b; c=d\r\nContent-Length: 4\r\n\r\nbody");
+	HTTPParser request_parser(true);
+	request_parser.setZeroCopyHeaders(true);
+	request_parser.setReadBuffer(request_str.c_str(), request_str.size());
+
+	HTTPRequest http_request;
+	boost::system::error_code ec;
+	BOOST_CHECK(request_parser.parse(http_request, ec));
+	BOOST_CHECK(!ec);
+	BOOST_CHECK_EQUAL(http_request.getContentLength(), 4UL);
+	BOOST_CHECK_EQUAL(http_request.getCookie("c"), "d");
+
+	// headers should still refer to the read buffer
+	BOOST_REQUIRE_EQUAL(http_request.getHeaderRefs().size(), 3UL);
+	HTTPTypes::StringRef host_ref(http_request.getHeaderRef("host"));
+	BOOST_CHECK(host_ref.data() >= request_str.c_str()
+				&& host_ref.data() < request_str.c_str() + request_str.size());
+	BOOST_CHECK_EQUAL(host_ref.str(), "www.example.com");
+	BOOST_CHECK(http_request.hasHeader(HTTPTypes::HEADER_COOKIE));
+	BOOST_CHECK(! http_request.hasHeader(HTTPTypes::HEADER_USER_AGENT));
+
+	// const accessors leave the header references alone
+	const HTTPRequest& const_request(http_request);
+	BOOST_CHECK(const_request.hasHeader(HTTPTypes::HEADER_HOST));
+	BOOST_CHECK_EQUAL(const_request.getHeader(HTTPTypes::HEADER_HOST), "www.example.com");
+	BOOST_CHECK_EQUAL(const_request.getHeader("content-length"), "4");
+	BOOST_CHECK_EQUAL(const_request.getHeaderRefs().size(), 3UL);
+
+	// non-const accessors copy them into the request
+	BOOST_CHECK_EQUAL(http_request.getHeaders().size(), 3UL);
+	BOOST_CHECK(http_request.getHeaderRefs().empty());
+	BOOST_CHECK_EQUAL(http_request.getHeader(HTTPTypes::HEADER_COOKIE), "a=b; c=d");
+}
+
+BOOST_AUTO_TEST_CASE(testHTTPParserZeroCopyHeadersSplitAcrossReads)
+{
+	std::string first_read("GET / HTTP/1.1\r\nHost: www.example.com\r\nAcc");
+	std::string second_read("ept: */*\r\n\r\n");
+	HTTPParser request_parser(true);
+	request_parser.setZeroCopyHeaders(true);
+
+	HTTPRequest http_request;
+	boost::system::error_code ec;
+	request_parser.setReadBuffer(first_read.c_str(), first_read.size());
+	BOOST_CHECK(boost::indeterminate(request_parser.parse(http_request, ec)));
+	BOOST_CHECK(!ec);
+
+	// headers must not refer to a buffer that is about to be reused
+	BOOST_CHECK(http_request.getHeaderRefs().empty());
+	first_read.assign(first_read.size(), 'X');
+
+	request_parser.setReadBuffer(second_read.c_str(), second_read.size());
+	BOOST_CHECK(request_parser.parse(http_request, ec));
+	BOOST_CHECK(!ec);
+	BOOST_CHECK(http_request.getHeaderRefs().empty());
+	BOOST_CHECK_EQUAL(http_request.getHeader(HTTPTypes::HEADER_HOST), "www.example.com");
+	BOOST_CHECK_EQUAL(http_request.getHeader("Accept"), "*/*");
+}
+
+BOOST_AUTO_TEST_CASE(testHTTPParserChunkedContentInSegments)
+{
+	// a chunk larger than the first segment, followed by a small one
+	const std::string large_chunk(10000, 'x');
+	std::string request_str("POST /upload HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n");
+	request_str += "2710\r\n" + large_chunk + "\r\n5\r\nklmno\r\n0\r\n\r\n";
+
+	HTTPParser request_parser(true);
+	request_parser.setConcatenateChunks(false);
+	request_parser.setReadBuffer(request_str.c_str(), request_str.size());
+
+	HTTPRequest http_request;
+	boost::system::error_code ec;
+	BOOST_CHECK(request_parser.parse(http_request, ec));
+	BOOST_CHECK(!ec);
+	BOOST_CHECK_EQUAL(request_parser.getTotalBytesRead(), request_str.size());
+
+	// the content is left in the chunk cache, which holds it in several segments
+	const HTTPMessage::ChunkCache& chunk_cache(http_request.getChunkCache());
+	BOOST_CHECK_EQUAL(http_request.getContentLength(), 0UL);
+	BOOST_CHECK_EQUAL(chunk_cache.size(), 10005UL);
+	BOOST_CHECK(chunk_cache.getNumSegments() > 1);
+	std::string content_str;
+	for (std::size_t n = 0; n < chunk_cache.getNumSegments(); ++n)
+		content_str.append(chunk_cache.getSegment(n), chunk_cache.getSegmentSize(n));
+	BOOST_CHECK(content_str == large_chunk + "klmno");
+
+	// content is concatenated by default
+	HTTPParser concatenating_parser(true);
+	concatenating_parser.setReadBuffer(request_str.c_str(), request_str.size());
+	http_request.clear();
+	BOOST_CHECK(concatenating_parser.parse(http_request, ec));
+	BOOST_CHECK_EQUAL(http_request.getContentLength(), 10005UL);
+	BOOST_CHECK(std::string(http_request.getContent()) == content_str);
+}
+
+BOOST_AUTO_TEST_CASE(testHTTPParserChunkedContentWithSmallerMaxSize)
+{
+	std::string request_str("POST /upload HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"
+							"5\r\nklmno\r\n4\r\n1234\r\n0\r\n\r\n");
+	HTTPParser request_parser(true);
+	request_parser.setMaxContentLength(7);
+	request_parser.setReadBuffer(request_str.c_str(), request_str.size());
+
+	// content beyond the maximum length is discarded, but still parsed
+	HTTPRequest http_request;
+	boost::system::error_code ec;
+	BOOST_CHECK(request_parser.parse(http_request, ec));
+	BOOST_CHECK(!ec);
+	BOOST_CHECK_EQUAL(request_parser.getTotalBytesRead(), request_str.size());
+	BOOST_CHECK_EQUAL(http_request.getContentLength(), 7UL);
+	BOOST_CHECK_EQUAL(std::string(http_request.getContent()), "klmno12");
+}
+
+BOOST_AUTO_TEST_CASE(testHTTPParserQueryAndCookiesParsedWhenUsed)
+{
+	std::string request_str("POST /form?a=1&b=2 HTTP/1.1\r\nCookie: c=3; d=4\r\n"
+							"Content-Type: application/x-www-form-urlencoded\r\n"
+							"Content-Length: 7\r\n\r\ne=5&a=6");
+	HTTPParser request_parser(true);
+	request_parser.setZeroCopyHeaders(true);
+	request_parser.setReadBuffer(request_str.c_str(), request_str.size());
+
+	HTTPRequest http_request;
+	boost::system::error_code ec;
+	BOOST_CHECK(request_parser.parse(http_request, ec));
+	BOOST_CHECK(!ec);
+	BOOST_CHECK_EQUAL(http_request.getQueryString(), "a=1&b=2");
+
+	// query pairs from the URI come before those from the content
+	// (parsing is deferred, and a const request is parsed into a copy)
+	const HTTPRequest& const_request(http_request);
+	BOOST_CHECK(const_request.hasQuery("b"));
+	BOOST_CHECK_EQUAL(const_request.getQuery("b"), "2");
+	BOOST_CHECK_EQUAL(const_request.getQuery("e"), "5");
+	BOOST_CHECK(! const_request.hasQuery("f"));
+	BOOST_CHECK_EQUAL(http_request.getQueryParams().size(), 4UL);
+	HTTPTypes::QueryParams::const_iterator i = http_request.getQueryParams().find("a");
+	BOOST_REQUIRE(i != http_request.getQueryParams().end());
+	BOOST_CHECK_EQUAL(i->second, "1");
+	BOOST_CHECK_EQUAL((++i)->second, "6");
+
+	// cookie headers are parsed even if they still refer to the read buffer
+	BOOST_CHECK(const_request.hasCookie("c"));
+	BOOST_CHECK_EQUAL(const_request.getCookie("d"), "4");
+	BOOST_CHECK_EQUAL(http_request.getCookieParams().size(), 2UL);
+
+	// parameters are not parsed again after they have been changed
+	http_request.deleteQuery("a");
+	http_request.deleteCookie("c");
+	BOOST_CHECK(! http_request.hasQuery("a"));
+	BOOST_CHECK(! http_request.hasCookie("c"));
+}
+
 
 /// fixture used for testing HTTPParser's X-Fowarded-For header parsing
 class HTTPParserForwardedForTests_F
@@ -10,6 +10,7 @@
 #include <pion/PionConfig.hpp>
 #include <pion/net/HTTPTypes.hpp>
 #include <pion/PionUnitTestDefs.hpp>
+#include <boost/lexical_cast.hpp>
 #include <boost/test/unit_test.hpp>
 
 using namespace pion;
@@ -39,4 +40,149 @@ BOOST_AUTO_TEST_CASE(testCaseInsensitiveEqual) {
 	BOOST_CHECK(!CaseInsensitiveEqual()("abc", "ab"));
 }
 
+BOOST_AUTO_TEST_CASE(testHeadersFindIgnoresCase) {
+	Headers headers;
+	BOOST_CHECK(headers.empty());
+	BOOST_CHECK(headers.find("Host") == headers.end());
+
+	headers.insert(std::make_pair(std::string("Content-Type"), std::string("text/html")));
+	headers.insert(std::make_pair(std::string("Host"), std::string("localhost")));
+	BOOST_CHECK_EQUAL(headers.size(), 2U);
+
+	Headers::const_iterator i = headers.find("content-type");
+	BOOST_REQUIRE(i != headers.end());
+	BOOST_CHECK_EQUAL(i->first, "Content-Type");
+	BOOST_CHECK_EQUAL(i->second, "text/html");
+	BOOST_CHECK(headers.find("HOST") != headers.end());
+	BOOST_CHECK(headers.find("Hos") == headers.end());
+	BOOST_CHECK_EQUAL(headers.count("Content-Length"), 0U);
+
+	// copies must not share the original's memory
+	Headers headers_copy(headers);
+	headers.clear();
+	BOOST_CHECK(headers.empty());
+	BOOST_CHECK_EQUAL(headers_copy.size(), 2U);
+	BOOST_CHECK_EQUAL(headers_copy.find("host")->second, "localhost");
+}
+
+BOOST_AUTO_TEST_CASE(testHeadersKeepValuesForSameNameTogether) {
+	Headers headers;
+	headers.insert(std::make_pair(std::string("Set-Cookie"), std::string("a=1")));
+	headers.insert(std::make_pair(std::string("Host"), std::string("localhost")));
+	headers.insert(std::make_pair(std::string("set-cookie"), std::string("b=2")));
+	// add enough headers to make the container grow
+	for (unsigned int n = 0; n < 40; ++n)
+		headers.insert(std::make_pair("X-Header-" + boost::lexical_cast<std::string>(n), std::string("x")));
+	headers.insert(std::make_pair(std::string("SET-COOKIE"), std::string("c=3")));
+	BOOST_CHECK_EQUAL(headers.size(), 44U);
+	BOOST_CHECK_EQUAL(headers.count("Set-Cookie"), 3U);
+
+	std::pair<Headers::iterator, Headers::iterator> range = headers.equal_range("Set-Cookie");
+	BOOST_REQUIRE(range.first != headers.end());
+	BOOST_CHECK_EQUAL(range.first->second, "a=1");
+	BOOST_CHECK_EQUAL((++range.first)->second, "b=2");
+	BOOST_CHECK_EQUAL((++range.first)->second, "c=3");
+	BOOST_CHECK(++range.first == range.second);
+	BOOST_CHECK_EQUAL(range.second->first, "Host");
+
+	BOOST_CHECK_EQUAL(headers.erase("set-cookie"), 3U);
+	BOOST_CHECK_EQUAL(headers.size(), 41U);
+	BOOST_CHECK(headers.find("Set-Cookie") == headers.end());
+	BOOST_CHECK_EQUAL(headers.begin()->first, "Host");
+	BOOST_CHECK_EQUAL(headers.find("x-header-39")->second, "x");
+}
+
+BOOST_AUTO_TEST_CASE(testFindHeaderIdForWellKnownHeaders) {
+	const std::string names[] = {
+		HEADER_HOST, HEADER_COOKIE, HEADER_SET_COOKIE, HEADER_CONNECTION,
+		HEADER_CONTENT_TYPE, HEADER_CONTENT_LENGTH, HEADER_CONTENT_LOCATION,
+		HEADER_CONTENT_ENCODING, HEADER_LAST_MODIFIED, HEADER_IF_MODIFIED_SINCE,
+		HEADER_TRANSFER_ENCODING, HEADER_LOCATION, HEADER_AUTHORIZATION,
+		HEADER_REFERER, HEADER_USER_AGENT, HEADER_X_FORWARDED_FOR, HEADER_CLIENT_IP
+	};
+	BOOST_REQUIRE_EQUAL(sizeof(names) / sizeof(names[0]), static_cast<std::size_t>(Headers::NUM_HEADER_IDS));
+	for (int n = 0; n < Headers::NUM_HEADER_IDS; ++n) {
+		BOOST_CHECK_EQUAL(Headers::findHeaderId(names[n]), static_cast<Headers::HeaderId>(n));
+		BOOST_CHECK(CaseInsensitiveEqual()(Headers::getHeaderName(static_cast<Headers::HeaderId>(n)), names[n]));
+	}
+	BOOST_CHECK_EQUAL(Headers::findHeaderId("CONTENT-length"), Headers::ID_CONTENT_LENGTH);
+	// same length and last character as well-known headers
+	BOOST_CHECK_EQUAL(Headers::findHeaderId("Content-Lengtg"), Headers::ID_UNKNOWN);
+	BOOST_CHECK_EQUAL(Headers::findHeaderId("Xost"), Headers::ID_UNKNOWN);
+	BOOST_CHECK_EQUAL(Headers::findHeaderId(""), Headers::ID_UNKNOWN);
+	BOOST_CHECK_EQUAL(Headers::findHeaderId("Accept"), Headers::ID_UNKNOWN);
+}
+
+BOOST_AUTO_TEST_CASE(testHeadersFindWellKnownHeadersAfterChanges) {
+	Headers headers;
+	headers.insert(std::make_pair(std::string("Accept"), std::string("*/*")));
+	headers.insert(std::make_pair(std::string("cookie"), std::string("a=1")));
+	headers.insert(std::make_pair(std::string("Host"), std::string("localhost")));
+	headers.insert(std::make_pair(std::string("Cookie"), std::string("b=2")));
+	BOOST_CHECK_EQUAL(headers.find(Headers::ID_HOST)->second, "localhost");
+	BOOST_CHECK_EQUAL(headers.find(Headers::ID_COOKIE)->second, "a=1");
+	BOOST_CHECK(headers.find(Headers::ID_CONNECTION) == headers.end());
+
+	// erasing the first cookie moves the slot to the second one
+	headers.erase(headers.find(Headers::ID_COOKIE));
+	BOOST_CHECK_EQUAL(headers.find(Headers::ID_COOKIE)->second, "b=2");
+	BOOST_CHECK_EQUAL(headers.find(Headers::ID_HOST)->second, "localhost");
+	headers.erase("Accept");
+	BOOST_CHECK_EQUAL(headers.find("COOKIE")->second, "b=2");
+	BOOST_CHECK_EQUAL(headers.find(Headers::ID_HOST)->second, "localhost");
+	headers.erase(HEADER_COOKIE);
+	BOOST_CHECK(headers.find(Headers::ID_COOKIE) == headers.end());
+	BOOST_CHECK_EQUAL(headers.size(), 1U);
+
+	Headers headers_copy(headers);
+	headers.clear();
+	BOOST_CHECK(headers.find(Headers::ID_HOST) == headers.end());
+	BOOST_CHECK_EQUAL(headers_copy.find(Headers::ID_HOST)->second, "localhost");
+}
+
+BOOST_AUTO_TEST_CASE(testParseUInt64) {
+	boost::uint64_t value = 0;
+	BOOST_CHECK(parse_uint64("0", 1, value));
+	BOOST_CHECK_EQUAL(value, 0U);
+	BOOST_CHECK(parse_uint64(" \t42 ", 5, value));
+	BOOST_CHECK_EQUAL(value, 42U);
+	BOOST_CHECK(parse_uint64("18446744073709551615", 20, value));
+	BOOST_CHECK_EQUAL(value, ~static_cast<boost::uint64_t>(0));
+
+	// invalid values leave the result unchanged
+	value = 7;
+	BOOST_CHECK(!parse_uint64("18446744073709551616", 20, value));
+	BOOST_CHECK(!parse_uint64("", 0, value));
+	BOOST_CHECK(!parse_uint64("  ", 2, value));
+	BOOST_CHECK(!parse_uint64("-1", 2, value));
+	BOOST_CHECK(!parse_uint64("1 2", 3, value));
+	BOOST_CHECK(!parse_uint64("0x10", 4, value));
+	BOOST_CHECK_EQUAL(value, 7U);
+}
+
+BOOST_AUTO_TEST_CASE(testFormatUInt64) {
+	char buf[UINT64_STRING_MAX];
+	BOOST_CHECK_EQUAL(std::string(buf, format_uint64(0, buf)), "0");
+	BOOST_CHECK_EQUAL(std::string(buf, format_uint64(1024, buf)), "1024");
+	BOOST_CHECK_EQUAL(std::string(buf, format_uint64(~static_cast<boost::uint64_t>(0), buf)),
+					  "18446744073709551615");
+
+	std::string str("Max-Age=");
+	append_uint64(str, 3600);
+	BOOST_CHECK_EQUAL(str, "Max-Age=3600");
+}
+
+BOOST_AUTO_TEST_CASE(testFindStatusLine) {
+	const std::string *status_line = find_status_line(RESPONSE_CODE_OK, RESPONSE_MESSAGE_OK);
+	BOOST_REQUIRE(status_line != NULL);
+	BOOST_CHECK_EQUAL(*status_line, "HTTP/1.1 200 OK");
+	status_line = find_status_line(RESPONSE_CODE_NOT_FOUND, RESPONSE_MESSAGE_NOT_FOUND);
+	BOOST_REQUIRE(status_line != NULL);
+	BOOST_CHECK_EQUAL(*status_line, "HTTP/1.1 404 Not Found");
+
+	// there are none for non-standard messages or unknown codes
+	BOOST_CHECK(find_status_line(RESPONSE_CODE_NOT_FOUND, RESPONSE_MESSAGE_OK) == NULL);
+	BOOST_CHECK(find_status_line(418, "I'm a teapot") == NULL);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -10,6 +10,7 @@
 #include <pion/PionConfig.hpp>
 #include <pion/PionScheduler.hpp>
 #include <pion/net/TCPServer.hpp>
+#include <pion/net/TCPTimer.hpp>
 #include <boost/asio.hpp>
 #include <boost/bind.hpp>
 #include <boost/function/function1.hpp>
@@ -17,6 +18,14 @@
 #include <boost/test/unit_test.hpp>
 #include <pion/net/HTTPRequest.hpp>
 #include <pion/net/HTTPResponse.hpp>
+#include <pion/net/HTTPRequestReader.hpp>
+#include <pion/net/HTTPResponseWriter.hpp>
+#include <pion/net/SlabPool.hpp>
+#include <pion/net/TCPSocketPolicy.hpp>
+#if defined(PION_HAVE_PTHREAD_SETAFFINITY)
+	#include <pthread.h>
+	#include <sched.h>
+#endif
 
 using namespace std;
 using namespace pion;
@@ -40,6 +49,15 @@ public:
 	 */
 	HelloServer(const unsigned int tcp_port = 0) : pion::net::TCPServer(tcp_port) {}
 	
+	/**
+	 * creates a Hello server
+	 *
+	 * @param scheduler the PionScheduler that will be used to manage worker threads
+	 * @param tcp_port port number used to listen for new connections (IPv4)
+	 */
+	HelloServer(PionScheduler& scheduler, const unsigned int tcp_port = 0)
+		: pion::net::TCPServer(scheduler, tcp_port) {}
+	
 	/**
 	 * handles a new TCP connection
 	 * 
@@ -227,10 +245,307 @@ BOOST_AUTO_TEST_CASE(checkServerExceptionsGetCaught) {
 	tcp_stream_a << "throw";
 	tcp_stream_a.flush();
 	tcp_stream_a.close();
+
+	// the orphaned connection should no longer be counted
+	checkNumConnectionsForUpToOneSecond(static_cast<std::size_t>(0));
+}
+
+BOOST_AUTO_TEST_CASE(checkConnectionObjectsAreRecycled) {
+	tcp::endpoint localhost(boost::asio::ip::address::from_string("127.0.0.1"), getServerPtr()->getPort());
+	std::string message;
+
+	// finished connections should be reused when new connections are accepted
+	for (int i = 0; i < 5; ++i) {
+		tcp::iostream tcp_stream(localhost);
+		std::getline(tcp_stream, message);
+		BOOST_CHECK(message == "Hello there!");
+		tcp_stream << "Hi!\n";
+		tcp_stream.flush();
+		std::getline(tcp_stream, message);
+		BOOST_CHECK(message == "Goodbye!");
+		tcp_stream.close();
+		checkNumConnectionsForUpToOneSecond(static_cast<std::size_t>(0));
+	}
+	BOOST_CHECK(getServerPtr()->getConnectionCacheHits() > 0);
+	BOOST_CHECK(getServerPtr()->getConnectionCacheMisses() > 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+///
+/// MultiAcceptorServerTests_F: fixture used for running (Hello) server tests
+/// with one acceptor per I/O service
+/// 
+class MultiAcceptorServerTests_F {
+public:
+	// default constructor and destructor
+	MultiAcceptorServerTests_F()
+		: m_scheduler(), m_hello_server_ptr()
+	{
+		m_scheduler.setNumThreads(4);
+		m_hello_server_ptr.reset(new HelloServer(m_scheduler));
+		m_hello_server_ptr->setNumAcceptors(0);
+		m_hello_server_ptr->start();
+	}
+	~MultiAcceptorServerTests_F() {
+		m_hello_server_ptr->stop();
+	}
+	inline TCPServerPtr& getServerPtr(void) { return m_hello_server_ptr; }
+	inline PionOneToOneScheduler& getScheduler(void) { return m_scheduler; }
+
+	/// returns the number of connections counted by the scheduler's services
+	inline long getServiceConnections(void) {
+		long total = 0;
+		for (boost::uint32_t n = 0; n < m_scheduler.getNumThreads(); ++n)
+			total += m_scheduler.getServiceConnections(n);
+		return total;
+	}
+
+private:
+	PionOneToOneScheduler	m_scheduler;
+	TCPServerPtr			m_hello_server_ptr;
+};
+
+
+// MultiAcceptorServer Test Cases
+
+BOOST_FIXTURE_TEST_SUITE(MultiAcceptorServerTests_S, MultiAcceptorServerTests_F)
+
+BOOST_AUTO_TEST_CASE(checkMultiAcceptorServerIsListening) {
+	BOOST_CHECK(getServerPtr()->isListening());
+	BOOST_CHECK_EQUAL(getServerPtr()->getConnections(), static_cast<std::size_t>(0));
+}
+
+BOOST_AUTO_TEST_CASE(checkMultiAcceptorServerConnectionBehavior) {
+	tcp::endpoint localhost(boost::asio::ip::address::from_string("127.0.0.1"), getServerPtr()->getPort());
+
+	// open enough connections that more than one acceptor is likely to be used
+	const unsigned int NUM_CONNECTIONS = 8;
+	boost::shared_ptr<tcp::iostream> streams[NUM_CONNECTIONS];
+	std::string message;
+	for (unsigned int n = 0; n < NUM_CONNECTIONS; ++n) {
+		streams[n].reset(new tcp::iostream(localhost));
+		std::getline(*streams[n], message);
+		BOOST_CHECK(message == "Hello there!");
+	}
+	BOOST_CHECK_EQUAL(getServerPtr()->getConnections(), static_cast<std::size_t>(NUM_CONNECTIONS));
+
+	// each connection should still be served correctly
+	for (unsigned int n = 0; n < NUM_CONNECTIONS; ++n) {
+		*streams[n] << "Hi!\n";
+		streams[n]->flush();
+		std::getline(*streams[n], message);
+		BOOST_CHECK(message == "Goodbye!");
+		streams[n]->close();
+	}
+}
+
+BOOST_AUTO_TEST_CASE(checkMultiAcceptorServerCountsServiceConnections) {
+	tcp::endpoint localhost(boost::asio::ip::address::from_string("127.0.0.1"), getServerPtr()->getPort());
+	const long num_acceptors = getServiceConnections();
+	BOOST_CHECK(num_acceptors > 0);
+
+	// connections that are closed by the client are no longer counted, even
+	// if the server never finishes them
+	const unsigned int NUM_CONNECTIONS = 8;
+	std::string message;
+	for (unsigned int n = 0; n < NUM_CONNECTIONS; ++n) {
+		tcp::iostream tcp_stream(localhost);
+		std::getline(tcp_stream, message);
+		BOOST_CHECK(message == "Hello there!");
+		tcp_stream.close();
+	}
+	for (int i = 0; i < 10 && getServiceConnections() != num_acceptors; ++i)
+		PionScheduler::sleep(0, 100000000);	// 0.1 seconds
+	BOOST_CHECK_EQUAL(getServiceConnections(), num_acceptors);
+}
+
+BOOST_AUTO_TEST_CASE(checkOneToOneSchedulerSelectsLeastConnections) {
+	PionOneToOneScheduler scheduler;
+	scheduler.setNumThreads(3);
+
+	// round-robin selection uses each service in turn
+	boost::asio::io_service *first_service = &scheduler.getIOService();
+	BOOST_CHECK(&scheduler.getIOService() != first_service);
+	BOOST_CHECK(&scheduler.getIOService() != first_service);
+	BOOST_CHECK(&scheduler.getIOService() == first_service);
+
+	// the least busy service is selected regardless of order
+	scheduler.setSelectionPolicy(PionOneToOneScheduler::SELECT_LEAST_CONNECTIONS);
+	scheduler.addServiceConnection(0);
+	scheduler.addServiceConnection(2);
+	for (int i = 0; i < 4; ++i)
+		BOOST_CHECK(&scheduler.getIOService() == &scheduler.getIOService(1));
+	BOOST_CHECK_EQUAL(scheduler.getServiceConnections(0), 1);
+	scheduler.removeServiceConnection(0);
+	scheduler.addServiceConnection(1);
+	BOOST_CHECK(&scheduler.getIOService() == &scheduler.getIOService(0));
+
+	// connections are told the number of the service that they use
+	boost::uint32_t service_num = 3;
+	BOOST_CHECK(&scheduler.getConnectionService(service_num) == &scheduler.getIOService(0));
+	BOOST_CHECK_EQUAL(service_num, 0UL);
+}
+
+/// increments a counter (used to check that posted work is run)
+static void incrementCount(boost::detail::atomic_count *count_ptr) { ++(*count_ptr); }
+
+BOOST_AUTO_TEST_CASE(checkOneToOneSchedulerKeepsServicesAcrossRestarts) {
+	PionOneToOneScheduler scheduler;
+	scheduler.setNumThreads(2);
+	scheduler.startup();
+	boost::asio::io_service *first_service = &scheduler.getIOService(0);
+	scheduler.shutdown();
+
+	// the services are reset rather than destroyed, since other threads may
+	// still be using them
+	BOOST_CHECK(&scheduler.getIOService(0) == first_service);
+
+	// work is run again after the scheduler restarts
+	boost::detail::atomic_count work_count(0);
+	scheduler.startup();
+	for (int n = 0; n < 4; ++n)
+		scheduler.post(boost::bind(&incrementCount, &work_count));
+	for (int i = 0; i < 30 && work_count < 4; ++i)
+		PionScheduler::sleep(0, 100000000);
+	BOOST_CHECK_EQUAL(static_cast<long>(work_count), 4L);
+	scheduler.shutdown();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+
+///
+/// WorkStealingServerTests_F: fixture used for running (Hello) server tests
+/// using a work-stealing scheduler
+///
+class WorkStealingServerTests_F {
+public:
+	// default constructor and destructor
+	WorkStealingServerTests_F()
+		: m_scheduler(), m_hello_server_ptr(), m_work_count(0)
+	{
+		m_scheduler.setNumThreads(4);
+		m_hello_server_ptr.reset(new HelloServer(m_scheduler));
+		m_hello_server_ptr->start();
+	}
+	~WorkStealingServerTests_F() {
+		m_hello_server_ptr->stop();
+	}
+	inline TCPServerPtr& getServerPtr(void) { return m_hello_server_ptr; }
+
+	/// counts the number of work items that have been run
+	void countWork(void) {
+		boost::mutex::scoped_lock work_lock(m_work_mutex);
+		++m_work_count;
+	}
+
+	/// queues work for the current thread, then blocks it for a while
+	void postWorkAndBlock(boost::uint32_t num_items) {
+		for (boost::uint32_t n = 0; n < num_items; ++n)
+			m_scheduler.post(boost::bind(&WorkStealingServerTests_F::countWork, this));
+		PionScheduler::sleep(1, 0);
+	}
+
+	PionWorkStealingScheduler	m_scheduler;
+	TCPServerPtr				m_hello_server_ptr;
+	boost::mutex				m_work_mutex;
+	boost::uint32_t				m_work_count;
+};
+
+
+// WorkStealingServer Test Cases
+
+BOOST_FIXTURE_TEST_SUITE(WorkStealingServerTests_S, WorkStealingServerTests_F)
+
+BOOST_AUTO_TEST_CASE(checkWorkStealingServerConnectionBehavior) {
+	tcp::endpoint localhost(boost::asio::ip::address::from_string("127.0.0.1"), getServerPtr()->getPort());
+	tcp::iostream tcp_stream(localhost);
+	std::string message;
+	std::getline(tcp_stream, message);
+	BOOST_CHECK(message == "Hello there!");
+	tcp_stream << "Hi!\n";
+	tcp_stream.flush();
+	std::getline(tcp_stream, message);
+	BOOST_CHECK(message == "Goodbye!");
+}
+
+BOOST_AUTO_TEST_CASE(checkIdleThreadsStealQueuedWork) {
+	// the work is queued for a thread that stays busy, so it can only be
+	// run (well before the busy thread finishes) if other threads steal it
+	m_scheduler.post(boost::bind(&WorkStealingServerTests_F::postWorkAndBlock, this, 100));
+	for (int i = 0; i < 5; ++i) {
+		PionScheduler::sleep(0, 100000000);
+		boost::mutex::scoped_lock work_lock(m_work_mutex);
+		if (m_work_count == 100) break;
+	}
+	boost::mutex::scoped_lock work_lock(m_work_mutex);
+	BOOST_CHECK_EQUAL(m_work_count, static_cast<boost::uint32_t>(100));
 }
 
 BOOST_AUTO_TEST_SUITE_END()
 
+
+#if defined(PION_HAVE_PTHREAD_SETAFFINITY)
+/// saves the CPU affinity of the thread that runs it
+static void saveThreadAffinity(cpu_set_t *cpu_set_ptr, boost::detail::atomic_count *count_ptr) {
+	CPU_ZERO(cpu_set_ptr);
+	pthread_getaffinity_np(pthread_self(), sizeof(cpu_set_t), cpu_set_ptr);
+	++(*count_ptr);
+}
+#endif
+
+BOOST_AUTO_TEST_CASE(checkPinnedSchedulerThreadsServeConnections) {
+	// pin the first thread to a CPU that this thread may run on, and leave
+	// the second one unpinned
+	PionOneToOneScheduler pinned_scheduler;
+	pinned_scheduler.setNumThreads(2);
+	pinned_scheduler.pinThreadsToCPUs();
+	PionMultiThreadScheduler::CPUSet cpus;
+#if defined(PION_HAVE_PTHREAD_SETAFFINITY)
+	cpu_set_t allowed_cpus;
+	CPU_ZERO(&allowed_cpus);
+	BOOST_REQUIRE_EQUAL(pthread_getaffinity_np(pthread_self(), sizeof(allowed_cpus), &allowed_cpus), 0);
+	for (int cpu = 0; cpu < CPU_SETSIZE && cpus.empty(); ++cpu) {
+		if (CPU_ISSET(cpu, &allowed_cpus))
+			cpus.push_back(cpu);
+	}
+#else
+	cpus.push_back(0);
+#endif
+	pinned_scheduler.setThreadAffinity(0, cpus);
+	pinned_scheduler.setThreadAffinity(1, PionMultiThreadScheduler::CPUSet());
+	TCPServerPtr pinned_server_ptr(new HelloServer(pinned_scheduler));
+	pinned_server_ptr->start();
+
+	tcp::endpoint localhost(boost::asio::ip::address::from_string("127.0.0.1"), pinned_server_ptr->getPort());
+	tcp::iostream tcp_stream(localhost);
+	std::string message;
+	std::getline(tcp_stream, message);
+	BOOST_CHECK(message == "Hello there!");
+	tcp_stream << "Hi!\n";
+	tcp_stream.flush();
+	std::getline(tcp_stream, message);
+	BOOST_CHECK(message == "Goodbye!");
+
+#if defined(PION_HAVE_PTHREAD_SETAFFINITY)
+	// check the affinity that each thread actually got (each one runs the
+	// work posted to its own service)
+	cpu_set_t thread_cpus[2];
+	boost::detail::atomic_count num_saved(0);
+	for (boost::uint32_t n = 0; n < 2; ++n)
+		pinned_scheduler.getIOService(n).post(boost::bind(&saveThreadAffinity, &thread_cpus[n], &num_saved));
+	for (int i = 0; i < 30 && num_saved < 2; ++i)
+		PionScheduler::sleep(0, 100000000);
+	BOOST_REQUIRE_EQUAL(static_cast<long>(num_saved), 2L);
+	BOOST_CHECK_EQUAL(CPU_COUNT(&thread_cpus[0]), 1);
+	BOOST_CHECK(CPU_ISSET(cpus[0], &thread_cpus[0]));
+	BOOST_CHECK(CPU_EQUAL(&thread_cpus[1], &allowed_cpus));
+#endif
+	pinned_server_ptr->stop();
+}
+
+
 ///
 /// MockSyncServer: simple TCP server that synchronously receives HTTP requests using HTTPMessage::receive(),
 /// and checks that the received request object has some expected properties.
@@ -312,6 +627,28 @@ public:
 	inline boost::shared_ptr<MockSyncServer>& getServerPtr(void) { return m_sync_server_ptr; }
 	inline boost::asio::io_service& getIOService(void) { return m_scheduler.getIOService(); }
 
+	/// client (first) and server (second) ends of a connection
+	typedef std::pair<TCPConnectionPtr, TCPConnectionPtr>	ConnectionPair;
+
+	/**
+	 * connects a client to a temporary acceptor and accepts the connection
+	 *
+	 * @param io_service the service used by both ends of the connection
+	 * @return ConnectionPair the connected client and server
+	 */
+	inline ConnectionPair connectClientAndServer(boost::asio::io_service& io_service) {
+		tcp::acceptor tcp_acceptor(io_service, tcp::endpoint(tcp::v4(), 0));
+		ConnectionPair conn_pair(TCPConnectionPtr(new TCPConnection(io_service)),
+								 TCPConnectionPtr(new TCPConnection(io_service)));
+		boost::system::error_code error_code;
+		error_code = conn_pair.first->connect(boost::asio::ip::address::from_string("127.0.0.1"),
+											  tcp_acceptor.local_endpoint().port());
+		BOOST_REQUIRE(!error_code);
+		error_code = conn_pair.second->accept(tcp_acceptor);
+		BOOST_REQUIRE(!error_code);
+		return conn_pair;
+	}
+
 private:
 	PionSingleServiceScheduler			m_scheduler;
 	boost::shared_ptr<MockSyncServer>	m_sync_server_ptr;
@@ -453,6 +790,377 @@ bool queryKeyXHasValueY(HTTPRequest& http_request) {
 	return http_request.getQuery("x") == "y";
 }
 
+BOOST_AUTO_TEST_CASE(checkAdaptiveReadBufferGrowsAndShrinks) {
+	TCPConnection tcp_conn(getIOService());
+	tcp_conn.setReadBufferSize(1024, 4096);
+	BOOST_CHECK_EQUAL(tcp_conn.getReadBuffer().size(), static_cast<std::size_t>(1024));
+
+	// the buffer only grows if the last read filled it
+	tcp_conn.growReadBuffer(512);
+	BOOST_CHECK_EQUAL(tcp_conn.getReadBuffer().size(), static_cast<std::size_t>(1024));
+	tcp_conn.growReadBuffer(1024);
+	BOOST_CHECK_EQUAL(tcp_conn.getReadBuffer().size(), static_cast<std::size_t>(2048));
+	tcp_conn.growReadBuffer(2048);
+	BOOST_CHECK_EQUAL(tcp_conn.getReadBuffer().size(), static_cast<std::size_t>(4096));
+	tcp_conn.growReadBuffer(4096);
+	BOOST_CHECK_EQUAL(tcp_conn.getReadBuffer().size(), static_cast<std::size_t>(4096));
+
+	// and returns to its initial size when shrunk
+	tcp_conn.shrinkReadBuffer();
+	BOOST_CHECK_EQUAL(tcp_conn.getReadBuffer().size(), static_cast<std::size_t>(1024));
+
+	// without a maximum size, the buffer never grows
+	tcp_conn.setReadBufferSize(512);
+	tcp_conn.growReadBuffer(512);
+	BOOST_CHECK_EQUAL(tcp_conn.getReadBuffer().size(), static_cast<std::size_t>(512));
+}
+
+BOOST_AUTO_TEST_CASE(checkReleasedReadBufferIsKeptBySlabPool) {
+	SlabPool& slab_pool = boost::asio::use_service<SlabPool>(getIOService());
+	slab_pool.setMaxFreeSlabs(0);
+	slab_pool.setMaxFreeSlabs(SlabPool::DEFAULT_MAX_FREE_SLABS);
+
+	// a buffer of the default size is returned to the pool when released
+	TCPConnection tcp_conn(getIOService());
+	const char *buffer_ptr = tcp_conn.getReadBuffer().data();
+	tcp_conn.releaseReadBuffer();
+	BOOST_CHECK_EQUAL(tcp_conn.getReadBuffer().size(), static_cast<std::size_t>(0));
+	BOOST_CHECK_EQUAL(slab_pool.getNumFreeSlabs(), static_cast<std::size_t>(1));
+
+	// and taken back from it when the connection needs it again
+	tcp_conn.shrinkReadBuffer();
+	BOOST_CHECK_EQUAL(tcp_conn.getReadBuffer().size(), static_cast<std::size_t>(TCPConnection::READ_BUFFER_SIZE));
+	BOOST_CHECK(tcp_conn.getReadBuffer().data() == buffer_ptr);
+	BOOST_CHECK_EQUAL(slab_pool.getNumFreeSlabs(), static_cast<std::size_t>(0));
+}
+
+BOOST_AUTO_TEST_CASE(checkRequestArenaIsReusedAfterFinish) {
+	TCPConnectionPtr tcp_conn(new TCPConnection(getIOService()));
+	HTTPRequest http_request;
+
+	// the reader, writer and their messages are allocated from the same arena
+	HTTPRequestReaderPtr reader_ptr(HTTPRequestReader::create(tcp_conn, HTTPRequestReader::FinishedHandler()));
+	RequestArena *first_arena = &tcp_conn->getRequestArena();
+	const std::size_t reader_bytes = first_arena->getBytesUsed();
+	BOOST_CHECK(reader_bytes > 0);
+	HTTPResponseWriterPtr writer_ptr(HTTPResponseWriter::create(tcp_conn, http_request));
+	BOOST_CHECK_EQUAL(&tcp_conn->getRequestArena(), first_arena);
+	BOOST_CHECK(first_arena->getBytesUsed() > reader_bytes);
+
+	// the next request uses another arena, since the first is still in use
+	tcp_conn->finish();
+	HTTPResponseWriterPtr next_writer_ptr(HTTPResponseWriter::create(tcp_conn, http_request));
+	BOOST_CHECK(&tcp_conn->getRequestArena() != first_arena);
+
+	// once its objects are released, the first arena is cleared and reused
+	reader_ptr.reset();
+	writer_ptr.reset();
+	next_writer_ptr.reset();
+	tcp_conn->finish();
+	BOOST_CHECK_EQUAL(&tcp_conn->getRequestArena(), first_arena);
+	BOOST_CHECK_EQUAL(first_arena->getBytesUsed(), static_cast<std::size_t>(0));
+
+	// objects remain valid after the connection is gone
+	writer_ptr = HTTPResponseWriter::create(tcp_conn, http_request);
+	writer_ptr->getResponse().setStatusCode(HTTPTypes::RESPONSE_CODE_NOT_FOUND);
+	tcp_conn->finish();
+	tcp_conn->finish();
+	tcp_conn.reset();
+	BOOST_CHECK_EQUAL(writer_ptr->getResponse().getStatusCode(), HTTPTypes::RESPONSE_CODE_NOT_FOUND);
+}
+
+BOOST_AUTO_TEST_CASE(checkHTTPWriterCopiesContentIntoSlabs) {
+	// connect a client to a temporary acceptor
+	ConnectionPair conn_pair(connectClientAndServer(getIOService()));
+	TCPConnectionPtr& client_conn(conn_pair.first);
+	TCPConnectionPtr& server_conn(conn_pair.second);
+	boost::system::error_code error_code;
+
+	// start with an empty pool
+	SlabPool& slab_pool = boost::asio::use_service<SlabPool>(getIOService());
+	slab_pool.setMaxFreeSlabs(0);
+	slab_pool.setMaxFreeSlabs(SlabPool::DEFAULT_MAX_FREE_SLABS);
+	BOOST_CHECK_EQUAL(slab_pool.getNumFreeSlabs(), static_cast<std::size_t>(0));
+
+	// mix formatted, copied and non-copied content; the copies span three slabs
+	const std::string big_content(SlabPool::SLAB_SIZE * 2, 'x');
+	const std::string no_copy_content("not copied");
+	HTTPRequest http_request;
+	HTTPResponseWriterPtr writer_ptr(HTTPResponseWriter::create(server_conn, http_request));
+	writer_ptr << "abc" << 123;
+	writer_ptr->write(big_content.data(), big_content.size());
+	writer_ptr->writeNoCopy(no_copy_content);
+	writer_ptr << 'z';
+	const std::string expected_content("abc123" + big_content + no_copy_content + "z");
+	BOOST_CHECK_EQUAL(writer_ptr->getContentLength(), expected_content.size());
+
+	// the client should receive the content intact
+	writer_ptr->send();
+	HTTPResponse http_response(http_request);
+	http_response.receive(*client_conn, error_code);
+	BOOST_REQUIRE(!error_code);
+	BOOST_REQUIRE_EQUAL(http_response.getContentLength(), expected_content.size());
+	BOOST_CHECK(std::string(http_response.getContent(), http_response.getContentLength()) == expected_content);
+
+	// the slabs are returned to the pool once the writer is released
+	writer_ptr.reset();
+	for (int i = 0; i < 30 && slab_pool.getNumFreeSlabs() < 3; ++i)
+		PionScheduler::sleep(0, 100000000);
+	BOOST_CHECK_EQUAL(slab_pool.getNumFreeSlabs(), static_cast<std::size_t>(3));
+}
+
+/// write handler that ignores the result
+static void ignoreWriteResult(const boost::system::error_code&, std::size_t) {}
+
+BOOST_AUTO_TEST_CASE(checkTCPConnectionCoalescesSmallWrites) {
+	// connect a client to a temporary acceptor
+	ConnectionPair conn_pair(connectClientAndServer(getIOService()));
+	TCPConnectionPtr& client_conn(conn_pair.first);
+	TCPConnectionPtr& server_conn(conn_pair.second);
+	boost::system::error_code error_code;
+
+	static const std::string FIRST("first,");
+	static const std::string SECOND("second,");
+	static const std::string THIRD("third");
+	std::vector<boost::asio::const_buffer> write_buffers;
+	write_buffers.push_back(boost::asio::buffer(FIRST));
+	write_buffers.push_back(boost::asio::buffer(SECOND));
+	write_buffers.push_back(boost::asio::buffer(THIRD));
+	const std::string expected_data(FIRST + SECOND + THIRD);
+	char read_buf[64];
+
+	// small writes are copied into one buffer
+	server_conn->async_write(write_buffers, ignoreWriteResult);
+	BOOST_CHECK_EQUAL(server_conn->getNumCoalescedWrites(), 1UL);
+	BOOST_CHECK_EQUAL(server_conn->getNumGatheredWrites(), 0UL);
+	client_conn->read(boost::asio::buffer(read_buf, expected_data.size()),
+					  boost::asio::transfer_all(), error_code);
+	BOOST_REQUIRE(!error_code);
+	BOOST_CHECK_EQUAL(std::string(read_buf, expected_data.size()), expected_data);
+
+	// writes larger than the limit are gathered from the original buffers
+	server_conn->setCoalesceLimit(expected_data.size() - 1);
+	server_conn->async_write(write_buffers, ignoreWriteResult);
+	BOOST_CHECK_EQUAL(server_conn->getNumCoalescedWrites(), 1UL);
+	BOOST_CHECK_EQUAL(server_conn->getNumGatheredWrites(), 1UL);
+	client_conn->read(boost::asio::buffer(read_buf, expected_data.size()),
+					  boost::asio::transfer_all(), error_code);
+	BOOST_REQUIRE(!error_code);
+	BOOST_CHECK_EQUAL(std::string(read_buf, expected_data.size()), expected_data);
+
+	// a recycled connection starts over with the default limit
+	server_conn->reset();
+	BOOST_CHECK_EQUAL(server_conn->getCoalesceLimit(), static_cast<std::size_t>(SlabPool::SLAB_SIZE));
+	BOOST_CHECK_EQUAL(server_conn->getNumCoalescedWrites(), 0UL);
+	BOOST_CHECK_EQUAL(server_conn->getNumGatheredWrites(), 0UL);
+}
+
+BOOST_AUTO_TEST_CASE(checkTCPConnectionKeepsSlabsUntilWritten) {
+	// write handlers only run when this service is polled
+	boost::asio::io_service io_service;
+	ConnectionPair conn_pair(connectClientAndServer(io_service));
+	TCPConnectionPtr& client_conn(conn_pair.first);
+	TCPConnectionPtr& server_conn(conn_pair.second);
+	boost::system::error_code error_code;
+
+	static const std::string FIRST("first,");
+	static const std::string SECOND("second");
+	std::vector<boost::asio::const_buffer> write_buffers;
+	write_buffers.push_back(boost::asio::buffer(FIRST));
+	write_buffers.push_back(boost::asio::buffer(SECOND));
+
+	// finishing before the write completes does not release its slab
+	SlabPool& slab_pool = boost::asio::use_service<SlabPool>(io_service);
+	server_conn->async_write(write_buffers, ignoreWriteResult);
+	BOOST_CHECK_EQUAL(server_conn->getNumCoalescedWrites(), 1UL);
+	const std::size_t num_free_slabs = slab_pool.getNumFreeSlabs();
+	server_conn->finish();
+	BOOST_CHECK_EQUAL(slab_pool.getNumFreeSlabs(), num_free_slabs);
+
+	// the slab is released once the write has finished
+	io_service.run();
+	BOOST_CHECK_EQUAL(slab_pool.getNumFreeSlabs(), num_free_slabs + 1);
+	char read_buf[64];
+	const std::string expected_data(FIRST + SECOND);
+	client_conn->read(boost::asio::buffer(read_buf, expected_data.size()),
+					  boost::asio::transfer_all(), error_code);
+	BOOST_REQUIRE(!error_code);
+	BOOST_CHECK_EQUAL(std::string(read_buf, expected_data.size()), expected_data);
+}
+
+BOOST_AUTO_TEST_CASE(checkTCPConnectionHoldsPipelinedWrites) {
+	// connect a client to a temporary acceptor
+	ConnectionPair conn_pair(connectClientAndServer(getIOService()));
+	TCPConnectionPtr& client_conn(conn_pair.first);
+	TCPConnectionPtr& server_conn(conn_pair.second);
+	boost::system::error_code error_code;
+
+	static const std::string FIRST("HTTP/1.1 200 OK\r\nContent-Length: 1\r\n\r\n1");
+	static const std::string SECOND("HTTP/1.1 200 OK\r\nContent-Length: 1\r\n\r\n2");
+	static const std::string THIRD("HTTP/1.1 200 OK\r\nContent-Length: 1\r\n\r\n3");
+	const std::string expected_data(FIRST + SECOND + THIRD);
+	char read_buf[256];
+
+	// pipelined writes are only held back when the server asks for it
+	server_conn->setLifecycle(TCPConnection::LIFECYCLE_PIPELINED);
+	BOOST_CHECK(! server_conn->getHoldWrites());
+
+	// responses to pipelined requests are held back
+	server_conn->setHoldWrites(true);
+	server_conn->async_write(boost::asio::buffer(FIRST), ignoreWriteResult);
+	server_conn->async_write(boost::asio::buffer(SECOND), ignoreWriteResult);
+	BOOST_CHECK_EQUAL(server_conn->getNumHeldWrites(), 2UL);
+	BOOST_CHECK_EQUAL(server_conn->getHeldBytes(), FIRST.size() + SECOND.size());
+
+	// and are sent along with the response to the last request
+	server_conn->setLifecycle(TCPConnection::LIFECYCLE_KEEPALIVE);
+	server_conn->async_write(boost::asio::buffer(THIRD), ignoreWriteResult);
+	BOOST_CHECK_EQUAL(server_conn->getNumCoalescedWrites(), 1UL);
+	BOOST_CHECK_EQUAL(server_conn->getHeldBytes(), 0UL);
+	client_conn->read(boost::asio::buffer(read_buf, expected_data.size()),
+					  boost::asio::transfer_all(), error_code);
+	BOOST_REQUIRE(!error_code);
+	BOOST_CHECK_EQUAL(std::string(read_buf, expected_data.size()), expected_data);
+
+	// held responses are also sent before waiting to read more requests
+	server_conn->setLifecycle(TCPConnection::LIFECYCLE_PIPELINED);
+	server_conn->setHoldWrites(true);
+	server_conn->async_write(boost::asio::buffer(FIRST), ignoreWriteResult);
+	BOOST_CHECK_EQUAL(server_conn->getHeldBytes(), FIRST.size());
+	server_conn->async_read_some(ignoreWriteResult);
+	client_conn->read(boost::asio::buffer(read_buf, FIRST.size()),
+					  boost::asio::transfer_all(), error_code);
+	BOOST_REQUIRE(!error_code);
+	BOOST_CHECK_EQUAL(std::string(read_buf, FIRST.size()), FIRST);
+}
+
+BOOST_AUTO_TEST_CASE(checkTCPConnectionSendsHeldWritesBeforeSyncWrite) {
+	// connect a client to a temporary acceptor
+	ConnectionPair conn_pair(connectClientAndServer(getIOService()));
+	TCPConnectionPtr& client_conn(conn_pair.first);
+	TCPConnectionPtr& server_conn(conn_pair.second);
+	boost::system::error_code error_code;
+
+	static const std::string FIRST("HTTP/1.1 200 OK\r\nContent-Length: 1\r\n\r\n1");
+	static const std::string SECOND("HTTP/1.1 200 OK\r\nContent-Length: 1\r\n\r\n2");
+	const std::string expected_data(FIRST + SECOND);
+	char read_buf[256];
+
+	// a blocking write sends the held response first, so order is kept
+	server_conn->setLifecycle(TCPConnection::LIFECYCLE_PIPELINED);
+	server_conn->setHoldWrites(true);
+	server_conn->async_write(boost::asio::buffer(FIRST), ignoreWriteResult);
+	BOOST_CHECK_EQUAL(server_conn->getHeldBytes(), FIRST.size());
+	BOOST_CHECK_EQUAL(server_conn->write(boost::asio::buffer(SECOND), error_code), SECOND.size());
+	BOOST_REQUIRE(!error_code);
+	BOOST_CHECK_EQUAL(server_conn->getHeldBytes(), 0UL);
+	client_conn->read(boost::asio::buffer(read_buf, expected_data.size()),
+					  boost::asio::transfer_all(), error_code);
+	BOOST_REQUIRE(!error_code);
+	BOOST_CHECK_EQUAL(std::string(read_buf, expected_data.size()), expected_data);
+
+	// a blocking read also sends held responses before waiting for data
+	server_conn->async_write(boost::asio::buffer(FIRST), ignoreWriteResult);
+	BOOST_CHECK_EQUAL(server_conn->getHeldBytes(), FIRST.size());
+	client_conn->write(boost::asio::buffer(SECOND), error_code);
+	BOOST_REQUIRE(!error_code);
+	BOOST_CHECK(server_conn->read_some(error_code) > 0);
+	BOOST_REQUIRE(!error_code);
+	BOOST_CHECK_EQUAL(server_conn->getHeldBytes(), 0UL);
+	client_conn->read(boost::asio::buffer(read_buf, FIRST.size()),
+					  boost::asio::transfer_all(), error_code);
+	BOOST_REQUIRE(!error_code);
+	BOOST_CHECK_EQUAL(std::string(read_buf, FIRST.size()), FIRST);
+
+	// a recycled connection starts over with the default limit
+	server_conn->setPipelineLimit(0);
+	server_conn->reset();
+	BOOST_CHECK_EQUAL(server_conn->getPipelineLimit(), static_cast<std::size_t>(TCPConnection::DEFAULT_PIPELINE_LIMIT));
+	BOOST_CHECK_EQUAL(server_conn->getNumHeldWrites(), 0UL);
+}
+
+BOOST_AUTO_TEST_CASE(checkTCPSocketPolicyAppliesOptions) {
+	// options are set using the names used by configuration files
+	TCPSocketPolicy socket_policy;
+	socket_policy.setOption("nodelay", "true");
+	socket_policy.setOption("cork", "yes");
+	socket_policy.setOption("keepalive", "1");
+	socket_policy.setOption("keepidle", "60");
+	socket_policy.setOption("sndbuf", "65536");
+	BOOST_CHECK(socket_policy.getNoDelay());
+	BOOST_CHECK(socket_policy.getCorkHeaders());
+	BOOST_CHECK(socket_policy.getKeepAlive());
+	BOOST_CHECK_EQUAL(socket_policy.getKeepAliveIdle(), 60);
+	BOOST_CHECK_EQUAL(socket_policy.getSendBufferSize(), 65536);
+	BOOST_CHECK_THROW(socket_policy.setOption("nodelay", "maybe"), TCPSocketPolicy::BadOptionException);
+	BOOST_CHECK_THROW(socket_policy.setOption("sndbuf", "-1"), TCPSocketPolicy::BadOptionException);
+	BOOST_CHECK_THROW(socket_policy.setOption("bogus", "1"), TCPSocketPolicy::BadOptionException);
+
+	// connect a client to a temporary acceptor
+	ConnectionPair conn_pair(connectClientAndServer(getIOService()));
+	TCPConnectionPtr& client_conn(conn_pair.first);
+	TCPConnectionPtr& server_conn(conn_pair.second);
+	boost::system::error_code error_code;
+
+	// the options are applied to the accepted socket
+	socket_policy.applyToConnection(*server_conn, error_code);
+	BOOST_REQUIRE(!error_code);
+	tcp::no_delay no_delay_option;
+	server_conn->getSocket().get_option(no_delay_option);
+	BOOST_CHECK(no_delay_option.value());
+	tcp::socket::keep_alive keep_alive_option;
+	server_conn->getSocket().get_option(keep_alive_option);
+	BOOST_CHECK(keep_alive_option.value());
+	BOOST_CHECK(server_conn->getCorkWrites());
+
+	// writes made while the socket is corked are sent once it is uncorked
+	static const std::string HEADERS("HTTP/1.1 200 OK\r\nContent-Length: 4\r\n\r\n");
+	static const std::string CONTENT("body");
+	server_conn->corkWrites();
+	server_conn->write(boost::asio::buffer(HEADERS), error_code);
+	BOOST_REQUIRE(!error_code);
+	server_conn->asyncWriteAndUncork(boost::asio::buffer(CONTENT), ignoreWriteResult);
+	char read_buf[128];
+	const std::string expected_data(HEADERS + CONTENT);
+	client_conn->read(boost::asio::buffer(read_buf, expected_data.size()),
+					  boost::asio::transfer_all(), error_code);
+	BOOST_REQUIRE(!error_code);
+	BOOST_CHECK_EQUAL(std::string(read_buf, expected_data.size()), expected_data);
+}
+
+BOOST_AUTO_TEST_CASE(checkTCPTimerClosesConnection) {
+	// connect a client to a temporary acceptor
+	ConnectionPair conn_pair(connectClientAndServer(getIOService()));
+	TCPConnectionPtr& client_conn(conn_pair.first);
+
+	// a cancelled timer is removed from the timing wheel, so it cannot
+	// close the connection
+	TCPTimerService& timer_service = boost::asio::use_service<TCPTimerService>(getIOService());
+	const std::size_t num_timers = timer_service.getNumTimers();
+	TCPTimer tcp_timer(client_conn);
+	tcp_timer.start(1);
+	BOOST_CHECK_EQUAL(timer_service.getNumTimers(), num_timers + 1);
+	tcp_timer.cancel();
+	BOOST_CHECK_EQUAL(timer_service.getNumTimers(), num_timers);
+	BOOST_CHECK(client_conn->is_open());
+
+	// an active timer should close the connection once it expires
+	tcp_timer.start(1);
+	for (int i = 0; i < 30 && client_conn->is_open(); ++i)
+		PionScheduler::sleep(0, 100000000);
+	BOOST_CHECK(! client_conn->is_open());
+}
+
+BOOST_AUTO_TEST_CASE(checkTCPTimerOwnedByConnection) {
+	// a connection that owns its idle timer should still be released
+	TCPConnectionPtr tcp_conn(new TCPConnection(getIOService()));
+	boost::weak_ptr<TCPConnection> weak_conn(tcp_conn);
+	tcp_conn->getIdleTimer().reset(new TCPTimer(tcp_conn));
+	tcp_conn->getIdleTimer()->start(1);
+	tcp_conn.reset();
+	BOOST_CHECK(weak_conn.expired());
+}
+
 BOOST_AUTO_TEST_CASE(checkQueryOfReceivedRequestParsed) {
 	// open a connection
 	tcp::endpoint localhost(boost::asio::ip::address::from_string("127.0.0.1"), getServerPtr()->getPort());
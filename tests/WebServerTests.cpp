@@ -23,7 +23,9 @@
 #include <pion/net/HTTPRequest.hpp>
 #include <pion/net/HTTPResponse.hpp>
 #include <pion/net/HTTPRequestWriter.hpp>
+#include <pion/net/HTTPRequestReader.hpp>
 #include <pion/net/HTTPResponseReader.hpp>
+#include <pion/net/HTTPResponseWriter.hpp>
 #include <pion/net/WebServer.hpp>
 #include <pion/net/PionUser.hpp>
 #include <pion/net/HTTPBasicAuth.hpp>
@@ -173,6 +175,55 @@ void ChunkedPostRequestSender::handleWrite(const boost::system::error_code& writ
 	}
 }
 
+/// reads streamed request content and echoes it back in the response
+class StreamingEchoHandler :
+	public boost::enable_shared_from_this<StreamingEchoHandler>,
+	private boost::noncopyable
+{
+public:
+	/// StreamingRequestHandler for HTTPServer::addStreamingResource()
+	static void handleRequest(HTTPRequestPtr& http_request, TCPConnectionPtr& tcp_conn,
+							  HTTPRequestReaderPtr& reader_ptr)
+	{
+		boost::shared_ptr<StreamingEchoHandler> handler_ptr(new StreamingEchoHandler(http_request, tcp_conn, reader_ptr));
+		handler_ptr->readContent();
+	}
+
+protected:
+
+	StreamingEchoHandler(HTTPRequestPtr& http_request, TCPConnectionPtr& tcp_conn,
+						 HTTPRequestReaderPtr& reader_ptr)
+		: m_request(http_request), m_tcp_conn(tcp_conn), m_reader(reader_ptr)
+	{}
+
+	void readContent(void) {
+		m_reader->readContent(boost::bind(&StreamingEchoHandler::handleContent,
+										  shared_from_this(), _1, _2, _3));
+	}
+
+	void handleContent(const boost::system::error_code& ec, const char *ptr, std::size_t len) {
+		if (ec) {
+			m_tcp_conn->setLifecycle(TCPConnection::LIFECYCLE_CLOSE);
+			m_tcp_conn->finish();
+		} else if (len > 0) {
+			m_content.append(ptr, len);
+			readContent();
+		} else {
+			// no more content -> send the response
+			HTTPResponseWriterPtr writer(HTTPResponseWriter::create(m_tcp_conn, *m_request,
+				boost::bind(&TCPConnection::finish, m_tcp_conn)));
+			writer << "[Streamed Content]" << m_content;
+			writer->send();
+		}
+	}
+
+private:
+	HTTPRequestPtr			m_request;
+	TCPConnectionPtr		m_tcp_conn;
+	HTTPRequestReaderPtr	m_reader;
+	std::string				m_content;
+};
+
 ///
 /// WebServerTests_F: fixture used for running web server tests
 /// 
@@ -355,10 +406,33 @@ public:
 		BOOST_CHECK_EQUAL(http_response.getStatusCode(), 404U);
 	}
 	
+	/**
+	 * keeps the request after sending an empty response to it
+	 *
+	 * @param request the HTTP request to respond to
+	 * @param tcp_conn the TCP connection to send the response over
+	 */
+	void keepRequest(HTTPRequestPtr& request, TCPConnectionPtr& tcp_conn) {
+		{
+			boost::mutex::scoped_lock kept_lock(m_kept_mutex);
+			m_kept_requests.push_back(request);
+		}
+		HTTPResponse http_response(*request);
+		boost::system::error_code error_code;
+		http_response.send(*tcp_conn, error_code);
+		tcp_conn->finish();
+	}
+	
 	inline boost::asio::io_service& getIOService(void) { return m_scheduler.getIOService(); }
 	
 	PionSingleServiceScheduler	m_scheduler;
 	WebServer					m_server;
+	
+	/// requests kept by keepRequest()
+	std::vector<HTTPRequestPtr>	m_kept_requests;
+	
+	/// used to protect m_kept_requests
+	boost::mutex				m_kept_mutex;
 };
 
 
@@ -393,6 +467,74 @@ BOOST_AUTO_TEST_CASE(checkSendRequestsAndReceiveResponses) {
 	checkSendAndReceiveMessages(tcp_conn);
 }
 
+BOOST_AUTO_TEST_CASE(checkIdleKeepAliveConnectionIsClosed) {
+	// load simple Hello service and start the server
+	m_server.loadService("/hello", "HelloService");
+	m_server.setKeepAliveTimeout(1);
+	m_server.start();
+
+	// open a connection
+	TCPConnection tcp_conn(getIOService());
+	tcp_conn.setLifecycle(TCPConnection::LIFECYCLE_KEEPALIVE);
+	boost::system::error_code error_code;
+	error_code = tcp_conn.connect(boost::asio::ip::address::from_string("127.0.0.1"), m_server.getPort());
+	BOOST_REQUIRE(! error_code);
+
+	// requests sent while the connection is parked should still be handled
+	checkSendAndReceiveMessages(tcp_conn);
+	BOOST_CHECK_EQUAL(m_server.getConnections(), static_cast<std::size_t>(1));
+
+	// the server should close the connection once it has been idle too long
+	for (int i = 0; i < 30 && m_server.getConnections() > 0; ++i)
+		PionScheduler::sleep(0, 100000000);
+	BOOST_CHECK_EQUAL(m_server.getConnections(), static_cast<std::size_t>(0));
+}
+
+BOOST_AUTO_TEST_CASE(checkZeroCopyHeadersOfKeptRequests) {
+	m_server.addResource("/keep", boost::bind(&WebServerTests_F::keepRequest, this, _1, _2));
+	m_server.setZeroCopyHeaders(true);
+	m_server.start();
+
+	// open a connection
+	TCPConnection tcp_conn(getIOService());
+	tcp_conn.setLifecycle(TCPConnection::LIFECYCLE_KEEPALIVE);
+	boost::system::error_code error_code;
+	error_code = tcp_conn.connect(boost::asio::ip::address::from_string("127.0.0.1"), m_server.getPort());
+	BOOST_REQUIRE(! error_code);
+
+	// send requests that are read into the same buffer on the server
+	for (int n = 0; n < 3; ++n) {
+		HTTPRequest http_request("/keep");
+		http_request.addHeader("X-Kept", "request-" + boost::lexical_cast<std::string>(n));
+		http_request.send(tcp_conn, error_code);
+		BOOST_REQUIRE(! error_code);
+		HTTPResponse http_response(http_request);
+		http_response.receive(tcp_conn, error_code);
+		BOOST_REQUIRE(! error_code);
+		BOOST_CHECK_EQUAL(http_response.getStatusCode(), 200U);
+	}
+
+	// the kept requests should still refer to the memory that their headers
+	// were read into, which the server must not have reused
+	boost::mutex::scoped_lock kept_lock(m_kept_mutex);
+	BOOST_REQUIRE_EQUAL(m_kept_requests.size(), 3UL);
+	for (int n = 0; n < 3; ++n) {
+		const HTTPRequest& kept_request(*m_kept_requests[n]);
+		BOOST_CHECK(! kept_request.getHeaderRefs().empty());
+		BOOST_CHECK_EQUAL(kept_request.getHeader("X-Kept"),
+						  "request-" + boost::lexical_cast<std::string>(n));
+	}
+
+	// closing the connection must not free the memory either
+	tcp_conn.close();
+	for (int i = 0; i < 30 && m_server.getConnections() > 0; ++i)
+		PionScheduler::sleep(0, 100000000);
+	for (int n = 0; n < 3; ++n) {
+		BOOST_CHECK_EQUAL(m_kept_requests[n]->getHeaderRef("X-Kept").str(),
+						  "request-" + boost::lexical_cast<std::string>(n));
+	}
+}
+
 BOOST_AUTO_TEST_CASE(checkSendRequestAndReceiveResponseFromEchoService) {
 	m_server.loadService("/echo", "EchoService");
 	m_server.start();
@@ -589,6 +731,69 @@ BOOST_AUTO_TEST_CASE(checkSendChunkedRequestWithNoChunksAndReceiveResponse) {
 	BOOST_CHECK(boost::regex_match(http_response.getContent(), content_length_of_request));
 }
 
+BOOST_AUTO_TEST_CASE(checkSendRequestToStreamingResource) {
+	m_server.addStreamingResource("/stream", &StreamingEchoHandler::handleRequest);
+	m_server.start();
+
+	// open a connection
+	TCPConnectionPtr tcp_conn(new TCPConnection(getIOService()));
+	tcp_conn->setLifecycle(TCPConnection::LIFECYCLE_KEEPALIVE);
+	boost::system::error_code error_code;
+	error_code = tcp_conn->connect(boost::asio::ip::address::from_string("127.0.0.1"), m_server.getPort());
+	BOOST_REQUIRE(!error_code);
+
+	HTTPRequestWriterPtr writer(HTTPRequestWriter::create(tcp_conn));
+	writer->getRequest().setMethod("POST");
+	writer->getRequest().setResource("/stream");
+	writer << "junk";
+	writer->send();
+
+	// receive the response from the server
+	HTTPResponse http_response(writer->getRequest());
+	http_response.receive(*tcp_conn, error_code);
+	BOOST_CHECK(!error_code);
+	BOOST_CHECK(http_response.getStatusCode() == 200);
+	BOOST_CHECK_EQUAL(std::string(http_response.getContent()), "[Streamed Content]junk");
+
+	// the connection is kept alive after all of the content was read
+	writer = HTTPRequestWriter::create(tcp_conn);
+	writer->getRequest().setMethod("POST");
+	writer->getRequest().setResource("/stream");
+	writer << "more junk";
+	writer->send();
+	HTTPResponse second_response(writer->getRequest());
+	second_response.receive(*tcp_conn, error_code);
+	BOOST_CHECK(!error_code);
+	BOOST_CHECK_EQUAL(std::string(second_response.getContent()), "[Streamed Content]more junk");
+}
+
+BOOST_AUTO_TEST_CASE(checkSendChunkedRequestToStreamingResource) {
+	// streamed content is not limited by the maximum content length
+	m_server.setMaxContentLength(8);
+	m_server.addStreamingResource("/stream", &StreamingEchoHandler::handleRequest);
+	m_server.start();
+
+	// open a connection
+	TCPConnectionPtr tcp_conn(new TCPConnection(getIOService()));
+	tcp_conn->setLifecycle(TCPConnection::LIFECYCLE_KEEPALIVE);
+	boost::system::error_code error_code;
+	error_code = tcp_conn->connect(boost::asio::ip::address::from_string("127.0.0.1"), m_server.getPort());
+	BOOST_REQUIRE(!error_code);
+
+	boost::shared_ptr<ChunkedPostRequestSender> sender = ChunkedPostRequestSender::create(tcp_conn, "/stream");
+	sender->addChunk(5, "klmno");
+	sender->addChunk(4, "1234");
+	sender->addChunk(10, "abcdefghij");
+	sender->send();
+
+	// receive the response from the server
+	HTTPResponse http_response("GET");
+	http_response.receive(*tcp_conn, error_code);
+	BOOST_CHECK(!error_code);
+	BOOST_CHECK(http_response.getStatusCode() == 200);
+	BOOST_CHECK_EQUAL(std::string(http_response.getContent()), "[Streamed Content]klmno1234abcdefghij");
+}
+
 #ifdef PION_HAVE_SSL
 BOOST_AUTO_TEST_CASE(checkSendRequestsAndReceiveResponsesUsingSSL) {
 	// load simple Hello service and start the server
@@ -651,6 +856,27 @@ BOOST_AUTO_TEST_CASE(checkAllowNothingServiceResponseContent) {
 }
 #endif // PION_STATIC_LINKING
 
+#ifndef PION_STATIC_LINKING
+BOOST_AUTO_TEST_CASE(checkSchedulerServiceResponseContent) {
+	// statistics must be enabled before the scheduler starts
+	m_scheduler.setCollectStats(true);
+	checkWebServerResponseContent("SchedulerService", "/scheduler",
+								  boost::regex(".*Scheduler\\sthreads:.*Thread\\s0:\\shandlers=.*"));
+
+	// at least the request itself should have been counted
+	boost::uint64_t num_handlers = 0;
+	for (boost::uint32_t n = 0; n < m_scheduler.getNumThreads(); ++n)
+		num_handlers += m_scheduler.getThreadStats(n).handlers;
+	BOOST_CHECK(num_handlers > 0);
+}
+#endif // PION_STATIC_LINKING
+
+BOOST_AUTO_TEST_CASE(checkServiceConfigSetsSocketOptions) {
+	// the configuration file sets nodelay=true
+	m_server.loadServiceConfig(SERVICES_CONFIG_FILE);
+	BOOST_CHECK(m_server.getSocketPolicy().getNoDelay());
+}
+
 BOOST_AUTO_TEST_CASE(checkFileServiceResponseContent) {
 	// load multiple services and start the server
 	m_server.loadServiceConfig(SERVICES_CONFIG_FILE);
@@ -0,0 +1,69 @@
+// ------------------------------------------------------------------
+// pion-net: a C++ framework for building lightweight HTTP interfaces
+// ------------------------------------------------------------------
+// Copyright (C) 2007-2011 Atomic Labs, Inc.  (http://www.atomiclabs.com)
+//
+// Distributed under the Boost Software License, Version 1.0.
+// See http://www.boost.org/LICENSE_1_0.txt
+//
+
+#include <cstdlib>
+#include <new>
+
+// the replacement operators below are kept in their own file so that they
+// cannot be inlined into code that allocates memory, which would make the
+// compiler pair the calls to malloc() and free() with new and delete
+
+#if __cplusplus >= 201103L
+	/// exception specification for functions that do not throw
+	#define PION_NO_THROW	noexcept
+#else
+	/// exception specification for functions that do not throw
+	#define PION_NO_THROW	throw()
+#endif
+
+
+/// number of heap allocations made by the process
+static unsigned long g_num_allocations = 0;
+
+/// returns the number of heap allocations made by the process
+unsigned long getNumAllocations(void)
+{
+	return g_num_allocations;
+}
+
+void *operator new(std::size_t n)
+{
+	++g_num_allocations;
+	void *ptr = std::malloc(n == 0 ? 1 : n);
+	if (ptr == NULL)
+		throw std::bad_alloc();
+	return ptr;
+}
+
+void *operator new[](std::size_t n)
+{
+	return operator new(n);
+}
+
+void operator delete(void *ptr) PION_NO_THROW
+{
+	std::free(ptr);
+}
+
+void operator delete[](void *ptr) PION_NO_THROW
+{
+	std::free(ptr);
+}
+
+#ifdef __cpp_sized_deallocation
+void operator delete(void *ptr, std::size_t) PION_NO_THROW
+{
+	std::free(ptr);
+}
+
+void operator delete[](void *ptr, std::size_t) PION_NO_THROW
+{
+	std::free(ptr);
+}
+#endif
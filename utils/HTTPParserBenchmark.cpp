@@ -0,0 +1,197 @@
+// ------------------------------------------------------------------
+// pion-net: a C++ framework for building lightweight HTTP interfaces
+// ------------------------------------------------------------------
+// Copyright (C) 2007-2011 Atomic Labs, Inc.  (http://www.atomiclabs.com)
+//
+// Distributed under the Boost Software License, Version 1.0.
+// See http://www.boost.org/LICENSE_1_0.txt
+//
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <boost/logic/tribool.hpp>
+#include <boost/system/error_code.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <pion/net/HTTPParser.hpp>
+#include <pion/net/HTTPRequest.hpp>
+#include <pion/net/HTTPResponse.hpp>
+
+using namespace std;
+using namespace pion;
+using namespace pion::net;
+
+
+/// returns the number of heap allocations made by the process (see AllocationCounter.cpp)
+extern unsigned long getNumAllocations(void);
+
+
+/// corpus files used if none are given on the command line
+static const char *DEFAULT_CORPUS_FILES[] = {
+	"request_small_get.http",
+	"request_browser_get.http",
+	"request_form_post.http",
+	"request_chunked_upload.http",
+	"request_pipelined.http",
+	"response_content_length.http",
+	"response_chunked.http",
+	"response_pipelined.http",
+	NULL
+};
+
+/// results from parsing a corpus file once
+struct ParseResult {
+	ParseResult(void) : m_messages(0), m_errors(0) {}
+	unsigned long	m_messages;
+	unsigned long	m_errors;
+};
+
+
+/// reads an entire file into a string; returns false if it could not be read
+static bool readCorpusFile(const std::string& filename, std::string& data)
+{
+	std::ifstream in(filename.c_str(), std::ios::in | std::ios::binary);
+	if (! in)
+		return false;
+	data.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+	return true;
+}
+
+/// returns true if the file name indicates that it contains HTTP requests
+static bool isRequestCorpus(const std::string& filename)
+{
+	const std::string::size_type pos = filename.find_last_of("/\\");
+	const std::string basename(pos == std::string::npos ? filename : filename.substr(pos + 1));
+	return (basename.compare(0, 9, "response_") != 0);
+}
+
+/**
+ * parses every message in a corpus, the same way that HTTPReader does:
+ * a new parser and message for each one, with bytes left over from a
+ * message carried forward to the next (pipelining)
+ *
+ * @param data the corpus to parse
+ * @param is_request true if the corpus contains requests
+ * @param read_size number of bytes made available to the parser at a time
+ *                  (0 means the entire corpus at once)
+ */
+static ParseResult parseCorpus(const std::string& data, const bool is_request,
+							   const std::size_t read_size)
+{
+	ParseResult result;
+	const char *read_ptr = data.data();
+	const char * const corpus_end = read_ptr + data.size();
+	boost::system::error_code ec;
+
+	while (read_ptr < corpus_end) {
+		HTTPParser parser(is_request);
+		HTTPRequest request;
+		HTTPResponse response;
+		HTTPMessage& http_msg = (is_request
+			? static_cast<HTTPMessage&>(request) : static_cast<HTTPMessage&>(response));
+		boost::tribool parse_result = boost::indeterminate;
+		const char *read_end_ptr = read_ptr;
+
+		while (boost::indeterminate(parse_result) && read_end_ptr < corpus_end) {
+			const std::size_t bytes_left = corpus_end - read_ptr;
+			const std::size_t len = (read_size == 0 || read_size > bytes_left ? bytes_left : read_size);
+			parser.setReadBuffer(read_ptr, len);
+			parse_result = parser.parse(http_msg, ec);
+			parser.loadReadPosition(read_ptr, read_end_ptr);
+		}
+
+		if (boost::indeterminate(parse_result))
+			parse_result = ! parser.checkPrematureEOF(http_msg);
+		if (parse_result) {
+			++result.m_messages;
+		} else {
+			++result.m_errors;
+			break;
+		}
+	}
+
+	return result;
+}
+
+
+/// main control function
+int main (int argc, char *argv[])
+{
+	static const unsigned long DEFAULT_ITERATIONS = 10000;
+
+	// parse command line
+	unsigned long iterations = DEFAULT_ITERATIONS;
+	std::size_t read_size = 0;
+	std::string corpus_dir("../tests/corpus");
+	std::vector<std::string> corpus_files;
+	for (int argnum = 1; argnum < argc; ++argnum) {
+		if (argv[argnum][0] != '-') {
+			corpus_files.push_back(argv[argnum]);
+		} else if (argnum + 1 < argc && strcmp(argv[argnum], "-n") == 0) {
+			iterations = strtoul(argv[++argnum], 0, 10);
+			if (iterations == 0) iterations = DEFAULT_ITERATIONS;
+		} else if (argnum + 1 < argc && strcmp(argv[argnum], "-r") == 0) {
+			read_size = strtoul(argv[++argnum], 0, 10);
+		} else if (argnum + 1 < argc && strcmp(argv[argnum], "-d") == 0) {
+			corpus_dir = argv[++argnum];
+		} else {
+			std::cerr << "usage: HTTPParserBenchmark [-n iterations] [-r read_size]"
+				" [-d corpus_dir] [corpus files...]" << std::endl;
+			return 1;
+		}
+	}
+	if (corpus_files.empty()) {
+		for (const char **name_ptr = DEFAULT_CORPUS_FILES; *name_ptr != NULL; ++name_ptr)
+			corpus_files.push_back(corpus_dir + '/' + *name_ptr);
+	}
+
+	std::cout << "HTTPParser::parse (" << iterations << " iterations, read size ";
+	if (read_size == 0)
+		std::cout << "unlimited";
+	else
+		std::cout << read_size;
+	std::cout << ')' << std::endl
+		<< std::left << std::setw(32) << "corpus" << std::right
+		<< std::setw(6) << "msgs" << std::setw(12) << "MB/s"
+		<< std::setw(14) << "msgs/s" << std::setw(14) << "allocs/msg" << std::endl;
+
+	std::string data;
+	for (std::vector<std::string>::const_iterator i = corpus_files.begin(); i != corpus_files.end(); ++i) {
+		if (! readCorpusFile(*i, data)) {
+			std::cerr << "unable to read corpus file: " << *i << std::endl;
+			return 1;
+		}
+		const bool is_request = isRequestCorpus(*i);
+
+		// make sure the corpus parses cleanly before timing it
+		const ParseResult check = parseCorpus(data, is_request, read_size);
+		if (check.m_errors != 0 || check.m_messages == 0) {
+			std::cerr << "corpus did not parse: " << *i << std::endl;
+			return 1;
+		}
+
+		const unsigned long start_allocations = getNumAllocations();
+		const boost::posix_time::ptime start_time(boost::posix_time::microsec_clock::universal_time());
+		unsigned long num_messages = 0;
+		for (unsigned long n = 0; n < iterations; ++n)
+			num_messages += parseCorpus(data, is_request, read_size).m_messages;
+		const boost::posix_time::time_duration elapsed(boost::posix_time::microsec_clock::universal_time() - start_time);
+		const unsigned long num_allocations = getNumAllocations() - start_allocations;
+
+		const double seconds = (elapsed.total_microseconds() == 0 ? 1 : elapsed.total_microseconds()) / 1000000.0;
+		const std::string::size_type pos = i->find_last_of("/\\");
+		std::cout << std::left << std::setw(32) << (pos == std::string::npos ? *i : i->substr(pos + 1))
+			<< std::right << std::setw(6) << check.m_messages
+			<< std::fixed << std::setprecision(1)
+			<< std::setw(12) << (data.size() * static_cast<double>(iterations)) / seconds / (1024 * 1024)
+			<< std::setw(14) << std::setprecision(0) << num_messages / seconds
+			<< std::setw(14) << std::setprecision(1) << static_cast<double>(num_allocations) / num_messages
+			<< std::endl;
+	}
+
+	return 0;
+}
@@ -0,0 +1,97 @@
+// ------------------------------------------------------------------
+// pion-net: a C++ framework for building lightweight HTTP interfaces
+// ------------------------------------------------------------------
+// Copyright (C) 2007-2011 Atomic Labs, Inc.  (http://www.atomiclabs.com)
+//
+// Distributed under the Boost Software License, Version 1.0.
+// See http://www.boost.org/LICENSE_1_0.txt
+//
+
+//
+// libFuzzer harness for HTTPParser::parse().  It is only compiled by default;
+// to build it, configure with a compiler that supports libFuzzer, i.e.:
+//
+//   ./configure --enable-fuzzer CXX=clang++ \
+//     CXXFLAGS="-g -O1 -fsanitize=fuzzer-no-link,address"
+//   make -C utils HTTPParserFuzzer
+//
+// and run it using the benchmark corpus as seeds:
+//
+//   ./HTTPParserFuzzer -max_len=65536 fuzz_corpus ../tests/corpus
+//
+
+#include <cstddef>
+#include <boost/cstdint.hpp>
+#include <boost/logic/tribool.hpp>
+#include <boost/system/error_code.hpp>
+#include <pion/net/HTTPParser.hpp>
+#include <pion/net/HTTPRequest.hpp>
+#include <pion/net/HTTPResponse.hpp>
+
+using namespace pion;
+using namespace pion::net;
+
+
+/// maximum content length used while fuzzing, so that large lengths are rejected quickly
+static const std::size_t FUZZ_CONTENT_MAX = 65536;
+
+
+/// touches everything that is parsed lazily from a finished message
+static void useMessage(HTTPMessage& http_msg)
+{
+	http_msg.getCookieParams().size();
+	// content buffers are always null-terminated
+	if (http_msg.getContent() != NULL && http_msg.getContent()[http_msg.getContentLength()] != '\0')
+		__builtin_trap();
+}
+
+
+/**
+ * parses the input as a sequence of pipelined messages.  The first byte
+ * selects between requests and responses, and how many bytes are made
+ * available to the parser at a time, so that every state can be reached
+ * from a partial read.
+ */
+extern "C" int LLVMFuzzerTestOneInput(const boost::uint8_t *data, std::size_t size)
+{
+	if (size < 1)
+		return 0;
+	const bool is_request = ((data[0] & 0x80) == 0);
+	const std::size_t read_size = (data[0] & 0x7F);
+	const char *read_ptr = reinterpret_cast<const char*>(data + 1);
+	const char * const input_end = reinterpret_cast<const char*>(data + size);
+	boost::system::error_code ec;
+
+	while (read_ptr < input_end) {
+		HTTPParser parser(is_request, FUZZ_CONTENT_MAX);
+		HTTPRequest request;
+		HTTPResponse response;
+		HTTPMessage& http_msg = (is_request
+			? static_cast<HTTPMessage&>(request) : static_cast<HTTPMessage&>(response));
+		boost::tribool parse_result = boost::indeterminate;
+		const char *read_end_ptr = read_ptr;
+
+		while (boost::indeterminate(parse_result) && read_end_ptr < input_end) {
+			const std::size_t bytes_left = input_end - read_ptr;
+			const std::size_t len = (read_size == 0 || read_size > bytes_left ? bytes_left : read_size);
+			parser.setReadBuffer(read_ptr, len);
+			parse_result = parser.parse(http_msg, ec);
+			parser.loadReadPosition(read_ptr, read_end_ptr);
+		}
+
+		if (boost::indeterminate(parse_result))
+			parse_result = ! parser.checkPrematureEOF(http_msg);
+		if (! parse_result)
+			break;
+
+		if (is_request)
+			request.getQueryParams().size();
+		useMessage(http_msg);
+
+		// stop if the parser did not make progress
+		if (parser.getTotalBytesRead() == 0)
+			break;
+	}
+
+	return 0;
+}
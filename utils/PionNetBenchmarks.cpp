@@ -0,0 +1,165 @@
+// ------------------------------------------------------------------
+// pion-net: a C++ framework for building lightweight HTTP interfaces
+// ------------------------------------------------------------------
+// Copyright (C) 2007-2011 Atomic Labs, Inc.  (http://www.atomiclabs.com)
+//
+// Distributed under the Boost Software License, Version 1.0.
+// See http://www.boost.org/LICENSE_1_0.txt
+//
+
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <string>
+#include <boost/cstdint.hpp>
+#include <boost/regex.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/algorithm/string/trim.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <pion/net/HTTPTypes.hpp>
+
+using namespace std;
+using namespace pion;
+using namespace pion::net;
+
+
+// header values used for each simulated request
+static const std::string	TRANSFER_ENCODING_VALUE("gzip, chunked");
+static const std::string	CONTENT_LENGTH_VALUE(" 1048576");
+static const unsigned int	STATUS_CODE = 404;
+
+
+/// checks for the chunked transfer coding the way HTTPMessage used to
+static unsigned long chunkedUsingRegex(unsigned long iterations)
+{
+	static const boost::regex REGEX_ICASE_CHUNKED(".*chunked.*", boost::regex::icase);
+	unsigned long result = 0;
+	for (unsigned long n = 0; n < iterations; ++n) {
+		if (boost::regex_match(TRANSFER_ENCODING_VALUE.data(),
+			TRANSFER_ENCODING_VALUE.data() + TRANSFER_ENCODING_VALUE.size(), REGEX_ICASE_CHUNKED))
+			++result;
+	}
+	return result;
+}
+
+/// checks for the chunked transfer coding using HTTPTypes::StringRef
+static unsigned long chunkedUsingScanner(unsigned long iterations)
+{
+	unsigned long result = 0;
+	for (unsigned long n = 0; n < iterations; ++n) {
+		if (HTTPTypes::StringRef(TRANSFER_ENCODING_VALUE).containsNoCase("chunked"))
+			++result;
+	}
+	return result;
+}
+
+/// parses a Content-Length value the way HTTPMessage used to
+static unsigned long lengthUsingLexicalCast(unsigned long iterations)
+{
+	unsigned long result = 0;
+	for (unsigned long n = 0; n < iterations; ++n) {
+		std::string trimmed_length(CONTENT_LENGTH_VALUE);
+		boost::algorithm::trim(trimmed_length);
+		result += static_cast<unsigned long>(boost::lexical_cast<boost::uint64_t>(trimmed_length));
+	}
+	return result;
+}
+
+/// parses a Content-Length value using HTTPTypes::parse_uint64()
+static unsigned long lengthUsingParser(unsigned long iterations)
+{
+	unsigned long result = 0;
+	boost::uint64_t length = 0;
+	for (unsigned long n = 0; n < iterations; ++n) {
+		HTTPTypes::parse_uint64(CONTENT_LENGTH_VALUE.data(), CONTENT_LENGTH_VALUE.size(), length);
+		result += static_cast<unsigned long>(length);
+	}
+	return result;
+}
+
+/// builds a response status line the way HTTPResponse used to
+static unsigned long statusLineUsingLexicalCast(unsigned long iterations)
+{
+	unsigned long result = 0;
+	std::string first_line;
+	for (unsigned long n = 0; n < iterations; ++n) {
+		std::string http_version(HTTPTypes::STRING_HTTP_VERSION);
+		http_version += boost::lexical_cast<std::string>(1);
+		http_version += '.';
+		http_version += boost::lexical_cast<std::string>(1);
+		first_line = http_version;
+		first_line += ' ';
+		first_line += boost::lexical_cast<std::string>(STATUS_CODE);
+		first_line += ' ';
+		first_line += HTTPTypes::RESPONSE_MESSAGE_NOT_FOUND;
+		result += first_line.size();
+	}
+	return result;
+}
+
+/// builds a response status line using HTTPTypes::append_uint64()
+static unsigned long statusLineUsingFormatter(unsigned long iterations)
+{
+	unsigned long result = 0;
+	std::string first_line;
+	for (unsigned long n = 0; n < iterations; ++n) {
+		first_line.clear();
+		first_line += HTTPTypes::STRING_HTTP_VERSION;
+		HTTPTypes::append_uint64(first_line, 1);
+		first_line += '.';
+		HTTPTypes::append_uint64(first_line, 1);
+		first_line += ' ';
+		HTTPTypes::append_uint64(first_line, STATUS_CODE);
+		first_line += ' ';
+		first_line += HTTPTypes::RESPONSE_MESSAGE_NOT_FOUND;
+		result += first_line.size();
+	}
+	return result;
+}
+
+/// runs a benchmark and prints the average time it took for each iteration
+static double runBenchmark(const char *name, unsigned long (*benchmark)(unsigned long),
+						   const unsigned long iterations)
+{
+	const boost::posix_time::ptime start_time(boost::posix_time::microsec_clock::universal_time());
+	const unsigned long result = benchmark(iterations);
+	const boost::posix_time::time_duration elapsed(boost::posix_time::microsec_clock::universal_time() - start_time);
+	const double ns_per_iteration = (elapsed.total_microseconds() * 1000.0) / iterations;
+	std::cout << std::left << std::setw(40) << name << std::right << std::setw(10)
+		<< std::fixed << std::setprecision(1) << ns_per_iteration << " ns"
+		<< "  (" << result << ')' << std::endl;
+	return ns_per_iteration;
+}
+
+
+/// main control function
+int main (int argc, char *argv[])
+{
+	static const unsigned long DEFAULT_ITERATIONS = 1000000;
+
+	// parse command line: determine number of iterations
+	unsigned long iterations = DEFAULT_ITERATIONS;
+	if (argc == 2) {
+		iterations = strtoul(argv[1], 0, 10);
+		if (iterations == 0) iterations = DEFAULT_ITERATIONS;
+	} else if (argc != 1) {
+		std::cerr << "usage: PionNetBenchmarks [iterations]" << std::endl;
+		return 1;
+	}
+
+	std::cout << "message layer header handling (" << iterations << " iterations)" << std::endl;
+	double old_total = 0.0;
+	double new_total = 0.0;
+	old_total += runBenchmark("chunked check: regex_match", chunkedUsingRegex, iterations);
+	new_total += runBenchmark("chunked check: containsNoCase", chunkedUsingScanner, iterations);
+	old_total += runBenchmark("content length: trim + lexical_cast", lengthUsingLexicalCast, iterations);
+	new_total += runBenchmark("content length: parse_uint64", lengthUsingParser, iterations);
+	old_total += runBenchmark("status line: lexical_cast", statusLineUsingLexicalCast, iterations);
+	new_total += runBenchmark("status line: append_uint64", statusLineUsingFormatter, iterations);
+	std::cout << std::left << std::setw(40) << "per request: before" << std::right
+		<< std::setw(10) << old_total << " ns" << std::endl
+		<< std::left << std::setw(40) << "per request: after" << std::right
+		<< std::setw(10) << new_total << " ns" << std::endl;
+
+	return 0;
+}
@@ -32,7 +32,8 @@ void argument_error(void)
 {
 	std::cerr << "usage:   PionWebServer [OPTIONS] RESOURCE WEBSERVICE" << std::endl
 		      << "         PionWebServer [OPTIONS] -c SERVICE_CONFIG_FILE" << std::endl
-		      << "options: [-ssl PEM_FILE] [-i IP] [-p PORT] [-d PLUGINS_DIR] [-o OPTION=VALUE] [-v]" << std::endl;
+		      << "options: [-ssl PEM_FILE] [-i IP] [-p PORT] [-d PLUGINS_DIR] [-o OPTION=VALUE]" << std::endl
+		      << "         [-s SOCKET_OPTION=VALUE] [-v]" << std::endl;
 }
 
 
@@ -41,9 +42,10 @@ int main (int argc, char *argv[])
 {
 	static const unsigned int DEFAULT_PORT = 8080;
 
-	// used to keep track of web service name=value options
+	// used to keep track of web service and socket name=value options
 	typedef std::vector<std::pair<std::string, std::string> >	ServiceOptionsType;
 	ServiceOptionsType service_options;
+	ServiceOptionsType socket_options;
 	
 	// parse command line: determine port number, RESOURCE and WEBSERVICE
 	boost::asio::ip::tcp::endpoint cfg_endpoint(boost::asio::ip::tcp::v4(), DEFAULT_PORT);
@@ -84,6 +86,16 @@ int main (int argc, char *argv[])
 				std::string option_value(option_name, pos + 1);
 				option_name.resize(pos);
 				service_options.push_back( std::make_pair(option_name, option_value) );
+			} else if (argv[argnum][1] == 's' && argv[argnum][2] == '\0' && argnum+1 < argc) {
+				std::string option_name(argv[++argnum]);
+				std::string::size_type pos = option_name.find('=');
+				if (pos == std::string::npos) {
+					argument_error();
+					return 1;
+				}
+				std::string option_value(option_name, pos + 1);
+				option_name.resize(pos);
+				socket_options.push_back( std::make_pair(option_name, option_value) );
 			} else if (argv[argnum][1] == 's' && argv[argnum][2] == 's' &&
 					   argv[argnum][3] == 'l' && argv[argnum][4] == '\0' && argnum+1 < argc) {
 				ssl_flag = true;
@@ -169,6 +181,13 @@ int main (int argc, char *argv[])
 			web_server.loadServiceConfig(service_config_file);
 		}
 
+		// socket options on the command line override the configuration file
+		for (ServiceOptionsType::iterator i = socket_options.begin();
+			 i != socket_options.end(); ++i)
+		{
+			web_server.getSocketPolicy().setOption(i->first, i->second);
+		}
+
 		// startup the server
 		web_server.start();
 		PionProcess::wait_for_shutdown();